@@ -0,0 +1,57 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Benchmarks for the parts of the reader that don't need the GUI. They aren't run by ctest.
+// Each group is a function that's listed in bench_main.cpp. Run thumbs_bench with the names of the groups to run, or with none to run them all.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "database_builder.h"
+
+#include <stdio.h>
+
+// Seconds since start, which came from get_performance_counter.
+double elapsed_seconds( long long start );
+
+// Resident set size of the process in bytes. 0 if it can't be read.
+unsigned long long get_resident_bytes();
+
+// Number of read system calls the process has made. 0 if it can't be read.
+unsigned long long get_read_operations();
+
+// Writes a Version 3 (512 byte sectors) or Version 4 (4096 byte sectors) database with count JPEG entries of entry_length bytes.
+// The sectors of each entry are step sectors apart. A step of 1 stores every entry in one piece.
+// Entry n is named "image" followed by n and has the catalog date CATALOG_DATE + n.
+bool write_bench_database( const char *path, unsigned long count, unsigned short sect_size, unsigned long entry_length, unsigned long step );
+
+// Frees every entry in the list, and with the last one, the database.
+void free_entries( fileinfo *fi );
+
+void bench_arena();
+void bench_arena_malloc();
+void bench_cmyk();
+void bench_extract();
+void bench_filename_hash();
+void bench_hash_index();
+void bench_load();
+void bench_raw_bitmap();
+void bench_scan();
+void bench_sector_size();
+
+#endif
@@ -0,0 +1,149 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+
+#include <stdlib.h>
+
+#define ARENA_ENTRIES	1000000
+#define ARENA_DATABASE	"thumbs_bench_arena.db"
+
+static const wchar_t catalog_name[] = L"image1000000.jpg";
+
+static void print_result( const char *name, double alloc_seconds, unsigned long long resident, double free_seconds )
+{
+	printf( "  %-22s allocate %8.2f ms (%5.1f ns/entry), %7.2f MB resident (%5.1f bytes/entry), free %7.2f ms\n",
+			name, alloc_seconds * 1000.0, alloc_seconds * 1e9 / ARENA_ENTRIES,
+			( double )resident / ( 1024.0 * 1024.0 ), ( double )resident / ARENA_ENTRIES, free_seconds * 1000.0 );
+}
+
+// The way entries were allocated before the arena: a fileinfo and its 32 character name, and then a copy of the catalog name that replaces it.
+// The resident size is only accurate on a fresh heap, so this is a group of its own. Run it in a separate process from the arena group.
+void bench_arena_malloc()
+{
+	fileinfo **entries = ( fileinfo ** )malloc( sizeof( fileinfo * ) * ARENA_ENTRIES );
+	if ( entries == NULL )
+	{
+		return;
+	}
+
+	unsigned long long resident = get_resident_bytes();
+	long long start = get_performance_counter();
+
+	unsigned long count = 0;
+	for ( ; count < ARENA_ENTRIES; ++count )
+	{
+		fileinfo *fi = ( fileinfo * )malloc( sizeof( fileinfo ) );
+		if ( fi == NULL )
+		{
+			break;
+		}
+
+		fi->filename = ( wchar_t * )malloc( sizeof( wchar_t ) * 32 );
+		if ( fi->filename != NULL )
+		{
+			wcscpy_s( fi->filename, 32, L"1000000" );
+			free( fi->filename );
+		}
+
+		size_t length = wcslen( catalog_name ) + 1;
+		fi->filename = ( wchar_t * )malloc( sizeof( wchar_t ) * length );
+		if ( fi->filename != NULL )
+		{
+			wmemcpy( fi->filename, catalog_name, length );
+		}
+
+		entries[ count ] = fi;
+	}
+
+	double alloc_seconds = elapsed_seconds( start );
+	resident = get_resident_bytes() - resident;
+
+	start = get_performance_counter();
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		free( entries[ i ]->filename );
+		free( entries[ i ] );
+	}
+	double free_seconds = elapsed_seconds( start );
+
+	free( entries );
+
+	print_result( "malloc per entry:", alloc_seconds, resident, free_seconds );
+}
+
+// The way build_directory and update_catalog_entries allocate entries now. The stream name is sized to fit.
+static void bench_arena_entries()
+{
+	arena a;
+	memset( &a, 0, sizeof( arena ) );
+
+	unsigned long long resident = get_resident_bytes();
+	long long start = get_performance_counter();
+
+	for ( unsigned long i = 0; i < ARENA_ENTRIES; ++i )
+	{
+		fileinfo *fi = ( fileinfo * )arena_alloc( &a, sizeof( fileinfo ) + ( sizeof( wchar_t ) * 8 ) );
+		if ( fi == NULL )
+		{
+			break;
+		}
+
+		fi->filename = ( wchar_t * )( fi + 1 );
+		wcscpy_s( fi->filename, 8, L"1000000" );
+		fi->filename = arena_wcsdup( &a, catalog_name );
+	}
+
+	double alloc_seconds = elapsed_seconds( start );
+	resident = get_resident_bytes() - resident;
+
+	start = get_performance_counter();
+	arena_release( &a );
+	double free_seconds = elapsed_seconds( start );
+
+	print_result( "arena:", alloc_seconds, resident, free_seconds );
+}
+
+// Allocates a million entries from an arena, and then loads a database of a million entries.
+// Compare it with arena_malloc, which should be run in a separate process.
+void bench_arena()
+{
+	bench_arena_entries();
+
+	if ( !write_bench_database( ARENA_DATABASE, ARENA_ENTRIES, 4096, 64, 1 ) )
+	{
+		printf( "  The database couldn't be written.\n" );
+		remove( ARENA_DATABASE );
+		return;
+	}
+
+	unsigned long long resident = get_resident_bytes();
+	long long start = get_performance_counter();
+	fileinfo *fi = parse_database( ( wchar_t * )L"" ARENA_DATABASE );
+	double load_seconds = elapsed_seconds( start );
+	unsigned long long loaded = get_resident_bytes() - resident;
+
+	start = get_performance_counter();
+	free_entries( fi );
+	double free_seconds = elapsed_seconds( start );
+
+	printf( "  database of %u entries: load %8.2f ms, %7.2f MB resident while loaded (including the mapped file), free %7.2f ms\n",
+			ARENA_ENTRIES, load_seconds * 1000.0, ( double )loaded / ( 1024.0 * 1024.0 ), free_seconds * 1000.0 );
+
+	remove( ARENA_DATABASE );
+}
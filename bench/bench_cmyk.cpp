@@ -0,0 +1,97 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "pixel_convert.h"
+
+#include <stdlib.h>
+
+#define CMYK_PIXELS		16000000	// Number of pixels converted for each image size.
+
+// How create_image converted CMYK pixels before the row kernel: one pixel at a time, with its index computed from the strides.
+static void cmyk_per_pixel( const unsigned char *src, int src_stride, unsigned char *dst, int dst_stride, unsigned int width, unsigned int height )
+{
+	const unsigned int *raw_bm = ( const unsigned int * )src;
+	unsigned int *raw_bm2 = ( unsigned int * )dst;
+
+	for ( unsigned int row = 0; row < height; ++row )
+	{
+		for ( unsigned int col = 0; col < width; ++col )
+		{
+			raw_bm2[ ( ( ( ( height - 1 ) - row ) * dst_stride ) / 4 ) + col ] = 0xFF000000
+				| ( ( 255 - ( ( 0x00FF0000 & raw_bm[ row * src_stride / 4 + col ] ) >> 16 ) ) << 16 )
+				| ( ( 255 - ( ( 0x0000FF00 & raw_bm[ row * src_stride / 4 + col ] ) >> 8 ) ) << 8 )
+				|   ( 255 - ( ( 0x000000FF & raw_bm[ row * src_stride / 4 + col ] ) ) );
+		}
+	}
+}
+
+static double convert( void ( *convert_image )( const unsigned char *, int, unsigned char *, int, unsigned int, unsigned int ),
+					   const unsigned char *src, unsigned char *dst, unsigned int width, unsigned int height, unsigned long rounds )
+{
+	long long start = get_performance_counter();
+
+	for ( unsigned long r = 0; r < rounds; ++r )
+	{
+		convert_image( src, width * 4, dst, width * 4, width, height );
+	}
+
+	return ( double )width * height * rounds / elapsed_seconds( start ) / 1e6;
+}
+
+// Converts CMYK images the old way and with cmyk_to_rgb_flipped, and checks that the results match.
+// The widths are odd so that the kernel's scalar remainder runs too.
+void bench_cmyk()
+{
+	static const unsigned int sizes[][ 2 ] = { { 95, 96 }, { 255, 256 }, { 1919, 1080 } };
+
+	for ( unsigned long s = 0; s < sizeof( sizes ) / sizeof( sizes[ 0 ] ); ++s )
+	{
+		unsigned int width = sizes[ s ][ 0 ], height = sizes[ s ][ 1 ];
+		size_t size = ( size_t )width * height * 4;
+
+		unsigned char *src = ( unsigned char * )malloc( size );
+		unsigned char *dst = ( unsigned char * )malloc( size );
+		unsigned char *expected = ( unsigned char * )malloc( size );
+		if ( src == NULL || dst == NULL || expected == NULL )
+		{
+			free( expected );
+			free( dst );
+			free( src );
+			printf( "  Not enough memory for a %ux%u image.\n", width, height );
+			return;
+		}
+
+		for ( size_t i = 0; i < size; ++i )
+		{
+			src[ i ] = ( unsigned char )( ( i * 131 ) + ( i >> 9 ) );
+		}
+
+		unsigned long rounds = CMYK_PIXELS / ( width * height ) + 1;
+
+		double old_rate = convert( cmyk_per_pixel, src, expected, width, height, rounds );
+		double new_rate = convert( cmyk_to_rgb_flipped, src, dst, width, height, rounds );
+
+		printf( "  %4ux%-4u per pixel %7.1f MP/s, cmyk_to_rgb_flipped %7.1f MP/s, %.2fx%s\n",
+				width, height, old_rate, new_rate, new_rate / old_rate, ( memcmp( dst, expected, size ) == 0 ? "" : " (the results don't match)" ) );
+
+		free( expected );
+		free( dst );
+		free( src );
+	}
+}
@@ -0,0 +1,143 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+
+#include <stdlib.h>
+
+#define EXTRACT_ENTRIES		1000
+#define EXTRACT_LENGTH		65536		// 16 sectors
+#define EXTRACT_DATABASE	"thumbs_bench_extract.db"
+
+// How extract read a stream before chains were mapped: a sector at a time, following the SAT.
+static unsigned long read_by_sector( fileinfo *fi, char *buf )
+{
+	shared_info *si = fi->si;
+	unsigned long sat_count = si->num_sat_sects * ( si->sect_size / sizeof( int32_t ) );
+	long sat_index = fi->offset;
+	unsigned long total = 0;
+
+	while ( total < fi->size && sat_index >= 0 && ( unsigned long )sat_index < sat_count )
+	{
+		unsigned long bytes_to_read = ( fi->size - total < si->sect_size ? fi->size - total : si->sect_size );
+		unsigned long read = read_database_sector( &si->reader, get_sector_offset( si->sect_size, sat_index ), buf + total, bytes_to_read );
+		total += read;
+
+		if ( read < bytes_to_read )
+		{
+			break;
+		}
+
+		sat_index = si->sat[ sat_index ];
+	}
+
+	return total;
+}
+
+static unsigned long read_with_extract( fileinfo *fi, char *buf )
+{
+	entry_view ev;
+	if ( !extract( fi, ev ) )
+	{
+		return 0;
+	}
+
+	// Touch the entry so that a mapped view is read too.
+	unsigned long size = ev.size + ev.header_offset;
+	memcpy_s( buf, EXTRACT_LENGTH, ev.data, size );
+
+	release_entry_view( ev );
+
+	return size;
+}
+
+static void run_extract( const char *name, fileinfo *first, unsigned long ( *read_entry )( fileinfo *, char * ), char *buf, unsigned long long read_overhead )
+{
+	unsigned long long bytes = 0;
+	unsigned long entries = 0;
+
+	unsigned long long reads = get_read_operations();
+	long long start = get_performance_counter();
+
+	for ( fileinfo *fi = first; fi != NULL; fi = fi->next )
+	{
+		bytes += read_entry( fi, buf );
+		++entries;
+	}
+
+	double seconds = elapsed_seconds( start );
+	reads = get_read_operations() - reads - read_overhead;
+
+	printf( "  %-28s %8.2f ms, %7.1f MB/s, %8llu reads (%5.1f per entry)\n",
+			name, seconds * 1000.0, ( double )bytes / seconds / ( 1024.0 * 1024.0 ), reads, ( double )reads / entries );
+}
+
+// Extracts every entry of a database with contiguous entries, and then of one where every sector of an entry is in a separate run.
+// The database is read through the sector cache the way it is when it can't be mapped. The file is in the page cache.
+void bench_extract()
+{
+	static const unsigned long steps[] = { 1, 2 };
+
+	char *buf = ( char * )malloc( EXTRACT_LENGTH );
+	if ( buf == NULL )
+	{
+		return;
+	}
+
+	// Reading the counter makes system calls of its own.
+	unsigned long long read_overhead = get_read_operations();
+	read_overhead = get_read_operations() - read_overhead;
+
+	for ( unsigned long s = 0; s < sizeof( steps ) / sizeof( steps[ 0 ] ); ++s )
+	{
+		if ( !write_bench_database( EXTRACT_DATABASE, EXTRACT_ENTRIES, 4096, EXTRACT_LENGTH, steps[ s ] ) )
+		{
+			printf( "  The database couldn't be written.\n" );
+			break;
+		}
+
+		fileinfo *first = parse_database( ( wchar_t * )L"" EXTRACT_DATABASE );
+		if ( first == NULL || first->si == NULL )
+		{
+			printf( "  The database couldn't be read.\n" );
+			free_entries( first );
+			break;
+		}
+
+		printf( " %u entries of %u bytes, %s:\n", EXTRACT_ENTRIES, EXTRACT_LENGTH, ( steps[ s ] == 1 ? "contiguous" : "one sector per run" ) );
+
+		database_reader *dr = &first->si->reader;
+		if ( dr->view != NULL )
+		{
+			run_extract( "extract (mapped):", first, read_with_extract, buf, read_overhead );
+
+			unmap_file( dr->file, dr->view, dr->size );
+			dr->view = NULL;
+			create_sector_cache( dr, first->si->sect_size );
+		}
+
+		run_extract( "sector at a time (unmapped):", first, read_by_sector, buf, read_overhead );
+		run_extract( "extract (unmapped):", first, read_with_extract, buf, read_overhead );
+
+		free_entries( first );
+	}
+
+	remove( EXTRACT_DATABASE );
+
+	free( buf );
+}
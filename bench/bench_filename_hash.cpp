@@ -0,0 +1,143 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "filename_hash.h"
+#include "scan_tree.h"
+
+#include <stdlib.h>
+
+#define HASH_BATCHES	8			// Number of different batches of names.
+#define HASH_ROUNDS		2000		// Number of times each batch is hashed.
+
+static const wchar_t name_characters[] = L"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_ -";
+
+static double print_result( const char *name, double seconds, unsigned long long names, unsigned long long code_units, double baseline )
+{
+	printf( "  %-26s %8.2f ms, %6.2f M names/s, %7.1f M code units/s",
+			name, seconds * 1000.0, ( double )names / seconds / 1e6, ( double )code_units / seconds / 1e6 );
+	if ( baseline > 0.0 )
+	{
+		printf( ", %.2fx", baseline / seconds );
+	}
+	printf( "\n" );
+
+	return seconds;
+}
+
+// Hashes batches of scan results the way the scanner did before, byte by byte with hash_data, then a name at a time with hash_filename, and then with hash_filenames.
+// The names are 5 to 36 characters plus ".jpg".
+void bench_filename_hash()
+{
+	scan_result *results = ( scan_result * )malloc( sizeof( scan_result ) * SCAN_BATCH_SIZE * HASH_BATCHES );
+	// The little-endian bytes of each name. On Windows, this is what hash_data was given.
+	char *bytes = ( char * )malloc( sizeof( results->filepath ) * SCAN_BATCH_SIZE * HASH_BATCHES );
+	unsigned long long *expected = ( unsigned long long * )malloc( sizeof( unsigned long long ) * SCAN_BATCH_SIZE * HASH_BATCHES );
+	if ( results == NULL || bytes == NULL || expected == NULL )
+	{
+		free( expected );
+		free( bytes );
+		free( results );
+		printf( "  Not enough memory for the names.\n" );
+		return;
+	}
+
+	unsigned long long code_units = 0;
+	unsigned int seed = 1;
+	for ( unsigned long i = 0; i < SCAN_BATCH_SIZE * HASH_BATCHES; ++i )
+	{
+		scan_result *sr = &results[ i ];
+		wcscpy_s( sr->filepath, ( MAX_PATH * 2 ) + 2, L"C:\\Users\\Public\\Pictures\\" );
+		sr->filename_offset = ( unsigned int )wcslen( sr->filepath );
+
+		seed = ( seed * 1103515245 ) + 12345;
+		unsigned int length = 5 + ( ( seed >> 16 ) % 32 );
+		wchar_t *filename = sr->filepath + sr->filename_offset;
+		for ( unsigned int j = 0; j < length; ++j )
+		{
+			seed = ( seed * 1103515245 ) + 12345;
+			filename[ j ] = name_characters[ ( seed >> 16 ) % ( ( sizeof( name_characters ) / sizeof( wchar_t ) ) - 1 ) ];
+		}
+		wcscpy_s( filename + length, 5, L".jpg" );
+		sr->filename_length = length + 4;
+		code_units += sr->filename_length;
+
+		char *b = bytes + ( i * sizeof( sr->filepath ) );
+		for ( unsigned int j = 0; j < sr->filename_length; ++j )
+		{
+			b[ j * 2 ] = ( char )( filename[ j ] & 0xFF );
+			b[ ( j * 2 ) + 1 ] = ( char )( filename[ j ] >> 8 );
+		}
+	}
+	code_units *= HASH_ROUNDS;
+
+	unsigned long long names = ( unsigned long long )SCAN_BATCH_SIZE * HASH_BATCHES * HASH_ROUNDS;
+	printf( " %llu names in batches of %u:\n", names, SCAN_BATCH_SIZE );
+
+	long long start = get_performance_counter();
+	for ( unsigned long r = 0; r < HASH_ROUNDS; ++r )
+	{
+		for ( unsigned long i = 0; i < SCAN_BATCH_SIZE * HASH_BATCHES; ++i )
+		{
+			expected[ i ] = hash_data( bytes + ( i * sizeof( results->filepath ) ), FILENAME_HASH_INITIAL, ( short )( results[ i ].filename_length * 2 ) );
+		}
+	}
+	double baseline = print_result( "hash_data (bytes):", elapsed_seconds( start ), names, code_units, 0.0 );
+
+	unsigned long mismatches = 0;
+
+	start = get_performance_counter();
+	for ( unsigned long r = 0; r < HASH_ROUNDS; ++r )
+	{
+		for ( unsigned long i = 0; i < SCAN_BATCH_SIZE * HASH_BATCHES; ++i )
+		{
+			results[ i ].hash = hash_filename( results[ i ].filepath + results[ i ].filename_offset, FILENAME_HASH_INITIAL, results[ i ].filename_length );
+		}
+	}
+	print_result( "hash_filename (one name):", elapsed_seconds( start ), names, code_units, baseline );
+
+	for ( unsigned long i = 0; i < SCAN_BATCH_SIZE * HASH_BATCHES; ++i )
+	{
+		mismatches += ( results[ i ].hash != expected[ i ] ? 1 : 0 );
+		results[ i ].hash = 0;
+	}
+
+	start = get_performance_counter();
+	for ( unsigned long r = 0; r < HASH_ROUNDS; ++r )
+	{
+		for ( unsigned long b = 0; b < HASH_BATCHES; ++b )
+		{
+			hash_filenames( results + ( b * SCAN_BATCH_SIZE ), SCAN_BATCH_SIZE, FILENAME_HASH_INITIAL );
+		}
+	}
+	print_result( "hash_filenames (batch):", elapsed_seconds( start ), names, code_units, baseline );
+
+	for ( unsigned long i = 0; i < SCAN_BATCH_SIZE * HASH_BATCHES; ++i )
+	{
+		mismatches += ( results[ i ].hash != expected[ i ] ? 1 : 0 );
+	}
+
+	if ( mismatches > 0 )
+	{
+		printf( "  %lu hashes didn't match hash_data.\n", mismatches );
+	}
+
+	free( expected );
+	free( bytes );
+	free( results );
+}
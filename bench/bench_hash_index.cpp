@@ -0,0 +1,255 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "hash_index.h"
+#include "dllrbt.h"
+
+#include <stdlib.h>
+
+// One in every DUPLICATE_INTERVAL keys repeats the key before it, like thumbnails that share a hash.
+#define DUPLICATE_INTERVAL	8
+
+// The value that the red-black tree held for each hash.
+struct linked_list
+{
+	void *fi;
+	linked_list *next;
+};
+
+// The keys were stored as pointers, so they're only complete on 64-bit builds.
+static int dllrbt_compare( void *a, void *b )
+{
+	if ( a > b )
+	{
+		return 1;
+	}
+
+	if ( a < b )
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+static unsigned long long next_key( unsigned long long *state )
+{
+	// xorshift64
+	unsigned long long x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+
+	return x;
+}
+
+// The way create_fileinfo_tree built the tree: a node per entry, and entries with the same hash linked after the first one.
+static dllrbt_tree *build_tree( const unsigned long long *keys, unsigned long count )
+{
+	dllrbt_tree *tree = dllrbt_create( dllrbt_compare );
+	if ( tree == NULL )
+	{
+		return NULL;
+	}
+
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		linked_list *fi_node = ( linked_list * )malloc( sizeof( linked_list ) );
+		if ( fi_node == NULL )
+		{
+			break;
+		}
+		fi_node->fi = ( void * )&keys[ i ];
+		fi_node->next = NULL;
+
+		linked_list *ll = ( linked_list * )dllrbt_find( tree, ( void * )keys[ i ], true );
+		if ( ll == NULL )
+		{
+			if ( dllrbt_insert( tree, ( void * )keys[ i ], fi_node ) != DLLRBT_STATUS_OK )
+			{
+				free( fi_node );
+			}
+		}
+		else
+		{
+			fi_node->next = ll->next;
+			ll->next = fi_node;
+		}
+	}
+
+	return tree;
+}
+
+static unsigned long find_tree( dllrbt_tree *tree, const unsigned long long *keys, unsigned long count )
+{
+	unsigned long found = 0;
+
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		for ( linked_list *ll = ( linked_list * )dllrbt_find( tree, ( void * )keys[ i ], true ); ll != NULL; ll = ll->next )
+		{
+			++found;
+		}
+	}
+
+	return found;
+}
+
+static void free_tree( dllrbt_tree *tree )
+{
+	node_type *node = dllrbt_get_head( tree );
+	while ( node != NULL )
+	{
+		linked_list *fi_node = ( linked_list * )node->val;
+		while ( fi_node != NULL )
+		{
+			linked_list *del_fi_node = fi_node;
+			fi_node = fi_node->next;
+			free( del_fi_node );
+		}
+
+		node = node->next;
+	}
+
+	dllrbt_delete_recursively( tree );
+}
+
+static hash_index *build_index( const unsigned long long *keys, unsigned long count )
+{
+	hash_index *hi = hash_index_create( count );
+	if ( hi == NULL )
+	{
+		return NULL;
+	}
+
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		if ( !hash_index_insert( hi, keys[ i ], ( void * )&keys[ i ] ) )
+		{
+			break;
+		}
+	}
+
+	return hi;
+}
+
+static unsigned long find_index( hash_index *hi, const unsigned long long *keys, unsigned long count )
+{
+	unsigned long found = 0;
+
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		for ( hash_index_value *hiv = hash_index_find( hi, keys[ i ] ); hiv != NULL; hiv = hash_index_next( hi, hiv ) )
+		{
+			++found;
+		}
+	}
+
+	return found;
+}
+
+static void print_result( const char *name, unsigned long count, double build_seconds, double hit_seconds, double miss_seconds, double free_seconds, unsigned long found )
+{
+	printf( "  %-11s build %8.2f ms (%6.1f ns/entry), hits %6.1f ns/lookup, misses %6.1f ns/lookup, free %7.2f ms, %lu found\n",
+			name, build_seconds * 1000.0, build_seconds * 1e9 / count, hit_seconds * 1e9 / count, miss_seconds * 1e9 / count,
+			free_seconds * 1000.0, found );
+}
+
+// Builds the old red-black tree and the hash index from the same keys, and looks up every key and as many keys that aren't there.
+// Most lookups during a scan are misses since a folder has more files than the database has thumbnails.
+void bench_hash_index()
+{
+	static const unsigned long counts[] = { 10000, 100000, 1000000 };
+
+	for ( unsigned long c = 0; c < sizeof( counts ) / sizeof( counts[ 0 ] ); ++c )
+	{
+		unsigned long count = counts[ c ];
+		unsigned long long *keys = ( unsigned long long * )malloc( sizeof( unsigned long long ) * count );
+		unsigned long long *hits = ( unsigned long long * )malloc( sizeof( unsigned long long ) * count );
+		unsigned long long *misses = ( unsigned long long * )malloc( sizeof( unsigned long long ) * count );
+		if ( keys == NULL || hits == NULL || misses == NULL )
+		{
+			free( misses );
+			free( hits );
+			free( keys );
+			printf( "  Not enough memory for %lu keys.\n", count );
+			return;
+		}
+
+		unsigned long long state = 0x9E3779B97F4A7C15ULL;
+		for ( unsigned long i = 0; i < count; ++i )
+		{
+			keys[ i ] = ( i > 0 && i % DUPLICATE_INTERVAL == 0 ? keys[ i - 1 ] : next_key( &state ) );
+			misses[ i ] = next_key( &state );
+		}
+
+		// Look up the keys in a different order than they were added.
+		for ( unsigned long i = 0; i < count; ++i )
+		{
+			hits[ i ] = keys[ next_key( &state ) % count ];
+		}
+
+		printf( " %lu entries:\n", count );
+
+		long long start = get_performance_counter();
+		dllrbt_tree *tree = build_tree( keys, count );
+		double build_seconds = elapsed_seconds( start );
+		if ( tree != NULL )
+		{
+			start = get_performance_counter();
+			unsigned long found = find_tree( tree, hits, count );
+			double hit_seconds = elapsed_seconds( start );
+
+			start = get_performance_counter();
+			found += find_tree( tree, misses, count );
+			double miss_seconds = elapsed_seconds( start );
+
+			start = get_performance_counter();
+			free_tree( tree );
+			double free_seconds = elapsed_seconds( start );
+
+			print_result( "dllrbt:", count, build_seconds, hit_seconds, miss_seconds, free_seconds, found );
+		}
+
+		start = get_performance_counter();
+		hash_index *hi = build_index( keys, count );
+		build_seconds = elapsed_seconds( start );
+		if ( hi != NULL )
+		{
+			start = get_performance_counter();
+			unsigned long found = find_index( hi, hits, count );
+			double hit_seconds = elapsed_seconds( start );
+
+			start = get_performance_counter();
+			found += find_index( hi, misses, count );
+			double miss_seconds = elapsed_seconds( start );
+
+			start = get_performance_counter();
+			hash_index_delete( hi );
+			double free_seconds = elapsed_seconds( start );
+
+			print_result( "hash_index:", count, build_seconds, hit_seconds, miss_seconds, free_seconds, found );
+		}
+
+		free( misses );
+		free( hits );
+		free( keys );
+	}
+}
@@ -0,0 +1,101 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "merge_sort.h"
+
+#include <stdlib.h>
+
+#define LOAD_DATABASE	"thumbs_bench_load.db"
+
+// The same growable array that the owner-data listview displays.
+struct entry_array
+{
+	fileinfo **entries;
+	unsigned long count;
+	unsigned long capacity;
+	long long append_time;		// Performance counter ticks spent appending.
+};
+
+// Appends each published batch the way add_entries does.
+static void append_entries( fileinfo *fi, unsigned long count, void *context )
+{
+	entry_array *ea = ( entry_array * )context;
+	long long start = get_performance_counter();
+
+	while ( fi != NULL && count-- > 0 )
+	{
+		if ( ea->count == ea->capacity )
+		{
+			unsigned long capacity = ( ea->capacity > 0 ? ea->capacity * 2 : 1024 );
+			fileinfo **entries = ( fileinfo ** )realloc( ea->entries, sizeof( fileinfo * ) * capacity );
+			if ( entries == NULL )
+			{
+				break;
+			}
+
+			ea->entries = entries;
+			ea->capacity = capacity;
+		}
+
+		ea->entries[ ea->count++ ] = fi;
+		fi = fi->next;
+	}
+
+	ea->append_time += get_performance_counter() - start;
+}
+
+static int compare_filenames( void *a, void *b, void * /*context*/ )
+{
+	return wcscmp( ( ( fileinfo * )a )->filename, ( ( fileinfo * )b )->filename );
+}
+
+// Loads databases of 10,000, 100,000 and 1,000,000 entries into an entry array, and sorts them by name.
+void bench_load()
+{
+	for ( unsigned long count = 10000; count <= 1000000; count *= 10 )
+	{
+		if ( !write_bench_database( LOAD_DATABASE, count, 4096, 64, 1 ) )
+		{
+			printf( "  The database with %lu entries couldn't be written.\n", count );
+			remove( LOAD_DATABASE );
+			return;
+		}
+
+		entry_array ea;
+		memset( &ea, 0, sizeof( entry_array ) );
+
+		long long start = get_performance_counter();
+		fileinfo *fi = parse_database( ( wchar_t * )L"" LOAD_DATABASE, append_entries, NULL, ( void * )&ea );
+		double load_seconds = elapsed_seconds( start );
+		double append_seconds = ( double )ea.append_time / ( double )get_performance_frequency();
+
+		start = get_performance_counter();
+		bool sorted = merge_sort( ( void ** )ea.entries, ea.count, compare_filenames, NULL );
+		double sort_seconds = elapsed_seconds( start );
+
+		printf( "  %7lu entries: load %9.2f ms (%6.0f ns/entry, %7.2f ms appending), sort by name %8.2f ms%s\n",
+				ea.count, load_seconds * 1000.0, load_seconds * 1e9 / ( double )( ea.count > 0 ? ea.count : 1 ), append_seconds * 1000.0,
+				sort_seconds * 1000.0, ( sorted ? "" : " (failed)" ) );
+
+		free( ea.entries );
+		free_entries( fi );
+
+		remove( LOAD_DATABASE );
+	}
+}
@@ -0,0 +1,216 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <unistd.h>
+#endif
+
+struct bench_group
+{
+	const char *name;
+	void ( *run )();
+};
+
+static const bench_group groups[] =
+{
+	{ "arena", bench_arena },
+	{ "arena_malloc", bench_arena_malloc },
+	{ "cmyk", bench_cmyk },
+	{ "extract", bench_extract },
+	{ "filename_hash", bench_filename_hash },
+	{ "hash_index", bench_hash_index },
+	{ "load", bench_load },
+	{ "raw_bitmap", bench_raw_bitmap },
+	{ "scan", bench_scan },
+	{ "sector_size", bench_sector_size }
+};
+
+double elapsed_seconds( long long start )
+{
+	return ( double )( get_performance_counter() - start ) / ( double )get_performance_frequency();
+}
+
+unsigned long long get_resident_bytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if ( GetProcessMemoryInfo( GetCurrentProcess(), &pmc, sizeof( pmc ) ) == FALSE )
+	{
+		return 0;
+	}
+
+	return pmc.WorkingSetSize;
+#else
+	// The second value is the number of resident pages.
+	FILE *f = fopen( "/proc/self/statm", "r" );
+	if ( f == NULL )
+	{
+		return 0;
+	}
+
+	unsigned long long size = 0, resident = 0;
+	if ( fscanf( f, "%llu %llu", &size, &resident ) != 2 )
+	{
+		resident = 0;
+	}
+	fclose( f );
+
+	return resident * ( unsigned long long )sysconf( _SC_PAGESIZE );
+#endif
+}
+
+unsigned long long get_read_operations()
+{
+#ifdef _WIN32
+	IO_COUNTERS ic;
+	if ( GetProcessIoCounters( GetCurrentProcess(), &ic ) == FALSE )
+	{
+		return 0;
+	}
+
+	return ic.ReadOperationCount;
+#else
+	FILE *f = fopen( "/proc/self/io", "r" );
+	if ( f == NULL )
+	{
+		return 0;
+	}
+
+	// The count includes the reads that fopen and fgets make.
+	unsigned long long reads = 0;
+	char line[ 64 ];
+	while ( fgets( line, sizeof( line ), f ) != NULL )
+	{
+		if ( sscanf( line, "syscr: %llu", &reads ) == 1 )
+		{
+			break;
+		}
+	}
+	fclose( f );
+
+	return reads;
+#endif
+}
+
+bool write_bench_database( const char *path, unsigned long count, unsigned short sect_size, unsigned long entry_length, unsigned long step )
+{
+	database_builder db;
+	if ( !create_builder( &db, sect_size ) )
+	{
+		return false;
+	}
+
+	// Every entry has the same contents. Only the names and dates differ.
+	char *jpeg = make_jpeg_entry( entry_length, 1 );
+	wchar_t *names = ( wchar_t * )malloc( sizeof( wchar_t ) * 20 * count );
+	const wchar_t **name_list = ( const wchar_t ** )malloc( sizeof( wchar_t * ) * count );
+	char *catalog = NULL;
+	bool written = false;
+
+	if ( jpeg != NULL && names != NULL && name_list != NULL )
+	{
+		for ( unsigned long i = 0; i < count; ++i )
+		{
+			wchar_t stream_name[ 11 ];
+			make_stream_name( i + 1, stream_name );
+			add_stream( &db, stream_name, jpeg, entry_length, step );
+
+			// Widen the name by hand since swprintf isn't the same everywhere.
+			char name[ 20 ];
+			int length = snprintf( name, 20, "image%lu.jpg", i + 1 );
+			for ( int j = 0; j <= length; ++j )
+			{
+				names[ ( i * 20 ) + j ] = ( wchar_t )name[ j ];
+			}
+			name_list[ i ] = names + ( i * 20 );
+		}
+
+		unsigned long catalog_length = make_catalog( NULL, name_list, count, sect_size );
+		catalog = ( char * )malloc( catalog_length );
+		if ( catalog != NULL )
+		{
+			make_catalog( catalog, name_list, count, sect_size );
+			add_stream( &db, L"Catalog", catalog, catalog_length, 1 );
+
+			written = write_database( &db, L"Root Entry", path );
+		}
+	}
+
+	free( catalog );
+	free( name_list );
+	free( names );
+	free( jpeg );
+	free_builder( &db );
+
+	return written;
+}
+
+void free_entries( fileinfo *fi )
+{
+	while ( fi != NULL )
+	{
+		fileinfo *next = fi->next;
+		free_fileinfo( fi );
+		fi = next;
+	}
+}
+
+// Runs every group, or only the ones that are named on the command-line.
+int main( int argc, char *argv[] )
+{
+	unsigned long run = 0;
+
+	initialize_buffer_pool();
+	initialize_short_stream_cache();
+
+	for ( unsigned long i = 0; i < sizeof( groups ) / sizeof( groups[ 0 ] ); ++i )
+	{
+		bool selected = ( argc < 2 );
+		for ( int j = 1; j < argc && !selected; ++j )
+		{
+			selected = ( strcmp( argv[ j ], groups[ i ].name ) == 0 );
+		}
+
+		if ( selected )
+		{
+			printf( "%s:\n", groups[ i ].name );
+			groups[ i ].run();
+			++run;
+		}
+	}
+
+	uninitialize_short_stream_cache();
+	uninitialize_buffer_pool();
+
+	if ( run == 0 )
+	{
+		fprintf( stderr, "No benchmark group matched.\n" );
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,189 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "pixel_convert.h"
+
+#include <stdlib.h>
+
+#define RAW_BYTES		256000000	// Number of pixel bytes unpacked for each layout.
+
+// Swaps red and blue a pixel at a time. This is the reference for copy_pixel_rows.
+static void swap_per_pixel( const unsigned char *src, int src_stride, unsigned char *dst, int dst_stride, unsigned int width, unsigned int height, unsigned char channels )
+{
+	for ( unsigned int row = 0; row < height; ++row )
+	{
+		const unsigned char *s = src + ( ( long long )src_stride * row );
+		unsigned char *d = dst + ( ( long long )dst_stride * row );
+
+		for ( unsigned int col = 0; col < width; ++col )
+		{
+			d[ 0 ] = s[ 2 ];
+			d[ 1 ] = s[ 1 ];
+			d[ 2 ] = s[ 0 ];
+			if ( channels == 4 )
+			{
+				d[ 3 ] = s[ 3 ];
+			}
+
+			s += channels;
+			d += channels;
+		}
+	}
+}
+
+// Writes the header of a raw entry followed by its pixels. 0x18 byte headers with 24 bit pixels are stored bottom up.
+static char *make_raw_bitmap( unsigned long header_offset, unsigned int width, unsigned int height, unsigned char channels, unsigned long *size )
+{
+	int32_t stride = ( int32_t )( ( ( width * channels ) + 3 ) & ~3 );
+	uint32_t raw_size = ( uint32_t )stride * height;
+
+	char *data = ( char * )malloc( header_offset + raw_size );
+	if ( data == NULL )
+	{
+		return NULL;
+	}
+	memset( data, 0, header_offset );
+
+	if ( header_offset == 0x18 )
+	{
+		int32_t negative_stride = -stride;
+		memcpy( data + 0x08, &negative_stride, sizeof( int32_t ) );
+		memcpy( data + 0x0C, &width, sizeof( uint32_t ) );
+		memcpy( data + 0x10, &height, sizeof( uint32_t ) );
+	}
+	else
+	{
+		memcpy( data + 0x04, &width, sizeof( uint32_t ) );
+		memcpy( data + 0x08, &height, sizeof( uint32_t ) );
+		memcpy( data + 0x0C, &stride, sizeof( int32_t ) );
+	}
+	memcpy( data + header_offset - sizeof( uint32_t ), &raw_size, sizeof( uint32_t ) );
+
+	for ( uint32_t i = 0; i < raw_size; ++i )
+	{
+		data[ header_offset + i ] = ( char )( ( i * 7 ) + ( i >> 11 ) );
+	}
+
+	*size = raw_size;
+
+	return data;
+}
+
+// Parses and unpacks raw bitmaps the way the preview (no swap) and the PNG writer (red and blue swapped) do.
+// The swap is compared with a per-pixel loop, and the results are checked against it.
+void bench_raw_bitmap()
+{
+	static const struct
+	{
+		unsigned long header_offset;
+		unsigned int width;
+		unsigned int height;
+		unsigned char channels;
+	} layouts[] =
+	{
+		{ 0x18, 255, 256, 3 },
+		{ 0x18, 1919, 1080, 3 },
+		{ 0x34, 256, 256, 4 },
+		{ 0x34, 1920, 1080, 4 }
+	};
+
+	for ( unsigned long l = 0; l < sizeof( layouts ) / sizeof( layouts[ 0 ] ); ++l )
+	{
+		unsigned long size = 0;
+		char *data = make_raw_bitmap( layouts[ l ].header_offset, layouts[ l ].width, layouts[ l ].height, layouts[ l ].channels, &size );
+		if ( data == NULL )
+		{
+			printf( "  Not enough memory for the bitmap.\n" );
+			return;
+		}
+
+		raw_bitmap rb;
+		unsigned long rounds = RAW_BYTES / size + 1;
+
+		long long start = get_performance_counter();
+		for ( unsigned long r = 0; r < rounds; ++r )
+		{
+			if ( !parse_raw_bitmap( data, layouts[ l ].header_offset, size, rb ) )
+			{
+				break;
+			}
+		}
+		double parse_ns = elapsed_seconds( start ) * 1e9 / rounds;
+
+		if ( !parse_raw_bitmap( data, layouts[ l ].header_offset, size, rb ) || rb.channels != layouts[ l ].channels )
+		{
+			printf( "  The 0x%02lX header couldn't be parsed.\n", layouts[ l ].header_offset );
+			free( data );
+			continue;
+		}
+
+		int row_size = ( int )( rb.width * rb.channels );
+		size_t dst_size = ( size_t )row_size * rb.height;
+		unsigned char *dst = ( unsigned char * )malloc( dst_size );
+		unsigned char *expected = ( unsigned char * )malloc( dst_size );
+		if ( dst == NULL || expected == NULL )
+		{
+			free( expected );
+			free( dst );
+			free( data );
+			printf( "  Not enough memory for the pixels.\n" );
+			return;
+		}
+
+		double mb = ( double )size * rounds / ( 1024.0 * 1024.0 );
+
+		start = get_performance_counter();
+		for ( unsigned long r = 0; r < rounds; ++r )
+		{
+			unpack_raw_bitmap( data + layouts[ l ].header_offset, rb, dst, row_size, false );
+		}
+		double copy_rate = mb / elapsed_seconds( start );
+
+		// The per-pixel loop reads the rows in the same order that unpack_raw_bitmap does.
+		const unsigned char *src = ( const unsigned char * )data + layouts[ l ].header_offset;
+		int src_stride = ( int )rb.stride;
+		if ( rb.flipped )
+		{
+			src += ( size_t )rb.stride * ( rb.height - 1 );
+			src_stride = -src_stride;
+		}
+
+		start = get_performance_counter();
+		for ( unsigned long r = 0; r < rounds; ++r )
+		{
+			swap_per_pixel( src, src_stride, expected, row_size, rb.width, rb.height, rb.channels );
+		}
+		double reference_rate = mb / elapsed_seconds( start );
+
+		start = get_performance_counter();
+		for ( unsigned long r = 0; r < rounds; ++r )
+		{
+			unpack_raw_bitmap( data + layouts[ l ].header_offset, rb, dst, row_size, true );
+		}
+		double swap_rate = mb / elapsed_seconds( start );
+
+		printf( "  0x%02lX %4ux%-4u %u bit: parse %5.1f ns, unpack %7.1f MB/s, swapped %7.1f MB/s, per-pixel swap %7.1f MB/s%s\n",
+				layouts[ l ].header_offset, rb.width, rb.height, rb.channels * 8, parse_ns, copy_rate, swap_rate, reference_rate,
+				( memcmp( dst, expected, dst_size ) == 0 ? "" : " (the results don't match)" ) );
+
+		free( expected );
+		free( dst );
+		free( data );
+	}
+}
@@ -0,0 +1,161 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "scan_tree.h"
+
+#ifdef _WIN32
+	#include <direct.h>
+	#define make_directory( path )		_mkdir( path )
+	#define remove_directory( path )	_rmdir( path )
+#else
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define make_directory( path )		mkdir( path, 0755 )
+	#define remove_directory( path )	rmdir( path )
+#endif
+
+#define SCAN_ROOT			"thumbs_bench_scan"
+#define TOP_DIRECTORIES		40
+#define SUBDIRECTORIES		25		// In each top directory.
+#define FILES				40		// In each subdirectory.
+#define RUNS				5		// The fastest run is reported.
+
+// Visits every file in the tree, and creates or removes it.
+static bool walk_tree( bool create )
+{
+	char path[ 256 ];
+
+	if ( create )
+	{
+		make_directory( SCAN_ROOT );
+	}
+
+	for ( int i = 0; i < TOP_DIRECTORIES; ++i )
+	{
+		snprintf( path, 256, SCAN_ROOT "/top%02d", i );
+		if ( create )
+		{
+			make_directory( path );
+		}
+
+		for ( int j = 0; j < SUBDIRECTORIES; ++j )
+		{
+			snprintf( path, 256, SCAN_ROOT "/top%02d/sub%02d", i, j );
+			if ( create )
+			{
+				make_directory( path );
+			}
+
+			for ( int k = 0; k < FILES; ++k )
+			{
+				snprintf( path, 256, SCAN_ROOT "/top%02d/sub%02d/image%03d.jpg", i, j, k );
+				if ( create )
+				{
+					FILE *f = fopen( path, "wb" );
+					if ( f == NULL )
+					{
+						return false;
+					}
+					fclose( f );
+				}
+				else
+				{
+					remove( path );
+				}
+			}
+
+			if ( !create )
+			{
+				snprintf( path, 256, SCAN_ROOT "/top%02d/sub%02d", i, j );
+				remove_directory( path );
+			}
+		}
+
+		if ( !create )
+		{
+			snprintf( path, 256, SCAN_ROOT "/top%02d", i );
+			remove_directory( path );
+		}
+	}
+
+	if ( !create )
+	{
+		remove_directory( SCAN_ROOT );
+	}
+
+	return true;
+}
+
+// Scans a tree of empty files with different numbers of threads.
+// The queue counts show how often the threads waited for each other to push and pop directories.
+void bench_scan()
+{
+	if ( !walk_tree( true ) )
+	{
+		printf( "  The directory tree couldn't be created.\n" );
+		walk_tree( false );
+		return;
+	}
+
+	scan_options so;
+	so.extension_filter = L"|.jpg|";
+	so.include_folders = false;
+	so.initial_hash = FILENAME_HASH_INITIAL_WIN8;
+	so.cancel = NULL;
+	so.callback = NULL;		// Only the scan and the hashing are measured.
+	so.context = NULL;
+
+	// The first scan fills the file system cache.
+	so.thread_count = 1;
+	scan_directory_tree( L"" SCAN_ROOT, &so, NULL );
+
+	printf( "  %lu directories, %lu files\n", 1UL + TOP_DIRECTORIES + ( TOP_DIRECTORIES * SUBDIRECTORIES ), ( unsigned long )( TOP_DIRECTORIES * SUBDIRECTORIES * FILES ) );
+
+	for ( unsigned long thread_count = 1; thread_count <= 8; thread_count *= 2 )
+	{
+		double best = 0.0;
+		scan_stats best_stats;
+		memset( &best_stats, 0, sizeof( scan_stats ) );
+
+		for ( int run = 0; run < RUNS; ++run )
+		{
+			so.thread_count = thread_count;
+
+			scan_stats ss;
+			long long start = get_performance_counter();
+			scan_directory_tree( L"" SCAN_ROOT, &so, &ss );
+			double seconds = elapsed_seconds( start );
+
+			if ( run == 0 || seconds < best )
+			{
+				best = seconds;
+				best_stats = ss;
+			}
+		}
+
+		double wait_ms = ( double )best_stats.queue_wait * 1000.0 / ( double )get_performance_frequency();
+
+		printf( "  %lu thread%s: %8.2f ms, %10.0f files/s, %llu queue locks, %llu contended (%.2f%%), %.3f ms waiting\n",
+				thread_count, ( thread_count > 1 ? "s" : " " ), best * 1000.0, ( double )best_stats.results / best,
+				best_stats.queue_locks, best_stats.queue_contended,
+				( best_stats.queue_locks > 0 ? ( double )best_stats.queue_contended * 100.0 / ( double )best_stats.queue_locks : 0.0 ), wait_ms );
+	}
+
+	walk_tree( false );
+}
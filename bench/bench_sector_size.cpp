@@ -0,0 +1,167 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+
+#include <stdlib.h>
+
+#define SECTOR_SIZE_DATABASE	"thumbs_bench_sector_size.db"
+#define SHORT_ENTRIES			10000		// Version 3 databases only have room for about 14,000 sectors, since the builder doesn't add DISATs.
+#define LONG_ENTRIES			500
+#define LOAD_ROUNDS				10
+#define MAP_ROUNDS				100
+
+// How map_stream worked before it was specialized on the sector size. Every sector's offset and the size of the tables are computed at run-time.
+static stream_map *map_generic( shared_info *si, long first_sect, unsigned long length, bool short_stream )
+{
+	int32_t *table = ( short_stream ? si->ssat : si->sat );
+	if ( table == NULL )
+	{
+		return NULL;
+	}
+
+	unsigned long sect_size = ( short_stream ? 64 : si->sect_size );
+	unsigned long table_count = ( short_stream ? si->num_ssat_sects : si->num_sat_sects ) * ( si->sect_size / sizeof( int32_t ) );
+
+	unsigned long capacity = 8;
+	stream_map *sm = ( stream_map * )malloc( sizeof( stream_map ) + ( sizeof( stream_extent ) * ( capacity - 1 ) ) );
+	if ( sm == NULL )
+	{
+		return NULL;
+	}
+
+	sm->error = NULL;
+	sm->count = 0;
+	sm->length = 0;
+
+	long index = first_sect;
+	while ( sm->length < length )
+	{
+		if ( index < 0 || ( unsigned long )index >= table_count )
+		{
+			sm->error = "The chain is invalid.";
+			break;
+		}
+
+		unsigned long long offset = ( short_stream ? ( unsigned long long )index * 64 : get_sector_offset( si->sect_size, index ) );
+		unsigned long bytes = ( length - sm->length < sect_size ? length - sm->length : sect_size );
+
+		if ( short_stream && ( offset > si->short_stream_length || bytes > si->short_stream_length - offset ) )
+		{
+			sm->error = "The chain is invalid.";
+			break;
+		}
+
+		stream_extent *last = ( sm->count > 0 ? &sm->extents[ sm->count - 1 ] : NULL );
+		if ( last != NULL && last->offset + last->length == offset )
+		{
+			last->length += bytes;
+		}
+		else
+		{
+			if ( sm->count == capacity )
+			{
+				capacity *= 2;
+				stream_map *larger = ( stream_map * )realloc( sm, sizeof( stream_map ) + ( sizeof( stream_extent ) * ( capacity - 1 ) ) );
+				if ( larger == NULL )
+				{
+					free( sm );
+					return NULL;
+				}
+
+				sm = larger;
+			}
+
+			sm->extents[ sm->count ].offset = offset;
+			sm->extents[ sm->count ].length = bytes;
+			sm->extents[ sm->count ].position = sm->length;
+			++sm->count;
+		}
+
+		sm->length += bytes;
+
+		index = table[ index ];
+	}
+
+	return sm;
+}
+
+// Maps the chain of every entry MAP_ROUNDS times. Returns the number of nanoseconds per entry.
+static double map_entries( fileinfo *first, stream_map *( *map )( shared_info *, long, unsigned long, bool ), unsigned long count )
+{
+	long long start = get_performance_counter();
+
+	for ( unsigned long r = 0; r < MAP_ROUNDS; ++r )
+	{
+		for ( fileinfo *fi = first; fi != NULL; fi = fi->next )
+		{
+			free( map( fi->si, fi->offset, fi->size, ( fi->size < fi->si->short_sect_cutoff ) ) );
+		}
+	}
+
+	return elapsed_seconds( start ) * 1e9 / ( ( double )count * MAP_ROUNDS );
+}
+
+static void bench_database( unsigned short sect_size, unsigned long count, unsigned long entry_length, bool load )
+{
+	if ( !write_bench_database( SECTOR_SIZE_DATABASE, count, sect_size, entry_length, 1 ) )
+	{
+		printf( "  The database couldn't be written.\n" );
+		return;
+	}
+
+	double load_ns = 0.0;
+	fileinfo *first = NULL;
+
+	for ( unsigned long r = 0; r < ( load ? LOAD_ROUNDS : 1 ); ++r )
+	{
+		free_entries( first );
+
+		long long start = get_performance_counter();
+		first = parse_database( ( wchar_t * )L"" SECTOR_SIZE_DATABASE );
+		load_ns += elapsed_seconds( start ) * 1e9 / count;
+	}
+
+	if ( first != NULL )
+	{
+		printf( "  %4u byte sectors, %5lu entries of %4lu bytes:", sect_size, count, entry_length );
+		if ( load )
+		{
+			printf( " load %6.1f ns/entry,", load_ns / LOAD_ROUNDS );
+		}
+		printf( " map_stream %6.1f ns/entry, run-time sector size %6.1f ns/entry\n",
+				map_entries( first, map_stream, count ), map_entries( first, map_generic, count ) );
+
+		free_entries( first );
+	}
+
+	remove( SECTOR_SIZE_DATABASE );
+}
+
+// Per-entry cost of loading Version 3 and Version 4 databases, and of mapping their entries' chains with map_stream and with a copy of it that isn't specialized.
+// Entries of 64 bytes are in the short stream container. Entries of 8192 bytes take 16 sectors in Version 3 and 2 in Version 4.
+void bench_sector_size()
+{
+	static const unsigned short sect_sizes[] = { 512, 4096 };
+
+	for ( unsigned long s = 0; s < sizeof( sect_sizes ) / sizeof( sect_sizes[ 0 ] ); ++s )
+	{
+		bench_database( sect_sizes[ s ], SHORT_ENTRIES, 64, true );
+		bench_database( sect_sizes[ s ], LONG_ENTRIES, 8192, false );
+	}
+}
@@ -0,0 +1,421 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "database_builder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Make room for count sectors. New sectors are zeroed and free.
+static bool reserve_sectors( database_builder *db, unsigned long count )
+{
+	if ( count <= db->sect_capacity )
+	{
+		return true;
+	}
+
+	unsigned long capacity = ( db->sect_capacity > 0 ? db->sect_capacity : 64 );
+	while ( capacity < count )
+	{
+		capacity *= 2;
+	}
+
+	char *sectors = ( char * )realloc( db->sectors, ( size_t )capacity * db->sect_size );
+	if ( sectors == NULL )
+	{
+		db->failed = true;
+		return false;
+	}
+	db->sectors = sectors;
+
+	int32_t *sat = ( int32_t * )realloc( db->sat, sizeof( int32_t ) * capacity );
+	if ( sat == NULL )
+	{
+		db->failed = true;
+		return false;
+	}
+	db->sat = sat;
+
+	memset( db->sectors + ( ( size_t )db->sect_capacity * db->sect_size ), 0, ( size_t )( capacity - db->sect_capacity ) * db->sect_size );
+	for ( unsigned long i = db->sect_capacity; i < capacity; ++i )
+	{
+		db->sat[ i ] = FREE_SECT;
+	}
+
+	db->sect_capacity = capacity;
+
+	return true;
+}
+
+static bool reserve_short_sectors( database_builder *db, unsigned long count )
+{
+	if ( count <= db->short_sect_capacity )
+	{
+		return true;
+	}
+
+	unsigned long capacity = ( db->short_sect_capacity > 0 ? db->short_sect_capacity : 64 );
+	while ( capacity < count )
+	{
+		capacity *= 2;
+	}
+
+	char *short_stream = ( char * )realloc( db->short_stream, ( size_t )capacity * 64 );
+	if ( short_stream == NULL )
+	{
+		db->failed = true;
+		return false;
+	}
+	db->short_stream = short_stream;
+
+	int32_t *ssat = ( int32_t * )realloc( db->ssat, sizeof( int32_t ) * capacity );
+	if ( ssat == NULL )
+	{
+		db->failed = true;
+		return false;
+	}
+	db->ssat = ssat;
+
+	for ( unsigned long i = db->short_sect_capacity; i < capacity; ++i )
+	{
+		db->ssat[ i ] = FREE_SECT;
+	}
+
+	db->short_sect_capacity = capacity;
+
+	return true;
+}
+
+bool create_builder( database_builder *db, unsigned short sect_size )
+{
+	memset( db, 0, sizeof( database_builder ) );
+	db->sect_size = sect_size;
+	db->directory_count = 1;	// The root entry is added last, but it comes first.
+
+	db->directory_capacity = 64;
+	db->directory = ( char * )malloc( sizeof( char ) * db->directory_capacity * 128 );
+	if ( db->directory == NULL || !reserve_sectors( db, 64 ) || !reserve_short_sectors( db, 64 ) )
+	{
+		free_builder( db );
+		return false;
+	}
+
+	memset( db->directory, 0, 128 );
+
+	return true;
+}
+
+void free_builder( database_builder *db )
+{
+	free( db->sectors );
+	free( db->sat );
+	free( db->short_stream );
+	free( db->ssat );
+	free( db->directory );
+	db->sectors = NULL;
+	db->sat = NULL;
+	db->short_stream = NULL;
+	db->ssat = NULL;
+	db->directory = NULL;
+}
+
+long add_chain( database_builder *db, const char *data, unsigned long length, unsigned long step )
+{
+	unsigned long count = ( length + db->sect_size - 1 ) / db->sect_size;
+	if ( count == 0 )
+	{
+		return END_OF_CHAIN;
+	}
+
+	long first = ( long )db->sect_count;
+	if ( !reserve_sectors( db, first + ( ( count - 1 ) * step ) + 1 ) )
+	{
+		return END_OF_CHAIN;
+	}
+
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		unsigned long sect = first + ( i * step );
+		unsigned long bytes = ( length - ( i * db->sect_size ) < db->sect_size ? length - ( i * db->sect_size ) : db->sect_size );
+		memcpy( db->sectors + ( ( size_t )sect * db->sect_size ), data + ( ( size_t )i * db->sect_size ), bytes );
+		db->sat[ sect ] = ( i + 1 < count ? ( int32_t )( sect + step ) : END_OF_CHAIN );
+	}
+
+	db->sect_count = first + ( ( count - 1 ) * step ) + 1;
+
+	return first;
+}
+
+long add_short_chain( database_builder *db, const char *data, unsigned long length )
+{
+	unsigned long count = ( length + 63 ) / 64;
+	long first = ( long )db->short_sect_count;
+	if ( count == 0 || !reserve_short_sectors( db, first + count ) )
+	{
+		return END_OF_CHAIN;
+	}
+
+	char *container = db->short_stream + ( ( size_t )first * 64 );
+	memset( container, 0, count * 64 );
+	memcpy( container, data, length );
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		db->ssat[ first + i ] = ( i + 1 < count ? ( int32_t )( first + i + 1 ) : END_OF_CHAIN );
+	}
+
+	db->short_sect_count += count;
+
+	return first;
+}
+
+static void set_directory_entry( char *entry, const wchar_t *name, char entry_type, long first_sect, unsigned long length )
+{
+	directory_header dh;
+	memset( &dh, 0, sizeof( directory_header ) );
+
+	unsigned long name_length = ( unsigned long )wcslen( name );
+	for ( unsigned long i = 0; i < name_length; ++i )
+	{
+		dh.sid[ i ] = ( uint16_t )name[ i ];
+	}
+	dh.sid_length = ( uint16_t )( ( name_length + 1 ) * 2 );
+	dh.entry_type = entry_type;
+	dh.node_color = 1;
+	dh.left_child = -1;
+	dh.right_child = -1;
+	dh.dir_id = -1;
+	dh.first_stream_sect = first_sect;
+	dh.stream_length = ( uint32_t )length;
+
+	memcpy( entry, &dh, 128 );
+}
+
+void add_directory_entry( database_builder *db, const wchar_t *name, char entry_type, long first_sect, unsigned long length )
+{
+	if ( db->directory_count == db->directory_capacity )
+	{
+		char *directory = ( char * )realloc( db->directory, sizeof( char ) * db->directory_capacity * 2 * 128 );
+		if ( directory == NULL )
+		{
+			db->failed = true;
+			return;
+		}
+
+		db->directory = directory;
+		db->directory_capacity *= 2;
+	}
+
+	set_directory_entry( db->directory + ( ( size_t )db->directory_count * 128 ), name, entry_type, first_sect, length );
+	++db->directory_count;
+}
+
+long add_stream( database_builder *db, const wchar_t *name, const char *data, unsigned long length, unsigned long step )
+{
+	long first = ( length < 4096 ? add_short_chain( db, data, length ) : add_chain( db, data, length, step ) );
+	add_directory_entry( db, name, 2, first, length );
+
+	return first;
+}
+
+// Adds the chain of a table, padded with free indices to a whole number of sectors. There's always at least one sector.
+static long add_table( database_builder *db, const int32_t *table, unsigned long count, unsigned long *sect_count )
+{
+	unsigned long indices = db->sect_size / sizeof( int32_t );
+	*sect_count = ( count > 0 ? ( count + indices - 1 ) / indices : 1 );
+
+	int32_t *padded = ( int32_t * )malloc( sizeof( int32_t ) * indices * *sect_count );
+	if ( padded == NULL )
+	{
+		db->failed = true;
+		return END_OF_CHAIN;
+	}
+
+	for ( unsigned long i = 0; i < indices * *sect_count; ++i )
+	{
+		padded[ i ] = ( i < count ? table[ i ] : FREE_SECT );
+	}
+
+	long first = add_chain( db, ( char * )padded, ( unsigned long )( sizeof( int32_t ) * indices * *sect_count ), 1 );
+	free( padded );
+
+	return first;
+}
+
+bool write_database( database_builder *db, const wchar_t *root_name, const char *path )
+{
+	unsigned long num_ssat_sects = 0;
+	long short_stream_sect = add_chain( db, db->short_stream, db->short_sect_count * 64, 1 );
+	long ssat_sect = add_table( db, db->ssat, db->short_sect_count, &num_ssat_sects );
+
+	// The root entry comes first.
+	set_directory_entry( db->directory, root_name, 5, short_stream_sect, db->short_sect_count * 64 );
+	long dir_sect = add_chain( db, db->directory, db->directory_count * 128, 1 );
+
+	// The SAT has to describe its own sectors too.
+	unsigned long indices = db->sect_size / sizeof( int32_t );
+	unsigned long num_sat_sects = 1;
+	while ( num_sat_sects * indices < db->sect_count + num_sat_sects )
+	{
+		++num_sat_sects;
+	}
+
+	if ( db->failed || num_sat_sects > 109 || !reserve_sectors( db, db->sect_count + num_sat_sects ) )
+	{
+		return false;
+	}
+
+	long first_sat_sect = ( long )db->sect_count;
+	for ( unsigned long i = 0; i < num_sat_sects; ++i )
+	{
+		db->sat[ db->sect_count++ ] = SAT_SECT;
+	}
+
+	char *header = ( char * )malloc( db->sect_size );
+	if ( header == NULL )
+	{
+		return false;
+	}
+
+	memset( header, 0, db->sect_size );
+
+	database_header dh;
+	memset( &dh, 0, sizeof( database_header ) );
+	memcpy( dh.magic_identifier, "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1", 8 );
+	dh.minor_version = 0x3E;
+	dh.dll_version = ( db->sect_size == 4096 ? 4 : 3 );
+	dh.byte_order = 0xFFFE;
+	dh.sector_shift = ( db->sect_size == 4096 ? 12 : 9 );
+	dh.short_sect_shift = 6;
+	dh.num_dir_sects = ( db->sect_size == 4096 ? ( ( db->directory_count * 128 ) + 4095 ) / 4096 : 0 );
+	dh.num_sat_sects = num_sat_sects;
+	dh.first_dir_sect = dir_sect;
+	dh.short_sect_cutoff = 4096;
+	dh.first_ssat_sect = ssat_sect;
+	dh.num_ssat_sects = num_ssat_sects;
+	dh.first_dis_sect = END_OF_CHAIN;
+	memcpy( header, &dh, sizeof( database_header ) );
+
+	// The MSAT in the header points to every SAT sector.
+	int32_t msat[ 109 ];
+	for ( unsigned long i = 0; i < 109; ++i )
+	{
+		msat[ i ] = ( i < num_sat_sects ? ( int32_t )( first_sat_sect + i ) : FREE_SECT );
+	}
+	memcpy( header + sizeof( database_header ), msat, sizeof( msat ) );
+
+	// The unused indices in the last SAT sector are free.
+	int32_t *sat = ( int32_t * )( db->sectors + ( ( size_t )first_sat_sect * db->sect_size ) );
+	for ( unsigned long i = 0; i < num_sat_sects * indices; ++i )
+	{
+		sat[ i ] = ( i < db->sect_count ? db->sat[ i ] : FREE_SECT );
+	}
+
+	FILE *f = fopen( path, "wb" );
+	bool written = ( f != NULL &&
+					 fwrite( header, 1, db->sect_size, f ) == db->sect_size &&
+					 fwrite( db->sectors, db->sect_size, db->sect_count, f ) == db->sect_count );
+	if ( f != NULL && fclose( f ) != 0 )
+	{
+		written = false;
+	}
+
+	free( header );
+
+	return written;
+}
+
+char *make_jpeg_entry( unsigned long length, unsigned char seed )
+{
+	char *data = ( char * )malloc( length );
+	if ( data != NULL )
+	{
+		uint32_t header[ 3 ] = { 12, 1, ( uint32_t )( length - 12 ) };
+		memcpy( data, header, sizeof( header ) );
+		memcpy( data + 12, "\xFF\xD8\xFF\xE0", 4 );
+		for ( unsigned long i = 16; i < length; ++i )
+		{
+			data[ i ] = ( char )( ( i * 7 ) + seed );
+		}
+	}
+
+	return data;
+}
+
+unsigned long make_raw_entry( char *data )
+{
+	const uint32_t width = 5, height = 3, stride = 16;
+
+	uint32_t header[ 6 ] = { 0x18, 0, stride, width, height, stride * height };
+	memcpy( data, header, sizeof( header ) );
+	for ( unsigned long i = 0; i < stride * height; ++i )
+	{
+		data[ 0x18 + i ] = ( char )( i + 9 );
+	}
+
+	return 0x18 + ( stride * height );
+}
+
+unsigned long make_catalog( char *data, const wchar_t **names, unsigned long count, unsigned short sect_size )
+{
+	if ( data != NULL )
+	{
+		uint16_t header[ 2 ] = { 16, 7 };
+		uint32_t values[ 3 ] = { ( uint32_t )count, 96, 96 };
+		memcpy( data, header, sizeof( header ) );
+		memcpy( data + 4, values, sizeof( values ) );
+	}
+
+	unsigned long length = 16;
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		uint32_t name_length = ( uint32_t )wcslen( names[ i ] ) * 2;
+		uint32_t extra = ( sect_size == 4096 ? 4 : 0 );
+
+		if ( data != NULL )
+		{
+			uint32_t entry[ 2 ] = { name_length + extra + 0x14, ( uint32_t )( i + 1 ) };
+			long long date = CATALOG_DATE + i + 1;
+			memcpy( data + length, entry, sizeof( entry ) );
+			memcpy( data + length + 8, &date, sizeof( date ) );
+			memset( data + length + 16, 0, extra );
+			for ( unsigned long j = 0; j < name_length / 2; ++j )
+			{
+				uint16_t c = ( uint16_t )names[ i ][ j ];
+				memcpy( data + length + 16 + extra + ( j * 2 ), &c, sizeof( c ) );
+			}
+			memset( data + length + 16 + extra + name_length, 0, 4 );
+		}
+
+		length += name_length + extra + 0x14;
+	}
+
+	return length;
+}
+
+void make_stream_name( unsigned long number, wchar_t *name )
+{
+	unsigned long length = 0;
+	do
+	{
+		name[ length++ ] = ( wchar_t )( L'0' + ( number % 10 ) );
+		number /= 10;
+	}
+	while ( number != 0 );
+
+	name[ length ] = L'\0';
+}
@@ -0,0 +1,78 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Builds Thumbs.db files for the tests and benchmarks. Everything is kept in memory until write_database.
+// Databases can have up to 109 SAT sectors, since the builder doesn't add DISATs. That's about 14,000 sectors for Version 3 and 116 million for Version 4.
+
+#ifndef DATABASE_BUILDER_H
+#define DATABASE_BUILDER_H
+
+#include "read_thumbs.h"
+
+#define FREE_SECT		-1
+#define END_OF_CHAIN	-2
+#define SAT_SECT		-3
+
+#define CATALOG_DATE	130000000000000000LL	// Entry n has this date plus n.
+
+// The sectors follow the header, which takes up the first sector. Directory entry 0 is saved for the root entry.
+struct database_builder
+{
+	unsigned short sect_size;
+	unsigned long sect_count;
+	unsigned long sect_capacity;
+	char *sectors;
+	int32_t *sat;					// One index per sector.
+	char *short_stream;				// The short stream container.
+	unsigned long short_sect_count;
+	unsigned long short_sect_capacity;
+	int32_t *ssat;					// One index per short sector.
+	char *directory;
+	unsigned long directory_count;
+	unsigned long directory_capacity;
+	bool failed;					// Something couldn't be allocated. The database won't be written.
+};
+
+bool create_builder( database_builder *db, unsigned short sect_size );
+void free_builder( database_builder *db );
+
+// Writes data into every step-th sector after the last one that's used. The sectors in between are left free. Returns the first sector.
+long add_chain( database_builder *db, const char *data, unsigned long length, unsigned long step );
+long add_short_chain( database_builder *db, const char *data, unsigned long length );
+void add_directory_entry( database_builder *db, const wchar_t *name, char entry_type, long first_sect, unsigned long length );
+
+// Streams below the cutoff go in the short stream container. Returns the first sector.
+long add_stream( database_builder *db, const wchar_t *name, const char *data, unsigned long length, unsigned long step );
+
+// Adds the short stream container, the Short SAT, the directory and the SAT, and writes the database to a file.
+bool write_database( database_builder *db, const wchar_t *root_name, const char *path );
+
+// An XP entry: a 12 byte header followed by a JPEG. The caller frees it.
+char *make_jpeg_entry( unsigned long length, unsigned char seed );
+
+// A raw 5x3 BGR bitmap with a 0x18 byte header. data needs room for 0x48 bytes.
+unsigned long make_raw_entry( char *data );
+
+// An XP catalog (version 7) that names entries 1 to count. Version 4 databases have an extra value before each name.
+// Returns the length of the catalog. Nothing is written if data is NULL.
+unsigned long make_catalog( char *data, const wchar_t **names, unsigned long count, unsigned short sect_size );
+
+// Stream names are entry numbers with their digits reversed. name needs room for 11 characters.
+void make_stream_name( unsigned long number, wchar_t *name );
+
+#endif
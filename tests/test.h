@@ -0,0 +1,43 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// A minimal test harness for the parts of the reader that don't need the GUI.
+// Each group is a function that's listed in test_main.cpp. A failed CHECK is reported and the group keeps going.
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+#define CHECK( e )	do { if ( !( e ) ) { report_failure( __FILE__, __LINE__, #e ); } } while ( 0 )
+
+void report_failure( const char *file, int line, const char *expression );
+
+void test_arena();
+void test_database();
+void test_filename_hash();
+void test_hash_index();
+void test_merge_sort();
+void test_pixel_convert();
+void test_png_writer();
+void test_raw_bitmap();
+void test_scan_tree();
+void test_sector_offset();
+void test_stream_map();
+
+#endif
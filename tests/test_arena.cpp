@@ -0,0 +1,101 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "read_thumbs.h"
+
+static unsigned long count_blocks( const arena *a )
+{
+	unsigned long count = 0;
+	for ( arena_block *block = a->head; block != NULL; block = block->next )
+	{
+		++count;
+	}
+
+	return count;
+}
+
+void test_arena()
+{
+	arena a;
+	memset( &a, 0, sizeof( arena ) );
+
+	CHECK( arena_alloc( NULL, 8 ) == NULL );
+	CHECK( arena_wcsdup( &a, NULL ) == NULL );
+	CHECK( a.head == NULL && a.total == 0 );
+
+	// Sizes are rounded up to 8 bytes and allocations follow each other in the same block.
+	char *first = ( char * )arena_alloc( &a, 1 );
+	char *second = ( char * )arena_alloc( &a, 13 );
+	char *third = ( char * )arena_alloc( &a, 16 );
+	CHECK( first != NULL && second != NULL && third != NULL );
+	CHECK( ( ( size_t )first & 7 ) == 0 && ( ( size_t )second & 7 ) == 0 && ( ( size_t )third & 7 ) == 0 );
+	CHECK( second == first + 8 );
+	CHECK( third == second + 16 );
+	CHECK( a.total == 40 );
+	CHECK( count_blocks( &a ) == 1 );
+
+	// A zero byte allocation doesn't use any space.
+	char *empty = ( char * )arena_alloc( &a, 0 );
+	CHECK( empty == third + 16 );
+	CHECK( a.total == 40 );
+
+	// An allocation that's larger than a block gets a block of its own and the current block keeps being used.
+	arena_block *head = a.head;
+	char *large = ( char * )arena_alloc( &a, ARENA_BLOCK_SIZE + 1 );
+	CHECK( large != NULL && ( ( size_t )large & 7 ) == 0 );
+	CHECK( a.head == head );
+	CHECK( count_blocks( &a ) == 2 );
+	CHECK( a.total == 40 + ARENA_BLOCK_SIZE + 8 );
+	memset( large, 0xAB, ARENA_BLOCK_SIZE + 1 );
+
+	char *after_large = ( char * )arena_alloc( &a, 8 );
+	CHECK( after_large == third + 16 );
+
+	// Fill the rest of the current block exactly. The next allocation starts a new block.
+	size_t remaining = a.head->size - a.head->used;
+	char *rest = ( char * )arena_alloc( &a, remaining );
+	CHECK( rest == after_large + 8 );
+	CHECK( a.head == head && a.head->used == a.head->size );
+
+	char *next_block = ( char * )arena_alloc( &a, 8 );
+	CHECK( next_block != NULL && a.head != head );
+	CHECK( count_blocks( &a ) == 3 );
+	CHECK( a.head->used == 8 );
+
+	// Copies include the terminator and are aligned.
+	const wchar_t *name = L"Thumbs.db entry";
+	wchar_t *copy = arena_wcsdup( &a, name );
+	CHECK( copy != NULL && copy != name );
+	CHECK( copy != NULL && wcscmp( copy, name ) == 0 );
+	CHECK( ( ( size_t )copy & 7 ) == 0 );
+
+	wchar_t *empty_copy = arena_wcsdup( &a, L"" );
+	CHECK( empty_copy != NULL && empty_copy[ 0 ] == L'\0' );
+
+	arena_release( &a );
+	CHECK( a.head == NULL && a.total == 0 );
+
+	// The arena can be used again after it's released, and releasing it twice is harmless.
+	CHECK( arena_alloc( &a, 24 ) != NULL );
+	CHECK( a.total == 24 && count_blocks( &a ) == 1 );
+	arena_release( &a );
+	arena_release( &a );
+	arena_release( NULL );
+	CHECK( a.head == NULL && a.total == 0 );
+}
@@ -0,0 +1,271 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "database_builder.h"
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+#include <limits.h>
+
+static fileinfo *find_entry( fileinfo *fi, const wchar_t *filename )
+{
+	for ( ; fi != NULL; fi = fi->next )
+	{
+		if ( fi->filename != NULL && wcscmp( fi->filename, filename ) == 0 )
+		{
+			return fi;
+		}
+	}
+
+	return NULL;
+}
+
+// Extracts an entry and compares it to the stream it came from. copied is whether the entry had to be copied out of the database.
+static bool check_entry( fileinfo *fi, const char *stream, unsigned long length, bool copied )
+{
+	entry_view ev;
+	memset( &ev, 0, sizeof( entry_view ) );
+	if ( fi == NULL || !extract( fi, ev ) )
+	{
+		return false;
+	}
+
+	uint32_t header_offset = 0;
+	memcpy( &header_offset, stream, sizeof( uint32_t ) );
+
+	bool matched = ( ev.header_offset == header_offset &&
+					 ev.size == length - header_offset &&
+					 memcmp( ev.data, stream, length ) == 0 &&
+					 ( ev.buffer != NULL ) == copied );
+
+	release_entry_view( ev );
+
+	return matched;
+}
+
+static void parse_test_database( unsigned short sect_size, const char *path, const wchar_t *wide_path )
+{
+	database_builder db;
+	CHECK( create_builder( &db, sect_size ) );
+
+	static const wchar_t *names[] = { L"photo one.jpg", L"bitmap.bmp", L"large.jpg", L"scattered.jpg" };
+
+	char *small_jpeg = make_jpeg_entry( 318, 1 );
+	char *large_jpeg = make_jpeg_entry( 9000, 2 );
+	char *scattered_jpeg = make_jpeg_entry( 5000 + sect_size, 3 );
+	char raw[ 0x18 + 48 ];
+	unsigned long raw_length = make_raw_entry( raw );
+	char catalog[ 256 ];
+	unsigned long catalog_length = make_catalog( catalog, names, 4, sect_size );
+
+	CHECK( small_jpeg != NULL && large_jpeg != NULL && scattered_jpeg != NULL );
+	if ( db.sectors == NULL || small_jpeg == NULL || large_jpeg == NULL || scattered_jpeg == NULL )
+	{
+		free( small_jpeg );
+		free( large_jpeg );
+		free( scattered_jpeg );
+		free_builder( &db );
+		return;
+	}
+
+	// The large entry is contiguous and can be viewed in place. The scattered entry skips every other sector and has to be copied.
+	add_stream( &db, L"1", small_jpeg, 318, 1 );
+	add_stream( &db, L"2", raw, raw_length, 1 );
+	long large_sect = add_stream( &db, L"3", large_jpeg, 9000, 1 );
+	add_stream( &db, L"4", scattered_jpeg, 5000 + sect_size, 2 );
+	add_stream( &db, L"Catalog", catalog, catalog_length, 1 );
+
+	CHECK( write_database( &db, L"Root Entry", path ) );
+
+	fileinfo *fi = parse_database( ( wchar_t * )wide_path );
+	CHECK( fi != NULL );
+	if ( fi != NULL )
+	{
+		CHECK( fi->si->sect_size == sect_size );
+		CHECK( fi->si->reader.view != NULL );
+		CHECK( fi->si->count == 4 );
+		CHECK( fi->si->version == 7 && fi->si->system == 2 );
+		CHECK( fi->si->diagnostic_count == 0 );
+
+		fileinfo *small_entry = find_entry( fi, names[ 0 ] );
+		fileinfo *raw_entry = find_entry( fi, names[ 1 ] );
+		fileinfo *large_entry = find_entry( fi, names[ 2 ] );
+		fileinfo *scattered_entry = find_entry( fi, names[ 3 ] );
+		CHECK( small_entry != NULL && small_entry->date_modified == CATALOG_DATE + 1 );
+		CHECK( raw_entry != NULL && raw_entry->size == raw_length );
+		CHECK( large_entry != NULL && large_entry->size == 9000 );
+		CHECK( scattered_entry != NULL && scattered_entry->date_modified == CATALOG_DATE + 4 );
+
+		// Short streams are viewed in place since the container is contiguous.
+		CHECK( check_entry( small_entry, small_jpeg, 318, false ) );
+		CHECK( check_entry( raw_entry, raw, raw_length, false ) );
+		CHECK( check_entry( large_entry, large_jpeg, 9000, false ) );
+		CHECK( check_entry( scattered_entry, scattered_jpeg, 5000 + sect_size, true ) );
+
+		// The chains are mapped once and reused.
+		CHECK( scattered_entry != NULL && scattered_entry->map != NULL && scattered_entry->map->count == 2 + ( 5000UL / sect_size ) );
+		CHECK( check_entry( scattered_entry, scattered_jpeg, 5000 + sect_size, true ) );
+
+		while ( fi != NULL )
+		{
+			fileinfo *next = fi->next;
+			free_fileinfo( fi );
+			fi = next;
+		}
+	}
+
+	// Read the same file without mapping it. Every read goes through read_file_at and the sector cache.
+	database_reader dr;
+	CHECK( open_database_reader( &dr, ( wchar_t * )wide_path ) );
+	if ( dr.file != NULL )
+	{
+		unsigned long long file_size = ( unsigned long long )( db.sect_count + 1 ) * sect_size;
+		CHECK( dr.size == file_size );
+
+		unmap_file( dr.file, dr.view, dr.size );
+		dr.view = NULL;
+		create_sector_cache( &dr, sect_size );
+		CHECK( dr.cache != NULL );
+
+		char *sector = ( char * )malloc( sect_size );
+		if ( sector != NULL )
+		{
+			unsigned long long offset = get_sector_offset( sect_size, large_sect );
+
+			CHECK( read_database( &dr, offset, sector, sect_size ) == sect_size );
+			CHECK( memcmp( sector, large_jpeg, sect_size ) == 0 );
+
+			CHECK( read_database_sector( &dr, offset, sector, sect_size ) == sect_size );
+			CHECK( read_database_sector( &dr, offset, sector, 100 ) == 100 );
+			CHECK( memcmp( sector, large_jpeg, 100 ) == 0 );
+			CHECK( dr.cache_misses == 1 && dr.cache_hits == 1 );
+
+			// Reads stop at the end of the file.
+			CHECK( read_database( &dr, file_size - 10, sector, sect_size ) == 10 );
+			CHECK( read_database( &dr, file_size, sector, sect_size ) == 0 );
+			CHECK( read_database_sector( &dr, file_size, sector, sect_size ) == 0 );
+
+			free( sector );
+		}
+
+		close_database_reader( &dr );
+	}
+
+	remove( path );
+
+	free( small_jpeg );
+	free( large_jpeg );
+	free( scattered_jpeg );
+	free_builder( &db );
+}
+
+static const char *last_error = NULL;
+
+static void save_error( const char *message )
+{
+	last_error = message;
+}
+
+// An entry whose size is near ULONG_MAX must be rejected before anything is allocated for it.
+static void oversized_entry_test( const char *path, const wchar_t *wide_path )
+{
+	database_builder db;
+	CHECK( create_builder( &db, 512 ) );
+
+	char *jpeg = make_jpeg_entry( 9000, 5 );
+	CHECK( jpeg != NULL );
+	if ( db.sectors == NULL || jpeg == NULL )
+	{
+		free( jpeg );
+		free_builder( &db );
+		return;
+	}
+
+	// The oversized entry points to the same chain as a valid entry.
+	long first_sect = add_stream( &db, L"1", jpeg, 9000, 1 );
+	add_directory_entry( &db, L"2", 2, first_sect, 0xFFFFFFF0 );
+
+	CHECK( write_database( &db, L"Root Entry", path ) );
+
+	fileinfo *fi = parse_database( ( wchar_t * )wide_path );
+	CHECK( fi != NULL );
+	if ( fi != NULL )
+	{
+		fileinfo *valid_entry = find_entry( fi, L"1" );
+		fileinfo *oversized_entry = find_entry( fi, L"2" );
+		CHECK( check_entry( valid_entry, jpeg, 9000, false ) );
+		CHECK( oversized_entry != NULL && oversized_entry->size == 0xFFFFFFF0 );
+
+		if ( oversized_entry != NULL )
+		{
+			// The chain is too short for the size.
+			CHECK( oversized_entry->flag & FIF_BAD_CHAIN );
+
+			buffer_pool_stats before, after;
+			get_buffer_pool_stats( &before );
+
+			g_error_callback = save_error;
+
+			entry_view ev;
+			memset( &ev, 0, sizeof( entry_view ) );
+			CHECK( !extract( oversized_entry, ev ) );
+			CHECK( last_error != NULL && strcmp( last_error, "The entry's sector chain is invalid." ) == 0 );
+
+			// Skip the chain check so that the size check is reached. Adding room for a CMYK header to this size would wrap.
+			oversized_entry->flag &= ~FIF_BAD_CHAIN;
+			oversized_entry->size = ULONG_MAX - 8;
+			CHECK( !extract( oversized_entry, ev ) );
+			CHECK( last_error != NULL && strcmp( last_error, "The entry is larger than the database." ) == 0 );
+
+			g_error_callback = NULL;
+
+			get_buffer_pool_stats( &after );
+			CHECK( after.requests == before.requests );
+			CHECK( ev.data == NULL && ev.buffer == NULL && ev.size == 0 );
+		}
+
+		while ( fi != NULL )
+		{
+			fileinfo *next = fi->next;
+			free_fileinfo( fi );
+			fi = next;
+		}
+	}
+
+	remove( path );
+
+	free( jpeg );
+	free_builder( &db );
+}
+
+void test_database()
+{
+	initialize_buffer_pool();
+	initialize_short_stream_cache();
+
+	parse_test_database( 512, "thumbs_tests_v3.db", L"thumbs_tests_v3.db" );
+	parse_test_database( 4096, "thumbs_tests_v4.db", L"thumbs_tests_v4.db" );
+	oversized_entry_test( "thumbs_tests_oversized.db", L"thumbs_tests_oversized.db" );
+
+	// Not a database.
+	CHECK( parse_database( ( wchar_t * )L"thumbs_tests_missing.db" ) == NULL );
+
+	uninitialize_short_stream_cache();
+	uninitialize_buffer_pool();
+}
@@ -0,0 +1,104 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "filename_hash.h"
+
+#include <stdlib.h>
+
+// hash_data over the little-endian UTF-16 bytes of a filename. This is how Windows hashes it.
+static unsigned long long hash_utf16_bytes( const wchar_t *filename, unsigned int length, unsigned long long hash )
+{
+	for ( unsigned int i = 0; i < length; ++i )
+	{
+		char bytes[ 2 ];
+		bytes[ 0 ] = ( char )( filename[ i ] & 0xFF );
+		bytes[ 1 ] = ( char )( ( filename[ i ] >> 8 ) & 0xFF );
+		hash = hash_data( bytes, hash, 2 );
+	}
+
+	return hash;
+}
+
+static void set_result( scan_result *sr, const wchar_t *directory, const wchar_t *filename )
+{
+	sr->hash = 0;
+	sr->filename_offset = ( unsigned int )wcslen( directory );
+	sr->filename_length = ( unsigned int )wcslen( filename );
+	wcscpy_s( sr->filepath, ( MAX_PATH * 2 ) + 2, directory );
+	wcscpy_s( sr->filepath + sr->filename_offset, ( ( MAX_PATH * 2 ) + 2 ) - sr->filename_offset, filename );
+}
+
+void test_filename_hash()
+{
+	// Values computed separately from the byte-wise algorithm.
+	CHECK( hash_filename( L"image.jpg", FILENAME_HASH_INITIAL, 9 ) == 0x7B52B62DD4851515ULL );
+	CHECK( hash_filename( L"image.jpg", FILENAME_HASH_INITIAL_WIN8, 9 ) == 0xF5CDF87B5A9F0E21ULL );
+	CHECK( hash_filename( L"Vacation Ph\x00F6to \x4E2D.png", FILENAME_HASH_INITIAL, 20 ) == 0x99137A151CA7DB05ULL );
+	CHECK( hash_filename( L"Vacation Ph\x00F6to \x4E2D.png", FILENAME_HASH_INITIAL_WIN8, 20 ) == 0xE087BBA5E2F4CB6CULL );
+
+	// An empty filename leaves the initial value alone.
+	CHECK( hash_filename( L"", FILENAME_HASH_INITIAL, 0 ) == FILENAME_HASH_INITIAL );
+	CHECK( hash_data( NULL, FILENAME_HASH_INITIAL, 0 ) == FILENAME_HASH_INITIAL );
+
+	// Bytes with the high bit set are hashed as unsigned values.
+	char high[ 2 ] = { ( char )0xE9, ( char )0x00 };
+	CHECK( hash_data( high, FILENAME_HASH_INITIAL, 2 ) == hash_filename( L"\x00E9", FILENAME_HASH_INITIAL, 1 ) );
+
+	static const wchar_t *names[] =
+	{
+		L"a", L"", L"Thumbs.db", L"IMG_0001.JPG", L"\x00E9t\x00E9.bmp", L"ab",
+		L"A much longer filename than the others in the batch.jpeg", L"\x4E2D\x6587.png", L"x.y", L"\xFFFF\x0100"
+	};
+	const unsigned long name_count = sizeof( names ) / sizeof( names[ 0 ] );
+
+	// Batches of every size up to a few groups of 4 so the side by side loop and the remainder are both used.
+	scan_result *results = ( scan_result * )malloc( sizeof( scan_result ) * 13 );
+	CHECK( results != NULL );
+	if ( results == NULL )
+	{
+		return;
+	}
+
+	for ( unsigned long count = 0; count <= 13; ++count )
+	{
+		for ( unsigned long i = 0; i < count; ++i )
+		{
+			// Rotate the names so that the shortest one moves around within each group.
+			set_result( &results[ i ], ( i & 1 ? L"C:\\Pictures\\" : L"" ), names[ ( i + count ) % name_count ] );
+		}
+
+		hash_filenames( results, count, FILENAME_HASH_INITIAL_WIN8 );
+
+		bool matched = true;
+		for ( unsigned long i = 0; i < count; ++i )
+		{
+			const wchar_t *filename = results[ i ].filepath + results[ i ].filename_offset;
+			matched &= ( results[ i ].hash == hash_utf16_bytes( filename, results[ i ].filename_length, FILENAME_HASH_INITIAL_WIN8 ) );
+			matched &= ( results[ i ].hash == hash_filename( filename, FILENAME_HASH_INITIAL_WIN8, results[ i ].filename_length ) );
+		}
+		CHECK( matched );
+	}
+
+	// The initial value that's passed in is the one that's used.
+	set_result( &results[ 0 ], L"", L"image.jpg" );
+	hash_filenames( results, 1, FILENAME_HASH_INITIAL );
+	CHECK( results[ 0 ].hash == 0x7B52B62DD4851515ULL );
+
+	free( results );
+}
@@ -0,0 +1,106 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "hash_index.h"
+
+#define KEY_COUNT	5000	// Enough keys for the slots and values to grow several times.
+
+// Turns an index into a value that can be told apart from NULL.
+#define TO_VALUE( i )	( ( void * )( ( size_t )( i ) + 1 ) )
+
+void test_hash_index()
+{
+	CHECK( hash_index_insert( NULL, 1, TO_VALUE( 0 ) ) == false );
+	CHECK( hash_index_find( NULL, 1 ) == NULL );
+	CHECK( hash_index_next( NULL, NULL ) == NULL );
+	hash_index_delete( NULL );
+
+	// Room for count keys keeps the load factor at or below 1/2.
+	hash_index *sized = hash_index_create( 3000 );
+	CHECK( sized != NULL );
+	if ( sized != NULL )
+	{
+		CHECK( sized->capacity == 8192 && sized->value_capacity == 3000 );
+		hash_index_delete( sized );
+	}
+
+	hash_index *hi = hash_index_create( 0 );
+	CHECK( hi != NULL );
+	if ( hi == NULL )
+	{
+		return;
+	}
+
+	CHECK( hi->capacity == HASH_INDEX_MIN_CAPACITY );
+	CHECK( hash_index_find( hi, 0 ) == NULL );
+
+	// Key 0 is a valid key. The keys only differ in their high bits so that they would collide without mixing.
+	bool inserted = true;
+	for ( unsigned long i = 0; i < KEY_COUNT; ++i )
+	{
+		inserted &= hash_index_insert( hi, ( unsigned long long )i << 40, TO_VALUE( i ) );
+
+		// Every 7th key gets two more values. Other keys are inserted in between so the chain isn't contiguous.
+		if ( i % 7 == 0 && i > 0 )
+		{
+			inserted &= hash_index_insert( hi, ( unsigned long long )( i - 7 ) << 40, TO_VALUE( i + KEY_COUNT ) );
+			inserted &= hash_index_insert( hi, ( unsigned long long )( i - 7 ) << 40, TO_VALUE( i + ( KEY_COUNT * 2 ) ) );
+		}
+	}
+	CHECK( inserted );
+
+	CHECK( hi->used == KEY_COUNT );
+	CHECK( hi->used * 2 <= hi->capacity );
+	CHECK( ( hi->capacity & ( hi->capacity - 1 ) ) == 0 );
+
+	bool found = true;
+	bool ordered = true;
+	for ( unsigned long i = 0; i < KEY_COUNT; ++i )
+	{
+		hash_index_value *hiv = hash_index_find( hi, ( unsigned long long )i << 40 );
+		found &= ( hiv != NULL && hiv->val == TO_VALUE( i ) );
+
+		hiv = hash_index_next( hi, hiv );
+
+		// The duplicates are added when key i + 7 is inserted, so the last key's don't exist.
+		if ( i % 7 == 0 && i + 7 < KEY_COUNT )
+		{
+			ordered &= ( hiv != NULL && hiv->val == TO_VALUE( i + 7 + KEY_COUNT ) );
+			hiv = hash_index_next( hi, hiv );
+			ordered &= ( hiv != NULL && hiv->val == TO_VALUE( i + 7 + ( KEY_COUNT * 2 ) ) );
+			hiv = hash_index_next( hi, hiv );
+		}
+
+		ordered &= ( hiv == NULL );
+	}
+	CHECK( found );
+	CHECK( ordered );
+
+	// Keys that were never inserted.
+	CHECK( hash_index_find( hi, 1 ) == NULL );
+	CHECK( hash_index_find( hi, ( unsigned long long )KEY_COUNT << 40 ) == NULL );
+	CHECK( hash_index_find( hi, 0xFFFFFFFFFFFFFFFFULL ) == NULL );
+
+	// NULL is a valid value.
+	CHECK( hash_index_insert( hi, 0xFFFFFFFFFFFFFFFFULL, NULL ) );
+	hash_index_value *null_value = hash_index_find( hi, 0xFFFFFFFFFFFFFFFFULL );
+	CHECK( null_value != NULL && null_value->val == NULL );
+
+	hash_index_delete( hi );
+}
@@ -0,0 +1,81 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <string.h>
+
+struct test_group
+{
+	const char *name;
+	void ( *run )();
+};
+
+static const test_group groups[] =
+{
+	{ "arena", test_arena },
+	{ "database", test_database },
+	{ "filename_hash", test_filename_hash },
+	{ "hash_index", test_hash_index },
+	{ "merge_sort", test_merge_sort },
+	{ "pixel_convert", test_pixel_convert },
+	{ "png_writer", test_png_writer },
+	{ "raw_bitmap", test_raw_bitmap },
+	{ "scan_tree", test_scan_tree },
+	{ "sector_offset", test_sector_offset },
+	{ "stream_map", test_stream_map }
+};
+
+static unsigned long failures = 0;
+
+void report_failure( const char *file, int line, const char *expression )
+{
+	fprintf( stderr, "%s(%d): CHECK( %s ) failed\n", file, line, expression );
+	++failures;
+}
+
+// Runs every group, or only the ones that are named on the command-line.
+int main( int argc, char *argv[] )
+{
+	unsigned long run = 0;
+
+	for ( unsigned long i = 0; i < sizeof( groups ) / sizeof( groups[ 0 ] ); ++i )
+	{
+		bool selected = ( argc < 2 );
+		for ( int j = 1; j < argc && !selected; ++j )
+		{
+			selected = ( strcmp( argv[ j ], groups[ i ].name ) == 0 );
+		}
+
+		if ( selected )
+		{
+			unsigned long before = failures;
+			groups[ i ].run();
+			printf( "%s: %s\n", groups[ i ].name, ( failures == before ? "passed" : "FAILED" ) );
+			++run;
+		}
+	}
+
+	if ( run == 0 )
+	{
+		fprintf( stderr, "No test group matched.\n" );
+		return 1;
+	}
+
+	return ( failures == 0 ? 0 : 1 );
+}
@@ -0,0 +1,135 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "merge_sort.h"
+
+#include <stdlib.h>
+
+struct sort_item
+{
+	unsigned long key;
+	unsigned long position;	// The index the item had before it was sorted.
+};
+
+static unsigned long compare_calls = 0;
+
+static int compare_keys( void *a, void *b, void *context )
+{
+	unsigned long *calls = ( unsigned long * )context;
+	++( *calls );
+
+	unsigned long key_a = ( ( sort_item * )a )->key;
+	unsigned long key_b = ( ( sort_item * )b )->key;
+
+	return ( key_a > key_b ? 1 : ( key_a < key_b ? -1 : 0 ) );
+}
+
+// Sorts count items that have key_range distinct keys and checks that the result is ordered and stable.
+static void sort_items( unsigned long count, unsigned long key_range, unsigned long seed )
+{
+	sort_item *items = ( sort_item * )malloc( sizeof( sort_item ) * ( count + 1 ) );
+	void **pointers = ( void ** )malloc( sizeof( void * ) * ( count + 1 ) );
+	CHECK( items != NULL && pointers != NULL );
+	if ( items == NULL || pointers == NULL )
+	{
+		free( items );
+		free( pointers );
+		return;
+	}
+
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		seed = ( seed * 1103515245 ) + 12345;
+		items[ i ].key = ( seed >> 16 ) % key_range;
+		items[ i ].position = i;
+		pointers[ i ] = &items[ i ];
+	}
+
+	compare_calls = 0;
+	CHECK( merge_sort( pointers, count, compare_keys, &compare_calls ) );
+
+	bool ordered = true;
+	bool stable = true;
+	for ( unsigned long i = 1; i < count; ++i )
+	{
+		sort_item *previous = ( sort_item * )pointers[ i - 1 ];
+		sort_item *current = ( sort_item * )pointers[ i ];
+
+		ordered &= ( previous->key <= current->key );
+		stable &= ( previous->key != current->key || previous->position < current->position );
+	}
+
+	CHECK( ordered );
+	CHECK( stable );
+
+	// Every item has to be there exactly once.
+	unsigned long position_sum = 0;
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		position_sum += ( ( sort_item * )pointers[ i ] )->position;
+	}
+	CHECK( count == 0 || position_sum == ( count * ( count - 1 ) ) / 2 );
+
+	free( pointers );
+	free( items );
+}
+
+void test_merge_sort()
+{
+	// Nothing to sort.
+	CHECK( merge_sort( NULL, 0, compare_keys, &compare_calls ) );
+
+	sort_item one = { 5, 0 };
+	void *single = &one;
+	compare_calls = 0;
+	CHECK( merge_sort( &single, 1, compare_keys, &compare_calls ) );
+	CHECK( single == &one && compare_calls == 0 );
+
+	// Sizes around the powers of 2 where the last run is short or the result ends up in the temporary array.
+	static const unsigned long counts[] = { 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 100, 1000 };
+	for ( unsigned long i = 0; i < sizeof( counts ) / sizeof( counts[ 0 ] ); ++i )
+	{
+		sort_items( counts[ i ], 4, counts[ i ] );		// Lots of equal keys.
+		sort_items( counts[ i ], 1000000, counts[ i ] );	// Mostly distinct keys.
+	}
+
+	// All keys equal. Nothing may move.
+	sort_items( 257, 1, 7 );
+
+	// Already sorted items only need one comparison per item and width.
+	sort_item sorted[ 8 ];
+	void *sorted_pointers[ 8 ];
+	for ( unsigned long i = 0; i < 8; ++i )
+	{
+		sorted[ i ].key = i;
+		sorted[ i ].position = i;
+		sorted_pointers[ i ] = &sorted[ i ];
+	}
+
+	compare_calls = 0;
+	CHECK( merge_sort( sorted_pointers, 8, compare_keys, &compare_calls ) );
+	CHECK( compare_calls == 12 );
+
+	bool unchanged = true;
+	for ( unsigned long i = 0; i < 8; ++i )
+	{
+		unchanged &= ( sorted_pointers[ i ] == &sorted[ i ] );
+	}
+	CHECK( unchanged );
+}
@@ -0,0 +1,171 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "pixel_convert.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_WIDTH	19		// Covers several groups of 4 pixels and every remainder.
+#define MAX_HEIGHT	3
+#define PADDING		5		// Extra bytes at the end of each source row.
+
+static void fill_pixels( unsigned char *data, size_t size, unsigned long seed )
+{
+	for ( size_t i = 0; i < size; ++i )
+	{
+		seed = ( seed * 1103515245 ) + 12345;
+		data[ i ] = ( unsigned char )( seed >> 16 );
+	}
+}
+
+static void test_copy_pixel_rows( unsigned char channels, bool swap_red_blue, bool bottom_up )
+{
+	const int src_stride = ( MAX_WIDTH * channels ) + PADDING;
+	const int dst_stride = MAX_WIDTH * channels;
+
+	// One extra byte so the rows don't start on an aligned address.
+	unsigned char src_buf[ ( ( MAX_WIDTH * 4 ) + PADDING ) * MAX_HEIGHT + 1 ];
+	unsigned char dst[ MAX_WIDTH * 4 * MAX_HEIGHT + 1 ];
+	unsigned char *src = src_buf + 1;
+
+	bool matched = true;
+	bool untouched = true;
+
+	for ( unsigned int height = 0; height <= MAX_HEIGHT; ++height )
+	{
+		for ( unsigned int width = 0; width <= MAX_WIDTH; ++width )
+		{
+			fill_pixels( src_buf, sizeof( src_buf ), ( width * 31 ) + height );
+			memset( dst, 0xCD, sizeof( dst ) );
+
+			// A negative stride starts at the last row.
+			const unsigned char *first_row = ( bottom_up && height > 0 ? src + ( ( height - 1 ) * src_stride ) : src );
+			copy_pixel_rows( first_row, ( bottom_up ? -src_stride : src_stride ), dst, dst_stride, width, height, channels, swap_red_blue );
+
+			for ( unsigned int row = 0; row < height; ++row )
+			{
+				const unsigned char *s = src + ( ( bottom_up ? height - 1 - row : row ) * src_stride );
+				const unsigned char *d = dst + ( row * dst_stride );
+
+				for ( unsigned int col = 0; col < width; ++col )
+				{
+					const unsigned char *sp = s + ( col * channels );
+					const unsigned char *dp = d + ( col * channels );
+
+					matched &= ( dp[ 0 ] == sp[ swap_red_blue ? 2 : 0 ] );
+					matched &= ( dp[ 1 ] == sp[ 1 ] );
+					matched &= ( dp[ 2 ] == sp[ swap_red_blue ? 0 : 2 ] );
+					matched &= ( channels == 3 || dp[ 3 ] == sp[ 3 ] );
+				}
+
+				// Nothing is written beyond the width of each row.
+				for ( unsigned int i = width * channels; i < ( unsigned int )dst_stride; ++i )
+				{
+					untouched &= ( d[ i ] == 0xCD );
+				}
+			}
+
+			for ( unsigned int i = height * dst_stride; i < sizeof( dst ); ++i )
+			{
+				untouched &= ( dst[ i ] == 0xCD );
+			}
+		}
+	}
+
+	CHECK( matched );
+	CHECK( untouched );
+}
+
+static void test_cmyk_to_rgb_flipped()
+{
+	const int src_stride = ( MAX_WIDTH * 4 ) + 8;
+	const int dst_stride = MAX_WIDTH * 4;
+
+	// The pixels are read and written as 32 bit values, so the rows are 4 byte aligned like they are in a GDI+ bitmap.
+	unsigned int src_buf[ ( ( MAX_WIDTH * 4 ) + 8 ) * MAX_HEIGHT / 4 ];
+	unsigned int dst_buf[ MAX_WIDTH * MAX_HEIGHT + 1 ];
+	unsigned char *src = ( unsigned char * )src_buf;
+	unsigned char *dst = ( unsigned char * )dst_buf;
+
+	bool matched = true;
+	bool untouched = true;
+
+	for ( unsigned int height = 0; height <= MAX_HEIGHT; ++height )
+	{
+		for ( unsigned int width = 0; width <= MAX_WIDTH; ++width )
+		{
+			fill_pixels( src, sizeof( src_buf ), ( width * 17 ) + height );
+			memset( dst, 0xCD, sizeof( dst_buf ) );
+
+			cmyk_to_rgb_flipped( src, src_stride, dst, dst_stride, width, height );
+
+			for ( unsigned int row = 0; row < height; ++row )
+			{
+				// The first source row becomes the last destination row.
+				const unsigned char *s = src + ( row * src_stride );
+				const unsigned char *d = dst + ( ( height - 1 - row ) * dst_stride );
+
+				for ( unsigned int col = 0; col < width; ++col )
+				{
+					const unsigned char *sp = s + ( col * 4 );
+					const unsigned char *dp = d + ( col * 4 );
+
+					// Each color channel is complemented and the alpha is opaque.
+					matched &= ( dp[ 0 ] == ( unsigned char )( 255 - sp[ 0 ] ) );
+					matched &= ( dp[ 1 ] == ( unsigned char )( 255 - sp[ 1 ] ) );
+					matched &= ( dp[ 2 ] == ( unsigned char )( 255 - sp[ 2 ] ) );
+					matched &= ( dp[ 3 ] == 255 );
+				}
+
+				for ( unsigned int i = width * 4; i < ( unsigned int )dst_stride; ++i )
+				{
+					untouched &= ( d[ i ] == 0xCD );
+				}
+			}
+
+			for ( unsigned int i = height * dst_stride; i < sizeof( dst_buf ); ++i )
+			{
+				untouched &= ( dst[ i ] == 0xCD );
+			}
+		}
+	}
+
+	CHECK( matched );
+	CHECK( untouched );
+
+	// A known pixel. C = 0x10, M = 0x20, Y = 0x30 in a little-endian 32 bit value becomes R, G, B = 0xEF, 0xDF, 0xCF.
+	unsigned int cmy = 0x00302010;
+	unsigned int rgb = 0;
+	cmyk_to_rgb_flipped( ( unsigned char * )&cmy, 4, ( unsigned char * )&rgb, 4, 1, 1 );
+	CHECK( rgb == 0xFFCFDFEF );
+}
+
+void test_pixel_convert()
+{
+	for ( unsigned char channels = 3; channels <= 4; ++channels )
+	{
+		test_copy_pixel_rows( channels, false, false );
+		test_copy_pixel_rows( channels, true, false );
+		test_copy_pixel_rows( channels, false, true );
+		test_copy_pixel_rows( channels, true, true );
+	}
+
+	test_cmyk_to_rgb_flipped();
+}
@@ -0,0 +1,498 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Every PNG is decoded again and compared against the pixels it was made from.
+// The encoder only writes stored and fixed Huffman blocks, so that's all the inflater below understands.
+
+#include "test.h"
+#include "png_writer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFLATE_MAX_MATCH_LENGTH	258
+
+// A 16x16 RGB image from make_pixels, with adaptive filtering and fast compression.
+#define PNG_GOLDEN_SIZE		417
+#define PNG_GOLDEN_CRC		0x6B9FA435
+
+static unsigned long crc32( const unsigned char *data, size_t size, unsigned long crc = 0 )
+{
+	crc = ~crc & 0xFFFFFFFF;
+	for ( size_t i = 0; i < size; ++i )
+	{
+		crc ^= data[ i ];
+		for ( int k = 0; k < 8; ++k )
+		{
+			crc = ( crc & 1 ? 0xEDB88320 ^ ( crc >> 1 ) : crc >> 1 );
+		}
+	}
+
+	return ~crc & 0xFFFFFFFF;
+}
+
+static unsigned long read_uint32_be( const unsigned char *data )
+{
+	return ( ( unsigned long )data[ 0 ] << 24 ) | ( ( unsigned long )data[ 1 ] << 16 ) | ( ( unsigned long )data[ 2 ] << 8 ) | data[ 3 ];
+}
+
+struct bit_reader
+{
+	const unsigned char *data;
+	size_t size;
+	size_t position;	// In bits.
+	bool overrun;
+};
+
+static unsigned long get_bits( bit_reader *br, unsigned char count )
+{
+	unsigned long value = 0;
+	for ( unsigned char i = 0; i < count; ++i )
+	{
+		if ( ( br->position >> 3 ) >= br->size )
+		{
+			br->overrun = true;
+			return 0;
+		}
+
+		value |= ( unsigned long )( ( br->data[ br->position >> 3 ] >> ( br->position & 7 ) ) & 1 ) << i;
+		++br->position;
+	}
+
+	return value;
+}
+
+// Canonical Huffman code, decoded a bit at a time.
+struct huffman
+{
+	unsigned short count[ 16 ];		// Number of codes of each length.
+	unsigned short symbol[ 288 ];	// Symbols ordered by code.
+};
+
+static void build_huffman( huffman *h, const unsigned char *lengths, int symbols )
+{
+	unsigned short offsets[ 16 ];
+
+	memset( h->count, 0, sizeof( h->count ) );
+	for ( int i = 0; i < symbols; ++i )
+	{
+		++h->count[ lengths[ i ] ];
+	}
+
+	h->count[ 0 ] = 0;
+	offsets[ 1 ] = 0;
+	for ( int len = 1; len < 15; ++len )
+	{
+		offsets[ len + 1 ] = offsets[ len ] + h->count[ len ];
+	}
+
+	for ( int i = 0; i < symbols; ++i )
+	{
+		if ( lengths[ i ] != 0 )
+		{
+			h->symbol[ offsets[ lengths[ i ] ]++ ] = ( unsigned short )i;
+		}
+	}
+}
+
+static int decode_symbol( bit_reader *br, const huffman *h )
+{
+	int code = 0, first = 0, index = 0;
+
+	for ( int len = 1; len < 16; ++len )
+	{
+		code |= ( int )get_bits( br, 1 );
+		int count = h->count[ len ];
+		if ( code - count < first )
+		{
+			return h->symbol[ index + ( code - first ) ];
+		}
+
+		index += count;
+		first = ( first + count ) << 1;
+		code <<= 1;
+	}
+
+	return -1;
+}
+
+// Returns the inflated data, or NULL if the stream uses anything other than stored and fixed blocks, or if it's corrupt.
+static unsigned char *inflate( const unsigned char *data, size_t size, size_t *out_size )
+{
+	static const unsigned short length_base[ 29 ] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const unsigned char length_extra[ 29 ] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const unsigned short distance_base[ 30 ] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const unsigned char distance_extra[ 30 ] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	unsigned char lengths[ 288 ];
+	huffman literals, distances;
+	memset( lengths, 8, 144 );
+	memset( lengths + 144, 9, 112 );
+	memset( lengths + 256, 7, 24 );
+	memset( lengths + 280, 8, 8 );
+	build_huffman( &literals, lengths, 288 );
+	memset( lengths, 5, 30 );
+	build_huffman( &distances, lengths, 30 );
+
+	size_t capacity = 1024, used = 0;
+	unsigned char *out = ( unsigned char * )malloc( capacity );
+
+	bit_reader br = { data, size, 0, false };
+	unsigned long last = 0;
+
+	while ( !last && out != NULL )
+	{
+		last = get_bits( &br, 1 );
+		unsigned long type = get_bits( &br, 2 );
+
+		if ( type == 0 )
+		{
+			br.position = ( br.position + 7 ) & ~( size_t )7;
+			unsigned long length = get_bits( &br, 16 );
+			unsigned long inverse = get_bits( &br, 16 );
+			if ( br.overrun || ( length ^ 0xFFFF ) != inverse || ( br.position >> 3 ) + length > size )
+			{
+				free( out );
+				return NULL;
+			}
+
+			if ( used + length > capacity )
+			{
+				capacity = ( used + length ) * 2;
+				out = ( unsigned char * )realloc( out, capacity );
+				if ( out == NULL )
+				{
+					break;
+				}
+			}
+
+			memcpy( out + used, data + ( br.position >> 3 ), length );
+			used += length;
+			br.position += length * 8;
+		}
+		else if ( type == 1 )
+		{
+			while ( out != NULL )
+			{
+				int symbol = decode_symbol( &br, &literals );
+				if ( symbol < 0 || br.overrun )
+				{
+					free( out );
+					return NULL;
+				}
+				else if ( symbol == 256 )
+				{
+					break;
+				}
+
+				if ( used + DEFLATE_MAX_MATCH_LENGTH > capacity )
+				{
+					capacity *= 2;
+					out = ( unsigned char * )realloc( out, capacity );
+					if ( out == NULL )
+					{
+						break;
+					}
+				}
+
+				if ( symbol < 256 )
+				{
+					out[ used++ ] = ( unsigned char )symbol;
+					continue;
+				}
+
+				symbol -= 257;
+				if ( symbol >= 29 )
+				{
+					free( out );
+					return NULL;
+				}
+
+				unsigned long length = length_base[ symbol ] + get_bits( &br, length_extra[ symbol ] );
+				int distance_symbol = decode_symbol( &br, &distances );
+				if ( distance_symbol < 0 || distance_symbol >= 30 )
+				{
+					free( out );
+					return NULL;
+				}
+
+				unsigned long distance = distance_base[ distance_symbol ] + get_bits( &br, distance_extra[ distance_symbol ] );
+				if ( distance > used || br.overrun )
+				{
+					free( out );
+					return NULL;
+				}
+
+				for ( unsigned long i = 0; i < length; ++i, ++used )
+				{
+					out[ used ] = out[ used - distance ];
+				}
+			}
+		}
+		else	// Dynamic Huffman blocks aren't written by the encoder.
+		{
+			free( out );
+			return NULL;
+		}
+	}
+
+	if ( out == NULL || br.overrun )
+	{
+		free( out );
+		return NULL;
+	}
+
+	*out_size = used;
+	return out;
+}
+
+static unsigned char paeth( unsigned char a, unsigned char b, unsigned char c )
+{
+	int p = a + b - c;
+	int pa = abs( p - a ), pb = abs( p - b ), pc = abs( p - c );
+
+	return ( pa <= pb && pa <= pc ? a : ( pb <= pc ? b : c ) );
+}
+
+// Checks the structure of the PNG and decodes it into tightly packed rows. Returns NULL if anything is wrong.
+static unsigned char *decode_png( const unsigned char *png, unsigned long size, unsigned int &width, unsigned int &height, unsigned char &channels )
+{
+	if ( size < 8 || memcmp( png, "\x89PNG\r\n\x1A\n", 8 ) != 0 )
+	{
+		return NULL;
+	}
+
+	unsigned char *idat = NULL;
+	size_t idat_size = 0;
+	bool ended = false;
+	width = height = 0;
+	channels = 0;
+
+	for ( unsigned long offset = 8; offset + 12 <= size && !ended; )
+	{
+		unsigned long length = read_uint32_be( png + offset );
+		if ( length > size - offset - 12 )
+		{
+			break;
+		}
+
+		const unsigned char *type = png + offset + 4;
+		const unsigned char *data = type + 4;
+
+		// The CRC covers the type and the data.
+		if ( crc32( type, length + 4 ) != read_uint32_be( data + length ) )
+		{
+			break;
+		}
+
+		if ( memcmp( type, "IHDR", 4 ) == 0 && length == 13 )
+		{
+			width = read_uint32_be( data );
+			height = read_uint32_be( data + 4 );
+			channels = ( data[ 9 ] == 6 ? 4 : ( data[ 9 ] == 2 ? 3 : 0 ) );
+			if ( data[ 8 ] != 8 || data[ 10 ] != 0 || data[ 11 ] != 0 || data[ 12 ] != 0 )
+			{
+				channels = 0;
+			}
+		}
+		else if ( memcmp( type, "IDAT", 4 ) == 0 )
+		{
+			idat = ( unsigned char * )realloc( idat, idat_size + length + 1 );
+			memcpy( idat + idat_size, data, length );
+			idat_size += length;
+		}
+		else if ( memcmp( type, "IEND", 4 ) == 0 )
+		{
+			ended = ( offset + 12 == size );
+		}
+
+		offset += length + 12;
+	}
+
+	// A zlib header, the deflate stream, and an Adler-32 of the filtered rows.
+	size_t filtered_size = 0;
+	unsigned char *filtered = NULL;
+	if ( ended && channels != 0 && idat != NULL && idat_size > 6 && ( idat[ 0 ] & 0x0F ) == 8 && ( ( idat[ 0 ] << 8 ) | idat[ 1 ] ) % 31 == 0 )
+	{
+		filtered = inflate( idat + 2, idat_size - 6, &filtered_size );
+	}
+
+	if ( filtered != NULL )
+	{
+		unsigned long a = 1, b = 0;
+		for ( size_t i = 0; i < filtered_size; ++i )
+		{
+			a = ( a + filtered[ i ] ) % 65521;
+			b = ( b + a ) % 65521;
+		}
+
+		if ( ( ( b << 16 ) | a ) != read_uint32_be( idat + idat_size - 4 ) )
+		{
+			free( filtered );
+			filtered = NULL;
+		}
+	}
+
+	free( idat );
+
+	size_t row_size = ( size_t )width * channels;
+	if ( filtered == NULL || filtered_size != ( row_size + 1 ) * height )
+	{
+		free( filtered );
+		return NULL;
+	}
+
+	unsigned char *pixels = ( unsigned char * )malloc( row_size * height + 1 );
+	for ( unsigned int y = 0; y < height; ++y )
+	{
+		const unsigned char *in = filtered + ( y * ( row_size + 1 ) );
+		unsigned char *row = pixels + ( y * row_size );
+		const unsigned char *prior = ( y > 0 ? row - row_size : NULL );
+
+		for ( size_t x = 0; x < row_size; ++x )
+		{
+			unsigned char a = ( x >= channels ? row[ x - channels ] : 0 );
+			unsigned char b = ( prior != NULL ? prior[ x ] : 0 );
+			unsigned char c = ( prior != NULL && x >= channels ? prior[ x - channels ] : 0 );
+
+			switch ( in[ 0 ] )
+			{
+				case PNG_FILTER_NONE:		{ row[ x ] = in[ x + 1 ]; } break;
+				case PNG_FILTER_SUB:		{ row[ x ] = ( unsigned char )( in[ x + 1 ] + a ); } break;
+				case PNG_FILTER_UP:			{ row[ x ] = ( unsigned char )( in[ x + 1 ] + b ); } break;
+				case PNG_FILTER_AVERAGE:	{ row[ x ] = ( unsigned char )( in[ x + 1 ] + ( ( a + b ) >> 1 ) ); } break;
+				case PNG_FILTER_PAETH:		{ row[ x ] = ( unsigned char )( in[ x + 1 ] + paeth( a, b, c ) ); } break;
+				default:
+				{
+					free( filtered );
+					free( pixels );
+					return NULL;
+				}
+			}
+		}
+	}
+
+	free( filtered );
+
+	return pixels;
+}
+
+// Smooth gradients with some noise and a few repeated runs, so that every filter and match length gets used.
+static unsigned char *make_pixels( unsigned int width, unsigned int height, unsigned char channels, int stride, unsigned long seed )
+{
+	unsigned char *pixels = ( unsigned char * )malloc( ( size_t )stride * height + 1 );
+	memset( pixels, 0xCD, ( size_t )stride * height );
+
+	for ( unsigned int y = 0; y < height; ++y )
+	{
+		for ( unsigned int x = 0; x < width; ++x )
+		{
+			seed = ( seed * 1103515245 + 12345 ) & 0x7FFFFFFF;
+			unsigned char noise = ( ( y / 4 ) % 2 == 0 ? ( unsigned char )( ( seed >> 16 ) & 0x07 ) : 0 );
+
+			for ( unsigned char c = 0; c < channels; ++c )
+			{
+				pixels[ ( y * stride ) + ( x * channels ) + c ] = ( unsigned char )( ( x * ( c + 1 ) * 3 ) + ( y * 5 ) + noise );
+			}
+		}
+	}
+
+	return pixels;
+}
+
+static bool round_trip( unsigned int width, unsigned int height, unsigned char channels, int stride, unsigned char filter, unsigned char compression )
+{
+	unsigned char *pixels = make_pixels( width, height, channels, stride, width * 31 + height );
+
+	unsigned long size = 0;
+	unsigned char *png = encode_png( pixels, width, height, stride, channels, filter, compression, &size );
+
+	bool ret = false;
+	if ( png != NULL )
+	{
+		unsigned int decoded_width = 0, decoded_height = 0;
+		unsigned char decoded_channels = 0;
+		unsigned char *decoded = decode_png( png, size, decoded_width, decoded_height, decoded_channels );
+
+		ret = ( decoded != NULL && decoded_width == width && decoded_height == height && decoded_channels == channels );
+
+		for ( unsigned int y = 0; y < height && ret; ++y )
+		{
+			ret = ( memcmp( decoded + ( ( size_t )y * width * channels ), pixels + ( ( size_t )y * stride ), ( size_t )width * channels ) == 0 );
+		}
+
+		free( decoded );
+		free( png );
+	}
+
+	free( pixels );
+
+	return ret;
+}
+
+void test_png_writer()
+{
+	static const unsigned int sizes[][ 2 ] = { { 1, 1 }, { 7, 5 }, { 33, 17 }, { 300, 2 }, { 2, 300 } };
+
+	for ( unsigned int s = 0; s < sizeof( sizes ) / sizeof( sizes[ 0 ] ); ++s )
+	{
+		for ( unsigned char channels = 3; channels <= 4; ++channels )
+		{
+			for ( unsigned char filter = PNG_FILTER_NONE; filter <= PNG_FILTER_ADAPTIVE; ++filter )
+			{
+				for ( unsigned char compression = PNG_COMPRESSION_STORE; compression <= PNG_COMPRESSION_BEST; ++compression )
+				{
+					CHECK( round_trip( sizes[ s ][ 0 ], sizes[ s ][ 1 ], channels, sizes[ s ][ 0 ] * channels, filter, compression ) );
+				}
+			}
+		}
+	}
+
+	// Padding at the end of each row isn't part of the image.
+	CHECK( round_trip( 13, 9, 3, 13 * 3 + 5, PNG_FILTER_ADAPTIVE, PNG_COMPRESSION_FAST ) );
+
+	// More than one stored block.
+	CHECK( round_trip( 200, 120, 3, 200 * 3, PNG_FILTER_NONE, PNG_COMPRESSION_STORE ) );
+
+	// Longer than the window, so matches have to stay within 32 KB.
+	CHECK( round_trip( 256, 256, 4, 256 * 4, PNG_FILTER_ADAPTIVE, PNG_COMPRESSION_BEST ) );
+
+	// The same pixels always produce the same file. The golden values catch any change to the encoder's output.
+	unsigned char *pixels = make_pixels( 16, 16, 3, 16 * 3, 1 );
+	unsigned long size_1 = 0, size_2 = 0;
+	unsigned char *png_1 = encode_png( pixels, 16, 16, 16 * 3, 3, PNG_FILTER_ADAPTIVE, PNG_COMPRESSION_FAST, &size_1 );
+	unsigned char *png_2 = encode_png( pixels, 16, 16, 16 * 3, 3, PNG_FILTER_ADAPTIVE, PNG_COMPRESSION_FAST, &size_2 );
+
+	CHECK( png_1 != NULL && png_2 != NULL );
+	if ( png_1 != NULL && png_2 != NULL )
+	{
+		CHECK( size_1 == size_2 && memcmp( png_1, png_2, size_1 ) == 0 );
+		CHECK( size_1 == PNG_GOLDEN_SIZE );
+		CHECK( crc32( png_1, size_1 ) == PNG_GOLDEN_CRC );
+	}
+
+	free( png_1 );
+	free( png_2 );
+	free( pixels );
+
+	// Nothing to encode.
+	unsigned long size = 0;
+	unsigned char pixel[ 4 ] = { 0 };
+	CHECK( encode_png( pixel, 0, 1, 4, 4, PNG_FILTER_NONE, PNG_COMPRESSION_FAST, &size ) == NULL );
+	CHECK( encode_png( pixel, 1, 1, 2, 2, PNG_FILTER_NONE, PNG_COMPRESSION_FAST, &size ) == NULL );
+}
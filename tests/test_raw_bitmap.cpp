@@ -0,0 +1,200 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "read_thumbs.h"
+
+#include <string.h>
+
+#define ENTRY_SIZE	( 0x34 + 256 )
+
+// The layout of Version 3 raw entries: 2 unknown values, stride, width, height, and the size of the pixels.
+static void make_header_18( char *entry, int32_t stride, uint32_t width, uint32_t height, uint32_t raw_size )
+{
+	memset( entry, 0, ENTRY_SIZE );
+
+	uint32_t header_length = 0x18;
+	memcpy( entry, &header_length, sizeof( uint32_t ) );
+	memcpy( entry + 0x08, &stride, sizeof( int32_t ) );
+	memcpy( entry + 0x0C, &width, sizeof( uint32_t ) );
+	memcpy( entry + 0x10, &height, sizeof( uint32_t ) );
+	memcpy( entry + 0x14, &raw_size, sizeof( uint32_t ) );
+}
+
+// The layout found in TVThumb.db: width, height, and stride come first, and the size of the pixels is last.
+static void make_header_34( char *entry, int32_t stride, uint32_t width, uint32_t height, uint32_t raw_size )
+{
+	memset( entry, 0, ENTRY_SIZE );
+
+	uint32_t header_length = 0x34;
+	memcpy( entry, &header_length, sizeof( uint32_t ) );
+	memcpy( entry + 0x04, &width, sizeof( uint32_t ) );
+	memcpy( entry + 0x08, &height, sizeof( uint32_t ) );
+	memcpy( entry + 0x0C, &stride, sizeof( int32_t ) );
+	memcpy( entry + 0x30, &raw_size, sizeof( uint32_t ) );
+}
+
+static bool check_layout( const raw_bitmap &rb, unsigned int width, unsigned int height, unsigned int stride, unsigned char channels, bool flipped )
+{
+	return ( rb.width == width && rb.height == height && rb.stride == stride && rb.channels == channels && rb.flipped == flipped );
+}
+
+static void test_parse_raw_bitmap()
+{
+	char entry[ ENTRY_SIZE ];
+	raw_bitmap rb;
+
+	// 24 bit rows are padded to 4 bytes, and the older layout stores them bottom up.
+	make_header_18( entry, 16, 5, 3, 48 );
+	CHECK( parse_raw_bitmap( entry, 0x18, 48, rb ) );
+	CHECK( check_layout( rb, 5, 3, 16, 3, true ) );
+	CHECK( rb.size == 48 );
+
+	// 32 bit rows are stored top down.
+	make_header_18( entry, 20, 5, 3, 60 );
+	CHECK( parse_raw_bitmap( entry, 0x18, 60, rb ) );
+	CHECK( check_layout( rb, 5, 3, 20, 4, false ) );
+
+	// A negative stride is the same distance between rows.
+	make_header_18( entry, -16, 5, 3, 48 );
+	CHECK( parse_raw_bitmap( entry, 0x18, 48, rb ) );
+	CHECK( check_layout( rb, 5, 3, 16, 3, true ) );
+
+	// Without a stride, the rows fill the pixels evenly.
+	make_header_18( entry, 0, 5, 3, 48 );
+	CHECK( parse_raw_bitmap( entry, 0x18, 100, rb ) );
+	CHECK( check_layout( rb, 5, 3, 16, 3, true ) );
+
+	make_header_18( entry, 0, 5, 3, 60 );
+	CHECK( parse_raw_bitmap( entry, 0x18, 60, rb ) );
+	CHECK( check_layout( rb, 5, 3, 20, 4, false ) );
+
+	// Narrow images have the same stride either way and are treated as 32 bit.
+	make_header_18( entry, 12, 3, 2, 24 );
+	CHECK( parse_raw_bitmap( entry, 0x18, 24, rb ) );
+	CHECK( check_layout( rb, 3, 2, 12, 4, false ) );
+
+	// The pixels can be followed by more data.
+	make_header_18( entry, 16, 5, 3, 50 );
+	CHECK( parse_raw_bitmap( entry, 0x18, 50, rb ) );
+	CHECK( rb.size == 50 );
+
+	// Neither layout is flipped in the newer header.
+	make_header_34( entry, 15, 5, 3, 45 );
+	CHECK( parse_raw_bitmap( entry, 0x34, 45, rb ) );
+	CHECK( check_layout( rb, 5, 3, 15, 3, false ) );
+
+	make_header_34( entry, 20, 5, 3, 60 );
+	CHECK( parse_raw_bitmap( entry, 0x34, 60, rb ) );
+	CHECK( check_layout( rb, 5, 3, 20, 4, false ) );
+
+	// Headers that aren't raw bitmaps.
+	make_header_18( entry, 16, 5, 3, 48 );
+	CHECK( !parse_raw_bitmap( entry, 0x0C, 48, rb ) );
+	CHECK( !parse_raw_bitmap( entry, 0x20, 48, rb ) );
+	CHECK( !parse_raw_bitmap( entry, 0, 48, rb ) );
+
+	// Empty images.
+	make_header_18( entry, 16, 0, 3, 48 );
+	CHECK( !parse_raw_bitmap( entry, 0x18, 48, rb ) );
+	make_header_18( entry, 16, 5, 0, 48 );
+	CHECK( !parse_raw_bitmap( entry, 0x18, 48, rb ) );
+	make_header_18( entry, 16, 5, 3, 0 );
+	CHECK( !parse_raw_bitmap( entry, 0x18, 48, rb ) );
+
+	// The pixels have to fit in the entry.
+	make_header_18( entry, 16, 5, 3, 48 );
+	CHECK( !parse_raw_bitmap( entry, 0x18, 47, rb ) );
+
+	// Every row has to fit in the pixels.
+	make_header_18( entry, 16, 5, 3, 47 );
+	CHECK( !parse_raw_bitmap( entry, 0x18, 48, rb ) );
+	make_header_34( entry, 20, 5, 3, 59 );
+	CHECK( !parse_raw_bitmap( entry, 0x34, 60, rb ) );
+
+	// Strides that are too small for 3 bytes per pixel or too large for 4.
+	make_header_18( entry, 14, 5, 3, 48 );
+	CHECK( !parse_raw_bitmap( entry, 0x18, 48, rb ) );
+	make_header_18( entry, 24, 5, 3, 72 );
+	CHECK( !parse_raw_bitmap( entry, 0x18, 72, rb ) );
+
+	// A huge width can't overflow the stride checks.
+	make_header_18( entry, 16, 0x80000000, 3, 48 );
+	CHECK( !parse_raw_bitmap( entry, 0x18, 48, rb ) );
+	make_header_18( entry, ( int32_t )0x80000000, 0x20000000, 1, 48 );
+	CHECK( !parse_raw_bitmap( entry, 0x18, 48, rb ) );
+}
+
+static void test_unpack_raw_bitmap()
+{
+	char pixels[ 60 ];
+	for ( unsigned int i = 0; i < sizeof( pixels ); ++i )
+	{
+		pixels[ i ] = ( char )i;
+	}
+
+	raw_bitmap rb;
+	unsigned char dst[ 5 * 4 * 3 ];
+
+	// A bottom up 24 bit image. The last row comes first and the padding is dropped.
+	rb.width = 5;
+	rb.height = 3;
+	rb.size = 48;
+	rb.stride = 16;
+	rb.channels = 3;
+	rb.flipped = true;
+
+	unpack_raw_bitmap( pixels, rb, dst, 15, false );
+	bool flipped = true;
+	for ( unsigned int row = 0; row < 3; ++row )
+	{
+		flipped &= ( memcmp( dst + ( row * 15 ), pixels + ( ( 2 - row ) * 16 ), 15 ) == 0 );
+	}
+	CHECK( flipped );
+
+	unpack_raw_bitmap( pixels, rb, dst, 15, true );
+	CHECK( dst[ 0 ] == 34 && dst[ 1 ] == 33 && dst[ 2 ] == 32 );	// First pixel of the last row with red and blue swapped.
+	CHECK( dst[ 42 ] == 14 && dst[ 43 ] == 13 && dst[ 44 ] == 12 );	// Last pixel of the first row.
+
+	// A top down 32 bit image is copied as it is.
+	rb.size = 60;
+	rb.stride = 20;
+	rb.channels = 4;
+	rb.flipped = false;
+
+	unpack_raw_bitmap( pixels, rb, dst, 20, false );
+	CHECK( memcmp( dst, pixels, 60 ) == 0 );
+
+	unpack_raw_bitmap( pixels, rb, dst, 20, true );
+	CHECK( dst[ 0 ] == 2 && dst[ 1 ] == 1 && dst[ 2 ] == 0 && dst[ 3 ] == 3 );
+	CHECK( dst[ 56 ] == 58 && dst[ 57 ] == 57 && dst[ 58 ] == 56 && dst[ 59 ] == 59 );
+
+	// An entry parsed from its header unpacks the same way.
+	char entry[ ENTRY_SIZE ];
+	make_header_18( entry, 16, 5, 3, 48 );
+	memcpy( entry + 0x18, pixels, 48 );
+	CHECK( parse_raw_bitmap( entry, 0x18, 48, rb ) );
+	unpack_raw_bitmap( entry + 0x18, rb, dst, 15, false );
+	CHECK( memcmp( dst, pixels + 32, 15 ) == 0 );
+}
+
+void test_raw_bitmap()
+{
+	test_parse_raw_bitmap();
+	test_unpack_raw_bitmap();
+}
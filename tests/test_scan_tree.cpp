@@ -0,0 +1,194 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "scan_tree.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+	#include <direct.h>
+	#define make_directory( path )		_mkdir( path )
+	#define remove_directory( path )	_rmdir( path )
+#else
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define make_directory( path )		mkdir( path, 0755 )
+	#define remove_directory( path )	rmdir( path )
+#endif
+
+#define SCAN_ROOT	"thumbs_tests_scan"
+
+struct collected_results
+{
+	unsigned long count;
+	bool overflowed;
+	scan_result results[ 32 ];
+};
+
+static void collect_results( scan_result *results, unsigned long count, void *context )
+{
+	collected_results *cr = ( collected_results * )context;
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		if ( cr->count < 32 )
+		{
+			cr->results[ cr->count++ ] = results[ i ];
+		}
+		else
+		{
+			cr->overflowed = true;
+		}
+	}
+}
+
+static bool create_file( const char *path )
+{
+	FILE *f = fopen( path, "wb" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+
+	fclose( f );
+	return true;
+}
+
+// Returns the number of results with the filename. Each one must have the right hash and be inside the root.
+static unsigned long count_filename( collected_results *cr, const wchar_t *filename, unsigned long long initial_hash )
+{
+	size_t root_length = wcslen( L"" SCAN_ROOT );
+	unsigned long count = 0;
+
+	for ( unsigned long i = 0; i < cr->count; ++i )
+	{
+		scan_result *sr = &cr->results[ i ];
+		if ( wcscmp( sr->filepath + sr->filename_offset, filename ) != 0 )
+		{
+			continue;
+		}
+
+		CHECK( sr->filename_length == wcslen( filename ) );
+		CHECK( sr->hash == hash_filename( filename, initial_hash, sr->filename_length ) );
+		CHECK( wcsncmp( sr->filepath, L"" SCAN_ROOT, root_length ) == 0 && sr->filepath[ root_length ] == PATH_SEPARATOR );
+		CHECK( sr->filepath[ sr->filename_offset - 1 ] == PATH_SEPARATOR );
+		++count;
+	}
+
+	return count;
+}
+
+static bool scan( collected_results *cr, const wchar_t *filter, bool include_folders, unsigned long thread_count, volatile bool *cancel, scan_stats *ss )
+{
+	memset( cr, 0, sizeof( collected_results ) );
+
+	scan_options so;
+	so.extension_filter = filter;
+	so.include_folders = include_folders;
+	so.thread_count = thread_count;
+	so.initial_hash = FILENAME_HASH_INITIAL_WIN8;
+	so.cancel = cancel;
+	so.callback = collect_results;
+	so.context = ( void * )cr;
+
+	return scan_directory_tree( L"" SCAN_ROOT, &so, ss );
+}
+
+void test_scan_tree()
+{
+	static collected_results cr;
+	scan_stats ss;
+
+	make_directory( SCAN_ROOT );
+	make_directory( SCAN_ROOT "/sub" );
+	make_directory( SCAN_ROOT "/sub/deeper" );
+	make_directory( SCAN_ROOT "/sub2" );
+
+	bool created = create_file( SCAN_ROOT "/a.jpg" ) &&
+				   create_file( SCAN_ROOT "/b.png" ) &&
+				   create_file( SCAN_ROOT "/sub/c.JPG" ) &&
+				   create_file( SCAN_ROOT "/sub/noext" ) &&
+				   create_file( SCAN_ROOT "/sub/deeper/d.txt" ) &&
+				   create_file( SCAN_ROOT "/sub2/e.jpg" );
+	CHECK( created );
+
+	// The threads share the directories. Every directory is scanned once, whichever thread gets it.
+	for ( unsigned long thread_count = 1; thread_count <= 4 && created; thread_count *= 2 )
+	{
+		CHECK( scan( &cr, L"|.jpg|", false, thread_count, NULL, &ss ) );
+		CHECK( cr.count == 3 && ss.results == 3 && !cr.overflowed );
+		CHECK( ss.directories == 4 );
+		CHECK( ss.threads == thread_count );
+		CHECK( ss.queue_locks > 0 && ss.queue_contended <= ss.queue_locks );
+		CHECK( count_filename( &cr, L"a.jpg", FILENAME_HASH_INITIAL_WIN8 ) == 1 );
+		CHECK( count_filename( &cr, L"c.JPG", FILENAME_HASH_INITIAL_WIN8 ) == 1 );
+		CHECK( count_filename( &cr, L"e.jpg", FILENAME_HASH_INITIAL_WIN8 ) == 1 );
+	}
+
+	// Files without an extension are compared by their whole name.
+	CHECK( scan( &cr, L"|.png|noext|", false, 2, NULL, &ss ) );
+	CHECK( cr.count == 2 );
+	CHECK( count_filename( &cr, L"b.png", FILENAME_HASH_INITIAL_WIN8 ) == 1 );
+	CHECK( count_filename( &cr, L"noext", FILENAME_HASH_INITIAL_WIN8 ) == 1 );
+
+	// Without a filter every file is included. Folders are only included if they're asked for.
+	CHECK( scan( &cr, NULL, false, 2, NULL, &ss ) );
+	CHECK( cr.count == 6 );
+	CHECK( scan( &cr, L"", true, 2, NULL, &ss ) );
+	CHECK( cr.count == 9 );
+	CHECK( count_filename( &cr, L"deeper", FILENAME_HASH_INITIAL_WIN8 ) == 1 );
+	CHECK( count_filename( &cr, L"sub2", FILENAME_HASH_INITIAL_WIN8 ) == 1 );
+
+#ifndef _WIN32
+	// Names are passed on as UTF-16 code units. Names that aren't valid UTF-8 are skipped.
+	const wchar_t umlaut[] = { 0x00FC, L'.', L'j', L'p', L'g', 0 };
+	const wchar_t emoji[] = { 0xD83D, 0xDE00, L'.', L'j', L'p', L'g', 0 };
+	CHECK( create_file( SCAN_ROOT "/\xC3\xBC.jpg" ) );
+	CHECK( create_file( SCAN_ROOT "/\xF0\x9F\x98\x80.jpg" ) );
+	CHECK( create_file( SCAN_ROOT "/\xFF.jpg" ) );
+
+	CHECK( scan( &cr, L"|.jpg|", false, 2, NULL, &ss ) );
+	CHECK( cr.count == 5 );
+	CHECK( count_filename( &cr, umlaut, FILENAME_HASH_INITIAL_WIN8 ) == 1 );
+	CHECK( count_filename( &cr, emoji, FILENAME_HASH_INITIAL_WIN8 ) == 1 );
+
+	remove( SCAN_ROOT "/\xC3\xBC.jpg" );
+	remove( SCAN_ROOT "/\xF0\x9F\x98\x80.jpg" );
+	remove( SCAN_ROOT "/\xFF.jpg" );
+#endif
+
+	// A cancelled scan passes nothing on.
+	volatile bool cancel = true;
+	CHECK( scan( &cr, NULL, true, 2, &cancel, &ss ) );
+	CHECK( cr.count == 0 && ss.directories == 0 );
+
+	remove( SCAN_ROOT "/sub2/e.jpg" );
+	remove( SCAN_ROOT "/sub/deeper/d.txt" );
+	remove( SCAN_ROOT "/sub/noext" );
+	remove( SCAN_ROOT "/sub/c.JPG" );
+	remove( SCAN_ROOT "/b.png" );
+	remove( SCAN_ROOT "/a.jpg" );
+	remove_directory( SCAN_ROOT "/sub2" );
+	remove_directory( SCAN_ROOT "/sub/deeper" );
+	remove_directory( SCAN_ROOT "/sub" );
+	remove_directory( SCAN_ROOT );
+
+	// A directory that doesn't exist has nothing to scan.
+	CHECK( scan( &cr, NULL, true, 2, NULL, &ss ) );
+	CHECK( cr.count == 0 && ss.directories == 0 );
+}
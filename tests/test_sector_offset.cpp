@@ -0,0 +1,82 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "read_thumbs.h"
+
+#include <stdlib.h>
+
+void test_sector_offset()
+{
+	// The header takes up the first sector.
+	CHECK( get_sector_offset( 512, 0 ) == 512 );
+	CHECK( get_sector_offset( 512, 1 ) == 1024 );
+	CHECK( get_sector_offset( 4096, 0 ) == 4096 );
+	CHECK( get_sector_offset( 4096, 3 ) == 4 * 4096 );
+
+	// Offsets beyond 4 GB don't wrap around.
+	CHECK( get_sector_offset( 512, 0x800000 ) == 0x100000200ULL );
+	CHECK( get_sector_offset( 4096, 0xFFFFF ) == 0x100000000ULL );
+	CHECK( get_sector_offset( 4096, 0x100000 ) == 0x100001000ULL );
+	CHECK( get_sector_offset( 4096, 0x7FFFFFFF ) == 0x80000000000ULL );
+
+	// The extents of a stream at the end of a database that's larger than 4 GB.
+	// 1025 SAT sectors of 1024 indices each reach just beyond sector 0x100000.
+	const long first_sect = 0xFFFFE;
+	const unsigned long num_sat_sects = 1025;
+
+	shared_info *si = ( shared_info * )malloc( sizeof( shared_info ) );
+	int32_t *sat = ( int32_t * )malloc( sizeof( int32_t ) * num_sat_sects * 1024 );
+	CHECK( si != NULL && sat != NULL );
+	if ( si == NULL || sat == NULL )
+	{
+		free( si );
+		free( sat );
+		return;
+	}
+
+	memset( si, 0, sizeof( shared_info ) );
+	si->sect_size = 4096;
+	si->num_sat_sects = num_sat_sects;
+	si->sat = sat;
+
+	sat[ first_sect ] = first_sect + 1;
+	sat[ first_sect + 1 ] = first_sect + 2;
+	sat[ first_sect + 2 ] = -2;
+
+	stream_map *sm = map_stream( si, first_sect, ( 2 * 4096 ) + 10, false );
+	CHECK( sm != NULL && sm->error == NULL && sm->count == 1 && sm->length == ( 2 * 4096 ) + 10 );
+	CHECK( sm != NULL && sm->count == 1 && sm->extents[ 0 ].offset == get_sector_offset( 4096, first_sect ) );
+	CHECK( sm != NULL && sm->count == 1 && sm->extents[ 0 ].offset == 0xFFFFF000ULL );
+
+	// The last sector of the stream starts 4 GB into the file.
+	CHECK( get_sector_offset( 4096, first_sect + 2 ) == 0x100001000ULL );
+	free( sm );
+
+	// A chain that's entirely beyond 4 GB.
+	sat[ 0x100100 ] = 0x100200;
+	sat[ 0x100200 ] = -2;
+	sm = map_stream( si, 0x100100, 4096 + 1, false );
+	CHECK( sm != NULL && sm->error == NULL && sm->count == 2 );
+	CHECK( sm != NULL && sm->count == 2 && sm->extents[ 0 ].offset == 0x100101000ULL && sm->extents[ 1 ].offset == 0x100201000ULL );
+	CHECK( sm != NULL && sm->count == 2 && sm->extents[ 1 ].length == 1 && sm->extents[ 1 ].position == 4096 );
+	free( sm );
+
+	free( sat );
+	free( si );
+}
@@ -0,0 +1,199 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "read_thumbs.h"
+
+#include <stdlib.h>
+
+#define FREE_SECT		-1
+#define END_OF_CHAIN	-2
+
+// A database with only its allocation tables. Every index is free until a chain is linked.
+static shared_info *create_tables( unsigned short sect_size, unsigned long num_sat_sects, unsigned long num_ssat_sects )
+{
+	shared_info *si = ( shared_info * )malloc( sizeof( shared_info ) );
+	if ( si == NULL )
+	{
+		return NULL;
+	}
+
+	memset( si, 0, sizeof( shared_info ) );
+	si->sect_size = sect_size;
+	si->num_sat_sects = num_sat_sects;
+	si->num_ssat_sects = num_ssat_sects;
+
+	unsigned long sat_count = num_sat_sects * ( sect_size / sizeof( int32_t ) );
+	unsigned long ssat_count = num_ssat_sects * ( sect_size / sizeof( int32_t ) );
+	si->sat = ( int32_t * )malloc( sizeof( int32_t ) * sat_count );
+	si->ssat = ( num_ssat_sects > 0 ? ( int32_t * )malloc( sizeof( int32_t ) * ssat_count ) : NULL );
+	if ( si->sat == NULL || ( num_ssat_sects > 0 && si->ssat == NULL ) )
+	{
+		free( si->sat );
+		free( si->ssat );
+		free( si );
+		return NULL;
+	}
+
+	for ( unsigned long i = 0; i < sat_count; ++i )
+	{
+		si->sat[ i ] = FREE_SECT;
+	}
+
+	for ( unsigned long i = 0; i < ssat_count; ++i )
+	{
+		si->ssat[ i ] = FREE_SECT;
+	}
+
+	return si;
+}
+
+static void free_tables( shared_info *si )
+{
+	if ( si != NULL )
+	{
+		free( si->sat );
+		free( si->ssat );
+		free( si );
+	}
+}
+
+// Links the sectors in order and terminates the chain.
+static void link_chain( int32_t *table, const long *sects, unsigned long count )
+{
+	for ( unsigned long i = 0; i < count; ++i )
+	{
+		table[ sects[ i ] ] = ( i + 1 < count ? ( int32_t )sects[ i + 1 ] : END_OF_CHAIN );
+	}
+}
+
+static bool check_extent( stream_map *sm, unsigned long i, unsigned long long offset, unsigned long length, unsigned long position )
+{
+	return ( sm != NULL && i < sm->count && sm->extents[ i ].offset == offset && sm->extents[ i ].length == length && sm->extents[ i ].position == position );
+}
+
+void test_stream_map()
+{
+	shared_info *si = create_tables( 512, 1, 1 );	// 128 SAT and Short SAT indices.
+	CHECK( si != NULL );
+	if ( si == NULL )
+	{
+		return;
+	}
+
+	// Adjacent sectors are combined. Sector n is at ( n + 1 ) * 512 since the header comes first.
+	static const long fragmented[] = { 0, 1, 2, 5, 6, 3 };
+	link_chain( si->sat, fragmented, 6 );
+
+	stream_map *sm = map_stream( si, 0, ( 5 * 512 ) + 100, false );
+	CHECK( sm != NULL && sm->error == NULL );
+	CHECK( sm != NULL && sm->count == 3 && sm->length == ( 5 * 512 ) + 100 );
+	CHECK( check_extent( sm, 0, 512, 3 * 512, 0 ) );
+	CHECK( check_extent( sm, 1, 6 * 512, 2 * 512, 3 * 512 ) );
+	CHECK( check_extent( sm, 2, 4 * 512, 100, 5 * 512 ) );
+	free( sm );
+
+	// Part of the chain.
+	sm = map_stream( si, 5, 600, false );
+	CHECK( sm != NULL && sm->error == NULL && sm->count == 1 && sm->length == 600 );
+	CHECK( check_extent( sm, 0, 6 * 512, 600, 0 ) );
+	free( sm );
+
+	// Nothing to map.
+	sm = map_stream( si, 0, 0, false );
+	CHECK( sm != NULL && sm->error == NULL && sm->count == 0 && sm->length == 0 );
+	free( sm );
+
+	// The chain ends before the stream does. The extents cover what was mapped.
+	sm = map_stream( si, 3, 1000, false );
+	CHECK( sm != NULL && sm->error != NULL && sm->count == 1 && sm->length == 512 );
+	free( sm );
+
+	// A chain that runs into a free sector.
+	si->sat[ 10 ] = 11;
+	sm = map_stream( si, 10, 3 * 512, false );
+	CHECK( sm != NULL && sm->error != NULL && sm->count == 1 && sm->length == 2 * 512 );
+	free( sm );
+
+	// An index beyond the SAT.
+	si->sat[ 12 ] = 128;
+	sm = map_stream( si, 12, 1024, false );
+	CHECK( sm != NULL && sm->error != NULL && sm->length == 512 );
+	free( sm );
+
+	sm = map_stream( si, 128, 1, false );
+	CHECK( sm != NULL && sm->error != NULL && sm->count == 0 );
+	free( sm );
+
+	// Every other sector, so that the extents have to grow beyond their initial capacity.
+	long scattered[ 20 ];
+	for ( unsigned long i = 0; i < 20; ++i )
+	{
+		scattered[ i ] = 40 + ( long )( i * 2 );
+	}
+	link_chain( si->sat, scattered, 20 );
+
+	sm = map_stream( si, 40, 20 * 512, false );
+	CHECK( sm != NULL && sm->error == NULL && sm->count == 20 && sm->length == 20 * 512 );
+	bool scattered_extents = ( sm != NULL );
+	for ( unsigned long i = 0; sm != NULL && i < 20; ++i )
+	{
+		scattered_extents &= check_extent( sm, i, ( unsigned long long )( scattered[ i ] + 1 ) * 512, 512, i * 512 );
+	}
+	CHECK( scattered_extents );
+	free( sm );
+
+	// Short streams are in 64 byte sectors of the container, which doesn't have a header.
+	si->short_stream_length = 10 * 64;
+	static const long short_chain[] = { 0, 1, 3, 9 };
+	link_chain( si->ssat, short_chain, 4 );
+
+	sm = map_stream( si, 0, 150, true );
+	CHECK( sm != NULL && sm->error == NULL && sm->count == 2 && sm->length == 150 );
+	CHECK( check_extent( sm, 0, 0, 128, 0 ) );
+	CHECK( check_extent( sm, 1, 3 * 64, 22, 128 ) );
+	free( sm );
+
+	sm = map_stream( si, 0, 4 * 64, true );
+	CHECK( sm != NULL && sm->error == NULL && sm->count == 3 );
+	CHECK( check_extent( sm, 2, 9 * 64, 64, 3 * 64 ) );
+	free( sm );
+
+	// Short sectors can't go past the end of the container, even if the Short SAT has room for them.
+	si->ssat[ 9 ] = 10;
+	si->ssat[ 10 ] = END_OF_CHAIN;
+	sm = map_stream( si, 9, 128, true );
+	CHECK( sm != NULL && sm->error != NULL && sm->length == 64 );
+	free( sm );
+
+	si->short_stream_length = 10 * 64 - 1;
+	sm = map_stream( si, 9, 64, true );
+	CHECK( sm != NULL && sm->error != NULL && sm->count == 0 );
+	free( sm );
+
+	free_tables( si );
+
+	// There's nothing to map without a Short SAT.
+	si = create_tables( 512, 1, 0 );
+	CHECK( si != NULL );
+	if ( si != NULL )
+	{
+		CHECK( map_stream( si, 0, 64, true ) == NULL );
+		free_tables( si );
+	}
+}
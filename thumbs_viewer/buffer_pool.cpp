@@ -0,0 +1,185 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "buffer_pool.h"
+#include "platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define OVERSIZED_CLASS		0xFF
+
+// Precedes every buffer. Its size is a multiple of the pointer size, so the buffer keeps malloc's alignment.
+struct pool_header
+{
+	pool_header *next;			// Next free buffer in the class.
+	size_t size_class;
+};
+
+static platform_lock *pool_lock = NULL;		// If it couldn't be created, then nothing is pooled.
+static pool_header *free_buffers[ BUFFER_POOL_CLASSES ];
+static unsigned long free_counts[ BUFFER_POOL_CLASSES ];
+static buffer_pool_stats stats;
+
+// Find the smallest class that can hold size bytes.
+static unsigned char get_size_class( size_t size )
+{
+	unsigned char size_class = 0;
+	while ( size_class < BUFFER_POOL_CLASSES && size > ( ( size_t )1 << ( BUFFER_POOL_MIN_SHIFT + size_class ) ) )
+	{
+		++size_class;
+	}
+
+	return ( size_class < BUFFER_POOL_CLASSES ? size_class : OVERSIZED_CLASS );
+}
+
+void initialize_buffer_pool()
+{
+	pool_lock = create_lock();
+
+	memset( free_buffers, 0, sizeof( free_buffers ) );
+	memset( free_counts, 0, sizeof( free_counts ) );
+	memset( &stats, 0, sizeof( buffer_pool_stats ) );
+}
+
+void uninitialize_buffer_pool()
+{
+	for ( unsigned char i = 0; i < BUFFER_POOL_CLASSES; ++i )
+	{
+		while ( free_buffers[ i ] != NULL )
+		{
+			pool_header *del = free_buffers[ i ];
+			free_buffers[ i ] = del->next;
+			free( del );
+		}
+
+		free_counts[ i ] = 0;
+	}
+
+	stats.free_count = 0;
+	stats.free_bytes = 0;
+
+	destroy_lock( pool_lock );
+	pool_lock = NULL;
+}
+
+char *pool_alloc( size_t size )
+{
+	unsigned char size_class = ( pool_lock != NULL ? get_size_class( size ) : OVERSIZED_CLASS );
+	pool_header *ph = NULL;
+
+	if ( pool_lock == NULL )
+	{
+		ph = ( pool_header * )malloc( sizeof( pool_header ) + size );
+		if ( ph == NULL )
+		{
+			return NULL;
+		}
+
+		ph->next = NULL;
+		ph->size_class = size_class;
+
+		return ( char * )( ph + 1 );
+	}
+
+	enter_lock( pool_lock );
+
+	++stats.requests;
+
+	if ( size_class != OVERSIZED_CLASS && free_buffers[ size_class ] != NULL )
+	{
+		ph = free_buffers[ size_class ];
+		free_buffers[ size_class ] = ph->next;
+		--free_counts[ size_class ];
+
+		++stats.reused;
+		--stats.free_count;
+		stats.free_bytes -= ( ( size_t )1 << ( BUFFER_POOL_MIN_SHIFT + size_class ) );
+	}
+	else
+	{
+		++stats.allocations;
+
+		if ( size_class == OVERSIZED_CLASS )
+		{
+			++stats.oversized;
+		}
+	}
+
+	leave_lock( pool_lock );
+
+	if ( ph == NULL )
+	{
+		ph = ( pool_header * )malloc( sizeof( pool_header ) + ( size_class != OVERSIZED_CLASS ? ( ( size_t )1 << ( BUFFER_POOL_MIN_SHIFT + size_class ) ) : size ) );
+		if ( ph == NULL )
+		{
+			return NULL;
+		}
+
+		ph->size_class = size_class;
+	}
+
+	ph->next = NULL;
+
+	return ( char * )( ph + 1 );
+}
+
+void pool_free( char *buf )
+{
+	if ( buf == NULL )
+	{
+		return;
+	}
+
+	pool_header *ph = ( pool_header * )buf - 1;
+
+	// Keep a few buffers of each class. The rest go back to the heap.
+	if ( ph->size_class != OVERSIZED_CLASS )
+	{
+		enter_lock( pool_lock );
+
+		if ( free_counts[ ph->size_class ] < BUFFER_POOL_DEPTH )
+		{
+			ph->next = free_buffers[ ph->size_class ];
+			free_buffers[ ph->size_class ] = ph;
+			++free_counts[ ph->size_class ];
+
+			++stats.free_count;
+			stats.free_bytes += ( ( size_t )1 << ( BUFFER_POOL_MIN_SHIFT + ph->size_class ) );
+
+			ph = NULL;
+		}
+
+		leave_lock( pool_lock );
+	}
+
+	free( ph );
+}
+
+void get_buffer_pool_stats( buffer_pool_stats *bps )
+{
+	if ( pool_lock == NULL )
+	{
+		memset( bps, 0, sizeof( buffer_pool_stats ) );
+		return;
+	}
+
+	enter_lock( pool_lock );
+	*bps = stats;
+	leave_lock( pool_lock );
+}
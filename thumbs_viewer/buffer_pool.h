@@ -0,0 +1,51 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Size classed buffers that are reused between extractions. Freed buffers are kept on a list for their class instead of going back to the heap.
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+#define BUFFER_POOL_MIN_SHIFT	12	// The smallest class holds 4 KB.
+#define BUFFER_POOL_CLASSES		13	// The largest class holds 16 MB. Anything larger isn't pooled.
+#define BUFFER_POOL_DEPTH		4	// Number of free buffers that are kept for each class.
+
+struct buffer_pool_stats
+{
+	unsigned long long requests;	// Number of calls to pool_alloc.
+	unsigned long long reused;		// Requests that were given a free buffer.
+	unsigned long long allocations;	// Requests that had to allocate a new buffer.
+	unsigned long long oversized;	// Allocations that were too large for any class.
+	unsigned long free_count;		// Number of buffers that are waiting to be reused.
+	unsigned long long free_bytes;	// Size of the buffers that are waiting to be reused.
+};
+
+void initialize_buffer_pool();
+void uninitialize_buffer_pool();
+
+// Returns a buffer of at least size bytes. Its contents are undefined.
+char *pool_alloc( size_t size );
+
+// Returns a buffer from pool_alloc to its class. NULL is ignored.
+void pool_free( char *buf );
+
+void get_buffer_pool_stats( buffer_pool_stats *bps );
+
+#endif
@@ -0,0 +1,94 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "filename_hash.h"
+
+unsigned long long hash_data( char *data, unsigned long long hash, short length )
+{
+	while ( length-- > 0 )
+	{
+		hash ^= ( ( ( hash * 0x820 ) + ( *data++ & 0x00000000000000FF ) ) + ( hash >> 2 ) );
+	}
+
+	return hash;
+}
+
+// Hash a UTF-16 code unit. This is the same as hashing its low byte and then its high byte with hash_data.
+#define HASH_CODE_UNIT( hash, c ) \
+	hash ^= ( ( ( hash * 0x820 ) + ( ( c ) & 0xFF ) ) + ( hash >> 2 ) ); \
+	hash ^= ( ( ( hash * 0x820 ) + ( ( c ) >> 8 ) ) + ( hash >> 2 ) );
+
+unsigned long long hash_filename( const wchar_t *filename, unsigned long long hash, unsigned int length )
+{
+	// Two code units per iteration.
+	while ( length >= 2 )
+	{
+		HASH_CODE_UNIT( hash, filename[ 0 ] )
+		HASH_CODE_UNIT( hash, filename[ 1 ] )
+		filename += 2;
+		length -= 2;
+	}
+
+	if ( length > 0 )
+	{
+		HASH_CODE_UNIT( hash, filename[ 0 ] )
+	}
+
+	return hash;
+}
+
+// Each hash depends on the one before it, so four filenames are hashed side by side to keep the multiplier busy.
+void hash_filenames( scan_result *results, unsigned long count, unsigned long long initial_hash )
+{
+	unsigned long i = 0;
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		const wchar_t *n0 = results[ i ].filepath + results[ i ].filename_offset;
+		const wchar_t *n1 = results[ i + 1 ].filepath + results[ i + 1 ].filename_offset;
+		const wchar_t *n2 = results[ i + 2 ].filepath + results[ i + 2 ].filename_offset;
+		const wchar_t *n3 = results[ i + 3 ].filepath + results[ i + 3 ].filename_offset;
+
+		unsigned long long h0 = initial_hash, h1 = initial_hash, h2 = initial_hash, h3 = initial_hash;
+
+		// Hash the length that all four filenames share.
+		unsigned int length = results[ i ].filename_length;
+		for ( unsigned int k = 1; k < 4; ++k )
+		{
+			length = ( results[ i + k ].filename_length < length ? results[ i + k ].filename_length : length );
+		}
+
+		for ( unsigned int j = 0; j < length; ++j )
+		{
+			HASH_CODE_UNIT( h0, n0[ j ] )
+			HASH_CODE_UNIT( h1, n1[ j ] )
+			HASH_CODE_UNIT( h2, n2[ j ] )
+			HASH_CODE_UNIT( h3, n3[ j ] )
+		}
+
+		// Then finish each one separately.
+		results[ i ].hash = hash_filename( n0 + length, h0, results[ i ].filename_length - length );
+		results[ i + 1 ].hash = hash_filename( n1 + length, h1, results[ i + 1 ].filename_length - length );
+		results[ i + 2 ].hash = hash_filename( n2 + length, h2, results[ i + 2 ].filename_length - length );
+		results[ i + 3 ].hash = hash_filename( n3 + length, h3, results[ i + 3 ].filename_length - length );
+	}
+
+	for ( ; i < count; ++i )
+	{
+		results[ i ].hash = hash_filename( results[ i ].filepath + results[ i ].filename_offset, initial_hash, results[ i ].filename_length );
+	}
+}
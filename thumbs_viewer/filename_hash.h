@@ -0,0 +1,49 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The filename hash that Windows stores in the header of Thumbs.db entries. It's used to match entries to the files they came from.
+// Nothing here depends on windows.h, so it can be built and tested along with the database reader.
+
+#ifndef FILENAME_HASH_H
+#define FILENAME_HASH_H
+
+#include "platform.h"
+
+// Initial hash values. These values were found in thumbcache.dll.
+#define FILENAME_HASH_INITIAL		0x295BA83CF71232D9ULL	// Windows 7 and older.
+#define FILENAME_HASH_INITIAL_WIN8	0x68DFB54498C54783ULL	// Windows 8 and newer.
+
+// A file that's waiting to be hashed and looked up.
+struct scan_result
+{
+	unsigned long long hash;
+	unsigned int filename_offset;	// Start of the filename in filepath.
+	unsigned int filename_length;	// In UTF-16 code units.
+	wchar_t filepath[ ( MAX_PATH * 2 ) + 2 ];
+};
+
+// Hash length bytes of data.
+unsigned long long hash_data( char *data, unsigned long long hash, short length );
+
+// Hash length UTF-16 code units. The result is the same as hashing the little-endian bytes of the filename with hash_data.
+unsigned long long hash_filename( const wchar_t *filename, unsigned long long hash, unsigned int length );
+
+// Hash the filenames in a batch of results.
+void hash_filenames( scan_result *results, unsigned long count, unsigned long long initial_hash );
+
+#endif
@@ -38,6 +38,8 @@
 #include <process.h>
 
 #include "resource.h"
+#include "read_thumbs.h"
+#include "preview.h"
 
 #define PROGRAM_CAPTION		L"Thumbs Viewer"
 #define PROGRAM_CAPTION_A	"Thumbs Viewer"
@@ -53,60 +55,14 @@
 #define WM_DESTROY_ALT		WM_APP + 1	// Allows non-window threads to call DestroyWindow.
 #define WM_CHANGE_CURSOR	WM_APP + 2	// Updates the window cursor.
 #define WM_ALERT			WM_APP + 3	// Called from threads to display a message box.
-
-// fileinfo flags.
-#define FIF_TYPE_JPG		1
-#define FIF_TYPE_CMYK_JPG	2
-#define FIF_TYPE_PNG		4
-#define FIF_TYPE_UNKNOWN	8
+#define WM_ADD_ENTRIES		WM_APP + 4	// Appends wParam entries of the list in lParam to g_entries. The array is only resized on the main thread.
+#define WM_PREVIEW_READY	WM_APP + 5	// lParam is a preview_result from the preview worker. The image window owns it afterward.
+#define WM_SHOW_ERRORS		WM_APP + 6	// Shows the database errors that were queued by the reading threads.
+#define WM_SAVE_STATUS		WM_APP + 7	// Shows the newest progress of the save pipeline in the window title.
+#define WM_UPDATE_ENTRIES	WM_APP + 8	// lParam is an entry_updates from a reading thread. It's applied before SendMessage returns.
 
 #define _WIN32_WINNT_WIN10	0x0A00
 
-// Holds shared variables among database entries.
-struct shared_info
-{
-	wchar_t dbpath[ MAX_PATH ];
-	long *sat;
-	long *ssat;
-	char *short_stream_container;
-	
-	//These are found in the database header.
-	unsigned long num_sat_sects;
-	long first_dir_sect;
-	long first_ssat_sect;
-	unsigned long num_ssat_sects;
-	long first_dis_sect;
-	unsigned long num_dis_sects;
-	unsigned long short_sect_cutoff;
-
-	unsigned long count;		// Number of directory entries.
-
-	unsigned short sect_size;
-	unsigned short version;
-	unsigned char system;		// 0 = Unknown, 1 = Me/2000, 2 = XP/2003, 3 = Vista/2008/7
-};
-
-// This structure holds information obtained as we read the database. It's passed as an lParam to our listview items.
-struct fileinfo
-{
-	long long entry_hash;				// Hashed filename for Vista and above.
-	long long date_modified;			// Modified FILETIME
-	shared_info *si;
-	fileinfo *next;						// Allows us to process catalog entries in order.
-	wchar_t *filename;					// Name of the database entry.
-	unsigned long offset;				// Offset in SAT or short stream container (depends on size of entry)
-	unsigned long size;					// Size of file.
-	char entry_type;
-	unsigned char flag;					// 1 = jpg, 2 = cmyk jpg, 4 = png, 8 = unknown, 16 = in tree.
-};
-
-// Holds duplicate entries.
-struct linked_list
-{
-	fileinfo *fi;
-	linked_list *next;
-};
-
 // Multi-file open structure.
 struct pathinfo
 {
@@ -131,6 +87,9 @@ LRESULT CALLBACK ScanWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 
 VOID CALLBACK TimerProc( HWND hWnd, UINT msg, UINT idTimer, DWORD dwTime );
 
+void show_image_window();
+void set_preview_image( Gdiplus::Image *image, unsigned char flag, const wchar_t *filename );
+
 // These are all variables that are shared among the separate .cpp files.
 
 // Object handles.
@@ -138,6 +97,9 @@ extern HWND g_hWnd_main;			// Handle to our main window.
 extern HWND g_hWnd_image;			// Handle to our image window.
 extern HWND g_hWnd_scan;			// Handle to our scan window.
 extern HWND g_hWnd_list;			// Handle to the listview control.
+
+extern fileinfo **g_entries;		// The owner-data listview displays this array. An item's index is its index in the array.
+extern unsigned long g_entry_count;	// Number of entries in g_entries.
 extern HWND g_hWnd_active;			// Handle to the active window. Used to handle tab stops.
 
 extern CRITICAL_SECTION pe_cs;		// Allow only one read_database thread to be active.
@@ -163,9 +125,11 @@ extern bool is_attached;			// Toggled when our windows are attached
 extern bool skip_main;				// Prevents the main window from moving the image window if it is about to attach.
 
 extern char cmd_line;				// Show the main window and message prompts.
+extern unsigned long g_worker_count;	// Number of threads that read databases and convert saved images. 0 = One per processor.
 
 // Image variables
-extern Gdiplus::Image *gdi_image;	// GDI+ image object. We need it to handle .png and .jpg images specifically.
+extern Gdiplus::Image *gdi_image;	// GDI+ image object. We need it to handle .png and .jpg images specifically. It's owned by the image cache.
+extern preview_worker g_preview;	// Decodes the selected entry for the image window.
 
 extern POINT drag_rect;				// The current position of gdi_image in the image window.
 extern POINT old_pos;				// The old position of gdi_image. Used to calculate the rate of change.
@@ -176,7 +140,6 @@ extern float scale;					// Scale of the image.
 extern bool is_kbytes_size;			// Toggle the size text.
 
 // Thread variables
-extern bool g_kill_thread;			// Allow for a clean shutdown.
 extern bool g_kill_scan;			// Stop a file scan.
 
 extern bool in_thread;				// Flag to indicate that we're in a worker thread.
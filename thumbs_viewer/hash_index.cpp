@@ -0,0 +1,191 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hash_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The keys are already hashes, but their low bits might not be evenly distributed. Mix them before we pick a slot.
+static unsigned long long mix_key( unsigned long long key )
+{
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDULL;
+	key ^= key >> 33;
+	key *= 0xC4CEB9FE1A85EC53ULL;
+	key ^= key >> 33;
+
+	return key;
+}
+
+// Find the slot that holds the key, or the empty slot that it would be placed in.
+static hash_index_slot *find_slot( hash_index_slot *slots, unsigned long capacity, unsigned long long key )
+{
+	unsigned long mask = capacity - 1;
+	unsigned long index = ( unsigned long )mix_key( key ) & mask;
+
+	while ( slots[ index ].first != 0 && slots[ index ].key != key )
+	{
+		index = ( index + 1 ) & mask;	// Linear probe.
+	}
+
+	return &slots[ index ];
+}
+
+static bool resize_slots( hash_index *hi, unsigned long capacity )
+{
+	hash_index_slot *slots = ( hash_index_slot * )malloc( sizeof( hash_index_slot ) * capacity );
+	if ( slots == NULL )
+	{
+		return false;
+	}
+
+	memset( slots, 0, sizeof( hash_index_slot ) * capacity );
+
+	// Move every key into the new slots.
+	for ( unsigned long i = 0; i < hi->capacity; ++i )
+	{
+		if ( hi->slots[ i ].first != 0 )
+		{
+			*find_slot( slots, capacity, hi->slots[ i ].key ) = hi->slots[ i ];
+		}
+	}
+
+	free( hi->slots );
+	hi->slots = slots;
+	hi->capacity = capacity;
+
+	return true;
+}
+
+hash_index *hash_index_create( unsigned long count )
+{
+	hash_index *hi = ( hash_index * )malloc( sizeof( hash_index ) );
+	if ( hi == NULL )
+	{
+		return NULL;
+	}
+
+	// Keep the load factor at or below 1/2.
+	unsigned long capacity = HASH_INDEX_MIN_CAPACITY;
+	while ( capacity < count * 2 && capacity < 0x80000000 )
+	{
+		capacity <<= 1;
+	}
+
+	hi->slots = ( hash_index_slot * )malloc( sizeof( hash_index_slot ) * capacity );
+	hi->value_capacity = ( count > 0 ? count : HASH_INDEX_MIN_CAPACITY );
+	hi->values = ( hash_index_value * )malloc( sizeof( hash_index_value ) * hi->value_capacity );
+	if ( hi->slots == NULL || hi->values == NULL )
+	{
+		free( hi->slots );
+		free( hi->values );
+		free( hi );
+		return NULL;
+	}
+
+	memset( hi->slots, 0, sizeof( hash_index_slot ) * capacity );
+	hi->capacity = capacity;
+	hi->used = 0;
+	hi->value_count = 0;
+
+	return hi;
+}
+
+bool hash_index_insert( hash_index *hi, unsigned long long key, void *val )
+{
+	if ( hi == NULL )
+	{
+		return false;
+	}
+
+	if ( hi->value_count == hi->value_capacity )
+	{
+		hash_index_value *values = ( hash_index_value * )realloc( hi->values, sizeof( hash_index_value ) * hi->value_capacity * 2 );
+		if ( values == NULL )
+		{
+			return false;
+		}
+
+		hi->values = values;
+		hi->value_capacity *= 2;
+	}
+
+	if ( ( hi->used + 1 ) * 2 > hi->capacity )
+	{
+		if ( !resize_slots( hi, hi->capacity * 2 ) )
+		{
+			return false;
+		}
+	}
+
+	hi->values[ hi->value_count ].val = val;
+	hi->values[ hi->value_count ].next = 0;
+	++hi->value_count;
+
+	// The new value goes at the end of the key's chain so that duplicates are found in the order they were added.
+	hash_index_slot *slot = find_slot( hi->slots, hi->capacity, key );
+	if ( slot->first == 0 )
+	{
+		slot->key = key;
+		slot->first = hi->value_count;
+		++hi->used;
+	}
+	else
+	{
+		hi->values[ slot->last - 1 ].next = hi->value_count;
+	}
+
+	slot->last = hi->value_count;
+
+	return true;
+}
+
+hash_index_value *hash_index_find( hash_index *hi, unsigned long long key )
+{
+	if ( hi == NULL )
+	{
+		return NULL;
+	}
+
+	hash_index_slot *slot = find_slot( hi->slots, hi->capacity, key );
+
+	return ( slot->first != 0 ? &hi->values[ slot->first - 1 ] : NULL );
+}
+
+hash_index_value *hash_index_next( hash_index *hi, hash_index_value *hiv )
+{
+	if ( hi == NULL || hiv == NULL || hiv->next == 0 )
+	{
+		return NULL;
+	}
+
+	return &hi->values[ hiv->next - 1 ];
+}
+
+void hash_index_delete( hash_index *hi )
+{
+	if ( hi == NULL )
+	{
+		return;
+	}
+
+	free( hi->slots );
+	free( hi->values );
+	free( hi );
+}
@@ -0,0 +1,67 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Open addressing hash map of 64-bit keys. Values with the same key are chained together in a single array.
+
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <stddef.h>
+
+#define HASH_INDEX_MIN_CAPACITY	1024	// Initial number of slots. Always a power of 2.
+
+struct hash_index_slot
+{
+	unsigned long long key;
+	unsigned long first;		// 1 + the index of the first value in the array. 0 if the slot is empty.
+	unsigned long last;			// 1 + the index of the last value that was added to the key.
+};
+
+struct hash_index_value
+{
+	void *val;					// User data
+	unsigned long next;			// 1 + the index of the next value with the same key. 0 if it's the last one.
+};
+
+struct hash_index
+{
+	hash_index_slot *slots;
+	hash_index_value *values;
+	unsigned long capacity;		// Number of slots.
+	unsigned long used;			// Number of slots that hold a key.
+	unsigned long value_count;
+	unsigned long value_capacity;
+};
+
+// Create a hash index with enough room for count keys.
+hash_index *hash_index_create( unsigned long count );
+
+// Add a value to a key. Values with the same key don't replace each other.
+bool hash_index_insert( hash_index *hi, unsigned long long key, void *val );
+
+// Returns the first value associated with a key, or NULL if there's none.
+// Values with the same key are returned in the order they were inserted.
+hash_index_value *hash_index_find( hash_index *hi, unsigned long long key );
+
+// Returns the next value that has the same key, or NULL if there's none.
+hash_index_value *hash_index_next( hash_index *hi, hash_index_value *hiv );
+
+// Does not free the values.
+void hash_index_delete( hash_index *hi );
+
+#endif
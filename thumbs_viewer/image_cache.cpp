@@ -0,0 +1,330 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "image_cache.h"
+
+struct image_cache_entry
+{
+	image_cache_entry *prev;		// More recently used.
+	image_cache_entry *next;		// Less recently used.
+	image_cache_entry *hash_next;	// Next entry in the same bucket.
+	fileinfo *fi;					// NULL if the entry was freed while its image was displayed.
+	Gdiplus::Image *image;
+	unsigned long long size;
+};
+
+static CRITICAL_SECTION cache_cs;
+static image_cache_entry *buckets[ IMAGE_CACHE_BUCKETS ];
+static image_cache_entry *head = NULL;		// Most recently used.
+static image_cache_entry *tail = NULL;		// Least recently used.
+static image_cache_entry *pinned = NULL;	// The displayed image.
+static image_cache_stats stats;
+static image_cache_filter cache_filter = NULL;
+static void *cache_filter_context = NULL;
+
+static unsigned long get_bucket( fileinfo *fi )
+{
+	// fileinfo structures are at least 8 byte aligned. Skip the bits that never change.
+	return ( unsigned long )( ( ( ULONG_PTR )fi >> 3 ) & ( IMAGE_CACHE_BUCKETS - 1 ) );
+}
+
+static image_cache_entry *find_entry( fileinfo *fi )
+{
+	image_cache_entry *ice = buckets[ get_bucket( fi ) ];
+	while ( ice != NULL && ice->fi != fi )
+	{
+		ice = ice->hash_next;
+	}
+
+	return ice;
+}
+
+static void unlink_hash( image_cache_entry *ice )
+{
+	if ( ice->fi == NULL )
+	{
+		return;
+	}
+
+	image_cache_entry **link = &buckets[ get_bucket( ice->fi ) ];
+	while ( *link != NULL && *link != ice )
+	{
+		link = &( *link )->hash_next;
+	}
+
+	if ( *link != NULL )
+	{
+		*link = ice->hash_next;
+	}
+
+	ice->hash_next = NULL;
+}
+
+static void unlink_entry( image_cache_entry *ice )
+{
+	if ( ice->prev != NULL )
+	{
+		ice->prev->next = ice->next;
+	}
+	else
+	{
+		head = ice->next;
+	}
+
+	if ( ice->next != NULL )
+	{
+		ice->next->prev = ice->prev;
+	}
+	else
+	{
+		tail = ice->prev;
+	}
+
+	ice->prev = ice->next = NULL;
+}
+
+static void link_front( image_cache_entry *ice )
+{
+	ice->prev = NULL;
+	ice->next = head;
+
+	if ( head != NULL )
+	{
+		head->prev = ice;
+	}
+	else
+	{
+		tail = ice;
+	}
+
+	head = ice;
+}
+
+static void delete_entry( image_cache_entry *ice )
+{
+	unlink_hash( ice );
+	unlink_entry( ice );
+
+	stats.size -= ice->size;
+	--stats.count;
+
+	delete ice->image;
+	free( ice );
+}
+
+// An entry that was orphaned by clear_image_cache is deleted as soon as it's no longer displayed.
+static void pin_entry( image_cache_entry *ice )
+{
+	if ( pinned != NULL && pinned != ice && pinned->fi == NULL )
+	{
+		delete_entry( pinned );
+	}
+
+	pinned = ice;
+}
+
+// keep is the entry that was just added. It stays even if it's larger than the budget.
+static void evict_entries( image_cache_entry *keep )
+{
+	image_cache_entry *ice = tail;
+	while ( ice != NULL && stats.size > IMAGE_CACHE_BUDGET )
+	{
+		image_cache_entry *prev = ice->prev;
+
+		if ( ice != pinned && ice != keep )
+		{
+			delete_entry( ice );
+			++stats.evictions;
+		}
+
+		ice = prev;
+	}
+}
+
+void initialize_image_cache( image_cache_filter filter, void *context )
+{
+	InitializeCriticalSection( &cache_cs );
+
+	memset( buckets, 0, sizeof( buckets ) );
+	head = tail = pinned = NULL;
+	memset( &stats, 0, sizeof( image_cache_stats ) );
+
+	cache_filter = filter;
+	cache_filter_context = context;
+}
+
+void uninitialize_image_cache()
+{
+	while ( head != NULL )
+	{
+		delete_entry( head );
+	}
+
+	pinned = NULL;
+
+	DeleteCriticalSection( &cache_cs );
+}
+
+static Gdiplus::Image *lookup_image( fileinfo *fi, bool pin, bool count )
+{
+	Gdiplus::Image *image = NULL;
+
+	EnterCriticalSection( &cache_cs );
+
+	image_cache_entry *ice = find_entry( fi );
+	if ( ice != NULL )
+	{
+		// Move it to the front of the list.
+		unlink_entry( ice );
+		link_front( ice );
+
+		if ( pin )
+		{
+			pin_entry( ice );
+		}
+
+		image = ice->image;
+	}
+
+	if ( count )
+	{
+		if ( ice != NULL )
+		{
+			++stats.hits;
+		}
+		else
+		{
+			++stats.misses;
+		}
+	}
+
+	LeaveCriticalSection( &cache_cs );
+
+	return image;
+}
+
+Gdiplus::Image *find_cached_image( fileinfo *fi, bool pin )
+{
+	return lookup_image( fi, pin, false );
+}
+
+Gdiplus::Image *select_cached_image( fileinfo *fi )
+{
+	return lookup_image( fi, true, true );
+}
+
+bool is_image_cached( fileinfo *fi )
+{
+	EnterCriticalSection( &cache_cs );
+	bool cached = ( find_entry( fi ) != NULL );
+	LeaveCriticalSection( &cache_cs );
+
+	return cached;
+}
+
+Gdiplus::Image *cache_image( fileinfo *fi, Gdiplus::Image *image, unsigned long tag, bool pin )
+{
+	EnterCriticalSection( &cache_cs );
+
+	if ( cache_filter != NULL && !cache_filter( tag, cache_filter_context ) )
+	{
+		LeaveCriticalSection( &cache_cs );
+
+		delete image;
+		return NULL;
+	}
+
+	image_cache_entry *ice = find_entry( fi );
+	if ( ice != NULL )
+	{
+		// Someone else decoded it first.
+		delete image;
+
+		unlink_entry( ice );
+		link_front( ice );
+	}
+	else
+	{
+		ice = ( image_cache_entry * )malloc( sizeof( image_cache_entry ) );
+		if ( ice == NULL )
+		{
+			LeaveCriticalSection( &cache_cs );
+
+			delete image;
+			return NULL;
+		}
+
+		ice->fi = fi;
+		ice->image = image;
+		ice->size = ( unsigned long long )image->GetWidth() * image->GetHeight() * 4;	// Previews are decoded to 32 bits per pixel.
+
+		unsigned long bucket = get_bucket( fi );
+		ice->hash_next = buckets[ bucket ];
+		buckets[ bucket ] = ice;
+
+		link_front( ice );
+
+		stats.size += ice->size;
+		++stats.count;
+	}
+
+	if ( pin )
+	{
+		pin_entry( ice );
+	}
+
+	image = ice->image;
+
+	evict_entries( ice );
+
+	LeaveCriticalSection( &cache_cs );
+
+	return image;
+}
+
+void clear_image_cache()
+{
+	EnterCriticalSection( &cache_cs );
+
+	image_cache_entry *ice = head;
+	while ( ice != NULL )
+	{
+		image_cache_entry *next = ice->next;
+
+		if ( ice != pinned )
+		{
+			delete_entry( ice );
+		}
+		else	// Keep the displayed image, but don't let it be found.
+		{
+			unlink_hash( ice );
+			ice->fi = NULL;
+		}
+
+		ice = next;
+	}
+
+	LeaveCriticalSection( &cache_cs );
+}
+
+void get_image_cache_stats( image_cache_stats *ics )
+{
+	EnterCriticalSection( &cache_cs );
+	*ics = stats;
+	LeaveCriticalSection( &cache_cs );
+}
@@ -0,0 +1,65 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Decoded preview images that are kept so that returning to an entry doesn't extract and decode it again.
+// The least recently used images are deleted once they take up more than IMAGE_CACHE_BUDGET bytes. The displayed image is never deleted.
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include "globals.h"
+
+#define IMAGE_CACHE_BUDGET	( 64 * 1024 * 1024 )	// Bytes of decoded images to keep.
+#define IMAGE_CACHE_BUCKETS	1024					// Number of hash buckets. Always a power of 2.
+
+struct image_cache_stats
+{
+	unsigned long long hits;		// Selected entries that were already decoded.
+	unsigned long long misses;		// Selected entries that had to be decoded.
+	unsigned long long evictions;	// Images that were deleted to stay within the budget.
+	unsigned long count;			// Number of images in the cache.
+	unsigned long long size;		// Size of the images in the cache.
+};
+
+// Decides whether an image that was decoded with the given tag can still be cached.
+// It's called while the cache is locked so that clear_image_cache can't run between the check and the insertion.
+typedef bool ( *image_cache_filter )( unsigned long tag, void *context );
+
+// If filter is NULL, then every image is cached.
+void initialize_image_cache( image_cache_filter filter, void *context );
+void uninitialize_image_cache();	// Deletes every image, including the displayed one.
+
+// Returns the entry's image, or NULL if it isn't cached.
+// If pin is set, then the image is about to be displayed and won't be deleted until another image is pinned.
+Gdiplus::Image *find_cached_image( fileinfo *fi, bool pin );
+
+// Same as find_cached_image with pin set, but the lookup is counted as a hit or miss. Called when an entry is selected.
+Gdiplus::Image *select_cached_image( fileinfo *fi );
+
+bool is_image_cached( fileinfo *fi );
+
+// The cache takes ownership of image. Returns the entry's cached image, which is the existing one if it was already cached.
+// Returns NULL and deletes image if the filter rejects tag, or if there's not enough memory to cache it.
+Gdiplus::Image *cache_image( fileinfo *fi, Gdiplus::Image *image, unsigned long tag, bool pin );
+
+// Deletes every image except the displayed one. Must be called before entries are freed.
+void clear_image_cache();
+
+void get_image_cache_stats( image_cache_stats *ics );
+
+#endif
@@ -35,6 +35,8 @@ bool is_win_8_or_higher = true;						// Windows 8 and newer use a different init
 unsigned int file_count = 0;						// Number of files scanned.
 unsigned int match_count = 0;						// Number of files that match an entry hash.
 
+DWORD last_update = 0;								// Time the scan window was last updated.
+
 //#define _WIN32_WINNT_WIN7		0x0601
 #define _WIN32_WINNT_WIN8		0x0602
 //#define _WIN32_WINNT_WINBLUE	0x0603
@@ -61,68 +63,46 @@ BOOL IsWindows8OrGreater()
 	return IsWindowsVersionOrGreater( HIBYTE( _WIN32_WINNT_WIN8 ), LOBYTE( _WIN32_WINNT_WIN8 ), 0 );
 }
 
-void update_scan_info( unsigned long long hash, wchar_t *filepath )
+// Look up a batch of hashes in our fileinfo index. The scan window is updated at most once every SCAN_STATUS_DELAY milliseconds.
+// The scanner serializes calls to this, which guards the fileinfo index, the entries it points to, and the scan counts.
+void update_scan_info( scan_result *results, unsigned long count, void * /*context*/ )
 {
-	// Now that we have a hash value to compare, search our fileinfo tree for the same value.
-	linked_list *ll = ( linked_list * )dllrbt_find( fileinfo_tree, ( void * )hash, true );
-	while ( ll != NULL )
+	for ( unsigned long i = 0; i < count; ++i )
 	{
-		if ( ll->fi != NULL )
+		// Now that we have a hash value to compare, search our fileinfo index for the same value.
+		hash_index_value *hiv = hash_index_find( fileinfo_index, results[ i ].hash );
+		while ( hiv != NULL )
 		{
-			++match_count;
+			fileinfo *fi = ( fileinfo * )hiv->val;
+			if ( fi != NULL )
+			{
+				++match_count;
 
-			// Replace the hash filename with the local filename.
-			free( ll->fi->filename );
-			ll->fi->filename = _wcsdup( filepath );
-		}
+				// Replace the hash filename with the local filename.
+				fi->filename = arena_wcsdup( &fi->si->entry_arena, results[ i ].filepath );
+			}
 
-		ll = ll->next;
+			hiv = hash_index_next( fileinfo_index, hiv );
+		}
 	}
 
-	++file_count; 
+	file_count += count;
 
-	// Update our scan window with new scan information.
-	if ( g_show_details )
+	// Update our scan window with the last file in the batch.
+	DWORD current_time = GetTickCount();
+	if ( g_show_details && ( current_time - last_update ) >= SCAN_STATUS_DELAY )
 	{
-		SendMessage( g_hWnd_scan, WM_PROPAGATE, 3, ( LPARAM )filepath );
+		last_update = current_time;
+
+		SendMessage( g_hWnd_scan, WM_PROPAGATE, 3, ( LPARAM )results[ count - 1 ].filepath );
 		char buf[ 17 ] = { 0 };
-		sprintf_s( buf, 17, "%016llx", hash );
+		sprintf_s( buf, 17, "%016llx", results[ count - 1 ].hash );
 		SendMessageA( g_hWnd_scan, WM_PROPAGATE, 4, ( LPARAM )buf );
 		sprintf_s( buf, 17, "%lu", file_count );
 		SendMessageA( g_hWnd_scan, WM_PROPAGATE, 5, ( LPARAM )buf );
 	}
 }
 
-unsigned long long hash_data( char *data, unsigned long long hash, short length )
-{
-	while ( length-- > 0 )
-	{
-		hash ^= ( ( ( hash * 0x820 ) + ( *data++ & 0x00000000000000FF ) ) + ( hash >> 2 ) );
-	}
-
-	return hash;
-}
-
-void hash_file( wchar_t *filepath, wchar_t *filename )
-{
-	// Initial hash value. This value was found in thumbcache.dll.
-	unsigned long long hash;
-
-	if ( !is_win_8_or_higher )
-	{
-		hash = 0x295BA83CF71232D9;
-	}
-	else
-	{
-		hash = 0x68DFB54498C54783;
-	}
-
-	// Hash the filename.
-	hash = hash_data( ( char * )filename, hash, ( short )( wcslen( filename ) * sizeof( wchar_t ) ) );
-
-	update_scan_info( hash, filepath );
-}
-
 /*
 // The header value for entries created on Windows Vista and newer will contain 8 bytes that are used to identify the original file.
 // On Windows Vista and 7 these 8 bytes are the original file's Thumbcache ID. The algorithm for generating that can be found in my Thumbcache Viewer project.
@@ -153,116 +133,47 @@ unsigned long long hash_id_and_date( wchar_t *filepath )
 	}
 }*/
 
-void traverse_directory( wchar_t *path )
-{
-	// We don't want to continue scanning if the user cancels the scan.
-	if ( g_kill_scan )
-	{
-		return;
-	}
-
-	// Set the file path to search for all files/folders in the current directory.
-	wchar_t filepath[ ( MAX_PATH * 2 ) + 2 ];
-	swprintf_s( filepath, ( MAX_PATH * 2 ) + 2, L"%.259s\\*", path );
-
-	WIN32_FIND_DATA FindFileData;
-	HANDLE hFind = FindFirstFileEx( ( LPCWSTR )filepath, FindExInfoStandard, &FindFileData, FindExSearchNameMatch, NULL, 0 );
-	if ( hFind != INVALID_HANDLE_VALUE ) 
-	{
-		do
-		{
-			if ( g_kill_scan )
-			{
-				break;	// We need to close the find file handle.
-			}
-
-			// See if the file is a directory.
-			if ( ( FindFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) != 0 )
-			{
-				// Go through all directories except "." and ".." (current and parent)
-				if ( ( wcscmp( FindFileData.cFileName, L"." ) != 0 ) && ( wcscmp( FindFileData.cFileName, L".." ) != 0 ) )
-				{
-					// Move to the next directory. Limit the path length to MAX_PATH.
-					if ( swprintf_s( filepath, ( MAX_PATH * 2 ) + 2, L"%.259s\\%.259s", path, FindFileData.cFileName ) < MAX_PATH )
-					{
-						traverse_directory( filepath );
-
-						// Only hash folders if enabled.
-						if ( g_include_folders )
-						{
-							hash_file( filepath, FindFileData.cFileName );
-						}
-					}
-				}
-			}
-			else
-			{
-				// See if the file's extension is in our filter. Go to the next file if it's not.
-				wchar_t *ext = get_extension_from_filename( FindFileData.cFileName, ( unsigned long )wcslen( FindFileData.cFileName ) );
-				if ( g_extension_filter[ 0 ] != 0 )
-				{
-					// Do a case-insensitive substring search for the extension.
-					int ext_length = ( int )wcslen( ext );
-					wchar_t *temp_ext = ( wchar_t * )malloc( sizeof( wchar_t ) * ( ext_length + 3 ) );
-					for ( int i = 0; i < ext_length; ++i )
-					{
-						temp_ext[ i + 1 ] = towlower( ext[ i ] );
-					}
-					temp_ext[ 0 ] = L'|';				// Append the delimiter to the beginning of the string.
-					temp_ext[ ext_length + 1 ] = L'|';	// Append the delimiter to the end of the string.
-					temp_ext[ ext_length + 2 ] = L'\0';
-
-					if ( wcsstr( g_extension_filter, temp_ext ) == NULL )
-					{
-						free( temp_ext );
-						continue;
-					}
-
-					free( temp_ext );
-				}
-
-				swprintf_s( filepath, ( MAX_PATH * 2 ) + 2, L"%.259s\\%.259s", path, FindFileData.cFileName );
-
-				hash_file( filepath, FindFileData.cFileName );
-			}
-		}
-		while ( FindNextFile( hFind, &FindFileData ) != 0 );	// Go to the next file.
-
-		FindClose( hFind );	// Close the find file handle.
-	}
-}
-
 unsigned __stdcall map_entries( void * /*pArguments*/ )
 {
 	// This will block every other thread from entering until the first thread is complete.
 	EnterCriticalSection( &pe_cs );
 
+	in_thread = true;	// Label edits are blocked while the scan adds filenames to the entry arenas.
+
 	SetWindowTextA( g_hWnd_scan, "Map File Paths to Entry Hashes - Please wait..." );	// Update the window title.
 	SendMessage( g_hWnd_scan, WM_CHANGE_CURSOR, TRUE, 0 );	// SetCursor only works from the main thread. Set it to an arrow with hourglass.
 
 	// Disable scan button, enable cancel button.
 	SendMessage( g_hWnd_scan, WM_PROPAGATE, 1, 0 );
 
-	create_fileinfo_tree();
+	create_fileinfo_index();
 
 	file_count = 0;		// Reset the file count.
 	match_count = 0;	// Reset the match count.
 
 	is_win_8_or_higher = ( IsWindows8OrGreater() != FALSE ? true : false );
 
-	traverse_directory( g_filepath );
+	last_update = 0;
+
+	scan_options so;
+	so.extension_filter = g_extension_filter;
+	so.include_folders = g_include_folders;
+	so.thread_count = get_worker_count( MAXIMUM_WAIT_OBJECTS );
+	so.initial_hash = ( is_win_8_or_higher ? FILENAME_HASH_INITIAL_WIN8 : FILENAME_HASH_INITIAL );
+	so.cancel = &g_kill_scan;
+	so.callback = update_scan_info;
+	so.context = NULL;
+
+	scan_directory_tree( g_filepath, &so, NULL );
 
-	cleanup_fileinfo_tree();
+	cleanup_fileinfo_index();
 
 	InvalidateRect( g_hWnd_list, NULL, TRUE );
 
-	// Update the details.
-	if ( !g_show_details )
-	{
-		char msg[ 11 ] = { 0 };
-		sprintf_s( msg, 11, "%lu", file_count );
-		SendMessageA( g_hWnd_scan, WM_PROPAGATE, 5, ( LPARAM )msg );
-	}
+	// Update the details. Progress updates are coalesced, so the final count may not have been shown.
+	char buf[ 11 ] = { 0 };
+	sprintf_s( buf, 11, "%lu", file_count );
+	SendMessageA( g_hWnd_scan, WM_PROPAGATE, 5, ( LPARAM )buf );
 
 	// Reset button and text.
 	SendMessage( g_hWnd_scan, WM_PROPAGATE, 2, 0 );
@@ -281,6 +192,14 @@ unsigned __stdcall map_entries( void * /*pArguments*/ )
 	SendMessage( g_hWnd_scan, WM_CHANGE_CURSOR, FALSE, 0 );	// Reset the cursor.
 	SetWindowTextA( g_hWnd_scan, "Map File Paths to Entry Hashes" );	// Reset the window title.
 
+	// Release the semaphore if we're killing the thread.
+	if ( shutdown_semaphore != NULL )
+	{
+		ReleaseSemaphore( shutdown_semaphore, 1, NULL );
+	}
+
+	in_thread = false;
+
 	// We're done. Let other threads continue.
 	LeaveCriticalSection( &pe_cs );
 
@@ -19,6 +19,11 @@
 #ifndef MAP_ENTRIES_H
 #define MAP_ENTRIES_H
 
+#include "globals.h"
+#include "scan_tree.h"
+
+#define SCAN_STATUS_DELAY	100		// Milliseconds between updates to the scan window.
+
 unsigned __stdcall map_entries( void *pArguments );
 
 extern wchar_t g_filepath[];			// Path to the files and folders to scan.
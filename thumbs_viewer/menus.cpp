@@ -109,6 +109,16 @@ void CreateMenus()
 	mii.wID = MENU_SCAN;
 	InsertMenuItemA( hMenuSub_tools, 0, TRUE, &mii );
 
+	mii.fType = MFT_SEPARATOR;
+	InsertMenuItemA( hMenuSub_tools, 1, TRUE, &mii );
+
+	mii.fType = MFT_STRING;
+	mii.dwTypeData = "&Statistics...";
+	mii.cch = 14;
+	mii.wID = MENU_STATISTICS;
+	mii.fState = MFS_ENABLED;
+	InsertMenuItemA( hMenuSub_tools, 2, TRUE, &mii );
+
 	// HELP MENU
 	mii.dwTypeData = "Thumbs Viewer &Home Page";
 	mii.cch = 24;
@@ -35,6 +35,7 @@
 #define MENU_SCAN		1009
 #define MENU_COPY_SEL	1010
 #define MENU_HOME_PAGE	1011
+#define MENU_STATISTICS	1012
 
 #define UM_DISABLE			0
 #define UM_ENABLE			1
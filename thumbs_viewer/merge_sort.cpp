@@ -0,0 +1,79 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "merge_sort.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool merge_sort( void **items, unsigned long count, item_compare compare, void *context )
+{
+	if ( count < 2 )
+	{
+		return true;
+	}
+
+	void **temp = ( void ** )malloc( sizeof( void * ) * count );
+	if ( temp == NULL )
+	{
+		return false;
+	}
+
+	void **src = items;
+	void **dst = temp;
+
+	// Merge runs of width items into runs of width * 2 items.
+	for ( unsigned long width = 1; width < count; width *= 2 )
+	{
+		for ( unsigned long left = 0; left < count; left += ( width * 2 ) )
+		{
+			unsigned long middle = ( count - left > width ? left + width : count );
+			unsigned long right = ( count - left > width * 2 ? left + ( width * 2 ) : count );
+
+			unsigned long l = left, r = middle, k = left;
+			while ( l < middle && r < right )
+			{
+				// Take the left item unless it's greater. Equal items keep their order.
+				dst[ k++ ] = ( compare( src[ l ], src[ r ], context ) > 0 ? src[ r++ ] : src[ l++ ] );
+			}
+
+			while ( l < middle )
+			{
+				dst[ k++ ] = src[ l++ ];
+			}
+
+			while ( r < right )
+			{
+				dst[ k++ ] = src[ r++ ];
+			}
+		}
+
+		void **swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if ( src != items )
+	{
+		memcpy( items, src, sizeof( void * ) * count );
+	}
+
+	free( temp );
+
+	return true;
+}
@@ -0,0 +1,30 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Stable bottom-up merge sort of an array of pointers. Items that compare equal keep their order.
+
+#ifndef MERGE_SORT_H
+#define MERGE_SORT_H
+
+// Returns a value greater than 0 if a sorts after b.
+typedef int ( *item_compare )( void *a, void *b, void *context );
+
+// Returns false if there wasn't enough memory. The items are left as they were.
+bool merge_sort( void **items, unsigned long count, item_compare compare, void *context );
+
+#endif
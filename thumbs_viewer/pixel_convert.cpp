@@ -0,0 +1,175 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pixel_convert.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// x64 processors always have SSE2, and so does anything we were told to build for with /arch:SSE2 or -msse2.
+// Other 32 bit x86 builds made with Visual C++ check for it at run time.
+#if defined( _M_X64 ) || defined( __SSE2__ ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+	#define USE_SSE2
+	#define SSE2_BASELINE
+	#include <emmintrin.h>
+#elif defined( _M_IX86 )
+	#define USE_SSE2
+	#include <emmintrin.h>
+	#include <intrin.h>
+#endif
+
+// LockBits with PixelFormat32bppCMYK appears to remove the black channel and leaves us with CMY values in the range of 0 to 255.
+// We take the compliment of cyan, magenta, and yellow to get our RGB values. (255 - C), (255 - M), (255 - Y)
+// Inverting the bits of a channel is the same as subtracting it from 255.
+static void cmyk_to_rgb_row_scalar( const unsigned int *src, unsigned int *dst, unsigned int width )
+{
+	for ( unsigned int col = 0; col < width; ++col )
+	{
+		dst[ col ] = ( src[ col ] ^ 0x00FFFFFF ) | 0xFF000000;
+	}
+}
+
+// Swaps the first and third bytes of each pixel.
+static void swap_red_blue_row_scalar( const unsigned char *src, unsigned char *dst, unsigned int width, unsigned char channels )
+{
+	for ( unsigned int col = 0; col < width; ++col )
+	{
+		dst[ 0 ] = src[ 2 ];
+		dst[ 1 ] = src[ 1 ];
+		dst[ 2 ] = src[ 0 ];
+		if ( channels == 4 )
+		{
+			dst[ 3 ] = src[ 3 ];
+		}
+
+		src += channels;
+		dst += channels;
+	}
+}
+
+#ifdef USE_SSE2
+
+// Swaps 4 pixels at a time. SSE2 has no byte shuffle, so the red and blue bytes are moved with 32 bit shifts.
+// Whatever remains is done with the scalar version.
+static void swap_red_blue_row_32_sse2( const unsigned char *src, unsigned char *dst, unsigned int width )
+{
+	const __m128i green_alpha = _mm_set1_epi32( 0xFF00FF00 );
+	const __m128i low = _mm_set1_epi32( 0x000000FF );
+	const __m128i high = _mm_set1_epi32( 0x00FF0000 );
+
+	unsigned int col = 0;
+	for ( ; col + 4 <= width; col += 4 )
+	{
+		__m128i pixels = _mm_loadu_si128( ( const __m128i * )( src + ( col * 4 ) ) );
+		__m128i swapped = _mm_or_si128( _mm_and_si128( pixels, green_alpha ),
+										_mm_or_si128( _mm_and_si128( _mm_srli_epi32( pixels, 16 ), low ),
+													  _mm_and_si128( _mm_slli_epi32( pixels, 16 ), high ) ) );
+		_mm_storeu_si128( ( __m128i * )( dst + ( col * 4 ) ), swapped );
+	}
+
+	swap_red_blue_row_scalar( src + ( col * 4 ), dst + ( col * 4 ), width - col, 4 );
+}
+
+// Converts 4 pixels at a time. Whatever remains is done with the scalar version.
+static void cmyk_to_rgb_row_sse2( const unsigned int *src, unsigned int *dst, unsigned int width )
+{
+	const __m128i invert = _mm_set1_epi32( 0x00FFFFFF );
+	const __m128i alpha = _mm_set1_epi32( 0xFF000000 );
+
+	unsigned int col = 0;
+	for ( ; col + 4 <= width; col += 4 )
+	{
+		__m128i pixels = _mm_loadu_si128( ( const __m128i * )( src + col ) );
+		pixels = _mm_or_si128( _mm_xor_si128( pixels, invert ), alpha );
+		_mm_storeu_si128( ( __m128i * )( dst + col ), pixels );
+	}
+
+	cmyk_to_rgb_row_scalar( src + col, dst + col, width - col );
+}
+
+static bool has_sse2()
+{
+	#ifdef SSE2_BASELINE
+		return true;
+	#else
+		// Bit 26 of EDX is set if the processor supports SSE2.
+		int info[ 4 ];
+		__cpuid( info, 1 );
+		return ( ( info[ 3 ] & ( 1 << 26 ) ) != 0 );
+	#endif
+}
+
+#endif
+
+void cmyk_to_rgb_flipped( const unsigned char *src, int src_stride, unsigned char *dst, int dst_stride, unsigned int width, unsigned int height )
+{
+	if ( height == 0 )
+	{
+		return;
+	}
+
+	// Only check for SSE2 once per image.
+	void ( *convert_row )( const unsigned int *, unsigned int *, unsigned int ) = cmyk_to_rgb_row_scalar;
+	#ifdef USE_SSE2
+		if ( has_sse2() )
+		{
+			convert_row = cmyk_to_rgb_row_sse2;
+		}
+	#endif
+
+	dst += ( ( ptrdiff_t )( height - 1 ) * dst_stride );
+
+	for ( unsigned int row = 0; row < height; ++row )
+	{
+		convert_row( ( const unsigned int * )src, ( unsigned int * )dst, width );
+
+		src += src_stride;
+		dst -= dst_stride;
+	}
+}
+
+void copy_pixel_rows( const unsigned char *src, int src_stride, unsigned char *dst, int dst_stride, unsigned int width, unsigned int height, unsigned char channels, bool swap_red_blue )
+{
+	size_t row_size = ( size_t )width * channels;
+
+	bool use_sse2 = false;
+	#ifdef USE_SSE2
+		use_sse2 = ( swap_red_blue && channels == 4 && has_sse2() );
+	#endif
+
+	for ( unsigned int row = 0; row < height; ++row )
+	{
+		if ( !swap_red_blue )
+		{
+			memcpy( dst, src, row_size );
+		}
+		#ifdef USE_SSE2
+		else if ( use_sse2 )
+		{
+			swap_red_blue_row_32_sse2( src, dst, width );
+		}
+		#endif
+		else
+		{
+			swap_red_blue_row_scalar( src, dst, width, channels );
+		}
+
+		src += src_stride;
+		dst += dst_stride;
+	}
+}
@@ -0,0 +1,32 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Pixel conversions that are done on whole rows. The SSE2 versions are used when the processor supports them, and give the same results as the scalar versions.
+
+#ifndef PIXEL_CONVERT_H
+#define PIXEL_CONVERT_H
+
+// Converts 32 bit CMY(K) pixels from GDI+ into 32 bit RGB pixels. Each channel is complemented and the alpha is set to 255.
+// The rows are written in reverse order to flip the image on the horizontal axis.
+void cmyk_to_rgb_flipped( const unsigned char *src, int src_stride, unsigned char *dst, int dst_stride, unsigned int width, unsigned int height );
+
+// Copies rows of 3 or 4 byte pixels and drops any padding at the end of the source rows. A negative src_stride reads the rows bottom up.
+// If swap_red_blue is set, then BGR(A) pixels become RGB(A) pixels.
+void copy_pixel_rows( const unsigned char *src, int src_stride, unsigned char *dst, int dst_stride, unsigned int width, unsigned int height, unsigned char channels, bool swap_red_blue );
+
+#endif
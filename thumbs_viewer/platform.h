@@ -0,0 +1,175 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The few operating system services that the database reader needs. platform_win32.cpp and platform_posix.cpp implement them.
+// Nothing here depends on windows.h, so the reader can be built without it.
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stddef.h>
+#include <string.h>
+#include <wchar.h>
+
+// Visual Studio 2008 doesn't have stdint.h.
+#if defined( _MSC_VER ) && _MSC_VER < 1600
+	typedef signed __int16 int16_t;
+	typedef unsigned __int16 uint16_t;
+	typedef signed __int32 int32_t;
+	typedef unsigned __int32 uint32_t;
+	typedef signed __int64 int64_t;
+	typedef unsigned __int64 uint64_t;
+#else
+	#include <stdint.h>
+#endif
+
+#ifndef MAX_PATH
+	#define MAX_PATH	260
+#endif
+
+#ifndef C_ASSERT
+	#define C_ASSERT( e )	typedef char __C_ASSERT__[ ( e ) ? 1 : -1 ]
+#endif
+
+// The bounds checked functions that the reader uses. They're only part of the Microsoft runtime.
+// Like the originals, the destination is emptied and nothing is copied if it's too small.
+#ifndef _WIN32
+
+#include <stdio.h>
+
+#define sprintf_s	snprintf
+
+inline int memcpy_s( void *dest, size_t dest_size, const void *src, size_t count )
+{
+	if ( count > dest_size )
+	{
+		memset( dest, 0, dest_size );
+		return 1;
+	}
+
+	memcpy( dest, src, count );
+	return 0;
+}
+
+inline int memmove_s( void *dest, size_t dest_size, const void *src, size_t count )
+{
+	if ( count > dest_size )
+	{
+		return 1;
+	}
+
+	memmove( dest, src, count );
+	return 0;
+}
+
+inline int wmemcpy_s( wchar_t *dest, size_t dest_size, const wchar_t *src, size_t count )
+{
+	return memcpy_s( dest, sizeof( wchar_t ) * dest_size, src, sizeof( wchar_t ) * count );
+}
+
+// Copies at most count characters and always terminates dest.
+inline int wcsncpy_s( wchar_t *dest, size_t dest_size, const wchar_t *src, size_t count )
+{
+	size_t length = 0;
+	while ( length < count && src[ length ] != L'\0' )
+	{
+		++length;
+	}
+
+	if ( length >= dest_size )
+	{
+		if ( dest_size > 0 )
+		{
+			dest[ 0 ] = L'\0';
+		}
+
+		return 1;
+	}
+
+	wmemcpy( dest, src, length );
+	dest[ length ] = L'\0';
+	return 0;
+}
+
+inline int wcscpy_s( wchar_t *dest, size_t dest_size, const wchar_t *src )
+{
+	return wcsncpy_s( dest, dest_size, src, ( size_t )-1 );
+}
+
+#endif
+
+struct platform_file;		// An open file.
+struct platform_lock;		// A mutex. It doesn't have to be recursive.
+struct platform_semaphore;	// A counting semaphore.
+struct platform_thread;		// A thread that can be waited on.
+struct platform_directory;	// A directory whose entries are being read.
+
+#ifdef _WIN32
+	#define PATH_SEPARATOR	L'\\'
+#else
+	#define PATH_SEPARATOR	L'/'
+#endif
+
+// Returns NULL if the file can't be opened for reading. size receives the size of the file.
+platform_file *open_file_read( const wchar_t *path, unsigned long long *size );
+void close_file( platform_file *pf );
+
+// Reads length bytes at offset without using a shared file pointer, so any thread can read at the same time.
+// Returns the number of bytes that were read. It's less than length if the end of the file was reached.
+unsigned long read_file_at( platform_file *pf, unsigned long long offset, void *buf, unsigned long length );
+
+// Maps the entire file into memory as read-only. Returns NULL if it can't be mapped, in which case read_file_at is used instead.
+// The view stays valid until it's passed to unmap_file, which must happen before the file is closed.
+char *map_file( platform_file *pf, unsigned long long size );
+void unmap_file( platform_file *pf, char *view, unsigned long long size );
+
+// Returns NULL if the lock couldn't be created.
+platform_lock *create_lock();
+void destroy_lock( platform_lock *pl );
+void enter_lock( platform_lock *pl );
+void leave_lock( platform_lock *pl );
+
+// Returns true if the lock was entered without having to wait for it.
+bool try_enter_lock( platform_lock *pl );
+
+// Returns NULL if the semaphore couldn't be created. Its count starts at 0.
+platform_semaphore *create_semaphore();
+void destroy_semaphore( platform_semaphore *ps );
+void release_semaphore( platform_semaphore *ps, unsigned long count );
+void wait_semaphore( platform_semaphore *ps );	// Waits for the count to be above 0 and then decrements it.
+
+// Returns NULL if the thread couldn't be started. join_thread waits for the thread to exit and frees it.
+typedef void ( *thread_function )( void *context );
+platform_thread *start_thread( thread_function function, void *context );
+void join_thread( platform_thread *pt );
+
+// Returns NULL if the directory can't be opened. Entries are read in no particular order, and include "." and ".." if the file system has them.
+// read_directory returns false once there are no more entries. The name is in UTF-16 code units, and it's skipped if it doesn't fit in name_size.
+// Symbolic links aren't reported as directories on POSIX systems, so they're never followed.
+platform_directory *open_directory( const wchar_t *path );
+bool read_directory( platform_directory *pd, wchar_t *name, size_t name_size, bool *is_directory );
+void close_directory( platform_directory *pd );
+
+// Sets *destination to exchange if it's equal to comparand. Returns the value *destination had before.
+void *compare_exchange_pointer( void * volatile *destination, void *exchange, void *comparand );
+
+// High resolution timer. The frequency is in counts per second.
+long long get_performance_counter();
+long long get_performance_frequency();
+
+#endif
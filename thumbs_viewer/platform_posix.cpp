@@ -0,0 +1,511 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "platform.h"
+
+#include <stdlib.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct platform_file
+{
+	int fd;
+};
+
+struct platform_lock
+{
+	pthread_mutex_t mutex;
+};
+
+struct platform_semaphore
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned long count;
+};
+
+struct platform_thread
+{
+	pthread_t thread;
+	thread_function function;
+	void *context;
+};
+
+struct platform_directory
+{
+	DIR *dir;
+};
+
+// Paths are passed around as wchar_t like they are on Windows. The file system expects UTF-8.
+static char *path_to_utf8( const wchar_t *path )
+{
+	size_t length = wcslen( path );
+
+	// A code point needs at most 4 bytes.
+	char *utf8 = ( char * )malloc( sizeof( char ) * ( ( length * 4 ) + 1 ) );
+	if ( utf8 == NULL )
+	{
+		return NULL;
+	}
+
+	char *p = utf8;
+	for ( size_t i = 0; i < length; ++i )
+	{
+		unsigned long c = ( unsigned long )path[ i ];
+
+		// Combine surrogate pairs in case wchar_t is only 16 bits.
+		if ( c >= 0xD800 && c <= 0xDBFF && i + 1 < length && ( unsigned long )path[ i + 1 ] >= 0xDC00 && ( unsigned long )path[ i + 1 ] <= 0xDFFF )
+		{
+			c = 0x10000 + ( ( c - 0xD800 ) << 10 ) + ( ( unsigned long )path[ ++i ] - 0xDC00 );
+		}
+
+		if ( c < 0x80 )
+		{
+			*p++ = ( char )c;
+		}
+		else if ( c < 0x800 )
+		{
+			*p++ = ( char )( 0xC0 | ( c >> 6 ) );
+			*p++ = ( char )( 0x80 | ( c & 0x3F ) );
+		}
+		else if ( c < 0x10000 )
+		{
+			*p++ = ( char )( 0xE0 | ( c >> 12 ) );
+			*p++ = ( char )( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+			*p++ = ( char )( 0x80 | ( c & 0x3F ) );
+		}
+		else
+		{
+			*p++ = ( char )( 0xF0 | ( ( c >> 18 ) & 0x07 ) );
+			*p++ = ( char )( 0x80 | ( ( c >> 12 ) & 0x3F ) );
+			*p++ = ( char )( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+			*p++ = ( char )( 0x80 | ( c & 0x3F ) );
+		}
+	}
+
+	*p = '\0';
+
+	return utf8;
+}
+
+// The reverse of path_to_utf8. Code points above 0xFFFF are stored as surrogate pairs so that names are in UTF-16 code units like they are on Windows.
+// Returns false if the name isn't valid UTF-8, or if it doesn't fit in name_size.
+static bool utf8_to_name( const char *utf8, wchar_t *name, size_t name_size )
+{
+	const unsigned char *p = ( const unsigned char * )utf8;
+	size_t length = 0;
+
+	while ( *p != 0 )
+	{
+		unsigned long c = *p++;
+		int continuation = 0;
+		unsigned long minimum = 0;
+
+		if ( c < 0x80 )
+		{
+			continuation = 0;
+		}
+		else if ( ( c & 0xE0 ) == 0xC0 )
+		{
+			c &= 0x1F;
+			continuation = 1;
+			minimum = 0x80;
+		}
+		else if ( ( c & 0xF0 ) == 0xE0 )
+		{
+			c &= 0x0F;
+			continuation = 2;
+			minimum = 0x800;
+		}
+		else if ( ( c & 0xF8 ) == 0xF0 )
+		{
+			c &= 0x07;
+			continuation = 3;
+			minimum = 0x10000;
+		}
+		else
+		{
+			return false;
+		}
+
+		for ( ; continuation > 0; --continuation )
+		{
+			if ( ( *p & 0xC0 ) != 0x80 )
+			{
+				return false;
+			}
+
+			c = ( c << 6 ) | ( *p++ & 0x3F );
+		}
+
+		// Reject overlong encodings, surrogates, and anything beyond the last code point.
+		if ( c < minimum || ( c >= 0xD800 && c <= 0xDFFF ) || c > 0x10FFFF )
+		{
+			return false;
+		}
+
+		if ( c >= 0x10000 )
+		{
+			if ( length + 2 >= name_size )
+			{
+				return false;
+			}
+
+			c -= 0x10000;
+			name[ length++ ] = ( wchar_t )( 0xD800 + ( c >> 10 ) );
+			name[ length++ ] = ( wchar_t )( 0xDC00 + ( c & 0x3FF ) );
+		}
+		else
+		{
+			if ( length + 1 >= name_size )
+			{
+				return false;
+			}
+
+			name[ length++ ] = ( wchar_t )c;
+		}
+	}
+
+	if ( length >= name_size )
+	{
+		return false;
+	}
+
+	name[ length ] = L'\0';
+
+	return true;
+}
+
+platform_file *open_file_read( const wchar_t *path, unsigned long long *size )
+{
+	char *utf8_path = path_to_utf8( path );
+	if ( utf8_path == NULL )
+	{
+		return NULL;
+	}
+
+	int fd = open( utf8_path, O_RDONLY );
+	free( utf8_path );
+
+	if ( fd == -1 )
+	{
+		return NULL;
+	}
+
+	// Directories can be opened for reading, but they can't be read.
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	platform_file *pf = ( platform_file * )malloc( sizeof( platform_file ) );
+	if ( pf == NULL )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	pf->fd = fd;
+	*size = ( unsigned long long )st.st_size;
+
+	return pf;
+}
+
+void close_file( platform_file *pf )
+{
+	if ( pf == NULL )
+	{
+		return;
+	}
+
+	close( pf->fd );
+	free( pf );
+}
+
+unsigned long read_file_at( platform_file *pf, unsigned long long offset, void *buf, unsigned long length )
+{
+	unsigned long total = 0;
+
+	// pread can return fewer bytes than were asked for without having reached the end of the file.
+	while ( total < length )
+	{
+		ssize_t read = pread( pf->fd, ( char * )buf + total, length - total, ( off_t )( offset + total ) );
+		if ( read > 0 )
+		{
+			total += ( unsigned long )read;
+		}
+		else if ( read == 0 || errno != EINTR )
+		{
+			break;
+		}
+	}
+
+	return total;
+}
+
+char *map_file( platform_file *pf, unsigned long long size )
+{
+	// Empty files can't be mapped, and 32-bit builds may not have enough address space for very large files.
+	if ( size == 0 || size > ( size_t )-1 )
+	{
+		return NULL;
+	}
+
+	void *view = mmap( NULL, ( size_t )size, PROT_READ, MAP_SHARED, pf->fd, 0 );
+
+	return ( view != MAP_FAILED ? ( char * )view : NULL );
+}
+
+void unmap_file( platform_file * /*pf*/, char *view, unsigned long long size )
+{
+	if ( view != NULL )
+	{
+		munmap( view, ( size_t )size );
+	}
+}
+
+platform_lock *create_lock()
+{
+	platform_lock *pl = ( platform_lock * )malloc( sizeof( platform_lock ) );
+	if ( pl != NULL && pthread_mutex_init( &pl->mutex, NULL ) != 0 )
+	{
+		free( pl );
+		pl = NULL;
+	}
+
+	return pl;
+}
+
+void destroy_lock( platform_lock *pl )
+{
+	if ( pl != NULL )
+	{
+		pthread_mutex_destroy( &pl->mutex );
+		free( pl );
+	}
+}
+
+void enter_lock( platform_lock *pl )
+{
+	pthread_mutex_lock( &pl->mutex );
+}
+
+void leave_lock( platform_lock *pl )
+{
+	pthread_mutex_unlock( &pl->mutex );
+}
+
+bool try_enter_lock( platform_lock *pl )
+{
+	return ( pthread_mutex_trylock( &pl->mutex ) == 0 );
+}
+
+platform_semaphore *create_semaphore()
+{
+	platform_semaphore *ps = ( platform_semaphore * )malloc( sizeof( platform_semaphore ) );
+	if ( ps == NULL )
+	{
+		return NULL;
+	}
+
+	if ( pthread_mutex_init( &ps->mutex, NULL ) != 0 )
+	{
+		free( ps );
+		return NULL;
+	}
+
+	if ( pthread_cond_init( &ps->cond, NULL ) != 0 )
+	{
+		pthread_mutex_destroy( &ps->mutex );
+		free( ps );
+		return NULL;
+	}
+
+	ps->count = 0;
+
+	return ps;
+}
+
+void destroy_semaphore( platform_semaphore *ps )
+{
+	if ( ps != NULL )
+	{
+		pthread_cond_destroy( &ps->cond );
+		pthread_mutex_destroy( &ps->mutex );
+		free( ps );
+	}
+}
+
+void release_semaphore( platform_semaphore *ps, unsigned long count )
+{
+	pthread_mutex_lock( &ps->mutex );
+	ps->count += count;
+	pthread_mutex_unlock( &ps->mutex );
+
+	if ( count == 1 )
+	{
+		pthread_cond_signal( &ps->cond );
+	}
+	else
+	{
+		pthread_cond_broadcast( &ps->cond );
+	}
+}
+
+void wait_semaphore( platform_semaphore *ps )
+{
+	pthread_mutex_lock( &ps->mutex );
+	while ( ps->count == 0 )
+	{
+		pthread_cond_wait( &ps->cond, &ps->mutex );
+	}
+	--ps->count;
+	pthread_mutex_unlock( &ps->mutex );
+}
+
+static void *run_thread( void *context )
+{
+	platform_thread *pt = ( platform_thread * )context;
+	pt->function( pt->context );
+
+	return NULL;
+}
+
+platform_thread *start_thread( thread_function function, void *context )
+{
+	platform_thread *pt = ( platform_thread * )malloc( sizeof( platform_thread ) );
+	if ( pt == NULL )
+	{
+		return NULL;
+	}
+
+	pt->function = function;
+	pt->context = context;
+	if ( pthread_create( &pt->thread, NULL, run_thread, ( void * )pt ) != 0 )
+	{
+		free( pt );
+		return NULL;
+	}
+
+	return pt;
+}
+
+void join_thread( platform_thread *pt )
+{
+	if ( pt != NULL )
+	{
+		pthread_join( pt->thread, NULL );
+		free( pt );
+	}
+}
+
+platform_directory *open_directory( const wchar_t *path )
+{
+	char *utf8_path = path_to_utf8( path );
+	if ( utf8_path == NULL )
+	{
+		return NULL;
+	}
+
+	DIR *dir = opendir( utf8_path );
+	free( utf8_path );
+
+	if ( dir == NULL )
+	{
+		return NULL;
+	}
+
+	platform_directory *pd = ( platform_directory * )malloc( sizeof( platform_directory ) );
+	if ( pd == NULL )
+	{
+		closedir( dir );
+		return NULL;
+	}
+
+	pd->dir = dir;
+
+	return pd;
+}
+
+bool read_directory( platform_directory *pd, wchar_t *name, size_t name_size, bool *is_directory )
+{
+	struct dirent *de;
+	while ( ( de = readdir( pd->dir ) ) != NULL )
+	{
+		// Names that Windows couldn't have produced are skipped.
+		if ( !utf8_to_name( de->d_name, name, name_size ) )
+		{
+			continue;
+		}
+
+		// Not every file system fills in the type.
+		if ( de->d_type == DT_UNKNOWN )
+		{
+			struct stat st;
+			if ( fstatat( dirfd( pd->dir ), de->d_name, &st, AT_SYMLINK_NOFOLLOW ) != 0 )
+			{
+				continue;
+			}
+
+			*is_directory = S_ISDIR( st.st_mode );
+		}
+		else
+		{
+			*is_directory = ( de->d_type == DT_DIR );
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+void close_directory( platform_directory *pd )
+{
+	if ( pd != NULL )
+	{
+		closedir( pd->dir );
+		free( pd );
+	}
+}
+
+void *compare_exchange_pointer( void * volatile *destination, void *exchange, void *comparand )
+{
+	return __sync_val_compare_and_swap( destination, comparand, exchange );
+}
+
+long long get_performance_counter()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ( ( long long )ts.tv_sec * 1000000000 ) + ts.tv_nsec;
+}
+
+long long get_performance_frequency()
+{
+	return 1000000000;
+}
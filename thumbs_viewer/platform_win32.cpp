@@ -0,0 +1,335 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "platform.h"
+
+#ifndef STRICT
+	#define STRICT
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+	#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <process.h>
+#include <stdlib.h>
+
+struct platform_file
+{
+	HANDLE hFile;
+	HANDLE hMapping;			// NULL unless the file is mapped.
+};
+
+struct platform_lock
+{
+	CRITICAL_SECTION cs;
+};
+
+struct platform_semaphore
+{
+	HANDLE hSemaphore;
+};
+
+struct platform_thread
+{
+	HANDLE hThread;
+	thread_function function;
+	void *context;
+};
+
+struct platform_directory
+{
+	HANDLE hFind;
+	WIN32_FIND_DATA fd;
+	bool found;			// fd holds an entry that hasn't been read yet.
+};
+
+platform_file *open_file_read( const wchar_t *path, unsigned long long *size )
+{
+	HANDLE hFile = CreateFile( path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+	{
+		return NULL;
+	}
+
+	platform_file *pf = ( platform_file * )malloc( sizeof( platform_file ) );
+	if ( pf == NULL )
+	{
+		CloseHandle( hFile );
+		return NULL;
+	}
+
+	pf->hFile = hFile;
+	pf->hMapping = NULL;
+
+	LARGE_INTEGER f_size = { 0 };
+	GetFileSizeEx( hFile, &f_size );
+	*size = f_size.QuadPart;
+
+	return pf;
+}
+
+void close_file( platform_file *pf )
+{
+	if ( pf == NULL )
+	{
+		return;
+	}
+
+	if ( pf->hMapping != NULL )
+	{
+		CloseHandle( pf->hMapping );
+	}
+
+	CloseHandle( pf->hFile );
+	free( pf );
+}
+
+unsigned long read_file_at( platform_file *pf, unsigned long long offset, void *buf, unsigned long length )
+{
+	// The offset in the OVERLAPPED structure is used instead of the file pointer. The handle is still synchronous.
+	OVERLAPPED ol = { 0 };
+	ol.Offset = ( DWORD )offset;
+	ol.OffsetHigh = ( DWORD )( offset >> 32 );
+
+	DWORD read = 0;
+	if ( ReadFile( pf->hFile, buf, length, &read, &ol ) == FALSE )
+	{
+		return 0;	// Reading at or beyond the end of the file fails with ERROR_HANDLE_EOF.
+	}
+
+	return read;
+}
+
+char *map_file( platform_file *pf, unsigned long long size )
+{
+	// Empty files can't be mapped, and 32-bit builds may not have enough address space for very large files.
+	if ( size == 0 || size > ( SIZE_T )-1 || pf->hMapping != NULL )
+	{
+		return NULL;
+	}
+
+	pf->hMapping = CreateFileMapping( pf->hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+	if ( pf->hMapping == NULL )
+	{
+		return NULL;
+	}
+
+	char *view = ( char * )MapViewOfFile( pf->hMapping, FILE_MAP_READ, 0, 0, 0 );
+	if ( view == NULL )
+	{
+		CloseHandle( pf->hMapping );
+		pf->hMapping = NULL;
+	}
+
+	return view;
+}
+
+void unmap_file( platform_file *pf, char *view, unsigned long long /*size*/ )
+{
+	if ( view != NULL )
+	{
+		UnmapViewOfFile( view );
+	}
+
+	if ( pf->hMapping != NULL )
+	{
+		CloseHandle( pf->hMapping );
+		pf->hMapping = NULL;
+	}
+}
+
+platform_lock *create_lock()
+{
+	platform_lock *pl = ( platform_lock * )malloc( sizeof( platform_lock ) );
+	if ( pl != NULL )
+	{
+		InitializeCriticalSection( &pl->cs );
+	}
+
+	return pl;
+}
+
+void destroy_lock( platform_lock *pl )
+{
+	if ( pl != NULL )
+	{
+		DeleteCriticalSection( &pl->cs );
+		free( pl );
+	}
+}
+
+void enter_lock( platform_lock *pl )
+{
+	EnterCriticalSection( &pl->cs );
+}
+
+void leave_lock( platform_lock *pl )
+{
+	LeaveCriticalSection( &pl->cs );
+}
+
+bool try_enter_lock( platform_lock *pl )
+{
+	return ( TryEnterCriticalSection( &pl->cs ) != FALSE );
+}
+
+platform_semaphore *create_semaphore()
+{
+	platform_semaphore *ps = ( platform_semaphore * )malloc( sizeof( platform_semaphore ) );
+	if ( ps != NULL )
+	{
+		ps->hSemaphore = CreateSemaphore( NULL, 0, MAXLONG, NULL );
+		if ( ps->hSemaphore == NULL )
+		{
+			free( ps );
+			ps = NULL;
+		}
+	}
+
+	return ps;
+}
+
+void destroy_semaphore( platform_semaphore *ps )
+{
+	if ( ps != NULL )
+	{
+		CloseHandle( ps->hSemaphore );
+		free( ps );
+	}
+}
+
+void release_semaphore( platform_semaphore *ps, unsigned long count )
+{
+	ReleaseSemaphore( ps->hSemaphore, ( LONG )count, NULL );
+}
+
+void wait_semaphore( platform_semaphore *ps )
+{
+	WaitForSingleObject( ps->hSemaphore, INFINITE );
+}
+
+// _beginthreadex needs a __stdcall function.
+static unsigned __stdcall run_thread( void *pArguments )
+{
+	platform_thread *pt = ( platform_thread * )pArguments;
+	pt->function( pt->context );
+
+	_endthreadex( 0 );
+	return 0;
+}
+
+platform_thread *start_thread( thread_function function, void *context )
+{
+	platform_thread *pt = ( platform_thread * )malloc( sizeof( platform_thread ) );
+	if ( pt == NULL )
+	{
+		return NULL;
+	}
+
+	pt->function = function;
+	pt->context = context;
+	pt->hThread = ( HANDLE )_beginthreadex( NULL, 0, &run_thread, ( void * )pt, 0, NULL );
+	if ( pt->hThread == NULL )
+	{
+		free( pt );
+		return NULL;
+	}
+
+	return pt;
+}
+
+void join_thread( platform_thread *pt )
+{
+	if ( pt != NULL )
+	{
+		WaitForSingleObject( pt->hThread, INFINITE );
+		CloseHandle( pt->hThread );
+		free( pt );
+	}
+}
+
+platform_directory *open_directory( const wchar_t *path )
+{
+	// Search for all files/folders in the directory. Limit the path length to MAX_PATH.
+	wchar_t filepath[ MAX_PATH + 2 ];
+	swprintf_s( filepath, MAX_PATH + 2, L"%.259s\\*", path );
+
+	platform_directory *pd = ( platform_directory * )malloc( sizeof( platform_directory ) );
+	if ( pd == NULL )
+	{
+		return NULL;
+	}
+
+	pd->hFind = FindFirstFileEx( ( LPCWSTR )filepath, FindExInfoStandard, &pd->fd, FindExSearchNameMatch, NULL, 0 );
+	if ( pd->hFind == INVALID_HANDLE_VALUE )
+	{
+		free( pd );
+		return NULL;
+	}
+
+	pd->found = true;	// FindFirstFileEx has already read the first entry.
+
+	return pd;
+}
+
+bool read_directory( platform_directory *pd, wchar_t *name, size_t name_size, bool *is_directory )
+{
+	while ( pd->found || FindNextFile( pd->hFind, &pd->fd ) != 0 )
+	{
+		pd->found = false;
+
+		if ( wcscpy_s( name, name_size, pd->fd.cFileName ) == 0 )
+		{
+			*is_directory = ( ( pd->fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) != 0 );
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void close_directory( platform_directory *pd )
+{
+	if ( pd != NULL )
+	{
+		FindClose( pd->hFind );
+		free( pd );
+	}
+}
+
+void *compare_exchange_pointer( void * volatile *destination, void *exchange, void *comparand )
+{
+	return InterlockedCompareExchangePointer( destination, exchange, comparand );
+}
+
+long long get_performance_counter()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter( &counter );
+
+	return counter.QuadPart;
+}
+
+long long get_performance_frequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency( &frequency );
+
+	return frequency.QuadPart;
+}
@@ -0,0 +1,568 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "png_writer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFLATE_WINDOW_SIZE		32768	// Farthest distance a match can refer back to.
+#define DEFLATE_WINDOW_MASK		( DEFLATE_WINDOW_SIZE - 1 )
+#define DEFLATE_HASH_SIZE		32768	// Number of hash chains. Always a power of 2.
+#define DEFLATE_MIN_MATCH		3
+#define DEFLATE_MAX_MATCH		258
+#define DEFLATE_MAX_STORED		65535	// Largest stored block.
+
+#define FAST_CHAIN_LENGTH		8		// Number of earlier positions that are compared for each match.
+#define BEST_CHAIN_LENGTH		256
+
+// Growable output that's written to a byte or a bit at a time. Bits are packed starting from the least significant bit.
+struct png_buffer
+{
+	unsigned char *data;
+	size_t size;
+	size_t capacity;
+	unsigned long bit_buffer;
+	unsigned char bit_count;
+	bool failed;				// An allocation failed. Everything that's written afterward is ignored.
+};
+
+static const unsigned short length_base[ 29 ] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char length_extra[ 29 ] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distance_base[ 30 ] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distance_extra[ 30 ] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void initialize_png_buffer( png_buffer *pb )
+{
+	pb->data = NULL;
+	pb->size = 0;
+	pb->capacity = 0;
+	pb->bit_buffer = 0;
+	pb->bit_count = 0;
+	pb->failed = false;
+}
+
+static bool reserve( png_buffer *pb, size_t size )
+{
+	if ( pb->failed )
+	{
+		return false;
+	}
+
+	if ( pb->size + size > pb->capacity )
+	{
+		size_t capacity = ( pb->capacity * 2 > pb->size + size ? pb->capacity * 2 : pb->size + size );
+		unsigned char *data = ( unsigned char * )realloc( pb->data, capacity );
+		if ( data == NULL )
+		{
+			pb->failed = true;
+			return false;
+		}
+
+		pb->data = data;
+		pb->capacity = capacity;
+	}
+
+	return true;
+}
+
+static void put_bytes( png_buffer *pb, const void *data, size_t size )
+{
+	if ( size > 0 && reserve( pb, size ) )
+	{
+		memcpy( pb->data + pb->size, data, size );
+		pb->size += size;
+	}
+}
+
+static void put_byte( png_buffer *pb, unsigned char value )
+{
+	if ( reserve( pb, 1 ) )
+	{
+		pb->data[ pb->size++ ] = value;
+	}
+}
+
+static void put_uint32_be( png_buffer *pb, unsigned long value )
+{
+	unsigned char bytes[ 4 ] = { ( unsigned char )( value >> 24 ), ( unsigned char )( value >> 16 ), ( unsigned char )( value >> 8 ), ( unsigned char )value };
+	put_bytes( pb, bytes, 4 );
+}
+
+// count is at most 16.
+static void put_bits( png_buffer *pb, unsigned long value, unsigned char count )
+{
+	pb->bit_buffer |= ( value << pb->bit_count );
+	pb->bit_count += count;
+
+	while ( pb->bit_count >= 8 )
+	{
+		put_byte( pb, ( unsigned char )pb->bit_buffer );
+		pb->bit_buffer >>= 8;
+		pb->bit_count -= 8;
+	}
+}
+
+// Pad to the next byte.
+static void flush_bits( png_buffer *pb )
+{
+	if ( pb->bit_count > 0 )
+	{
+		put_byte( pb, ( unsigned char )pb->bit_buffer );
+	}
+
+	pb->bit_buffer = 0;
+	pb->bit_count = 0;
+}
+
+// Huffman codes are packed starting from their most significant bit.
+static void put_huffman( png_buffer *pb, unsigned long code, unsigned char length )
+{
+	unsigned long reversed = 0;
+	for ( unsigned char i = 0; i < length; ++i )
+	{
+		reversed = ( reversed << 1 ) | ( ( code >> i ) & 1 );
+	}
+
+	put_bits( pb, reversed, length );
+}
+
+// Write a literal/length symbol with the fixed Huffman codes.
+static void put_symbol( png_buffer *pb, unsigned int symbol )
+{
+	if ( symbol < 144 )
+	{
+		put_huffman( pb, 0x30 + symbol, 8 );
+	}
+	else if ( symbol < 256 )
+	{
+		put_huffman( pb, 0x190 + ( symbol - 144 ), 9 );
+	}
+	else if ( symbol < 280 )
+	{
+		put_huffman( pb, symbol - 256, 7 );
+	}
+	else
+	{
+		put_huffman( pb, 0xC0 + ( symbol - 280 ), 8 );
+	}
+}
+
+static void put_match( png_buffer *pb, unsigned int length, unsigned int distance )
+{
+	unsigned char code = 28;
+	while ( length < length_base[ code ] )
+	{
+		--code;
+	}
+
+	put_symbol( pb, 257 + code );
+	put_bits( pb, length - length_base[ code ], length_extra[ code ] );
+
+	code = 29;
+	while ( distance < distance_base[ code ] )
+	{
+		--code;
+	}
+
+	put_huffman( pb, code, 5 );
+	put_bits( pb, distance - distance_base[ code ], distance_extra[ code ] );
+}
+
+static void deflate_stored( png_buffer *pb, const unsigned char *data, size_t size )
+{
+	size_t offset = 0;
+	do
+	{
+		size_t block_size = ( size - offset > DEFLATE_MAX_STORED ? DEFLATE_MAX_STORED : size - offset );
+		bool final = ( offset + block_size == size );
+
+		put_bits( pb, ( final ? 1 : 0 ), 3 );	// BFINAL and BTYPE 00
+		flush_bits( pb );
+
+		put_byte( pb, ( unsigned char )block_size );
+		put_byte( pb, ( unsigned char )( block_size >> 8 ) );
+		put_byte( pb, ( unsigned char )~block_size );
+		put_byte( pb, ( unsigned char )( ~block_size >> 8 ) );
+		put_bytes( pb, data + offset, block_size );
+
+		offset += block_size;
+	}
+	while ( offset < size );
+}
+
+static unsigned long hash_position( const unsigned char *data )
+{
+	return ( ( ( unsigned long )data[ 0 ] << 10 ) ^ ( ( unsigned long )data[ 1 ] << 5 ) ^ data[ 2 ] ) & ( DEFLATE_HASH_SIZE - 1 );
+}
+
+// A single block with the fixed Huffman codes. Matches are found with hash chains, and the longest match is always taken.
+static void deflate_fixed( png_buffer *pb, const unsigned char *data, size_t size, unsigned int max_chain )
+{
+	// Positions are stored plus 1 so that 0 ends a chain.
+	size_t *head = ( size_t * )calloc( DEFLATE_HASH_SIZE, sizeof( size_t ) );
+	size_t *prev = ( size_t * )calloc( DEFLATE_WINDOW_SIZE, sizeof( size_t ) );
+	if ( head == NULL || prev == NULL )
+	{
+		free( head );
+		free( prev );
+
+		pb->failed = true;
+		return;
+	}
+
+	put_bits( pb, 1 | ( 1 << 1 ), 3 );	// BFINAL and BTYPE 01
+
+	size_t position = 0;
+	while ( position < size )
+	{
+		unsigned int best_length = 0;
+		unsigned int best_distance = 0;
+
+		if ( position + DEFLATE_MIN_MATCH <= size )
+		{
+			size_t max_length = ( size - position > DEFLATE_MAX_MATCH ? DEFLATE_MAX_MATCH : size - position );
+
+			unsigned long hash = hash_position( data + position );
+			size_t candidate = head[ hash ];
+			unsigned int chain = max_chain;
+			while ( candidate != 0 && chain-- > 0 )
+			{
+				size_t match = candidate - 1;
+				if ( position - match > DEFLATE_WINDOW_SIZE )
+				{
+					break;
+				}
+
+				unsigned int length = 0;
+				while ( length < max_length && data[ match + length ] == data[ position + length ] )
+				{
+					++length;
+				}
+
+				if ( length > best_length )
+				{
+					best_length = length;
+					best_distance = ( unsigned int )( position - match );
+
+					if ( length == max_length )
+					{
+						break;
+					}
+				}
+
+				// Older positions in the window may have been replaced. A chain only ever moves backward.
+				size_t next = prev[ match & DEFLATE_WINDOW_MASK ];
+				if ( next >= candidate )
+				{
+					break;
+				}
+
+				candidate = next;
+			}
+
+			// Add the current position to its chain.
+			prev[ position & DEFLATE_WINDOW_MASK ] = head[ hash ];
+			head[ hash ] = position + 1;
+		}
+
+		if ( best_length >= DEFLATE_MIN_MATCH )
+		{
+			put_match( pb, best_length, best_distance );
+
+			// Add the positions that the match covers.
+			for ( size_t i = position + 1; i < position + best_length && i + DEFLATE_MIN_MATCH <= size; ++i )
+			{
+				unsigned long hash = hash_position( data + i );
+				prev[ i & DEFLATE_WINDOW_MASK ] = head[ hash ];
+				head[ hash ] = i + 1;
+			}
+
+			position += best_length;
+		}
+		else
+		{
+			put_symbol( pb, data[ position ] );
+			++position;
+		}
+	}
+
+	put_symbol( pb, 256 );	// End of block
+	flush_bits( pb );
+
+	free( head );
+	free( prev );
+}
+
+static unsigned long adler32( const unsigned char *data, size_t size )
+{
+	unsigned long a = 1;
+	unsigned long b = 0;
+
+	while ( size > 0 )
+	{
+		// 5552 is the most bytes that can be summed before b can overflow 32 bits.
+		size_t block_size = ( size > 5552 ? 5552 : size );
+		size -= block_size;
+
+		while ( block_size-- > 0 )
+		{
+			a += *data++;
+			b += a;
+		}
+
+		a %= 65521;
+		b %= 65521;
+	}
+
+	return ( b << 16 ) | a;
+}
+
+static unsigned long crc32( const unsigned long *crc_table, unsigned long crc, const unsigned char *data, size_t size )
+{
+	crc = ~crc & 0xFFFFFFFF;	// long might be larger than 32 bits.
+	while ( size-- > 0 )
+	{
+		crc = crc_table[ ( crc ^ *data++ ) & 0xFF ] ^ ( crc >> 8 );
+	}
+
+	return ~crc & 0xFFFFFFFF;
+}
+
+static void make_crc_table( unsigned long *crc_table )
+{
+	for ( unsigned long n = 0; n < 256; ++n )
+	{
+		unsigned long c = n;
+		for ( unsigned char k = 0; k < 8; ++k )
+		{
+			c = ( c & 1 ? 0xEDB88320 ^ ( c >> 1 ) : c >> 1 );
+		}
+
+		crc_table[ n ] = c;
+	}
+}
+
+static void put_chunk( png_buffer *pb, const unsigned long *crc_table, const char *type, const unsigned char *data, size_t size )
+{
+	put_uint32_be( pb, ( unsigned long )size );
+	put_bytes( pb, type, 4 );
+	put_bytes( pb, data, size );
+
+	unsigned long crc = crc32( crc_table, 0, ( const unsigned char * )type, 4 );
+	crc = crc32( crc_table, crc, data, size );
+	put_uint32_be( pb, crc );
+}
+
+static unsigned char paeth_predictor( unsigned char a, unsigned char b, unsigned char c )
+{
+	int p = a + b - c;
+	int pa = abs( p - a );
+	int pb = abs( p - b );
+	int pc = abs( p - c );
+
+	if ( pa <= pb && pa <= pc )
+	{
+		return a;
+	}
+	else if ( pb <= pc )
+	{
+		return b;
+	}
+
+	return c;
+}
+
+// out receives the filter type followed by the filtered row. prior is NULL for the first row.
+static void filter_row( unsigned char type, const unsigned char *row, const unsigned char *prior, size_t row_size, unsigned char bpp, unsigned char *out )
+{
+	*out++ = type;
+
+	size_t i;
+	switch ( type )
+	{
+		case PNG_FILTER_SUB:
+		{
+			for ( i = 0; i < bpp; ++i )
+			{
+				out[ i ] = row[ i ];
+			}
+			for ( ; i < row_size; ++i )
+			{
+				out[ i ] = ( unsigned char )( row[ i ] - row[ i - bpp ] );
+			}
+		}
+		break;
+
+		case PNG_FILTER_UP:
+		{
+			for ( i = 0; i < row_size; ++i )
+			{
+				out[ i ] = ( unsigned char )( row[ i ] - ( prior != NULL ? prior[ i ] : 0 ) );
+			}
+		}
+		break;
+
+		case PNG_FILTER_AVERAGE:
+		{
+			for ( i = 0; i < row_size; ++i )
+			{
+				unsigned int left = ( i >= bpp ? row[ i - bpp ] : 0 );
+				unsigned int up = ( prior != NULL ? prior[ i ] : 0 );
+				out[ i ] = ( unsigned char )( row[ i ] - ( ( left + up ) >> 1 ) );
+			}
+		}
+		break;
+
+		case PNG_FILTER_PAETH:
+		{
+			for ( i = 0; i < row_size; ++i )
+			{
+				unsigned char left = ( i >= bpp ? row[ i - bpp ] : 0 );
+				unsigned char up = ( prior != NULL ? prior[ i ] : 0 );
+				unsigned char up_left = ( prior != NULL && i >= bpp ? prior[ i - bpp ] : 0 );
+				out[ i ] = ( unsigned char )( row[ i ] - paeth_predictor( left, up, up_left ) );
+			}
+		}
+		break;
+
+		default:
+		{
+			memcpy( out, row, row_size );
+		}
+		break;
+	}
+}
+
+// The sum of the filtered bytes as signed values. Smaller sums tend to compress better.
+static unsigned long long filter_cost( const unsigned char *filtered, size_t row_size )
+{
+	unsigned long long cost = 0;
+	for ( size_t i = 0; i < row_size; ++i )
+	{
+		cost += ( filtered[ i ] < 128 ? filtered[ i ] : 256 - filtered[ i ] );
+	}
+
+	return cost;
+}
+
+unsigned char *encode_png( const unsigned char *pixels, unsigned int width, unsigned int height, int stride, unsigned char channels, unsigned char filter, unsigned char compression, unsigned long *size )
+{
+	if ( pixels == NULL || size == NULL || width == 0 || height == 0 || ( channels != 3 && channels != 4 ) || filter > PNG_FILTER_ADAPTIVE )
+	{
+		return NULL;
+	}
+
+	size_t row_size = ( size_t )width * channels;
+	size_t filtered_size = ( row_size + 1 ) * height;
+
+	// Every row starts with its filter type.
+	unsigned char *filtered = ( unsigned char * )malloc( filtered_size );
+	unsigned char *candidate = ( filter == PNG_FILTER_ADAPTIVE ? ( unsigned char * )malloc( row_size + 1 ) : NULL );
+	if ( filtered == NULL || ( filter == PNG_FILTER_ADAPTIVE && candidate == NULL ) )
+	{
+		free( filtered );
+		free( candidate );
+		return NULL;
+	}
+
+	const unsigned char *prior = NULL;
+	for ( unsigned int row = 0; row < height; ++row )
+	{
+		const unsigned char *current = pixels + ( ( long long )row * stride );
+		unsigned char *out = filtered + ( row * ( row_size + 1 ) );
+
+		if ( filter == PNG_FILTER_ADAPTIVE )
+		{
+			filter_row( PNG_FILTER_NONE, current, prior, row_size, channels, out );
+			unsigned long long best_cost = filter_cost( out + 1, row_size );
+
+			for ( unsigned char type = PNG_FILTER_SUB; type <= PNG_FILTER_PAETH; ++type )
+			{
+				filter_row( type, current, prior, row_size, channels, candidate );
+				unsigned long long cost = filter_cost( candidate + 1, row_size );
+				if ( cost < best_cost )
+				{
+					best_cost = cost;
+					memcpy( out, candidate, row_size + 1 );
+				}
+			}
+		}
+		else
+		{
+			filter_row( filter, current, prior, row_size, channels, out );
+		}
+
+		prior = current;
+	}
+
+	free( candidate );
+
+	// The image data is a zlib stream.
+	png_buffer idat;
+	initialize_png_buffer( &idat );
+	put_byte( &idat, 0x78 );	// Deflate with a 32 KB window.
+	put_byte( &idat, 0x01 );	// No dictionary. The header is a multiple of 31.
+
+	if ( compression == PNG_COMPRESSION_STORE )
+	{
+		deflate_stored( &idat, filtered, filtered_size );
+	}
+	else
+	{
+		deflate_fixed( &idat, filtered, filtered_size, ( compression == PNG_COMPRESSION_BEST ? BEST_CHAIN_LENGTH : FAST_CHAIN_LENGTH ) );
+	}
+
+	put_uint32_be( &idat, adler32( filtered, filtered_size ) );
+
+	free( filtered );
+
+	unsigned long crc_table[ 256 ];
+	make_crc_table( crc_table );
+
+	unsigned char ihdr[ 13 ] = { ( unsigned char )( width >> 24 ), ( unsigned char )( width >> 16 ), ( unsigned char )( width >> 8 ), ( unsigned char )width,
+								 ( unsigned char )( height >> 24 ), ( unsigned char )( height >> 16 ), ( unsigned char )( height >> 8 ), ( unsigned char )height,
+								 8,							// Bit depth
+								 ( unsigned char )( channels == 4 ? 6 : 2 ),	// Color type: 2 = RGB, 6 = RGBA
+								 0,							// Compression method
+								 0,							// Filter method
+								 0 };						// No interlacing
+
+	static const unsigned char signature[ 8 ] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+	png_buffer png;
+	initialize_png_buffer( &png );
+	if ( !idat.failed && reserve( &png, sizeof( signature ) + ( 12 * 3 ) + sizeof( ihdr ) + idat.size ) )
+	{
+		put_bytes( &png, signature, sizeof( signature ) );
+		put_chunk( &png, crc_table, "IHDR", ihdr, sizeof( ihdr ) );
+		put_chunk( &png, crc_table, "IDAT", idat.data, idat.size );
+		put_chunk( &png, crc_table, "IEND", NULL, 0 );
+	}
+
+	free( idat.data );
+
+	if ( png.failed || png.data == NULL )
+	{
+		free( png.data );
+		return NULL;
+	}
+
+	*size = ( unsigned long )png.size;
+	return png.data;
+}
@@ -0,0 +1,42 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Encodes 8 bit RGB and RGBA pixels as a PNG without GDI+. There's no shared state, so any number of threads can encode at once.
+// The same pixels and settings always produce the same bytes.
+
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+// How each row is filtered before it's compressed.
+#define PNG_FILTER_NONE			0
+#define PNG_FILTER_SUB			1
+#define PNG_FILTER_UP			2
+#define PNG_FILTER_AVERAGE		3
+#define PNG_FILTER_PAETH		4
+#define PNG_FILTER_ADAPTIVE		5	// Try every filter on each row and keep the one that's likely to compress best.
+
+// How hard the compressor looks for repeated data.
+#define PNG_COMPRESSION_STORE	0	// No compression.
+#define PNG_COMPRESSION_FAST	1
+#define PNG_COMPRESSION_BEST	2
+
+// pixels are top down rows of RGB (3 channels) or RGBA (4 channels) pixels that are stride bytes apart.
+// Returns the PNG file, or NULL if it couldn't be encoded. size is set to its length. The caller must free it.
+unsigned char *encode_png( const unsigned char *pixels, unsigned int width, unsigned int height, int stride, unsigned char channels, unsigned char filter, unsigned char compression, unsigned long *size );
+
+#endif
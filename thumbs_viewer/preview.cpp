@@ -0,0 +1,212 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "preview.h"
+
+#include <process.h>
+
+unsigned __stdcall preview_thread( void *pArguments )
+{
+	preview_worker *pw = ( preview_worker * )pArguments;
+
+	while ( WaitForSingleObject( pw->wake, INFINITE ) == WAIT_OBJECT_0 )
+	{
+		// Every new request restarts the wait. The newest request is decoded once they stop coming.
+		while ( true )
+		{
+			EnterCriticalSection( &pw->cs );
+
+			if ( pw->quit || ( pw->pending == NULL && pw->prefetch_count == 0 ) )
+			{
+				LeaveCriticalSection( &pw->cs );
+				break;
+			}
+
+			fileinfo *fi = NULL;
+			bool prefetch = false;
+
+			DWORD elapsed = GetTickCount() - pw->request_time;
+			if ( pw->pending != NULL && elapsed >= PREVIEW_DEBOUNCE )
+			{
+				fi = pw->pending;
+				pw->pending = NULL;
+			}
+			else if ( pw->prefetch_count > 0 )	// Use the time that we'd otherwise spend waiting.
+			{
+				fi = pw->prefetch[ 0 ];
+				prefetch = true;
+
+				--pw->prefetch_count;
+				memmove_s( pw->prefetch, sizeof( fileinfo * ) * PREVIEW_PREFETCH, pw->prefetch + 1, sizeof( fileinfo * ) * pw->prefetch_count );
+			}
+			else
+			{
+				LeaveCriticalSection( &pw->cs );
+				WaitForSingleObject( pw->wake, PREVIEW_DEBOUNCE - elapsed );
+				continue;
+			}
+
+			unsigned long generation = ( unsigned long )pw->generation;
+			unsigned long epoch = ( unsigned long )pw->epoch;
+
+			// Hold the decode lock before the request can be cancelled. cancel_preview will wait for us to finish with the entry.
+			EnterCriticalSection( &pw->decode_cs );
+			LeaveCriticalSection( &pw->cs );
+
+			pw->decode( fi, generation, epoch, prefetch, pw->context );
+
+			LeaveCriticalSection( &pw->decode_cs );
+		}
+
+		if ( pw->quit )
+		{
+			break;
+		}
+	}
+
+	_endthreadex( 0 );
+	return 0;
+}
+
+bool start_preview_worker( preview_worker *pw, preview_decoder decode, void *context )
+{
+	InitializeCriticalSection( &pw->cs );
+	InitializeCriticalSection( &pw->decode_cs );
+	pw->decode = decode;
+	pw->context = context;
+	pw->pending = NULL;
+	pw->prefetch_count = 0;
+	pw->request_time = 0;
+	pw->generation = 0;
+	pw->epoch = 0;
+	pw->quit = false;
+
+	pw->wake = CreateEvent( NULL, FALSE, FALSE, NULL );
+	pw->thread = ( pw->wake != NULL ? ( HANDLE )_beginthreadex( NULL, 0, &preview_thread, ( void * )pw, 0, NULL ) : NULL );
+
+	if ( pw->thread == NULL )
+	{
+		if ( pw->wake != NULL )
+		{
+			CloseHandle( pw->wake );
+			pw->wake = NULL;
+		}
+
+		DeleteCriticalSection( &pw->decode_cs );
+		DeleteCriticalSection( &pw->cs );
+
+		return false;
+	}
+
+	return true;
+}
+
+// If this is called from a thread that owns a window, then it'll continue to handle sent messages while it waits.
+// The decoder may be showing a message box that's owned by one of our windows.
+void stop_preview_worker( preview_worker *pw )
+{
+	if ( pw->thread == NULL )
+	{
+		return;
+	}
+
+	EnterCriticalSection( &pw->cs );
+	pw->quit = true;
+	pw->pending = NULL;
+	pw->prefetch_count = 0;
+	InterlockedIncrement( &pw->generation );
+	LeaveCriticalSection( &pw->cs );
+
+	SetEvent( pw->wake );
+
+	while ( MsgWaitForMultipleObjects( 1, &pw->thread, FALSE, INFINITE, QS_SENDMESSAGE ) == WAIT_OBJECT_0 + 1 )
+	{
+		MSG msg;
+		PeekMessage( &msg, NULL, 0, 0, PM_NOREMOVE );	// Dispatches any sent messages.
+	}
+
+	CloseHandle( pw->thread );
+	pw->thread = NULL;
+	CloseHandle( pw->wake );
+	pw->wake = NULL;
+
+	DeleteCriticalSection( &pw->decode_cs );
+	DeleteCriticalSection( &pw->cs );
+}
+
+unsigned long request_preview( preview_worker *pw, fileinfo *fi )
+{
+	if ( pw->thread == NULL )
+	{
+		return 0;
+	}
+
+	EnterCriticalSection( &pw->cs );
+	pw->pending = fi;
+	pw->request_time = GetTickCount();
+	unsigned long generation = ( unsigned long )InterlockedIncrement( &pw->generation );
+	LeaveCriticalSection( &pw->cs );
+
+	SetEvent( pw->wake );
+
+	return generation;
+}
+
+void prefetch_previews( preview_worker *pw, fileinfo **entries, unsigned long count )
+{
+	if ( pw->thread == NULL )
+	{
+		return;
+	}
+
+	EnterCriticalSection( &pw->cs );
+	pw->prefetch_count = min( count, ( unsigned long )PREVIEW_PREFETCH );
+	memcpy_s( pw->prefetch, sizeof( fileinfo * ) * PREVIEW_PREFETCH, entries, sizeof( fileinfo * ) * pw->prefetch_count );
+	LeaveCriticalSection( &pw->cs );
+
+	SetEvent( pw->wake );
+}
+
+void cancel_preview( preview_worker *pw )
+{
+	if ( pw->thread == NULL )
+	{
+		return;
+	}
+
+	EnterCriticalSection( &pw->cs );
+	pw->pending = NULL;
+	pw->prefetch_count = 0;
+	InterlockedIncrement( &pw->generation );
+	InterlockedIncrement( &pw->epoch );
+	LeaveCriticalSection( &pw->cs );
+
+	// Wait for any decode that's in progress.
+	EnterCriticalSection( &pw->decode_cs );
+	LeaveCriticalSection( &pw->decode_cs );
+}
+
+bool is_preview_current( preview_worker *pw, unsigned long generation )
+{
+	return ( ( unsigned long )pw->generation == generation );
+}
+
+bool is_preview_epoch_current( preview_worker *pw, unsigned long epoch )
+{
+	return ( ( unsigned long )pw->epoch == epoch );
+}
@@ -0,0 +1,82 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Decodes the image preview in a worker thread. Only the newest request is decoded, and only after no new request has arrived for PREVIEW_DEBOUNCE milliseconds.
+// Holding down an arrow key in the list therefore decodes one image instead of every image it passes.
+// While the worker has no request, or is waiting for the requests to stop, it decodes the entries that are likely to be selected next.
+// There's no dependency on the GUI. The decoder is a callback that's responsible for handing off its result.
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#ifndef STRICT
+	#define STRICT
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+	#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include "read_thumbs.h"
+
+#define PREVIEW_DEBOUNCE	50	// Milliseconds without a new request before the newest one is decoded.
+#define PREVIEW_PREFETCH	5	// Maximum number of entries that can be prefetched.
+
+// Called from the worker thread. generation can be passed to is_preview_current to see if the request has been replaced or cancelled.
+// epoch can be passed to is_preview_epoch_current to see if the entry might have been freed.
+// prefetch is set if the entry hasn't been requested, but is likely to be.
+typedef void ( *preview_decoder )( fileinfo *fi, unsigned long generation, unsigned long epoch, bool prefetch, void *context );
+
+struct preview_worker
+{
+	CRITICAL_SECTION cs;			// Guards the request.
+	CRITICAL_SECTION decode_cs;		// Held while a request is being decoded.
+	HANDLE wake;					// Signaled when there's a new request, or when the worker should exit.
+	HANDLE thread;					// NULL if the worker isn't running.
+	preview_decoder decode;
+	void *context;
+	fileinfo *pending;				// The newest request. NULL if there's nothing to decode.
+	fileinfo *prefetch[ PREVIEW_PREFETCH ];	// Entries to decode when there's nothing else to do. The first is decoded first.
+	unsigned long prefetch_count;
+	DWORD request_time;				// Tick count of the newest request.
+	volatile LONG generation;		// Incremented by every request and cancellation.
+	volatile LONG epoch;			// Incremented by every cancellation.
+	bool quit;
+};
+
+bool start_preview_worker( preview_worker *pw, preview_decoder decode, void *context );
+void stop_preview_worker( preview_worker *pw );
+
+// Replaces any request that hasn't been decoded. Returns the request's generation.
+// If fi is NULL, then the pending request is dropped without waiting for the one being decoded.
+unsigned long request_preview( preview_worker *pw, fileinfo *fi );
+
+// Replaces the entries that are waiting to be prefetched.
+void prefetch_previews( preview_worker *pw, fileinfo **entries, unsigned long count );
+
+// Drops any request or prefetch that hasn't been decoded, and waits for the one being decoded to finish. Entries can be freed afterward.
+void cancel_preview( preview_worker *pw );
+
+// See if a request is still the newest one.
+bool is_preview_current( preview_worker *pw, unsigned long generation );
+
+// See if there's been no cancellation since the entry was decoded. Its fileinfo is still valid if so.
+bool is_preview_epoch_current( preview_worker *pw, unsigned long epoch );
+
+#endif
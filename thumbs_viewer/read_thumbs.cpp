@@ -17,241 +17,1080 @@
 */
 
 #include "read_thumbs.h"
-#include "globals.h"
-#include "utilities.h"
+#include "hash_index.h"
+#include "pixel_convert.h"
 
-unsigned long msat_size = 0;
-unsigned long sat_size = 0;
-unsigned long ssat_size = 0;
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-long *g_msat = NULL;
+void ( *g_error_callback )( const char *message ) = NULL;	// Receives any error messages. They're ignored if this is NULL.
 
-// Extract the file from the SAT or short stream container.
-char *extract( fileinfo *fi, unsigned long &size, unsigned long &header_offset )
+bool g_kill_thread = false;			// Allow for a clean shutdown.
+
+unsigned long long g_short_stream_budget = SHORT_STREAM_BUDGET;	// Maximum number of bytes that short stream pages can use.
+
+platform_lock *short_stream_lock = NULL;			// Guards the page list and every database's page array.
+short_stream_page *short_stream_head = NULL;		// Most recently used page.
+short_stream_page *short_stream_tail = NULL;		// Least recently used page.
+unsigned long long short_stream_used = 0;			// Number of bytes held by all pages.
+
+void report_error( const char *message )
 {
-	char *buf = NULL;
+	if ( g_error_callback != NULL )
+	{
+		g_error_callback( message );
+	}
+}
+
+// Stream names are entry numbers with their digits reversed. The stream for entry 10 is named "01".
+// Returns false if the name isn't one that an entry number would produce.
+bool parse_stream_number( const wchar_t *name, unsigned long &number )
+{
+	if ( name == NULL )
+	{
+		return false;
+	}
+
+	unsigned long long value = 0;
+	unsigned long long place = 1;
+	int length = 0;
+
+	for ( ; name[ length ] != L'\0'; ++length )
+	{
+		if ( length == 10 || name[ length ] < L'0' || name[ length ] > L'9' )
+		{
+			return false;
+		}
+
+		value += ( name[ length ] - L'0' ) * place;
+		place *= 10;
+	}
+
+	// Entry numbers don't have leading zeros, so the last character can only be 0 if it's the only one.
+	if ( length == 0 || value > 0xFFFFFFFF || ( length > 1 && name[ length - 1 ] == L'0' ) )
+	{
+		return false;
+	}
+
+	number = ( unsigned long )value;
+
+	return true;
+}
+
+// Allocations are aligned to 8 bytes.
+void *arena_alloc( arena *a, size_t size )
+{
+	if ( a == NULL )
+	{
+		return NULL;
+	}
+
+	size = ( size + 7 ) & ~( ( size_t )7 );
+
+	arena_block *block = a->head;
+	if ( block == NULL || block->size - block->used < size )
+	{
+		size_t block_size = ( size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE );
+
+		// The block header and its data are allocated together.
+		block = ( arena_block * )malloc( sizeof( arena_block ) + block_size );
+		if ( block == NULL )
+		{
+			return NULL;
+		}
+
+		block->data = ( char * )( block + 1 );
+		block->size = block_size;
+		block->used = 0;
+
+		// Keep allocating from the current block if the new one was only made for a large allocation.
+		if ( a->head != NULL && block_size > ARENA_BLOCK_SIZE )
+		{
+			block->next = a->head->next;
+			a->head->next = block;
+		}
+		else
+		{
+			block->next = a->head;
+			a->head = block;
+		}
+	}
+
+	void *ptr = block->data + block->used;
+	block->used += size;
+	a->total += size;
+
+	return ptr;
+}
+
+wchar_t *arena_wcsdup( arena *a, const wchar_t *string )
+{
+	if ( string == NULL )
+	{
+		return NULL;
+	}
+
+	size_t length = wcslen( string ) + 1;
+	wchar_t *copy = ( wchar_t * )arena_alloc( a, sizeof( wchar_t ) * length );
+	if ( copy != NULL )
+	{
+		wmemcpy_s( copy, length, string, length );
+	}
+
+	return copy;
+}
+
+void arena_release( arena *a )
+{
+	if ( a == NULL )
+	{
+		return;
+	}
+
+	while ( a->head != NULL )
+	{
+		arena_block *del = a->head;
+		a->head = a->head->next;
+		free( del );
+	}
+
+	a->total = 0;
+}
+
+bool initialize_short_stream_cache()
+{
+	short_stream_lock = create_lock();
+
+	return ( short_stream_lock != NULL );
+}
+
+void uninitialize_short_stream_cache()
+{
+	destroy_lock( short_stream_lock );
+	short_stream_lock = NULL;
+}
+
+// Must be called from within short_stream_lock.
+void unlink_short_stream_page( short_stream_page *ssp )
+{
+	if ( ssp->prev != NULL )
+	{
+		ssp->prev->next = ssp->next;
+	}
+	else
+	{
+		short_stream_head = ssp->next;
+	}
+
+	if ( ssp->next != NULL )
+	{
+		ssp->next->prev = ssp->prev;
+	}
+	else
+	{
+		short_stream_tail = ssp->prev;
+	}
+
+	ssp->prev = NULL;
+	ssp->next = NULL;
+}
+
+// Must be called from within short_stream_lock.
+void link_short_stream_page( short_stream_page *ssp )
+{
+	ssp->prev = NULL;
+	ssp->next = short_stream_head;
+
+	if ( short_stream_head != NULL )
+	{
+		short_stream_head->prev = ssp;
+	}
+	else
+	{
+		short_stream_tail = ssp;
+	}
+
+	short_stream_head = ssp;
+}
+
+// Remove a database's pages from the cache.
+void free_short_stream_pages( shared_info *si )
+{
+	if ( si->short_stream_pages != NULL )
+	{
+		unsigned long page_count = ( si->short_stream_length + SHORT_STREAM_PAGE_SIZE - 1 ) / SHORT_STREAM_PAGE_SIZE;
+
+		enter_lock( short_stream_lock );
+
+		for ( unsigned long i = 0; i < page_count; ++i )
+		{
+			short_stream_page *ssp = si->short_stream_pages[ i ];
+			if ( ssp != NULL )
+			{
+				unlink_short_stream_page( ssp );
+				short_stream_used -= ssp->length;
+				free( ssp );
+			}
+		}
+
+		leave_lock( short_stream_lock );
+
+		free( si->short_stream_pages );
+		si->short_stream_pages = NULL;
+	}
+
+	free( si->short_stream_map );
+	si->short_stream_map = NULL;
+}
+
+void cleanup_shared_info( shared_info **si )
+{
+	arena_release( &( *si )->entry_arena );
+	free( ( *si )->diagnostics );
+	close_database_reader( &( *si )->reader );
+	free_short_stream_pages( *si );
+	free( ( *si )->ssat );
+	free( ( *si )->sat );
+	free( *si );
+	*si = NULL;
+}
+
+// Free an entry. The shared information is freed along with the last entry of its database.
+void free_fileinfo( fileinfo *fi )
+{
+	if ( fi == NULL )
+	{
+		return;
+	}
+
+	free( fi->map );
+
+	// The entry and its filename live in the database's arena. They're released along with the last entry.
+	shared_info *si = fi->si;
+	if ( si != NULL )
+	{
+		--( si->count );
+
+		// Remove our shared information if there's no more items for this database.
+		if ( si->count == 0 )
+		{
+			cleanup_shared_info( &si );
+		}
+	}
+}
+
+// Open the database and map it into memory.
+// If the mapping fails, then the file is read at each offset instead.
+bool open_database_reader( database_reader *dr, wchar_t *filepath )
+{
+	if ( dr == NULL )
+	{
+		return false;
+	}
+
+	dr->view = NULL;
+	dr->cache = NULL;
+	dr->size = 0;
+	dr->cache_hits = 0;
+	dr->cache_misses = 0;
+
+	dr->file = open_file_read( filepath, &dr->size );
+	if ( dr->file == NULL )
+	{
+		return false;
+	}
+
+	dr->view = map_file( dr->file, dr->size );
+
+	return true;
+}
+
+void close_database_reader( database_reader *dr )
+{
+	if ( dr == NULL )
+	{
+		return;
+	}
+
+	if ( dr->file != NULL )
+	{
+		unmap_file( dr->file, dr->view, dr->size );
+		dr->view = NULL;
+
+		close_file( dr->file );
+		dr->file = NULL;
+	}
+
+	if ( dr->cache != NULL )
+	{
+		destroy_lock( dr->cache->lock );
+		free( dr->cache->data );
+		free( dr->cache );
+		dr->cache = NULL;
+	}
+}
+
+// Databases that are read through their handle get a small cache of recently read sectors.
+// Mapped databases don't need one since the system already caches their pages.
+void create_sector_cache( database_reader *dr, unsigned short sect_size )
+{
+	if ( dr == NULL || dr->view != NULL || dr->cache != NULL )
+	{
+		return;
+	}
+
+	// Without a cache, every sector is read from the file.
+	sector_cache *sc = ( sector_cache * )malloc( sizeof( sector_cache ) );
+	if ( sc == NULL )
+	{
+		return;
+	}
+
+	sc->data = ( char * )malloc( sizeof( char ) * SECTOR_CACHE_SIZE * sect_size );
+	if ( sc->data == NULL )
+	{
+		free( sc );
+		return;
+	}
+
+	sc->lock = create_lock();
+	if ( sc->lock == NULL )
+	{
+		free( sc->data );
+		free( sc );
+		return;
+	}
+
+	sc->clock = 0;
+	sc->used = 0;
+	sc->sect_size = sect_size;
+
+	for ( unsigned long i = 0; i < SECTOR_CACHE_SIZE; ++i )
+	{
+		sc->entries[ i ].offset = 0;
+		sc->entries[ i ].last_used = 0;
+		sc->entries[ i ].length = 0;
+		sc->entries[ i ].data = sc->data + ( i * sect_size );
+	}
+
+	dr->cache = sc;
+}
+
+// Copy length bytes at offset into buf. Returns the number of bytes that were read.
+unsigned long read_database( database_reader *dr, unsigned long long offset, void *buf, unsigned long length )
+{
+	unsigned long read = 0;
+
+	if ( dr->view != NULL )
+	{
+		// Don't read past the end of the mapping.
+		if ( offset < dr->size )
+		{
+			read = ( unsigned long )( dr->size - offset < length ? dr->size - offset : length );
+			memcpy_s( buf, length, dr->view + offset, read );
+		}
+	}
+	else
+	{
+		// Each read has its own offset, so threads that read from this database don't need to wait on each other.
+		read = read_file_at( dr->file, offset, buf, length );
+	}
+
+	return read;
+}
+
+// Same as read_database, but the sector at offset is kept in the sector cache if there is one.
+// offset must be the start of a sector and length must be no greater than the sector size.
+unsigned long read_database_sector( database_reader *dr, unsigned long long offset, void *buf, unsigned long length )
+{
+	sector_cache *sc = dr->cache;
+
+	if ( sc == NULL || length > sc->sect_size )
+	{
+		return read_database( dr, offset, buf, length );
+	}
+
+	enter_lock( sc->lock );
+
+	++sc->clock;
+
+	// Find the sector, or the least recently used entry if it's not in the cache.
+	sector_cache_entry *sce = NULL;
+	for ( unsigned long i = 0; i < sc->used; ++i )
+	{
+		if ( sc->entries[ i ].offset == offset )
+		{
+			sce = &sc->entries[ i ];
+			break;
+		}
+	}
+
+	if ( sce != NULL )
+	{
+		++dr->cache_hits;
+	}
+	else
+	{
+		++dr->cache_misses;
+
+		if ( sc->used < SECTOR_CACHE_SIZE )
+		{
+			sce = &sc->entries[ sc->used++ ];
+		}
+		else
+		{
+			sce = &sc->entries[ 0 ];
+			for ( unsigned long i = 1; i < SECTOR_CACHE_SIZE; ++i )
+			{
+				if ( sc->entries[ i ].last_used < sce->last_used )
+				{
+					sce = &sc->entries[ i ];
+				}
+			}
+		}
+
+		sce->offset = offset;
+		sce->length = read_database( dr, offset, sce->data, sc->sect_size );
+	}
+
+	sce->last_used = sc->clock;
+
+	unsigned long read = ( sce->length < length ? sce->length : length );
+	memcpy_s( buf, length, sce->data, read );
+
+	leave_lock( sc->lock );
+
+	return read;
+}
+
+// Returns a pointer to length bytes at offset within the mapped view.
+// NULL is returned if the database isn't mapped or if the range extends beyond the end of the file.
+char *view_database( database_reader *dr, unsigned long long offset, unsigned long length )
+{
+	if ( dr->view == NULL || offset > dr->size || length > dr->size - offset )
+	{
+		return NULL;
+	}
+
+	return dr->view + offset;
+}
+
+// The header takes up the first sector. Version 4 databases can be larger than 4 GB, so the offset is 64-bit.
+unsigned long long get_sector_offset( unsigned short sect_size, long index )
+{
+	return ( unsigned long long )sect_size + ( ( unsigned long long )index * sect_size );
+}
+
+bool create_chain_validator( chain_validator *cv, shared_info *si )
+{
+	cv->sat_count = si->num_sat_sects * ( si->sect_size / sizeof( int32_t ) );
+	cv->ssat_count = si->num_ssat_sects * ( si->sect_size / sizeof( int32_t ) );
+	cv->sat_visited = ( unsigned char * )malloc( sizeof( unsigned char ) * ( ( cv->sat_count + 7 ) / 8 ) + 1 );
+	cv->ssat_visited = ( unsigned char * )malloc( sizeof( unsigned char ) * ( ( cv->ssat_count + 7 ) / 8 ) + 1 );
+	cv->diagnostics = NULL;
+	cv->diagnostic_count = 0;
+
+	if ( cv->sat_visited == NULL || cv->ssat_visited == NULL )
+	{
+		free( cv->sat_visited );
+		free( cv->ssat_visited );
+		return false;
+	}
+
+	memset( cv->sat_visited, 0, sizeof( unsigned char ) * ( ( cv->sat_count + 7 ) / 8 ) + 1 );
+	memset( cv->ssat_visited, 0, sizeof( unsigned char ) * ( ( cv->ssat_count + 7 ) / 8 ) + 1 );
+
+	return true;
+}
+
+// The diagnostics are kept. They're handed to the shared_info if the database has entries.
+void free_chain_validator( chain_validator *cv )
+{
+	free( cv->sat_visited );
+	free( cv->ssat_visited );
+	cv->sat_visited = NULL;
+	cv->ssat_visited = NULL;
+}
+
+// Follow a chain and mark each of its sectors as visited.
+// If max_sects is 0, then the chain is followed until it terminates. Otherwise, it must have at least max_sects sectors.
+// Returns the number of sectors that can be used. Anything less than max_sects means the chain was rejected.
+unsigned long validate_chain( chain_validator *cv, shared_info *si, long first_sect, bool short_stream, unsigned long max_sects )
+{
+	int32_t *table = ( short_stream ? si->ssat : si->sat );
+	unsigned char *visited = ( short_stream ? cv->ssat_visited : cv->sat_visited );
+	unsigned long table_count = ( short_stream ? cv->ssat_count : cv->sat_count );
+
+	if ( table == NULL || visited == NULL )
+	{
+		return 0;
+	}
+
+	unsigned char problem = 0;
+	unsigned long count = 0;
+	long index = first_sect;
+
+	while ( max_sects == 0 || count < max_sects )
+	{
+		if ( index < 0 )
+		{
+			if ( index != -2 )
+			{
+				problem = CHAIN_BAD_TERMINATION;
+			}
+			else if ( max_sects != 0 )
+			{
+				problem = CHAIN_TOO_SHORT;
+			}
+
+			break;
+		}
+
+		if ( ( unsigned long )index >= table_count )
+		{
+			problem = CHAIN_OUT_OF_RANGE;
+			break;
+		}
+
+		if ( visited[ index >> 3 ] & ( 1 << ( index & 7 ) ) )
+		{
+			// See whether the sector was visited by this chain or by another one.
+			problem = CHAIN_CROSS_LINKED;
+
+			long temp_index = first_sect;
+			for ( unsigned long i = 0; i < count; ++i )
+			{
+				if ( temp_index == index )
+				{
+					problem = CHAIN_CYCLE;
+					break;
+				}
+
+				temp_index = table[ temp_index ];
+			}
+
+			break;
+		}
+
+		visited[ index >> 3 ] |= ( 1 << ( index & 7 ) );
+		++count;
+
+		index = table[ index ];
+	}
+
+	if ( problem != 0 )
+	{
+		if ( cv->diagnostic_count < CHAIN_DIAGNOSTIC_LIMIT )
+		{
+			// Only try once so that the diagnostics always start with the first problem.
+			if ( cv->diagnostics == NULL && cv->diagnostic_count == 0 )
+			{
+				cv->diagnostics = ( chain_diagnostic * )malloc( sizeof( chain_diagnostic ) * CHAIN_DIAGNOSTIC_LIMIT );
+			}
+
+			// The problem is still counted if there's no room to describe it.
+			if ( cv->diagnostics != NULL )
+			{
+				chain_diagnostic *cd = &cv->diagnostics[ cv->diagnostic_count ];
+				cd->first_sect = first_sect;
+				cd->sect = index;
+				cd->position = count;
+				cd->problem = problem;
+				cd->short_stream = short_stream;
+			}
+		}
+
+		++cv->diagnostic_count;
+	}
+
+	return count;
+}
+
+// Summarize the problems that were found in a database's sector chains.
+void report_chain_diagnostics( chain_validator *cv )
+{
+	if ( cv->diagnostic_count == 0 || cv->diagnostics == NULL )
+	{
+		return;
+	}
+
+	const char *problem;
+	switch ( cv->diagnostics[ 0 ].problem )
+	{
+		case CHAIN_OUT_OF_RANGE:	{ problem = "has an index that's out of bounds"; } break;
+		case CHAIN_CYCLE:			{ problem = "loops back on itself"; } break;
+		case CHAIN_CROSS_LINKED:	{ problem = "is linked into another chain"; } break;
+		case CHAIN_BAD_TERMINATION:	{ problem = "has an invalid termination index"; } break;
+		default:					{ problem = "ends before its stream does"; } break;
+	}
+
+	char msg[ 256 ] = { 0 };
+	sprintf_s( msg, 256, "%lu sector chain%s could not be used. The first is the %s chain starting at sector %ld, which %s at index %ld.",
+			   cv->diagnostic_count, ( cv->diagnostic_count > 1 ? "s" : "" ),
+			   ( cv->diagnostics[ 0 ].short_stream ? "Short SAT" : "SAT" ), cv->diagnostics[ 0 ].first_sect, problem, cv->diagnostics[ 0 ].sect );
+
+	report_error( msg );
+}
+
+// Follow a stream's sector chain and combine adjacent sectors into extents.
+// The tables are made of 2^SECT_SHIFT byte sectors, so the sector arithmetic is done with constants.
+// Short streams are chained in the Short SAT and their 64 byte sectors are in the short stream container.
+template < unsigned char SECT_SHIFT, bool SHORT_STREAM >
+stream_map *map_chain( shared_info *si, long first_sect, unsigned long length )
+{
+	int32_t *table = ( SHORT_STREAM ? si->ssat : si->sat );
+	if ( table == NULL )
+	{
+		return NULL;
+	}
+
+	const unsigned long sect_size = ( SHORT_STREAM ? 64 : ( 1 << SECT_SHIFT ) );
+	const unsigned long table_count = ( SHORT_STREAM ? si->num_ssat_sects : si->num_sat_sects ) << ( SECT_SHIFT - 2 );	// 4 byte indices.
+
+	unsigned long capacity = 8;
+	stream_map *sm = ( stream_map * )malloc( sizeof( stream_map ) + ( sizeof( stream_extent ) * ( capacity - 1 ) ) );
+	if ( sm == NULL )
+	{
+		return NULL;
+	}
+
+	sm->error = NULL;
+	sm->count = 0;
+	sm->length = 0;
+
+	long index = first_sect;
+	while ( sm->length < length )
+	{
+		// The chain should terminate with -2, but we shouldn't get here before the stream has been covered.
+		if ( index < 0 )
+		{
+			sm->error = ( SHORT_STREAM ? "Invalid Short SAT termination index." : "Invalid SAT termination index." );
+			break;
+		}
+
+		// Each index should be less than the size of its table.
+		if ( ( unsigned long )index >= table_count )
+		{
+			sm->error = ( SHORT_STREAM ? "Short SAT index out of bounds." : "SAT index out of bounds." );
+			break;
+		}
+
+		// The header takes up the first sector of the database.
+		unsigned long long offset = ( SHORT_STREAM ? ( ( unsigned long long )index << 6 ) : ( ( ( unsigned long long )index + 1 ) << SECT_SHIFT ) );
+		unsigned long bytes = ( length - sm->length < sect_size ? length - sm->length : sect_size );
+
+		// Short sectors can't extend beyond the end of the short stream container.
+		if ( SHORT_STREAM && ( offset > si->short_stream_length || bytes > si->short_stream_length - offset ) )
+		{
+			sm->error = "Short SAT index out of bounds.";
+			break;
+		}
+
+		stream_extent *last = ( sm->count > 0 ? &sm->extents[ sm->count - 1 ] : NULL );
+		if ( last != NULL && last->offset + last->length == offset )
+		{
+			last->length += bytes;
+		}
+		else
+		{
+			if ( sm->count == capacity )
+			{
+				capacity *= 2;
+				stream_map *larger = ( stream_map * )realloc( sm, sizeof( stream_map ) + ( sizeof( stream_extent ) * ( capacity - 1 ) ) );
+				if ( larger == NULL )
+				{
+					free( sm );
+					return NULL;
+				}
+
+				sm = larger;
+			}
+
+			sm->extents[ sm->count ].offset = offset;
+			sm->extents[ sm->count ].length = bytes;
+			sm->extents[ sm->count ].position = sm->length;
+			++sm->count;
+		}
+
+		sm->length += bytes;
+
+		index = table[ index ];
+	}
+
+	return sm;
+}
+
+// The sector size is either 512 (Version 3) or 4096 (Version 4) bytes.
+stream_map *map_stream( shared_info *si, long first_sect, unsigned long length, bool short_stream )
+{
+	if ( si->sect_size == 4096 )
+	{
+		return ( short_stream ? map_chain< 12, true >( si, first_sect, length ) : map_chain< 12, false >( si, first_sect, length ) );
+	}
+	else
+	{
+		return ( short_stream ? map_chain< 9, true >( si, first_sect, length ) : map_chain< 9, false >( si, first_sect, length ) );
+	}
+}
+
+// Find the extent that holds offset within a stream. The extents are in stream order.
+unsigned long find_extent( stream_map *sm, unsigned long offset )
+{
+	unsigned long low = 0, high = sm->count;
+	while ( high - low > 1 )
+	{
+		unsigned long middle = low + ( ( high - low ) / 2 );
+		if ( sm->extents[ middle ].position <= offset )
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+// Copy length bytes starting at offset within a stream into buf. Returns the number of bytes that were copied.
+unsigned long read_stream_range( database_reader *dr, stream_map *sm, unsigned long offset, char *buf, unsigned long length )
+{
+	unsigned long total = 0;
+
+	for ( unsigned long i = find_extent( sm, offset ); i < sm->count && total < length; ++i )
+	{
+		stream_extent *se = &sm->extents[ i ];
+
+		unsigned long start = ( offset + total ) - se->position;
+		if ( start >= se->length )
+		{
+			break;
+		}
+
+		unsigned long bytes_to_read = ( se->length - start < length - total ? se->length - start : length - total );
+		unsigned long read = read_database( dr, se->offset + start, buf + total, bytes_to_read );
+		total += read;
+
+		if ( read < bytes_to_read )
+		{
+			break;
+		}
+	}
 
-	if ( fi == NULL || ( fi != NULL && fi->si == NULL ) )
+	return total;
+}
+
+// Copy length bytes at offset within a database's short stream container into buf. Returns the number of bytes that were copied.
+// Mapped databases are read directly. Otherwise, the container is read a page at a time and the pages are kept within g_short_stream_budget.
+unsigned long read_short_stream( database_reader *dr, shared_info *si, unsigned long offset, char *buf, unsigned long length )
+{
+	if ( si->short_stream_pages == NULL )
 	{
-		return NULL;
+		return read_stream_range( dr, si->short_stream_map, offset, buf, length );
 	}
 
-	if ( fi->entry_type == 2 )
+	unsigned long total = 0;
+
+	enter_lock( short_stream_lock );
+
+	while ( total < length )
 	{
-		// See if the stream is in the SAT.
-		if ( fi->size >= fi->si->short_sect_cutoff && fi->si->sat != NULL )
-		{
-			DWORD read = 0, total = 0;
-			long sat_index = fi->offset; 
-			unsigned long sector_offset = fi->si->sect_size + ( sat_index * fi->si->sect_size );
-			unsigned long bytes_to_read = fi->si->sect_size;
+		unsigned long page_index = ( offset + total ) / SHORT_STREAM_PAGE_SIZE;
+		unsigned long page_offset = ( offset + total ) % SHORT_STREAM_PAGE_SIZE;
 
-			bool exit_extract = false;
+		short_stream_page *ssp = si->short_stream_pages[ page_index ];
+		if ( ssp == NULL )
+		{
+			unsigned long page_length = si->short_stream_length - ( page_index * SHORT_STREAM_PAGE_SIZE );
+			if ( page_length > SHORT_STREAM_PAGE_SIZE )
+			{
+				page_length = SHORT_STREAM_PAGE_SIZE;
+			}
 
-			// Attempt to open a file for reading.
-			HANDLE hFile = CreateFile( fi->si->dbpath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
-			if ( hFile == INVALID_HANDLE_VALUE )
+			ssp = ( short_stream_page * )malloc( sizeof( short_stream_page ) + page_length );
+			if ( ssp == NULL )
 			{
-				return NULL;
+				break;
 			}
 
-			buf = ( char * )malloc( sizeof( char ) * fi->size );
-			memset( buf, 0, sizeof( char ) * fi->size );
+			ssp->si = si;
+			ssp->index = page_index;
+			ssp->length = read_stream_range( dr, si->short_stream_map, page_index * SHORT_STREAM_PAGE_SIZE, ssp->data, page_length );
+
+			si->short_stream_pages[ page_index ] = ssp;
+			short_stream_used += ssp->length;
 
-			while ( total < fi->size )
+			// Make room by dropping the least recently used pages. The new page is kept even if it alone exceeds the budget.
+			while ( short_stream_used > g_short_stream_budget && short_stream_tail != NULL )
 			{
-				// The Short SAT should terminate with -2, but we shouldn't get here before the for loop completes.
-				if ( sat_index < 0 )
-				{
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Invalid SAT termination index.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-					break;
-				}
-				
-				// Each index should be no greater than the size of the SAT array.
-				if ( sat_index > ( long )( fi->si->num_sat_sects * ( fi->si->sect_size / sizeof( long ) ) ) )
-				{
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "SAT index out of bounds.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-					exit_extract = true;
-				}
+				short_stream_page *del = short_stream_tail;
+				unlink_short_stream_page( del );
+				del->si->short_stream_pages[ del->index ] = NULL;
+				short_stream_used -= del->length;
+				free( del );
+			}
+		}
+		else
+		{
+			unlink_short_stream_page( ssp );
+		}
 
-				// Adjust the file pointer to the Short SAT
-				SetFilePointer( hFile, sector_offset, 0, FILE_BEGIN );
+		link_short_stream_page( ssp );
 
-				if ( !exit_extract )
-				{
-					sector_offset = fi->si->sect_size + ( fi->si->sat[ sat_index ] * fi->si->sect_size );
-				}
+		// The page is short if the end of the file was reached.
+		if ( page_offset >= ssp->length )
+		{
+			break;
+		}
 
-				if ( total + fi->si->sect_size > fi->size )
-				{
-					bytes_to_read = fi->size - total;
-				}
+		unsigned long bytes_to_copy = ( ssp->length - page_offset < length - total ? ssp->length - page_offset : length - total );
+		memcpy_s( buf + total, length - total, ssp->data + page_offset, bytes_to_copy );
+		total += bytes_to_copy;
+	}
 
-				ReadFile( hFile, buf + total, bytes_to_read, &read, NULL );
-				total += read;
+	leave_lock( short_stream_lock );
 
-				if ( read < bytes_to_read )
-				{
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while extracting the file.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-					break;
-				}
+	return total;
+}
 
-				if ( exit_extract )
-				{
-					break;
-				}
+// Copy each extent of a stream into buf. buf must be able to hold sm->length bytes.
+// Returns the number of bytes that were copied. It's less than sm->length if the end of the file was reached.
+unsigned long read_stream( database_reader *dr, shared_info *si, stream_map *sm, bool short_stream, char *buf )
+{
+	unsigned long total = 0;
 
-				sat_index = fi->si->sat[ sat_index ];
-			}
+	for ( unsigned long i = 0; i < sm->count; ++i )
+	{
+		stream_extent *se = &sm->extents[ i ];
 
-			CloseHandle( hFile );
+		unsigned long read;
 
-			header_offset = 0;
-			if ( total > sizeof( unsigned long ) )
-			{
-				memcpy_s( &header_offset, sizeof( unsigned long ), buf, sizeof( unsigned long ) );
+		if ( short_stream )
+		{
+			read = read_short_stream( dr, si, ( unsigned long )se->offset, buf + total, se->length );
+		}
+		else
+		{
+			// Runs of a single sector come from fragmented streams. They go through the sector cache since they're likely to be read again.
+			read = ( se->length <= si->sect_size ? read_database_sector( dr, se->offset, buf + total, se->length ) : read_database( dr, se->offset, buf + total, se->length ) );
+		}
 
-				if ( header_offset > total )
-				{
-					header_offset = 0;
-				}
-			}
+		total += read;
 
-			size = total - header_offset;
+		if ( read < se->length )
+		{
+			break;
+		}
+	}
 
-			// The first header will look like this:
-			// Header length (4 bytes)
-			// Some value (4 bytes)
-			// Content length (4 bytes)
-			//
-			// Vista and newer
-			//
-			// Some value (4 bytes)
-			// Windows Vista/7: Thumbcache ID, Window 8/8.1/10: Hashed File ID and FILETIME (8 bytes)
+	return total;
+}
 
-			// See if there's a second header.
-			if ( size > 2 && memcmp( buf + header_offset, "\xFF\xD8", 2 ) != 0 )
-			{
-				// Second header exists. Reconstruct the image.
-				// The second header will look like this:
-				// Some value (4 bytes)
-				// Content length (4 bytes)
-				// Image width (4 bytes)
-				// Image height (4 bytes)
-				unsigned long second_header = 0;
-				memcpy_s( &second_header, sizeof( unsigned long ), buf + header_offset, sizeof( unsigned long ) );
-				if ( second_header == 1 )
-				{
-					char *buf2 = ( char * )malloc( sizeof( char ) * total + 374 - 30 );
+// Returns a pointer to a stream within the mapped database, or NULL if it isn't mapped or isn't stored in one piece.
+// A short stream also has to be within a single run of the short stream container.
+char *view_stream( database_reader *dr, shared_info *si, stream_map *sm, bool short_stream )
+{
+	if ( sm->count != 1 || dr->view == NULL )
+	{
+		return NULL;
+	}
 
-					memcpy_s( buf2, total + 374 - 30, jfif_header, 20 );
-					memcpy_s( buf2 + 20, total + 374 - 30 - 20, quantization, 138 );
-					memcpy_s( buf2 + 158, total + 374 - 30 - 158, buf + 30, 22 );
-					memcpy_s( buf2 + 180, total + 374 - 30 - 180, huffman_table, 216 );
-					memcpy_s( buf2 + 396, total + 374 - 30 - 396, buf + 52, total - 52 );
+	stream_extent *se = &sm->extents[ 0 ];
 
-					free( buf );
+	if ( short_stream )
+	{
+		stream_map *container = si->short_stream_map;
+		if ( container == NULL || container->count == 0 )
+		{
+			return NULL;
+		}
+
+		stream_extent *ce = &container->extents[ find_extent( container, ( unsigned long )se->offset ) ];
+		unsigned long start = ( unsigned long )se->offset - ce->position;
+		if ( start > ce->length || se->length > ce->length - start )
+		{
+			return NULL;
+		}
+
+		return view_database( dr, ce->offset + start, se->length );
+	}
 
-					buf = buf2;
+	return view_database( dr, se->offset, se->length );
+}
 
-					header_offset = 0;
+// Extract the file from the SAT or short stream container.
+// Streams that are stored in one piece are viewed in place if the database is mapped. Everything else is copied.
+bool extract( fileinfo *fi, entry_view &ev )
+{
+	ev.data = NULL;
+	ev.buffer = NULL;
+	ev.size = 0;
+	ev.header_offset = 0;
 
-					size = total + 374 - 30;
+	if ( fi == NULL || ( fi != NULL && fi->si == NULL ) )
+	{
+		return false;
+	}
 
-					fi->flag |= FIF_TYPE_CMYK_JPG;
-				}
-			}
+	if ( fi->flag & FIF_BAD_CHAIN )
+	{
+		report_error( "The entry's sector chain is invalid." );
+		return false;
+	}
+
+	if ( fi->entry_type == 2 )
+	{
+		bool short_stream;
+
+		// See if the stream is in the SAT.
+		if ( fi->size >= fi->si->short_sect_cutoff && fi->si->sat != NULL )
+		{
+			short_stream = false;
+		}
+		else if ( fi->si->short_stream_map != NULL && fi->si->ssat != NULL )	// Stream is in the short stream.
+		{
+			short_stream = true;
+		}
+		else
+		{
+			return false;
 		}
-		else if ( fi->si->short_stream_container != NULL && fi->si->ssat != NULL )	// Stream is in the short stream.
+
+		// The database was left open when it was read.
+		database_reader *dr = &fi->si->reader;
+		if ( !short_stream && dr->file == NULL )
 		{
-			long ssat_index = fi->offset;
-			unsigned long sector_offset = 0;
+			return false;
+		}
 
-			buf = ( char * )malloc( sizeof( char ) * fi->size );
-			memset( buf, 0, sizeof( char ) * fi->size );
+		// A stream can't be larger than the database it's in. This also keeps the room we add for a CMYK header from wrapping the size of the buffer.
+		if ( fi->size > dr->size || fi->size > ULONG_MAX - CMYK_HEADER_GROWTH )
+		{
+			report_error( "The entry is larger than the database." );
+			return false;
+		}
 
-			unsigned long buf_offset = 0;
-			unsigned long bytes_to_read = 64;
-			while ( buf_offset < fi->size )
+		// Resolve the sector chain once. Another thread may have done so at the same time.
+		stream_map *sm = fi->map;
+		if ( sm == NULL )
+		{
+			sm = map_stream( fi->si, fi->offset, fi->size, short_stream );
+			if ( sm == NULL )
 			{
-				// The Short SAT should terminate with -2, but we shouldn't get here before the for loop completes.
-				if ( ssat_index < 0 )
-				{
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Invalid Short SAT termination index.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-					break;
-				}
-				
-				// Each index should be no greater than the size of the Short SAT array.
-				if ( ssat_index > ( long )( fi->si->num_ssat_sects * ( fi->si->sect_size / sizeof( long ) ) ) )
-				{
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Short SAT index out of bounds.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-					break;
-				}
+				return false;
+			}
 
-				sector_offset = ssat_index * 64;
+			if ( compare_exchange_pointer( ( void * volatile * )&fi->map, sm, NULL ) != NULL )
+			{
+				free( sm );
+				sm = fi->map;
+			}
+		}
 
-				if ( buf_offset + 64 > fi->size )
-				{
-					bytes_to_read = fi->size - buf_offset;
-				}
+		if ( sm->error != NULL )
+		{
+			report_error( sm->error );
+		}
+
+		unsigned long total = sm->length;
+
+		// A stream that's in one piece doesn't need to be copied. Its chain covers the whole entry if there's no error.
+		if ( sm->error == NULL && sm->length == fi->size )
+		{
+			ev.data = view_stream( dr, fi->si, sm, short_stream );
+		}
+
+		// Copies leave room in front of the entry in case it's a CMYK JPEG that needs its header reconstructed.
+		if ( ev.data == NULL )
+		{
+			ev.buffer = pool_alloc( fi->size + CMYK_HEADER_GROWTH );
+			if ( ev.buffer == NULL )
+			{
+				return false;
+			}
 
-				memcpy_s( buf + buf_offset, fi->size - buf_offset, fi->si->short_stream_container + sector_offset, bytes_to_read );
-				buf_offset += bytes_to_read;
+			ev.data = ev.buffer + CMYK_HEADER_GROWTH;
 
-				ssat_index = fi->si->ssat[ ssat_index ];
+			total = read_stream( dr, fi->si, sm, short_stream, ev.data );
+			if ( total < sm->length )
+			{
+				report_error( "Premature end of file encountered while extracting the file." );
 			}
 
-			header_offset = 0;
-			if ( buf_offset > sizeof( unsigned long ) )
+			// Anything the chain didn't cover is zeroed.
+			if ( total < fi->size )
 			{
-				memcpy_s( &header_offset, sizeof( unsigned long ), buf, sizeof( unsigned long ) );
+				memset( ev.data + total, 0, fi->size - total );
+			}
+		}
 
-				if ( header_offset > fi->size )
-				{
-					header_offset = 0;
-				}
+		if ( total > sizeof( uint32_t ) )
+		{
+			uint32_t header_length = 0;
+			memcpy_s( &header_length, sizeof( uint32_t ), ev.data, sizeof( uint32_t ) );
+			ev.header_offset = header_length;
+
+			if ( ev.header_offset > total )
+			{
+				ev.header_offset = 0;
 			}
+		}
 
-			size = fi->size - header_offset;
+		ev.size = total - ev.header_offset;
 
-			// The first header will look like this:
-			// Header length (4 bytes)
+		// The first header will look like this:
+		// Header length (4 bytes)
+		// Some value (4 bytes)
+		// Content length (4 bytes)
+		//
+		// Vista and newer
+		//
+		// Some value (4 bytes)
+		// Windows Vista/7: Thumbcache ID, Window 8/8.1/10: Hashed File ID and FILETIME (8 bytes)
+
+		// See if there's a second header.
+		if ( ev.size > 2 && memcmp( ev.data + ev.header_offset, "\xFF\xD8", 2 ) != 0 )
+		{
+			// Second header exists. Reconstruct the image.
+			// The second header will look like this:
 			// Some value (4 bytes)
 			// Content length (4 bytes)
-			//
-			// Vista and newer
-			//
-			// Some value (4 bytes)
-			// Windows Vista/7: Thumbcache ID, Window 8/8.1/10: Hashed File ID and FILETIME (8 bytes)
-
-			// See if there's a second header.
-			if ( size > 2 && memcmp( buf + header_offset, "\xFF\xD8", 2 ) != 0 )
+			// Image width (4 bytes)
+			// Image height (4 bytes)
+			uint32_t second_header = 0;
+			memcpy_s( &second_header, sizeof( uint32_t ), ev.data + ev.header_offset, sizeof( uint32_t ) );
+			if ( second_header == 1 && total > 52 )
 			{
-				// The second header will look like this:
-				// Some value (4 bytes)
-				// Content length (4 bytes)
-				// Image width (4 bytes)
-				// Image height (4 bytes)
-				// Second header exists. Reconstruct the image.
-				unsigned long second_header = 0;
-				memcpy_s( &second_header, sizeof( unsigned long ), buf + header_offset, sizeof( unsigned long ) );
-				if ( second_header == 1 )
+				// The 30 byte header becomes a 374 byte JPEG header. A copy already has the image data where it needs to be.
+				// Views are read-only, so their image data has to be copied after the new header.
+				// total is no larger than fi->size, so the size of the new buffer can't wrap.
+				char *buf2 = ev.buffer;
+				if ( buf2 == NULL )
 				{
-					char *buf2 = ( char * )malloc( sizeof( char ) * fi->size + 374 - 30 );
-
-					memcpy_s( buf2, fi->size + 374 - 30, jfif_header, 20 );
-					memcpy_s( buf2 + 20, fi->size + 374 - 30 - 20, quantization, 138 );
-					memcpy_s( buf2 + 158, fi->size + 374 - 30 - 158, buf + 30, 22 );
-					memcpy_s( buf2 + 180, fi->size + 374 - 30 - 180, huffman_table, 216 );
-					memcpy_s( buf2 + 396, fi->size + 374 - 30 - 396, buf + 52, fi->size - 52 );
+					buf2 = pool_alloc( total + CMYK_HEADER_GROWTH );
+					if ( buf2 != NULL )
+					{
+						memcpy_s( buf2 + 396, total + CMYK_HEADER_GROWTH - 396, ev.data + 52, total - 52 );
+					}
+				}
 
-					free( buf );
+				if ( buf2 != NULL )
+				{
+					// The image's 22 bytes are moved first since the Huffman table overwrites them in a copy.
+					memmove_s( buf2 + 158, total + CMYK_HEADER_GROWTH - 158, ev.data + 30, 22 );
+					memcpy_s( buf2, total + CMYK_HEADER_GROWTH, jfif_header, 20 );
+					memcpy_s( buf2 + 20, total + CMYK_HEADER_GROWTH - 20, quantization, 138 );
+					memcpy_s( buf2 + 180, total + CMYK_HEADER_GROWTH - 180, huffman_table, 216 );
 
-					buf = buf2;
+					ev.buffer = buf2;
+					ev.data = buf2;
 
-					header_offset = 0;
+					ev.header_offset = 0;
 
-					size = fi->size + 374 - 30;
+					ev.size = total + CMYK_HEADER_GROWTH;
 
 					fi->flag |= FIF_TYPE_CMYK_JPG;
 				}
@@ -260,14 +1099,14 @@ char *extract( fileinfo *fi, unsigned long &size, unsigned long &header_offset )
 	}
 
 	// Set the extension if none has been set.
-	if ( !( fi->flag & 0x0F ) && buf != NULL )	// Mask the first 4 bits to see if an extension has been set.
+	if ( !( fi->flag & 0x0F ) && ev.data != NULL )	// Mask the first 4 bits to see if an extension has been set.
 	{
 		// Detect the file extension and copy it into the filename string.
-		if ( size > 4 && memcmp( buf + header_offset, FILE_TYPE_JPEG, 4 ) == 0 )		// First 4 bytes
+		if ( ev.size > 4 && memcmp( ev.data + ev.header_offset, FILE_TYPE_JPEG, 4 ) == 0 )		// First 4 bytes
 		{
 			fi->flag |= FIF_TYPE_JPG;
 		}
-		else if ( size > 8 && memcmp( buf + header_offset, FILE_TYPE_PNG, 8 ) == 0 )	// First 8 bytes
+		else if ( ev.size > 8 && memcmp( ev.data + ev.header_offset, FILE_TYPE_PNG, 8 ) == 0 )	// First 8 bytes
 		{
 			fi->flag |= FIF_TYPE_PNG;
 		}
@@ -277,149 +1116,279 @@ char *extract( fileinfo *fi, unsigned long &size, unsigned long &header_offset )
 		}
 	}
 
-	return buf;
+	return ( ev.data != NULL );
 }
 
-// Entries that exist in the catalog will be updated.
-// Me, and 2000 will have full paths.
-// XP and 2003 will just have the file name.
-// Windows Vista, 2008, and 7 don't appear to have catalogs.
-char update_catalog_entries( HANDLE hFile, fileinfo *fi, directory_header dh )
+// Returns the copy of an extracted entry to the buffer pool. Views into the database don't need to be released.
+void release_entry_view( entry_view &ev )
 {
-	if ( fi == NULL || ( fi != NULL && fi->si == NULL ) )
+	pool_free( ev.buffer );
+	ev.buffer = NULL;
+	ev.data = NULL;
+}
+
+bool parse_raw_bitmap( const char *data, unsigned long header_offset, unsigned long size, raw_bitmap &rb )
+{
+	int32_t stride = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t raw_size = 0;
+
+	if ( header_offset == 0x18 )
 	{
-		return SC_FAIL;	// Fail silently. Don't do shared_info cleanup.
+		memcpy_s( &stride, sizeof( int32_t ), data + 0x08, sizeof( int32_t ) );
+		memcpy_s( &width, sizeof( uint32_t ), data + 0x0C, sizeof( uint32_t ) );
+		memcpy_s( &height, sizeof( uint32_t ), data + 0x10, sizeof( uint32_t ) );
+	}
+	else if ( header_offset == 0x34 )	// Found in TVThumb.db (Version 4 databases)
+	{
+		memcpy_s( &width, sizeof( uint32_t ), data + 0x04, sizeof( uint32_t ) );
+		memcpy_s( &height, sizeof( uint32_t ), data + 0x08, sizeof( uint32_t ) );
+		memcpy_s( &stride, sizeof( int32_t ), data + 0x0C, sizeof( int32_t ) );
+	}
+	else
+	{
+		return false;
 	}
 
-	char *buf = NULL;
-	if ( dh.stream_length >= fi->si->short_sect_cutoff && fi->si->sat != NULL )
+	// The size of the pixels is always the last value in the header.
+	memcpy_s( &raw_size, sizeof( uint32_t ), data + ( header_offset - sizeof( uint32_t ) ), sizeof( uint32_t ) );
+
+	if ( width == 0 || height == 0 || raw_size == 0 || raw_size > size )
+	{
+		return false;
+	}
+
+	// Without a stride, the rows are assumed to fill the pixels evenly.
+	unsigned long long abs_stride = ( stride < 0 ? -( long long )stride : stride );
+	if ( abs_stride == 0 )
+	{
+		abs_stride = raw_size / height;
+	}
+
+	// The rows are DWORD aligned like a DIB, so the stride tells us the number of bytes per pixel.
+	// 32 bit rows never have padding. 24 bit rows have less than a pixel of padding.
+	// Images that are 3 pixels wide or less have the same stride either way. They're treated as 32 bit.
+	unsigned char channels = 0;
+	if ( abs_stride == ( unsigned long long )width * 4 )
+	{
+		channels = 4;
+	}
+	else if ( abs_stride >= ( unsigned long long )width * 3 && abs_stride < ( unsigned long long )width * 4 )
+	{
+		channels = 3;
+	}
+	else
 	{
-		DWORD read = 0, total = 0;
-		long sat_index = dh.first_stream_sect; 
-		unsigned long sector_offset = fi->si->sect_size + ( sat_index * fi->si->sect_size );
-		unsigned long bytes_to_read = fi->si->sect_size;
+		return false;
+	}
+
+	// Every row, including its padding, has to be in the entry.
+	if ( abs_stride * height > raw_size )
+	{
+		return false;
+	}
+
+	rb.width = width;
+	rb.height = height;
+	rb.size = raw_size;
+	rb.stride = ( unsigned int )abs_stride;
+	rb.channels = channels;
+	rb.flipped = ( header_offset == 0x18 && channels == 3 );	// Only the 24 bit images of the older layout are stored bottom up.
+
+	return true;
+}
+
+void unpack_raw_bitmap( const char *pixels, const raw_bitmap &rb, unsigned char *dst, int dst_stride, bool swap_red_blue )
+{
+	const unsigned char *src = ( const unsigned char * )pixels;
+	int src_stride = ( int )rb.stride;
 
-		bool exit_update = false;
+	// Start from the last row and work up.
+	if ( rb.flipped )
+	{
+		src += ( size_t )rb.stride * ( rb.height - 1 );
+		src_stride = -src_stride;
+	}
 
-		buf = ( char * )malloc( sizeof( char ) * dh.stream_length );
-		memset( buf, 0, sizeof( char ) * dh.stream_length );
+	copy_pixel_rows( src, src_stride, dst, dst_stride, rb.width, rb.height, rb.channels, swap_red_blue );
+}
 
-		while ( total < dh.stream_length )
+// Record a new name and date for an entry. The entry itself isn't changed until the updates are applied.
+bool add_entry_update( entry_updates *eu, fileinfo *fi, wchar_t *filename, long long date_modified )
+{
+	if ( eu->count == eu->capacity )
+	{
+		unsigned long capacity = ( eu->capacity > 0 ? eu->capacity * 2 : 64 );
+		entry_update *updates = ( entry_update * )realloc( eu->updates, sizeof( entry_update ) * capacity );
+		if ( updates == NULL )
 		{
-			// Stop processing and exit the thread.
-			if ( g_kill_thread )
-			{
-				free( buf );
-				return SC_QUIT;	// Quit silently. Don't do shared_info cleanup.
-			}
+			return false;
+		}
 
-			// The SAT should terminate with -2, but we shouldn't get here before the for loop completes.
-			if ( sat_index < 0 )
-			{
-				if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Invalid SAT termination index.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-				break;
-			}
-			
-			// Each index should be no greater than the size of the SAT array.
-			if ( sat_index > ( long )( fi->si->num_sat_sects * ( fi->si->sect_size / sizeof( long ) ) ) )
-			{
-				if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "SAT index out of bounds.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-				exit_update = true;
-			}
+		eu->updates = updates;
+		eu->capacity = capacity;
+	}
 
-			// Adjust the file pointer to the SAT
-			SetFilePointer( hFile, sector_offset, 0, FILE_BEGIN );
+	eu->updates[ eu->count ].fi = fi;
+	eu->updates[ eu->count ].filename = filename;
+	eu->updates[ eu->count ].date_modified = date_modified;
+	++eu->count;
 
-			if ( !exit_update )
-			{
-				sector_offset = fi->si->sect_size + ( fi->si->sat[ sat_index ] * fi->si->sect_size );
-			}
+	return true;
+}
 
-			if ( total + fi->si->sect_size > dh.stream_length )
-			{
-				bytes_to_read = dh.stream_length - total;
-			}
+// Must be called on the thread that reads the entries, or while nothing else can.
+void apply_entry_updates( entry_updates *eu )
+{
+	if ( eu == NULL || eu->si == NULL )
+	{
+		return;
+	}
 
-			ReadFile( hFile, buf + total, bytes_to_read, &read, NULL );
-			total += read;
+	// The old filenames stay in the arena until the database is closed.
+	for ( unsigned long i = 0; i < eu->count; ++i )
+	{
+		eu->updates[ i ].fi->filename = eu->updates[ i ].filename;
+		eu->updates[ i ].fi->date_modified = eu->updates[ i ].date_modified;
+	}
 
-			if ( read < bytes_to_read )
-			{
-				if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while updating the directory.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-				break;
-			}
+	eu->si->version = eu->version;
+	eu->si->system = eu->system;
+}
 
-			if ( exit_update )
-			{
-				break;
-			}
+// The names in the catalog are UTF-16. wchar_t is 32 bits on some platforms, so each code unit is widened and surrogate pairs are combined.
+// name must be able to hold units + 1 characters. Copying stops at the first NULL character.
+void copy_utf16_name( wchar_t *name, const char *utf16, unsigned long units )
+{
+	unsigned long length = 0;
+
+	for ( unsigned long i = 0; i < units; ++i )
+	{
+		uint16_t c;
+		memcpy_s( &c, sizeof( uint16_t ), utf16 + ( i * sizeof( uint16_t ) ), sizeof( uint16_t ) );
+		if ( c == 0 )
+		{
+			break;
+		}
+
+		uint16_t low = 0;
+		if ( sizeof( wchar_t ) > sizeof( uint16_t ) && c >= 0xD800 && c <= 0xDBFF && i + 1 < units )
+		{
+			memcpy_s( &low, sizeof( uint16_t ), utf16 + ( ( i + 1 ) * sizeof( uint16_t ) ), sizeof( uint16_t ) );
+		}
 
-			sat_index = fi->si->sat[ sat_index ];
+		if ( low >= 0xDC00 && low <= 0xDFFF )
+		{
+			name[ length++ ] = ( wchar_t )( 0x10000 + ( ( ( unsigned long )c - 0xD800 ) << 10 ) + ( low - 0xDC00 ) );
+			++i;
+		}
+		else
+		{
+			name[ length++ ] = ( wchar_t )c;
 		}
 	}
-	else if ( fi->si->short_stream_container != NULL && fi->si->ssat != NULL )
-	{
-		long ssat_index = dh.first_stream_sect;
-		unsigned long sector_offset = 0;
 
-		buf = ( char * )malloc( sizeof( char ) * dh.stream_length );
-		memset( buf, 0, sizeof( char ) * dh.stream_length );
+	name[ length ] = L'\0';
+}
 
-		unsigned long buf_offset = 0;
-		unsigned long bytes_to_read = 64;
-		while ( buf_offset < dh.stream_length )
+// Returns the index value of an entry that hasn't been matched to a catalog record yet, or NULL if it's already been matched.
+hash_index_value *find_unmatched_entry( hash_index *entry_index, unsigned long number, fileinfo *fi )
+{
+	for ( hash_index_value *hiv = hash_index_find( entry_index, number ); hiv != NULL; hiv = hash_index_next( entry_index, hiv ) )
+	{
+		if ( hiv->val == ( void * )fi )
 		{
-			// Stop processing and exit the thread.
-			if ( g_kill_thread )
-			{
-				free( buf );
-				return SC_QUIT;	// Quit silently. Don't do shared_info cleanup.
-			}
+			return hiv;
+		}
+	}
+
+	return NULL;
+}
+
+// Entries that exist in the catalog will be updated.
+// Me, and 2000 will have full paths.
+// XP and 2003 will just have the file name.
+// Windows Vista, 2008, and 7 don't appear to have catalogs.
+// The entries have already been published, so their new names and dates are added to eu instead of being set here.
+char update_catalog_entries( database_reader *dr, fileinfo *fi, directory_header dh, entry_updates *eu )
+{
+	if ( fi == NULL || ( fi != NULL && fi->si == NULL ) )
+	{
+		return SC_FAIL;	// Fail silently. Don't do shared_info cleanup.
+	}
 
-			// The Short SAT should terminate with -2, but we shouldn't get here before the for loop completes.
-			if ( ssat_index < 0 )
+	char *buf = NULL;
+	bool short_stream = !( dh.stream_length >= fi->si->short_sect_cutoff && fi->si->sat != NULL );
+	if ( !short_stream || ( fi->si->short_stream_map != NULL && fi->si->ssat != NULL ) )
+	{
+		stream_map *sm = map_stream( fi->si, dh.first_stream_sect, dh.stream_length, short_stream );
+		if ( sm != NULL )
+		{
+			if ( sm->error != NULL )
 			{
-				if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Invalid Short SAT termination index.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-				break;
+				report_error( sm->error );
 			}
-			
-			// Each index should be no greater than the size of the Short SAT array.
-			if ( ssat_index > ( long )( fi->si->num_ssat_sects * ( fi->si->sect_size / sizeof( long ) ) ) )
+
+			buf = ( char * )malloc( sizeof( char ) * dh.stream_length );
+			if ( buf == NULL )
 			{
-				if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Short SAT index out of bounds.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-				break;
+				report_error( "Not enough memory to update the directory." );
+				free( sm );
+				return SC_FAIL;	// The entries keep their stream names. Don't do shared_info cleanup.
 			}
 
-			sector_offset = ssat_index * 64;
+			memset( buf, 0, sizeof( char ) * dh.stream_length );
 
-			if ( buf_offset + 64 > dh.stream_length )
+			if ( read_stream( dr, fi->si, sm, short_stream, buf ) < sm->length )
 			{
-				bytes_to_read = dh.stream_length - buf_offset;
+				report_error( "Premature end of file encountered while updating the directory." );
 			}
 
-			memcpy_s( buf + buf_offset, dh.stream_length - buf_offset, fi->si->short_stream_container + sector_offset, bytes_to_read );
-			buf_offset += bytes_to_read;
-
-			ssat_index = fi->si->ssat[ ssat_index ];
+			free( sm );
 		}
 	}
 
+	// Stop processing and exit the thread.
+	if ( g_kill_thread )
+	{
+		free( buf );
+		return SC_QUIT;	// Quit silently. Don't do shared_info cleanup.
+	}
+
 	if ( buf != NULL && dh.stream_length > ( 2 * sizeof( unsigned short ) ) )
 	{
 		// 2 byte offset, 2 byte version, 4 bytes number of entries.
 		unsigned long offset = 0;
 		memcpy_s( &offset, sizeof( unsigned long ), buf, sizeof( unsigned short ) );
-		memcpy_s( &fi->si->version, sizeof( unsigned short ), buf + sizeof( unsigned short ), sizeof( unsigned short ) );
+		memcpy_s( &eu->version, sizeof( unsigned short ), buf + sizeof( unsigned short ), sizeof( unsigned short ) );
 
 		fileinfo *root_fi = fi;
 		fileinfo *last_fi = NULL;
-		wchar_t sid[ 32 ];
+
+		// Index the entries by the number in their stream name so that we don't have to scan the list when the catalog is out of order.
+		hash_index *entry_index = hash_index_create( fi->si->count );
+		if ( entry_index == NULL )
+		{
+			free( buf );
+			return SC_FAIL;
+		}
+
+		for ( fileinfo *temp_fi = root_fi; temp_fi != NULL; temp_fi = temp_fi->next )
+		{
+			unsigned long number;
+			if ( parse_stream_number( temp_fi->filename, number ) )
+			{
+				hash_index_insert( entry_index, number, ( void * )temp_fi );
+			}
+		}
 
 		while ( offset < dh.stream_length )
 		{
 			// Stop processing and exit the thread.
 			if ( g_kill_thread )
 			{
+				hash_index_delete( entry_index );
 				free( buf );
 				return SC_QUIT;	// Quit silently. Don't do shared_info cleanup.
 			}
@@ -437,73 +1406,95 @@ char update_catalog_entries( HANDLE hFile, fileinfo *fi, directory_header dh )
 				}
 			}
 
-			unsigned long entry_length = 0;
-			memcpy_s( &entry_length, sizeof( unsigned long ), buf + offset, sizeof( unsigned long ) );
-			offset += sizeof( long );
-			unsigned long entry_num = 0;
-			memcpy_s( &entry_num, sizeof( unsigned long ), buf + offset, sizeof( unsigned long ) );
-			offset += sizeof( long );
-			__int64 date_modified = 0;
-			memcpy_s( &date_modified, sizeof( __int64 ), buf + offset, 8 );
-			offset += sizeof( __int64 );
+			uint32_t entry_length = 0;
+			memcpy_s( &entry_length, sizeof( uint32_t ), buf + offset, sizeof( uint32_t ) );
+			offset += sizeof( uint32_t );
+			uint32_t entry_num = 0;
+			memcpy_s( &entry_num, sizeof( uint32_t ), buf + offset, sizeof( uint32_t ) );
+			offset += sizeof( uint32_t );
+			long long date_modified = 0;
+			memcpy_s( &date_modified, sizeof( long long ), buf + offset, 8 );
+			offset += sizeof( long long );
 
 			// It seems that version 4 databases have an additional value before the filename.
 			if ( fi->si->sect_size == 4096 )
 			{
-				unsigned long unknown = 0;	// Padding?
-				memcpy_s( &unknown, sizeof( unsigned long ), buf + offset, sizeof( unsigned long ) );
-				offset += sizeof( long );
+				uint32_t unknown = 0;	// Padding?
+				memcpy_s( &unknown, sizeof( uint32_t ), buf + offset, sizeof( uint32_t ) );
+				offset += sizeof( uint32_t );
 
-				entry_length -= sizeof( unsigned long );
+				entry_length -= sizeof( uint32_t );
 			}
 
 			unsigned long name_length = entry_length - 0x14;
 
-			if ( name_length > dh.stream_length )
+			if ( offset > dh.stream_length || name_length > dh.stream_length - offset )
 			{
+				hash_index_delete( entry_index );
 				free( buf );
-				if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Invalid directory entry.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+				report_error( "Invalid directory entry." );
 				return SC_FAIL;
 			}
 
-			wchar_t *original_name = ( wchar_t * )malloc( name_length + sizeof( wchar_t ) );
-			wcsncpy_s( original_name, ( name_length + sizeof( wchar_t ) ) / sizeof( wchar_t ), ( wchar_t * )( buf + offset ), name_length / sizeof( wchar_t ) );
+			unsigned long name_units = name_length / sizeof( uint16_t );
+			wchar_t *original_name = ( wchar_t * )arena_alloc( &root_fi->si->entry_arena, sizeof( wchar_t ) * ( name_units + 1 ) );
+			if ( original_name == NULL )
+			{
+				hash_index_delete( entry_index );
+				free( buf );
+				report_error( "Not enough memory to update the directory." );
+				return SC_FAIL;
+			}
+			copy_utf16_name( original_name, buf + offset, name_units );
 
 			if ( fi != NULL )
 			{
-				// We need to verify that the entry number and sid match.
+				// We need to verify that the entry number and the stream name match.
 				// The catalog entries generally appear to be in order, but the actual content in our linked list might not be. I've seen this in ehthumbs.db files.
-				swprintf_s( sid, 32, L"%u", ( fi->si->version == 1 ? entry_num * 10 : entry_num ) );	// The entry number needs to be multiplied by 10 if the version is 1.
-				reverse_string( sid );
-				if ( wcscmp( sid, fi->filename ) != 0 )
+				unsigned long entry_key = ( eu->version == 1 ? entry_num * 10 : entry_num );	// The entry number needs to be multiplied by 10 if the version is 1.
+				unsigned long number;
+				if ( !parse_stream_number( fi->filename, number ) || number != entry_key || find_unmatched_entry( entry_index, number, fi ) == NULL )
 				{
 					last_fi = fi;
 
-					// If we used a tree instead of a linked list, this would be much faster, but it's overkill since this isn't common.
-					fileinfo *temp_fi = root_fi;
-					while ( temp_fi != NULL )
+					// Entries that share a stream number are matched in list order, skipping any that were already matched.
+					hash_index_value *hiv = hash_index_find( entry_index, entry_key );
+					while ( hiv != NULL && hiv->val == NULL )
 					{
-						if ( wcscmp( sid, temp_fi->filename ) == 0 )
-						{
-							fi = temp_fi;
-							break;
-						}
+						hiv = hash_index_next( entry_index, hiv );
+					}
+
+					if ( hiv != NULL )
+					{
+						fi = ( fileinfo * )hiv->val;
+					}
+				}
 
-						temp_fi = temp_fi->next;
+				// Once an entry is matched, it's treated as if it had been renamed and can't be matched again.
+				if ( parse_stream_number( fi->filename, number ) )
+				{
+					hash_index_value *hiv = find_unmatched_entry( entry_index, number, fi );
+					if ( hiv != NULL )
+					{
+						hiv->val = NULL;
 					}
 				}
 
-				fi->date_modified = date_modified;
-				free( fi->filename );
-				fi->filename = original_name;
+				if ( !add_entry_update( eu, fi, original_name, date_modified ) )
+				{
+					hash_index_delete( entry_index );
+					free( buf );
+					report_error( "Not enough memory to update the directory." );
+					return SC_FAIL;
+				}
 
 				// There's no documentation on this and it's difficult to find test cases. Anyone want to install Windows Me? I didn't think so.
 				// I can't refine this until I get test cases, but this should suffice for now.
-				switch ( fi->si->version )
+				switch ( eu->version )
 				{
 					case 4:	// 2000?
 					{
-						fi->si->system = 1;	// Me, 2000
+						eu->system = 1;	// Me, 2000
 					}
 					break;
 
@@ -512,20 +1503,20 @@ char update_catalog_entries( HANDLE hFile, fileinfo *fi, directory_header dh )
 					case 6:	// XP - SP1?
 					case 7:	// XP - SP2+?
 					{
-						fi->si->system = 2;	// XP, 2003
+						eu->system = 2;	// XP, 2003
 					}
 					break;
 
 					default:	// Fall back to our old method of detection.
 					{
 						// See if the filename contains a path. ":\" should be enough to signify a path.
-						if ( name_length > 2 && fi->filename[ 1 ] == L':' && fi->filename[ 2 ] == L'\\' )
+						if ( name_length > 2 && original_name[ 1 ] == L':' && original_name[ 2 ] == L'\\' )
 						{
-							fi->si->system = 1;	// Me, 2000
+							eu->system = 1;	// Me, 2000
 						}
 						else
 						{
-							fi->si->system = 2;	// XP, 2003
+							eu->system = 2;	// XP, 2003
 						}
 					}
 					break;
@@ -537,17 +1528,16 @@ char update_catalog_entries( HANDLE hFile, fileinfo *fi, directory_header dh )
 			offset += ( name_length + 4 );
 		}
 		
+		hash_index_delete( entry_index );
 		free( buf );
 	}
 
-	InvalidateRect( g_hWnd_list, NULL, TRUE );
-
 	return SC_OK;
 }
 
-// Save the short stream container for later lookup.
+// Find the short stream container for later lookup. Its contents are read as they're needed.
 // This is always located in the SAT.
-char cache_short_stream_container( HANDLE hFile, directory_header dh, shared_info *g_si )
+char map_short_stream_container( database_reader *dr, directory_header dh, shared_info *g_si )
 {
 	if ( g_si == NULL || ( g_si != NULL && g_si->sat == NULL ) )
 	{
@@ -560,77 +1550,90 @@ char cache_short_stream_container( HANDLE hFile, directory_header dh, shared_inf
 		return SC_OK;
 	}
 
-	DWORD read = 0, total = 0;
-	long sat_index = dh.first_stream_sect; 
-	unsigned long sector_offset = g_si->sect_size + ( sat_index * g_si->sect_size );
-	unsigned long bytes_to_read = g_si->sect_size;
-
-	bool exit_cache = false;
+	// Stop processing and exit the thread.
+	if ( g_kill_thread )
+	{
+		return SC_QUIT;	// Quit silently. Don't do shared_info cleanup.
+	}
 
-	g_si->short_stream_container = ( char * )malloc( sizeof( char ) * dh.stream_length );
-	memset( g_si->short_stream_container, 0, sizeof( char ) * dh.stream_length );
+	stream_map *sm = map_stream( g_si, dh.first_stream_sect, dh.stream_length, false );
+	if ( sm == NULL )
+	{
+		return SC_FAIL;
+	}
 
-	while ( total < dh.stream_length )
+	if ( sm->error != NULL )
 	{
-		// Stop processing and exit the thread.
-		if ( g_kill_thread )
-		{
-			return SC_QUIT;	// Quit silently. Don't do shared_info cleanup.
-		}
+		report_error( sm->error );
+		free( sm );
+		return SC_FAIL;
+	}
 
-		// The SAT should terminate with -2, but we shouldn't get here before the for loop completes.
-		if ( sat_index < 0 )
+	// The container isn't read yet, but it has to be within the file.
+	for ( unsigned long i = 0; i < sm->count; ++i )
+	{
+		if ( sm->extents[ i ].offset + sm->extents[ i ].length > dr->size )
 		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Invalid SAT termination index.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+			report_error( "Premature end of file encountered while building the short stream container." );
+			free( sm );
 			return SC_FAIL;
 		}
-		
-		// Each index should be no greater than the size of the SAT array.
-		if ( sat_index > ( long )( g_si->num_sat_sects * ( g_si->sect_size / sizeof( long ) ) ) )
-		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "SAT index out of bounds.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-			exit_cache = true;
-		}
-
-		// Adjust the file pointer to the Short SAT
-		SetFilePointer( hFile, sector_offset, 0, FILE_BEGIN );
+	}
 
-		// Adjust the offset if we have a valid sat index.
-		if ( !exit_cache )
+	// Mapped databases don't need pages. Without pages, the container is read directly.
+	if ( dr->view == NULL && short_stream_lock != NULL )
+	{
+		unsigned long page_count = ( dh.stream_length + SHORT_STREAM_PAGE_SIZE - 1 ) / SHORT_STREAM_PAGE_SIZE;
+		g_si->short_stream_pages = ( short_stream_page ** )malloc( sizeof( short_stream_page * ) * page_count );
+		if ( g_si->short_stream_pages != NULL )
 		{
-			sector_offset = g_si->sect_size + ( g_si->sat[ sat_index ] * g_si->sect_size );
+			memset( g_si->short_stream_pages, 0, sizeof( short_stream_page * ) * page_count );
 		}
+	}
 
-		if ( total + g_si->sect_size > dh.stream_length )
-		{
-			bytes_to_read = dh.stream_length - total;
-		}
+	g_si->short_stream_length = dh.stream_length;
+	g_si->short_stream_map = sm;
 
-		ReadFile( hFile, g_si->short_stream_container + total, bytes_to_read, &read, NULL );
-		total += read;
+	return SC_OK;
+}
 
-		if ( read < bytes_to_read )
-		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while building the short stream container.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-			return SC_FAIL;
-		}
+unsigned long get_elapsed_time( long long start )
+{
+	long long frequency = get_performance_frequency();
+
+	return ( frequency > 0 ? ( unsigned long )( ( ( get_performance_counter() - start ) * 1000 ) / frequency ) : 0 );
+}
 
-		if ( exit_cache )
+// Hand any entries that haven't been seen to the caller.
+void publish_entries( shared_info *g_si, entries_callback publish, void *context, fileinfo *&first, unsigned long &count )
+{
+	if ( publish != NULL && count > 0 )
+	{
+		if ( g_si->first_entry_time == 0 )
 		{
-			return SC_FAIL;
+			unsigned long elapsed = get_elapsed_time( g_si->load_start );
+			g_si->first_entry_time = ( elapsed > 0 ? elapsed : 1 );	// 0 means nothing has been published.
 		}
 
-		sat_index = g_si->sat[ sat_index ];
+		publish( first, count, context );
 	}
 
-	return SC_OK;
+	first = NULL;
+	count = 0;
 }
 
 // Builds a list of directory entries.
 // This list is found by traversing the SAT.
 // The directory is stored as a red-black tree in the database, but we can simply iterate through it with a linked list.
-char build_directory( HANDLE hFile, shared_info *g_si )
+// Entries are published in batches as they're found. The short stream container and catalog are read afterward.
+// The directory sectors are 2^SECT_SHIFT bytes, so the number of entries in each is a constant.
+template < unsigned char SECT_SHIFT >
+char build_directory( database_reader *dr, shared_info *g_si, chain_validator *cv, fileinfo **head, entries_callback publish, updates_callback update, void *context )
 {
+	const unsigned short sect_size = ( 1 << SECT_SHIFT );
+
+	*head = NULL;
+
 	if ( g_si == NULL )
 	{
 		return SC_QUIT;
@@ -642,26 +1645,39 @@ char build_directory( HANDLE hFile, shared_info *g_si )
 		return SC_QUIT;
 	}
 
-	DWORD read = 0;
+	unsigned long read = 0;
+	char sector_buf[ sect_size ];	// Holds the directory sector if the database isn't mapped.
 	long sat_index = g_si->first_dir_sect;
-	unsigned long sector_offset = g_si->sect_size + ( sat_index * g_si->sect_size );
+	unsigned long long sector_offset = get_sector_offset( sect_size, sat_index );
 	unsigned long sector_count = 0;
+	const unsigned long sat_count = g_si->num_sat_sects << ( SECT_SHIFT - 2 );	// Number of 4 byte indices in the SAT.
 
 	bool root_found = false;
-	directory_header root_dh = { 0 };
+	directory_header root_dh;
+	memset( &root_dh, 0, sizeof( directory_header ) );
 
 	bool catalog_found = false;
-	directory_header catalog_dh = { 0 };
+	directory_header catalog_dh;
+	memset( &catalog_dh, 0, sizeof( directory_header ) );
+
+	// Published entries can be drawn at any time, so anything we learn about them afterward is handed to the caller.
+	entry_updates eu;
+	memset( &eu, 0, sizeof( entry_updates ) );
+	eu.si = g_si;
 
 	fileinfo *g_fi = NULL;
 	fileinfo *last_fi = NULL;
 
+	fileinfo *batch_fi = NULL;		// First entry that hasn't been published.
+	unsigned long batch_count = 0;
+
 	bool exit_build = false;
 
-	int item_count = ( int )SendMessage( g_hWnd_list, LVM_GETITEMCOUNT, 0, 0 ); // We don't need to call this for each item.
+	// Only the sectors before a broken link are read. A looping chain would otherwise make us read the same sectors over and over.
+	unsigned long directory_sects = validate_chain( cv, g_si, g_si->first_dir_sect, false, 0 );
 
 	// Save each directory sector from the SAT. The number of directory list sectors is not known for Version 3 databases.
-	while ( sector_count < ( g_si->num_sat_sects * ( g_si->sect_size / sizeof( long ) ) ) )
+	while ( sector_count < sat_count )
 	{
 		// Stop processing and exit the thread.
 		if ( g_kill_thread )
@@ -670,6 +1686,10 @@ char build_directory( HANDLE hFile, shared_info *g_si )
 			{
 				cleanup_shared_info( &g_si );
 			}
+			else
+			{
+				publish_entries( g_si, publish, context, batch_fi, batch_count );
+			}
 
 			return SC_QUIT;
 		}
@@ -681,38 +1701,43 @@ char build_directory( HANDLE hFile, shared_info *g_si )
 			{
 				if ( g_fi != NULL )
 				{
-					g_fi->si->system = 3;	// Assume the system is Vista/2008/7
+					eu.system = 3;	// Assume the system is Vista/2008/7
 				}
 				else
 				{
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "No entries were found.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+					report_error( "No entries were found." );
 				}
 			}
 			else
 			{
-				if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Invalid SAT termination index.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+				report_error( "Invalid SAT termination index." );
 			}
 
 			break;
 		}
-		
-		// Each index should be no greater than the size of the SAT array.
-		if ( sat_index > ( long )( g_si->num_sat_sects * ( g_si->sect_size / sizeof( long ) ) ) )
+
+		// The validator has already checked that the first directory_sects indices are within the SAT.
+		if ( sector_count >= directory_sects )
 		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "SAT index out of bounds.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-			exit_build = true;
+			break;
 		}
 
-		// Adjust the file pointer to the Short SAT
-		SetFilePointer( hFile, sector_offset, 0, FILE_BEGIN );
-
-		if ( !exit_build )
+		// Point directly into the mapped view if we can. Otherwise, read the whole sector at once.
+		char *sector = view_database( dr, sector_offset, sect_size );
+		if ( sector != NULL )
+		{
+			read = sect_size;
+		}
+		else
 		{
-			sector_offset = g_si->sect_size + ( g_si->sat[ sat_index ] * g_si->sect_size );
+			sector = sector_buf;
+			read = read_database( dr, sector_offset, sector_buf, sect_size );
 		}
 
+		sector_offset = get_sector_offset( sect_size, g_si->sat[ sat_index ] );
+
 		// There are 4 directory items per 512 byte sector.
-		for ( int i = 0; i < ( g_si->sect_size / 128 ); i++ )
+		for ( unsigned int i = 0; i < ( sect_size / sizeof( directory_header ) ); i++ )
 		{
 			// Stop processing and exit the thread.
 			if ( g_kill_thread )
@@ -721,20 +1746,24 @@ char build_directory( HANDLE hFile, shared_info *g_si )
 				{
 					cleanup_shared_info( &g_si );
 				}
+				else
+				{
+					publish_entries( g_si, publish, context, batch_fi, batch_count );
+				}
 
 				return SC_QUIT;
 			}
 
-			directory_header dh;
-			ReadFile( hFile, &dh, sizeof( directory_header ), &read, NULL );
-
-			if ( read < sizeof( directory_header ) )
+			if ( read < ( i + 1 ) * sizeof( directory_header ) )
 			{
-				if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while building the directory.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+				report_error( "Premature end of file encountered while building the directory." );
 				exit_build = true;
 				break;
 			}
 
+			directory_header dh;
+			memcpy_s( &dh, sizeof( directory_header ), sector + ( i * sizeof( directory_header ) ), sizeof( directory_header ) );
+
 			// Skip invalid entries.
 			if ( dh.entry_type == 0 )
 			{
@@ -744,11 +1773,21 @@ char build_directory( HANDLE hFile, shared_info *g_si )
 			if ( dh.entry_type == 5 )
 			{
 				root_dh = dh;			// Save the root entry
-				root_found = true;
+				root_found = ( dh.stream_length == 0 || dh.first_stream_sect < 0 ||
+							   validate_chain( cv, g_si, dh.first_stream_sect, false, ( dh.stream_length + sect_size - 1 ) >> SECT_SHIFT ) == ( dh.stream_length + sect_size - 1 ) >> SECT_SHIFT );
 				continue;
 			}
 
-			if ( !catalog_found && wcsncmp( dh.sid, L"Catalog", 32 ) == 0 )
+			// The name is stored as UTF-16. Widen it in case wchar_t is 32 bits.
+			wchar_t sid[ 32 ];
+			unsigned char sid_index = 0;
+			for ( ; sid_index < 31 && dh.sid[ sid_index ] != 0; ++sid_index )
+			{
+				sid[ sid_index ] = ( wchar_t )dh.sid[ sid_index ];
+			}
+			sid[ sid_index ] = 0;	// NULL terminate.
+
+			if ( !catalog_found && wcsncmp( sid, L"Catalog", 32 ) == 0 )
 			{
 				catalog_dh = dh;		// Save the catalog entry
 				catalog_found = true;	// Short circuit the condition above.
@@ -756,21 +1795,41 @@ char build_directory( HANDLE hFile, shared_info *g_si )
 			}
 
 			// dh.create_time never seems to be set.
-			fileinfo *fi = ( fileinfo * )malloc( sizeof( fileinfo ) );
-			fi->filename = ( wchar_t * )malloc( sizeof( wchar_t ) * 32 );
-			wcsncpy_s( fi->filename, 32, dh.sid, 31 );
-			memcpy_s( &fi->date_modified, sizeof( __int64 ), dh.modify_time, 8 );
+			// The stream name only needs to fit until the catalog replaces it, so there's no room to spare.
+			fileinfo *fi = ( fileinfo * )arena_alloc( &g_si->entry_arena, sizeof( fileinfo ) + ( sizeof( wchar_t ) * ( sid_index + 1 ) ) );
+			if ( fi == NULL )
+			{
+				report_error( "Not enough memory to build the directory." );
+				exit_build = true;
+				break;
+			}
+
+			fi->filename = ( wchar_t * )( fi + 1 );	// The filename follows the structure.
+			wcsncpy_s( fi->filename, sid_index + 1, sid, sid_index );
+			memcpy_s( &fi->date_modified, sizeof( long long ), dh.modify_time, 8 );
 			fi->offset = dh.first_stream_sect;
 			fi->size = dh.stream_length;
 			fi->entry_type = dh.entry_type;
 			fi->flag = 0;			// None set.
 			fi->si = g_si;
-			fi->si->version = 0;	// Unknown until/if we process a catalog entry.
-			fi->si->system = 0;		// Unknown until/if we process a catalog entry.
 			++( fi->si->count );	// Increment the number of entries.
 			fi->next = NULL;
+			fi->map = NULL;
 			fi->entry_hash = 0;
 
+			// Streams are rejected if their chain loops, leads into another chain, or ends early.
+			if ( dh.entry_type == 2 && dh.stream_length > 0 )
+			{
+				bool short_stream = ( dh.stream_length < g_si->short_sect_cutoff );
+				unsigned long short_sect_size = ( short_stream ? 64 : sect_size );
+				unsigned long stream_sects = ( dh.stream_length + short_sect_size - 1 ) / short_sect_size;
+
+				if ( validate_chain( cv, g_si, dh.first_stream_sect, short_stream, stream_sects ) < stream_sects )
+				{
+					fi->flag |= FIF_BAD_CHAIN;
+				}
+			}
+
 			// Store the fileinfo in the list (first in, first out)
 			if ( last_fi != NULL )
 			{
@@ -779,16 +1838,19 @@ char build_directory( HANDLE hFile, shared_info *g_si )
 			else
 			{
 				g_fi = fi;
+				*head = fi;	// The caller gets the list of entries once the database has been read.
 			}
 			last_fi = fi;
 
-			// Insert a row into our listview.
-			LVITEM lvi = { NULL };
-			lvi.mask = LVIF_PARAM; // Our listview items will display the text contained the lParam value.
-			lvi.iItem = item_count++;
-			lvi.iSubItem = 0;
-			lvi.lParam = ( LPARAM )fi;
-			SendMessage( g_hWnd_list, LVM_INSERTITEM, 0, ( LPARAM )&lvi );
+			if ( batch_fi == NULL )
+			{
+				batch_fi = fi;
+			}
+
+			if ( ++batch_count == DIRECTORY_BATCH_SIZE )
+			{
+				publish_entries( g_si, publish, context, batch_fi, batch_count );
+			}
 		}
 
 		if ( exit_build )
@@ -801,23 +1863,50 @@ char build_directory( HANDLE hFile, shared_info *g_si )
 		++sector_count;	// Update the number of sectors we've traversed.
 	}
 
+	// The caller has every entry now. Their names and dates are updated below.
+	publish_entries( g_si, publish, context, batch_fi, batch_count );
+
 	if ( g_fi != NULL )
 	{
 		if ( root_found )
 		{
-			if ( cache_short_stream_container( hFile, root_dh, g_si ) == SC_QUIT )
+			if ( map_short_stream_container( dr, root_dh, g_si ) == SC_QUIT )
 			{
-				return SC_QUIT;	// Allow the main thread to do shared_info cleanup.
+				return SC_QUIT;	// Allow the caller to do shared_info cleanup once it has the entries.
 			}
 		}
 
+		// The catalog is a short stream, unless it's very large.
+		if ( catalog_found && catalog_dh.stream_length > 0 )
+		{
+			bool short_stream = ( catalog_dh.stream_length < g_si->short_sect_cutoff );
+			unsigned long short_sect_size = ( short_stream ? 64 : sect_size );
+			unsigned long stream_sects = ( catalog_dh.stream_length + short_sect_size - 1 ) / short_sect_size;
+
+			catalog_found = ( validate_chain( cv, g_si, catalog_dh.first_stream_sect, short_stream, stream_sects ) == stream_sects );
+		}
+
 		if ( catalog_found )
 		{
-			if ( update_catalog_entries( hFile, g_fi, catalog_dh ) == SC_QUIT )
+			if ( update_catalog_entries( dr, g_fi, catalog_dh, &eu ) == SC_QUIT )
 			{
-				return SC_QUIT;	// Allow the main thread to do shared_info cleanup.
+				free( eu.updates );
+				return SC_QUIT;	// Allow the caller to do shared_info cleanup once it has the entries.
 			}
 		}
+
+		g_si->load_time = get_elapsed_time( g_si->load_start );
+
+		if ( update != NULL )
+		{
+			update( &eu, context );
+		}
+		else
+		{
+			apply_entry_updates( &eu );
+		}
+
+		free( eu.updates );
 	}
 	else	// Free our shared info structure if no item was added to the list.
 	{
@@ -829,7 +1918,7 @@ char build_directory( HANDLE hFile, shared_info *g_si )
 
 // Builds the Short SAT.
 // This table is found by traversing the SAT.
-char build_ssat( HANDLE hFile, shared_info *g_si )
+char build_ssat( database_reader *dr, shared_info *g_si, chain_validator *cv )
 {
 	if ( g_si == NULL )
 	{
@@ -842,64 +1931,54 @@ char build_ssat( HANDLE hFile, shared_info *g_si )
 		return SC_QUIT;
 	}
 
-	DWORD read = 0, total = 0;
-	long sat_index = g_si->first_ssat_sect;
-	unsigned long sector_offset = g_si->sect_size + ( sat_index * g_si->sect_size );
+	unsigned long ssat_size = g_si->num_ssat_sects * g_si->sect_size;
 
-	bool exit_build = false;
+	g_si->ssat = ( int32_t * )malloc( ssat_size );
+	if ( g_si->ssat == NULL )
+	{
+		report_error( "Not enough memory to build the Short SAT." );
+		cleanup_shared_info( &g_si );
+
+		return SC_QUIT;
+	}
 
-	g_si->ssat = ( long * )malloc( ssat_size );
 	memset( g_si->ssat, -1, ssat_size );
 
-	// Save each sector from the SAT.
-	for ( unsigned long i = 0; i < g_si->num_ssat_sects; i++ )
+	// Stop processing and exit the thread.
+	if ( g_kill_thread )
 	{
-		// Stop processing and exit the thread.
-		if ( g_kill_thread )
-		{
-			cleanup_shared_info( &g_si );
-
-			return SC_QUIT;
-		}
-
-		// The Short SAT should terminate with -2, but we shouldn't get here before the for loop completes.
-		if ( sat_index < 0 )
-		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Invalid SAT termination index.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-			return SC_FAIL;
-		}
-		
-		// Each index should be no greater than the size of the SAT array.
-		if ( sat_index > ( long )( g_si->num_sat_sects * ( g_si->sect_size / sizeof( long ) ) ) )
-		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "SAT index out of bounds.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-			exit_build = true;
-		}
+		cleanup_shared_info( &g_si );
 
-		// Adjust the file pointer to the Short SAT
-		SetFilePointer( hFile, sector_offset, 0, FILE_BEGIN );
+		return SC_QUIT;
+	}
 
-		if ( !exit_build )
-		{
-			sector_offset = g_si->sect_size + ( g_si->sat[ sat_index ] * g_si->sect_size );
-		}
+	// Make sure the chain is sound before we read it.
+	if ( g_si->num_ssat_sects > 0 && validate_chain( cv, g_si, g_si->first_ssat_sect, false, g_si->num_ssat_sects ) < g_si->num_ssat_sects )
+	{
+		return SC_FAIL;
+	}
 
-		ReadFile( hFile, g_si->ssat + ( total / sizeof( long ) ), g_si->sect_size, &read, NULL );
-		total += read;
+	// The Short SAT is a regular stream in the SAT.
+	stream_map *sm = map_stream( g_si, g_si->first_ssat_sect, ssat_size, false );
+	if ( sm == NULL )
+	{
+		return SC_FAIL;
+	}
 
-		if ( read < g_si->sect_size )
-		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while building the Short SAT.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-			return SC_FAIL;
-		}
+	if ( sm->error != NULL )
+	{
+		report_error( sm->error );
+		free( sm );
+		return SC_FAIL;
+	}
 
-		if ( exit_build )
-		{
-			return SC_FAIL;
-		}
+	unsigned long total = read_stream( dr, g_si, sm, false, ( char * )g_si->ssat );
+	free( sm );
 
-		// Each index points to the next index.
-		sat_index = g_si->sat[ sat_index ];
+	if ( total < ssat_size )
+	{
+		report_error( "Premature end of file encountered while building the Short SAT." );
+		return SC_FAIL;
 	}
 
 	return SC_OK;
@@ -907,17 +1986,27 @@ char build_ssat( HANDLE hFile, shared_info *g_si )
 
 // Builds the SAT.
 // We concatenate each sector listed in the MSAT to build the SAT.
-char build_sat( HANDLE hFile, shared_info *g_si )
+char build_sat( database_reader *dr, shared_info *g_si, int32_t *msat )
 {
 	if ( g_si == NULL )
 	{
 		return SC_QUIT;
 	}
 
-	DWORD read = 0, total = 0;
-	unsigned long sector_offset = 0;
+	unsigned long read = 0, total = 0;
+	unsigned long long sector_offset = 0;
+
+	unsigned long sat_size = g_si->num_sat_sects * g_si->sect_size;
+
+	g_si->sat = ( int32_t * )malloc( sat_size );
+	if ( g_si->sat == NULL )
+	{
+		report_error( "Not enough memory to build the SAT." );
+		cleanup_shared_info( &g_si );
+
+		return SC_QUIT;
+	}
 
-	g_si->sat = ( long * )malloc( sat_size );
 	memset( g_si->sat, -1, sat_size );
 
 	// Save each sector in the Master SAT.
@@ -932,22 +2021,20 @@ char build_sat( HANDLE hFile, shared_info *g_si )
 		}
 
 		// We shouldn't get here before the for loop completes.
-		if ( g_msat[ msat_index ] < 0 )
+		if ( msat[ msat_index ] < 0 )
 		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Invalid Master SAT termination index.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+			report_error( "Invalid Master SAT termination index." );
 			return SC_FAIL;
 		}
 
-		// Adjust the file pointer to the SAT
-		sector_offset = g_si->sect_size + ( g_msat[ msat_index ] * g_si->sect_size );
-		SetFilePointer( hFile, sector_offset, 0, FILE_BEGIN );
-
-		ReadFile( hFile, g_si->sat + ( total / sizeof( long ) ), g_si->sect_size, &read, NULL );
+		// Copy the SAT sector.
+		sector_offset = get_sector_offset( g_si->sect_size, msat[ msat_index ] );
+		read = read_database( dr, sector_offset, g_si->sat + ( total / sizeof( int32_t ) ), g_si->sect_size );
 		total += read;
 
 		if ( read < g_si->sect_size )
 		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while building the SAT.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+			report_error( "Premature end of file encountered while building the SAT." );
 			return SC_FAIL;
 		}
 	}
@@ -957,28 +2044,23 @@ char build_sat( HANDLE hFile, shared_info *g_si )
 
 // Builds the MSAT.
 // This is only used to build the SAT and nothing more.
-char build_msat( HANDLE hFile, shared_info *g_si )
+// msat must be large enough to hold the 109 header entries and the entries of every DISAT.
+char build_msat( database_reader *dr, shared_info *g_si, int32_t *msat )
 {
 	if ( g_si == NULL )
 	{
 		return SC_QUIT;
 	}
 
-	DWORD read = 0, total = 436;	// If the sector size is 4096 bytes, then the remaining 3585 bytes are filled with 0.
-	unsigned long last_sector = g_si->sect_size + ( g_si->first_dis_sect * g_si->sect_size );	// Offset to the next DISAT (double indirect sector allocation table)
-
-	g_msat = ( long * )malloc( msat_size );	// g_msat is freed in our read database function.
-	memset( g_msat, -1, msat_size );
+	unsigned long read = 0, total = 436;	// If the sector size is 4096 bytes, then the remaining 3585 bytes are filled with 0.
+	unsigned long long last_sector = get_sector_offset( g_si->sect_size, g_si->first_dis_sect );	// Offset to the next DISAT (double indirect sector allocation table)
 
-	// Set the file pionter to the beginning of the master sector allocation table.
-	SetFilePointer( hFile, 76, 0, FILE_BEGIN );
-
-	// The first MSAT (contained within the 512 byte header) is 436 bytes. Every other MSAT will be 512 or 4096 bytes.
-	ReadFile( hFile, g_msat, 436, &read, NULL );
+	// The first MSAT (contained within the 512 byte header) begins at offset 76 and is 436 bytes. Every other MSAT will be 512 or 4096 bytes.
+	read = read_database( dr, 76, msat, 436 );
 
 	if ( read < 436 )
 	{
-		if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while building the Master SAT.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+		report_error( "Premature end of file encountered while building the Master SAT." );
 		return SC_FAIL;
 	}
 
@@ -993,250 +2075,196 @@ char build_msat( HANDLE hFile, shared_info *g_si )
 			return SC_QUIT;
 		}
 
-		SetFilePointer( hFile, last_sector, 0, FILE_BEGIN );
-
 		// Read the first 127 or 1023 SAT sectors (508 or 4092 bytes) in the DISAT.
-		ReadFile( hFile, g_msat + ( total / sizeof( long ) ), g_si->sect_size - sizeof( long ), &read, NULL );
+		read = read_database( dr, last_sector, msat + ( total / sizeof( int32_t ) ), g_si->sect_size - sizeof( int32_t ) );
 		total += read;
 
-		if ( read < g_si->sect_size - sizeof( long ) )
+		if ( read < g_si->sect_size - sizeof( int32_t ) )
 		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while building the Master SAT.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+			report_error( "Premature end of file encountered while building the Master SAT." );
 			return SC_FAIL;
 		}
 
 		// Get the pointer to the next DISAT.
-		ReadFile( hFile, &last_sector, 4, &read, NULL );
+		int32_t next_dis_sect = -1;
+		read = read_database( dr, last_sector + ( g_si->sect_size - sizeof( int32_t ) ), &next_dis_sect, sizeof( int32_t ) );
 
-		if ( read < 4 )
+		if ( read < sizeof( int32_t ) )
 		{
-			if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while building the Master SAT.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+			report_error( "Premature end of file encountered while building the Master SAT." );
 			return SC_FAIL;
 		}
 
 		// The last index in the DISAT contains a pointer to the next DISAT. That's assuming there's any more DISATs left.
-		last_sector = g_si->sect_size + ( last_sector * g_si->sect_size );
+		last_sector = get_sector_offset( g_si->sect_size, next_dis_sect );
 	}
 
 	return SC_OK;
 }
 
-unsigned __stdcall read_thumbs( void *pArguments )
+// Reads a database and returns the first entry in its list of entries. NULL is returned if no entries were read.
+// Walk the list with fileinfo->next, get the contents of each entry with extract and release_entry_view, and release each entry with free_fileinfo.
+// Nothing is shared between databases, so multiple databases can be read at the same time.
+// If publish is set, then it receives every entry before this returns. The returned list is the same.
+fileinfo *parse_database( wchar_t *filepath, entries_callback publish, updates_callback update, void *context )
 {
-	// This will block every other thread from entering until the first thread is complete.
-	// Protects our global variables.
-	EnterCriticalSection( &pe_cs );
+	fileinfo *head = NULL;
 
-	in_thread = true;
+	long long load_start = get_performance_counter();
 
-	Processing_Window( true );
-
-	pathinfo *pi = ( pathinfo * )pArguments;
-	if ( pi != NULL && pi->filepath != NULL )
+	// Attempt to open and map our database file.
+	database_reader dr;
+	if ( open_database_reader( &dr, filepath ) )
 	{
-		int fname_length = 0;
-		wchar_t *fname = pi->filepath + pi->offset;
+		unsigned long read = 0;
 
-		int filepath_length = ( int )wcslen( pi->filepath ) + 1;	// Include NULL character.
-		
-		bool construct_filepath = ( filepath_length > pi->offset && cmd_line == 0 ? false : true );
+		database_header dh;
+		memset( &dh, 0, sizeof( database_header ) );
 
-		wchar_t *filepath = NULL;
+		// Get the header information for this database.
+		read = read_database( &dr, 0, &dh, sizeof( database_header ) );
 
-		// We're going to open each file in the path info.
-		do
+		if ( read < sizeof( database_header ) )
 		{
-			// Stop processing and exit the thread.
-			if ( g_kill_thread )
-			{
-				break;
-			}
+			close_database_reader( &dr );
 
-			// Construct the filepath for each file.
-			if ( construct_filepath )
-			{
-				fname_length = ( int )wcslen( fname ) + 1;	// Include '\' character or NULL character
+			report_error( "Premature end of file encountered while reading the header." );
 
-				if ( cmd_line != 0 )
-				{
-					filepath = ( wchar_t * )malloc( sizeof( wchar_t ) * fname_length );
-					wcscpy_s( filepath, fname_length, fname );
-				}
-				else
-				{
-					filepath = ( wchar_t * )malloc( sizeof( wchar_t ) * ( filepath_length + fname_length ) );
-					swprintf_s( filepath, filepath_length + fname_length, L"%s\\%s", pi->filepath, fname );
-				}
+			return NULL;
+		}
 
-				// Move to the next file name.
-				fname += fname_length;
-			}
-			else	// Copy the filepath.
-			{
-				filepath = ( wchar_t * )malloc( sizeof( wchar_t ) * filepath_length );
-				wcscpy_s( filepath, filepath_length, pi->filepath );
-			}
+		// Make sure it's a thumbs database and the stucture was filled correctly.
+		if ( memcmp( dh.magic_identifier, "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1", 8 ) != 0 )
+		{
+			close_database_reader( &dr );
 
-			// Attempt to open our database file.
-			HANDLE hFile = CreateFile( filepath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
-			if ( hFile != INVALID_HANDLE_VALUE )
-			{
-				DWORD read = 0;
-				LARGE_INTEGER f_size = { 0 };
+			report_error( "The file is not a thumbs database." );
 
-				database_header dh = { 0 };
+			return NULL;
+		}
 
-				// Get the header information for this database.
-				ReadFile( hFile, &dh, sizeof( database_header ), &read, NULL );
+		// These values are the minimum at which we can multiply the sector size (512) and not go out of range.
+		if ( dh.num_sat_sects > 0x7FFFFF || dh.num_ssat_sects > 0x7FFFFF || dh.num_dis_sects > 0x810203 )
+		{
+			close_database_reader( &dr );
 
-				if ( read < sizeof( database_header ) )
-				{
-					CloseHandle( hFile );
-					free( filepath );
+			report_error( "The total sector allocation table size is too large." );
 
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "Premature end of file encountered while reading the header.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+			return NULL;
+		}
 
-					continue;
-				}
+		// The sector size is equivalent to the 2 to the power of sector_shift. Version 3 = 2^9 = 512. Version 4 = 2^12 = 4096. We'll default to 512 if it's not version 4.
+		unsigned short sect_size = ( dh.dll_version == 0x0004 && dh.sector_shift == 0x000C ? 4096 : 512 );
 
-				// Make sure it's a thumbs database and the stucture was filled correctly.
-				if ( memcmp( dh.magic_identifier, "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1", 8 ) != 0 )
-				{
-					CloseHandle( hFile );
-					free( filepath );
+		unsigned long msat_size = sizeof( int32_t ) * ( 109 + ( ( dh.num_dis_sects > 0 ? dh.num_dis_sects : 0 ) * ( ( sect_size / sizeof( int32_t ) ) - 1 ) ) );
+		unsigned long sat_size = ( dh.num_sat_sects > 0 ? dh.num_sat_sects : 0 ) * sect_size;
+		unsigned long ssat_size = ( dh.num_ssat_sects > 0 ? dh.num_ssat_sects : 0 ) * sect_size;
 
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "The file is not a thumbs database.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+		// This is a simple check to make sure we don't allocate too much memory.
+		if ( ( msat_size + sat_size + ssat_size ) > dr.size )
+		{
+			close_database_reader( &dr );
 
-					continue;
-				}
+			report_error( "The total sector allocation table size exceeds the size of the database." );
 
-				// These values are the minimum at which we can multiply the sector size (512) and not go out of range.
-				if ( dh.num_sat_sects > 0x7FFFFF || dh.num_ssat_sects > 0x7FFFFF || dh.num_dis_sects > 0x810203 )
-				{
-					CloseHandle( hFile );
-					free( filepath );
+			return NULL;
+		}
 
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "The total sector allocation table size is too large.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+		// This information is shared between entries within the database.
+		shared_info *si = ( shared_info * )malloc( sizeof( shared_info ) );
+		if ( si == NULL )
+		{
+			close_database_reader( &dr );
 
-					continue;
-				}
+			report_error( "Not enough memory to read the database." );
 
-				// The sector size is equivalent to the 2 to the power of sector_shift. Version 3 = 2^9 = 512. Version 4 = 2^12 = 4096. We'll default to 512 if it's not version 4.
-				unsigned short sect_size = ( dh.dll_version == 0x0004 && dh.sector_shift == 0x000C ? 4096 : 512 );
+			return NULL;
+		}
 
-				msat_size = sizeof( long ) * ( 109 + ( ( dh.num_dis_sects > 0 ? dh.num_dis_sects : 0 ) * ( ( sect_size / sizeof( long ) ) - 1 ) ) );
-				sat_size = ( dh.num_sat_sects > 0 ? dh.num_sat_sects : 0 ) * sect_size;
-				ssat_size = ( dh.num_ssat_sects > 0 ? dh.num_ssat_sects : 0 ) * sect_size;
+		si->sat = NULL;
+		si->ssat = NULL;
+		si->short_stream_map = NULL;
+		si->short_stream_pages = NULL;
+		si->short_stream_length = 0;
+		si->diagnostics = NULL;
+		si->diagnostic_count = 0;
+		si->entry_arena.head = NULL;
+		si->entry_arena.total = 0;
+		si->count = 0;
+		si->version = 0;	// Unknown until/if we process a catalog entry.
+		si->system = 0;		// Unknown until/if we process a catalog entry.
+		si->load_start = load_start;
+		si->first_entry_time = 0;
+		si->load_time = 0;
+		si->sect_size = sect_size;
+		si->first_dir_sect = dh.first_dir_sect;
+		si->first_dis_sect = dh.first_dis_sect;
+		si->first_ssat_sect = dh.first_ssat_sect;
+		si->num_ssat_sects = dh.num_ssat_sects;
+		si->num_dis_sects = dh.num_dis_sects;
+		si->num_sat_sects = dh.num_sat_sects;
+		si->short_sect_cutoff = dh.short_sect_cutoff;
+		
+		wcscpy_s( si->dbpath, MAX_PATH, filepath );
 
-				GetFileSizeEx( hFile, &f_size );
+		// The database stays open for extraction. Its entries share the reader (and sector cache) through shared_info.
+		// Everything from here on reads through si->reader so that there's only one set of cache counters.
+		si->reader = dr;
+		database_reader *reader = &si->reader;
+		create_sector_cache( reader, sect_size );
 
-				// This is a simple check to make sure we don't allocate too much memory.
-				if ( ( msat_size + sat_size + ssat_size ) > f_size.QuadPart )
-				{
-					CloseHandle( hFile );
-					free( filepath );
+		// Each database gets its own MSAT so that several can be read at once.
+		int32_t *msat = ( int32_t * )malloc( msat_size );
+		if ( msat == NULL )
+		{
+			report_error( "Not enough memory to read the master sector allocation table." );
+			cleanup_shared_info( &si );	// Closes the reader.
 
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "The total sector allocation table size exceeds the size of the database.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+			return NULL;
+		}
 
-					continue;
-				}
+		memset( msat, -1, msat_size );
 
-				// This information is shared between entries within the database.
-				shared_info *si = ( shared_info * )malloc( sizeof( shared_info ) );
-				si->sat = NULL;
-				si->ssat = NULL;
-				si->short_stream_container = NULL;
-				si->count = 0;
-				si->sect_size = sect_size;
-				si->first_dir_sect = dh.first_dir_sect;
-				si->first_dis_sect = dh.first_dis_sect;
-				si->first_ssat_sect = dh.first_ssat_sect;
-				si->num_ssat_sects = dh.num_ssat_sects;
-				si->num_dis_sects = dh.num_dis_sects;
-				si->num_sat_sects = dh.num_sat_sects;
-				si->short_sect_cutoff = dh.short_sect_cutoff;
-				
-				wcscpy_s( si->dbpath, MAX_PATH, filepath );
-
-				// Short-circuit the remaining functions if the status code is quit. The functions must be called in this order.
-				if ( build_msat( hFile, si ) != SC_QUIT && build_sat( hFile, si ) != SC_QUIT && build_ssat( hFile, si ) != SC_QUIT && build_directory( hFile, si ) != SC_QUIT ){}
-
-				// We no longer need this table.
-				free( g_msat );
-
-				// Close the input file.
-				CloseHandle( hFile );
-			}
-			else
+		chain_validator cv;
+		memset( &cv, 0, sizeof( chain_validator ) );
+
+		// Short-circuit the remaining functions if the status code is quit. The functions must be called in this order.
+		if ( build_msat( reader, si, msat ) != SC_QUIT && build_sat( reader, si, msat ) != SC_QUIT )
+		{
+			// The chains are validated as they're used. The SAT has to be built before we know how many sectors there are.
+			if ( !create_chain_validator( &cv, si ) )
 			{
-				// If this occurs, then there's something wrong with the user's system.
-				if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "The database file failed to open.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+				report_error( "The sector chains could not be validated." );
+				cleanup_shared_info( &si );
 			}
+			else if ( build_ssat( reader, si, &cv ) != SC_QUIT &&
+					 ( sect_size == 4096 ? build_directory< 12 >( reader, si, &cv, &head, publish, update, context ) : build_directory< 9 >( reader, si, &cv, &head, publish, update, context ) ) != SC_QUIT ){}
 
-			// Free the old filepath.
-			free( filepath );
+			free_chain_validator( &cv );
 		}
-		while ( construct_filepath && *fname != L'\0' );
 
-		// Save the files or a CSV if the user specified an output directory through the command-line.
-		if ( pi->output_path != NULL )
+		// The shared info only exists if there are entries.
+		report_chain_diagnostics( &cv );
+		if ( head != NULL )
 		{
-			if ( pi->type == 0 )	// Save thumbnail images.
-			{
-				save_param *save_type = ( save_param * )malloc( sizeof( save_param ) );
-				save_type->type = 1;	// Build directory. It may not exist.
-				save_type->save_all = true;
-				save_type->filepath = pi->output_path;
-
-				// save_type is freed in the save_items thread.
-				HANDLE thread = ( HANDLE )_beginthreadex( NULL, 0, &save_items, ( void * )save_type, 0, NULL );
-				if ( thread != NULL )
-				{
-					CloseHandle( thread );
-				}
-				else
-				{
-					free( save_type->filepath );
-					free( save_type );
-				}
-			}
-			else	// Save CSV.
-			{
-				// output_path is freed in save_csv.
-				HANDLE thread = ( HANDLE )_beginthreadex( NULL, 0, &save_csv, ( void * )pi->output_path, 0, NULL );
-				if ( thread != NULL )
-				{
-					CloseHandle( thread );
-				}
-				else
-				{
-					free( pi->output_path );
-				}
-			}
+			head->si->diagnostics = cv.diagnostics;
+			head->si->diagnostic_count = cv.diagnostic_count;
+		}
+		else
+		{
+			free( cv.diagnostics );
 		}
 
-		free( pi->filepath );
-	}
-	else if ( pi != NULL )	// filepath == NULL
-	{
-		free( pi->output_path );	// Assume output_path is set.
-	}
-
-	free( pi );
-
-	Processing_Window( false );
+		// We no longer need this table.
+		free( msat );
 
-	// Release the semaphore if we're killing the thread.
-	if ( shutdown_semaphore != NULL )
+		// The reader is closed in cleanup_shared_info once the last entry of this database is removed.
+	}
+	else
 	{
-		ReleaseSemaphore( shutdown_semaphore, 1, NULL );
+		// If this occurs, then there's something wrong with the user's system.
+		report_error( "The database file failed to open." );
 	}
 
-	in_thread = false;
-
-	// We're done. Let other threads continue.
-	LeaveCriticalSection( &pe_cs );
-
-	_endthreadex( 0 );
-	return 0;
+	return head;
 }
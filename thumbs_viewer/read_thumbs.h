@@ -19,7 +19,13 @@
 #ifndef READ_THUMBS_H
 #define READ_THUMBS_H
 
-#include "globals.h"
+// The database reader has no dependency on the GUI. Errors are passed to g_error_callback.
+// The operating system is only used through platform.h, so it builds without windows.h.
+
+#include <wchar.h>
+
+#include "platform.h"
+#include "buffer_pool.h"
 
 #define FILE_TYPE_JPEG	"\xFF\xD8\xFF\xE0"
 #define FILE_TYPE_PNG	"\x89\x50\x4E\x47\x0D\x0A\x1A\x0A"
@@ -56,55 +62,326 @@
 						"\xD7\xD8\xD9\xDA\xE1\xE2\xE3\xE4\xE5\xE6\xE7\xE8\xE9\xEA\xF1\xF2" \
 						"\xF3\xF4\xF5\xF6\xF7\xF8\xF9\xFA"
 
+// A CMYK JPEG's 30 byte header is replaced with the 374 bytes above.
+#define CMYK_HEADER_GROWTH	( 374 - 30 )
+
 // Return status codes for various functions.
 #define SC_FAIL	0
 #define SC_OK	1
 #define SC_QUIT	2
 
-struct database_header
+// fileinfo flags.
+#define FIF_TYPE_JPG		1
+#define FIF_TYPE_CMYK_JPG	2
+#define FIF_TYPE_PNG		4
+#define FIF_TYPE_UNKNOWN	8
+#define FIF_SELECTED		32	// Keeps track of the listview selection while the entries are sorted.
+#define FIF_BAD_CHAIN		64	// The entry's sector chain failed validation. It won't be extracted.
+
+// Problems that can be found in a sector chain.
+#define CHAIN_OUT_OF_RANGE		1	// An index is beyond the end of its table.
+#define CHAIN_CYCLE				2	// The chain leads back into itself.
+#define CHAIN_CROSS_LINKED		3	// The chain leads into a sector that belongs to another chain.
+#define CHAIN_BAD_TERMINATION	4	// The chain ends with a negative index other than -2.
+#define CHAIN_TOO_SHORT			5	// The chain ends before the stream does.
+
+#define CHAIN_DIAGNOSTIC_LIMIT	64	// Number of diagnostics that are kept for each database. The rest are only counted.
+
+#define DIRECTORY_BATCH_SIZE	256	// Number of directory entries that are decoded before they're handed to the caller.
+
+#define SECTOR_CACHE_SIZE	64	// Number of sectors each unmapped database keeps in memory.
+
+#define SHORT_STREAM_PAGE_SIZE	65536		// Number of bytes of a short stream container that are read at once.
+#define SHORT_STREAM_BUDGET		33554432	// Default number of bytes that the short stream pages of all databases can use.
+
+struct sector_cache_entry
 {
-	char magic_identifier[ 8 ]; // {0xd0, 0xcf, 0x11, 0xe0, 0xa1, 0xb1, 0x1a, 0xe1} for current version, was {0x0e, 0x11, 0xfc, 0x0d, 0xd0, 0xcf, 0x11, 0xe0} on old, beta 2 files (late '92) 
-	char class_id[ 16 ];
-	unsigned short minor_version;
-	unsigned short dll_version;
-	unsigned short byte_order;	// Always 0xFFFE
-	unsigned short sector_shift;
-	unsigned short short_sect_shift;
-	unsigned short reserved_1;
-	unsigned long reserved_2;
-	unsigned long num_dir_sects;	// Not supported in Version 3 databases.
+	unsigned long long offset;	// Offset of the sector in the file.
+	unsigned long last_used;	// Value of the cache clock when the sector was last read.
+	unsigned long length;				// Number of valid bytes. The last sector in the file may be short.
+	char *data;
+};
+
+// Least recently used cache of sectors for databases that are read through their file handle.
+struct sector_cache
+{
+	platform_lock *lock;		// Guards the entries. The file itself is read without a shared file pointer.
+	sector_cache_entry entries[ SECTOR_CACHE_SIZE ];
+	char *data;					// Backing memory for all the entries.
+	unsigned long clock;		// Incremented for every read.
+	unsigned long used;			// Number of entries that hold a sector.
+	unsigned short sect_size;
+};
+
+// Provides read access to a database file.
+// The entire file is mapped into memory if possible. Otherwise, we fall back to reading it through its handle.
+struct database_reader
+{
+	platform_file *file;
+	char *view;					// Read-only view of the entire file. NULL if the file could not be mapped.
+	sector_cache *cache;		// Only used if the file could not be mapped.
+	unsigned long long size;	// Size of the file.
+	unsigned long long cache_hits;
+	unsigned long long cache_misses;
+};
+
+#define ARENA_BLOCK_SIZE	65536	// Bytes in each arena block. Larger allocations get a block of their own.
+
+struct arena_block
+{
+	arena_block *next;
+	size_t size;				// Usable bytes in data.
+	size_t used;
+	char *data;
+};
+
+// Bump allocator for the entries of a database. Nothing is freed until the entire arena is released.
+struct arena
+{
+	arena_block *head;			// Block that's currently being allocated from.
+	size_t total;				// Number of bytes allocated across all blocks.
+};
+
+// Describes a sector chain that failed validation.
+struct chain_diagnostic
+{
+	long first_sect;			// First sector of the chain.
+	long sect;					// Index at which the problem was found.
+	unsigned long position;		// Number of valid sectors before the problem.
+	unsigned char problem;		// One of the CHAIN_ values.
+	bool short_stream;			// The chain is in the Short SAT.
+};
+
+// Records which sectors belong to a chain while a database is being read. Every sector can be visited once, so validation is linear.
+struct chain_validator
+{
+	unsigned char *sat_visited;		// One bit for each SAT index.
+	unsigned char *ssat_visited;	// One bit for each Short SAT index.
+	unsigned long sat_count;
+	unsigned long ssat_count;
+	chain_diagnostic *diagnostics;
+	unsigned long diagnostic_count;	// Total number of problems. Only the first CHAIN_DIAGNOSTIC_LIMIT are kept.
+};
+
+// A run of adjacent sectors in a stream.
+struct stream_extent
+{
+	unsigned long long offset;	// Offset in the database, or in the short stream container if it's a short stream.
+	unsigned long length;
+	unsigned long position;		// Offset of the run within the stream.
+};
+
+// A stream's sector chain, resolved into the runs that make it up.
+struct stream_map
+{
+	const char *error;			// Set if the chain was broken. The extents cover the part of the stream before the break.
+	unsigned long count;		// Number of extents.
+	unsigned long length;		// Number of bytes the extents cover.
+	stream_extent extents[ 1 ];
+};
+
+// An extracted entry. data points into the mapped database if the stream is stored in one piece. Otherwise, it's a copy.
+// The data is read-only and stays valid until release_entry_view is called, or until the entry is freed.
+struct entry_view
+{
+	char *data;					// The entry, starting with its header.
+	char *buffer;				// Holds data if it had to be copied. It's from the buffer pool. NULL if data points into the database.
+	unsigned long size;			// Size of the entry, excluding the header offset.
+	unsigned long header_offset;
+};
+
+// The pixels of an entry that has no image header. Its layout is described by the entry's header.
+struct raw_bitmap
+{
+	unsigned int width;
+	unsigned int height;
+	unsigned int size;			// Size of the pixels, including any padding at the end of each row.
+	unsigned int stride;		// Distance between the start of each row.
+	unsigned char channels;		// 3 = BGR, 4 = BGRA
+	bool flipped;				// The rows are stored bottom up.
+};
+
+struct shared_info;
+
+// Part of a short stream container that's been read from an unmapped database.
+// The pages of every database are kept in a single least recently used list.
+struct short_stream_page
+{
+	shared_info *si;
+	short_stream_page *prev;	// Page that was used more recently.
+	short_stream_page *next;	// Page that was used less recently.
+	unsigned long index;		// Index of the page in si->short_stream_pages.
+	unsigned long length;
+	char data[ 1 ];
+};
+
+// Holds shared variables among database entries.
+struct shared_info
+{
+	wchar_t dbpath[ MAX_PATH ];
+	database_reader reader;		// Stays open until every entry of the database has been removed.
+	arena entry_arena;			// Holds the fileinfo structures and their filenames.
+	int32_t *sat;
+	int32_t *ssat;
+	stream_map *short_stream_map;			// Location of the short stream container in the database. It's read as it's needed.
+	short_stream_page **short_stream_pages;	// Pages of the container that are in memory. NULL if the database is mapped.
+	unsigned long short_stream_length;
+	
+	//These are found in the database header.
 	unsigned long num_sat_sects;
 	long first_dir_sect;
-	unsigned long transactioning_sig;
-	unsigned long short_sect_cutoff;
 	long first_ssat_sect;
 	unsigned long num_ssat_sects;
 	long first_dis_sect;
 	unsigned long num_dis_sects;
+	unsigned long short_sect_cutoff;
+
+	unsigned long count;		// Number of directory entries.
+
+	chain_diagnostic *diagnostics;		// Chains that were rejected while the database was read.
+	unsigned long diagnostic_count;		// Total number of problems. Only the first CHAIN_DIAGNOSTIC_LIMIT are kept.
+
+	long long load_start;			// Performance counter value when the database was opened.
+	unsigned long first_entry_time;	// Milliseconds until the first entries were handed to the caller.
+	unsigned long load_time;		// Milliseconds until the entire database was read.
+
+	unsigned short sect_size;
+	unsigned short version;
+	unsigned char system;		// 0 = Unknown, 1 = Me/2000, 2 = XP/2003, 3 = Vista/2008/7
+};
+
+// This structure holds information obtained as we read the database. The GUI passes it as an lParam to our listview items.
+struct fileinfo
+{
+	long long entry_hash;				// Hashed filename for Vista and above.
+	long long date_modified;			// Modified FILETIME
+	shared_info *si;
+	fileinfo *next;						// Allows us to process catalog entries in order.
+	stream_map *map;					// The entry's sector chain. Built the first time the entry is extracted.
+	wchar_t *filename;					// Name of the database entry. Allocated from si->entry_arena.
+	unsigned long offset;				// Offset in SAT or short stream container (depends on size of entry)
+	unsigned long size;					// Size of file.
+	char entry_type;
+	unsigned char flag;					// 1 = jpg, 2 = cmyk jpg, 4 = png, 8 = unknown, 32 = selected, 64 = bad chain.
+};
+
+// A catalog name and date for an entry that was already handed to the caller.
+struct entry_update
+{
+	fileinfo *fi;
+	wchar_t *filename;					// Allocated from the entry's arena.
+	long long date_modified;
+};
+
+// Everything that changes about a database's entries after they've been published.
+struct entry_updates
+{
+	shared_info *si;
+	entry_update *updates;
+	unsigned long count;
+	unsigned long capacity;
+	unsigned short version;				// Values for si->version and si->system.
+	unsigned char system;
+};
+
+// The on-disk structures are little-endian and use fixed width fields so that they're the same size on every platform.
+#pragma pack( push, 1 )
+
+struct database_header
+{
+	char magic_identifier[ 8 ]; // {0xd0, 0xcf, 0x11, 0xe0, 0xa1, 0xb1, 0x1a, 0xe1} for current version, was {0x0e, 0x11, 0xfc, 0x0d, 0xd0, 0xcf, 0x11, 0xe0} on old, beta 2 files (late '92) 
+	char class_id[ 16 ];
+	uint16_t minor_version;
+	uint16_t dll_version;
+	uint16_t byte_order;		// Always 0xFFFE
+	uint16_t sector_shift;
+	uint16_t short_sect_shift;
+	uint16_t reserved_1;
+	uint32_t reserved_2;
+	uint32_t num_dir_sects;	// Not supported in Version 3 databases.
+	uint32_t num_sat_sects;
+	int32_t first_dir_sect;
+	uint32_t transactioning_sig;
+	uint32_t short_sect_cutoff;
+	int32_t first_ssat_sect;
+	uint32_t num_ssat_sects;
+	int32_t first_dis_sect;
+	uint32_t num_dis_sects;
 };
 
 struct directory_header
 {
-	wchar_t sid[ 32 ];			// NULL terminated
-	unsigned short sid_length;
+	uint16_t sid[ 32 ];			// NULL terminated UTF-16
+	uint16_t sid_length;
 	char entry_type;			// 0 = Invalid, 1 = Storage, 2 = Stream, 3 = Lock bytes, 4 = Property, 5 = Root
 	char node_color;			// 0 = Red, 1 = Black
-	long left_child;
-	long right_child;
-	long dir_id;
+	int32_t left_child;
+	int32_t right_child;
+	int32_t dir_id;
 	char clsid[ 16 ];
-	unsigned long user_flags;
+	uint32_t user_flags;
 	
 	char create_time[ 8 ];
 	char modify_time[ 8 ];
 
-	long first_stream_sect;
-	unsigned long stream_length;		// Low order bits. Should be less than or equal to 0x80000000 for Version 3 databases.
-	unsigned long stream_length_high;	// High order bits.
+	int32_t first_stream_sect;
+	uint32_t stream_length;		// Low order bits. Should be less than or equal to 0x80000000 for Version 3 databases.
+	uint32_t stream_length_high;	// High order bits.
 };
 
-unsigned __stdcall read_thumbs( void *pArguments );
+#pragma pack( pop )
+
+// The MSAT begins right after the header, and the directory is read in 128 byte entries.
+C_ASSERT( sizeof( database_header ) == 76 );
+C_ASSERT( sizeof( directory_header ) == 128 );
+
+bool open_database_reader( database_reader *dr, wchar_t *filepath );
+void close_database_reader( database_reader *dr );
+void create_sector_cache( database_reader *dr, unsigned short sect_size );
+unsigned long read_database( database_reader *dr, unsigned long long offset, void *buf, unsigned long length );
+unsigned long read_database_sector( database_reader *dr, unsigned long long offset, void *buf, unsigned long length );
+char *view_database( database_reader *dr, unsigned long long offset, unsigned long length );
+
+// Offset of a sector in the database. It's 64-bit since version 4 databases can be larger than 4 GB.
+unsigned long long get_sector_offset( unsigned short sect_size, long index );
+
+// Returns false if the pages can't be guarded. Unmapped databases then read their short stream containers directly.
+bool initialize_short_stream_cache();
+void uninitialize_short_stream_cache();
+
+// Returns NULL if there's not enough memory. If the chain is broken, then error is set and the extents cover what could be mapped.
+stream_map *map_stream( shared_info *si, long first_sect, unsigned long length, bool short_stream );
+unsigned long read_stream( database_reader *dr, shared_info *si, stream_map *sm, bool short_stream, char *buf );
+
+void *arena_alloc( arena *a, size_t size );
+wchar_t *arena_wcsdup( arena *a, const wchar_t *string );
+void arena_release( arena *a );
+
+// Receives entries as they're decoded. They aren't changed afterward except through an updates_callback.
+typedef void ( *entries_callback )( fileinfo *first, unsigned long count, void *context );
+
+// Receives the catalog names, dates, and system of the published entries once the whole database has been read.
+// It's called from the reading thread and has to apply them with apply_entry_updates before it returns.
+// Since it decides when they're applied, it can do so on whichever thread reads the entries.
+typedef void ( *updates_callback )( entry_updates *eu, void *context );
+
+// If update is NULL, then the changes are applied to the entries before this returns.
+fileinfo *parse_database( wchar_t *filepath, entries_callback publish = NULL, updates_callback update = NULL, void *context = NULL );
+void apply_entry_updates( entry_updates *eu );
+bool extract( fileinfo *fi, entry_view &ev );
+void release_entry_view( entry_view &ev );
+
+// Reads the raw bitmap layout of an entry with a 0x18 or 0x34 byte header. Returns false if there isn't one, or if it doesn't fit in the entry.
+bool parse_raw_bitmap( const char *data, unsigned long header_offset, unsigned long size, raw_bitmap &rb );
+
+// Copy the pixels of a raw bitmap into tightly packed, top down rows. Pixels are in BGR(A) order unless swap_red_blue is set.
+void unpack_raw_bitmap( const char *pixels, const raw_bitmap &rb, unsigned char *dst, int dst_stride, bool swap_red_blue );
+
+void free_fileinfo( fileinfo *fi );
+void cleanup_shared_info( shared_info **si );
 
-char *extract( fileinfo *fi, unsigned long &size, unsigned long &header_offset );
+extern void ( *g_error_callback )( const char *message );	// Receives any error messages. They're ignored if this is NULL.
+extern bool g_kill_thread;									// Stops any database that's being read.
+extern unsigned long long g_short_stream_budget;			// Maximum number of bytes that short stream pages can use.
 
 #endif
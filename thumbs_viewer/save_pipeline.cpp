@@ -0,0 +1,550 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "globals.h"
+#include "save_pipeline.h"
+#include "utilities.h"
+
+#include <stdio.h>
+
+// Saving is split into three stages that run at the same time.
+// The calling thread extracts each entry, a pool of converters reconstructs the images that can't be written as is, and a single writer saves them to disk.
+// If the threads can't be started, then the calling thread does all three stages itself.
+
+CRITICAL_SECTION save_status_cs;	// Guards the save status.
+wchar_t save_status[ 128 ];			// The window title that shows how far along we are.
+bool save_status_active = false;	// Set while entries are being saved.
+bool save_status_posted = false;	// Set while WM_SAVE_STATUS is waiting to be handled.
+
+void init_save_queue( save_queue *sq )
+{
+	InitializeCriticalSection( &sq->cs );
+	sq->free_slots = CreateSemaphore( NULL, SAVE_QUEUE_SIZE, SAVE_QUEUE_SIZE, NULL );
+	sq->used_slots = CreateSemaphore( NULL, 0, SAVE_QUEUE_SIZE, NULL );
+	sq->head = 0;
+	sq->tail = 0;
+}
+
+void destroy_save_queue( save_queue *sq )
+{
+	CloseHandle( sq->used_slots );
+	CloseHandle( sq->free_slots );
+	DeleteCriticalSection( &sq->cs );
+}
+
+// A NULL item tells the consumer that nothing else will be added.
+void push_save_queue( save_queue *sq, save_item *item )
+{
+	WaitForSingleObject( sq->free_slots, INFINITE );
+
+	EnterCriticalSection( &sq->cs );
+	sq->items[ sq->tail ] = item;
+	sq->tail = ( sq->tail + 1 ) % SAVE_QUEUE_SIZE;
+	LeaveCriticalSection( &sq->cs );
+
+	ReleaseSemaphore( sq->used_slots, 1, NULL );
+}
+
+save_item *pop_save_queue( save_queue *sq )
+{
+	WaitForSingleObject( sq->used_slots, INFINITE );
+
+	EnterCriticalSection( &sq->cs );
+	save_item *item = sq->items[ sq->head ];
+	sq->head = ( sq->head + 1 ) % SAVE_QUEUE_SIZE;
+	LeaveCriticalSection( &sq->cs );
+
+	ReleaseSemaphore( sq->free_slots, 1, NULL );
+
+	return item;
+}
+
+void free_save_item( save_item *item )
+{
+	if ( item->hData != NULL )
+	{
+		GlobalUnlock( item->hData );
+		GlobalFree( item->hData );
+	}
+
+	free( item->encoded );
+	pool_free( item->copy );
+	free( item );
+}
+
+// Build the path that the entry will be saved to.
+void set_save_path( save_item *item, fileinfo *fi, wchar_t *save_directory )
+{
+	wchar_t *filename = get_filename_from_path( fi->filename, ( unsigned long )wcslen( fi->filename ) );
+
+	// Replace any invalid filename characters with an underscore "_".
+	wchar_t escaped_filename[ MAX_PATH ] = { 0 };
+	unsigned int escaped_filename_length = 0;
+	while ( filename != NULL && *filename != NULL && escaped_filename_length < MAX_PATH )
+	{
+		if ( *filename == L'\\' ||
+			 *filename == L'/' ||
+			 *filename == L':' ||
+			 *filename == L'*' ||
+			 *filename == L'?' ||
+			 *filename == L'\"' ||
+			 *filename == L'<' ||
+			 *filename == L'>' ||
+			 *filename == L'|' )
+		{
+			escaped_filename[ escaped_filename_length ] = L'_';
+		}
+		else
+		{
+			escaped_filename[ escaped_filename_length ] = *filename;
+		}
+
+		++escaped_filename_length;
+		++filename;
+	}
+	escaped_filename[ escaped_filename_length ] = 0;	// Sanity.
+
+	if ( ( fi->flag & FIF_TYPE_JPG ) || ( fi->flag & FIF_TYPE_CMYK_JPG ) )
+	{
+		wchar_t *ext = get_extension_from_filename( escaped_filename, escaped_filename_length );
+		// The extension in the filename might not be the actual type. So we'll append .jpg to the end of it.
+		if ( _wcsicmp( ext, L".jpg" ) == 0 || _wcsicmp( ext, L".jpeg" ) == 0 )
+		{
+			swprintf_s( item->fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s", save_directory, escaped_filename );
+		}
+		else
+		{
+			swprintf_s( item->fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s.jpg", save_directory, escaped_filename );
+		}
+	}
+	else if ( ( fi->flag & FIF_TYPE_PNG ) || ( ( fi->flag & FIF_TYPE_UNKNOWN ) && item->header_offset > 0 ) )
+	{
+		wchar_t *ext = get_extension_from_filename( escaped_filename, escaped_filename_length );
+		// The extension in the filename might not be the actual type. So we'll append .png to the end of it.
+		if ( _wcsicmp( ext, L".png" ) == 0 )
+		{
+			swprintf_s( item->fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s", save_directory, escaped_filename );
+		}
+		else
+		{
+			swprintf_s( item->fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s.png", save_directory, escaped_filename );
+		}
+	}
+	else
+	{
+		swprintf_s( item->fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s", save_directory, escaped_filename );
+	}
+}
+
+// Encode the image into memory so that the writer can save it.
+bool encode_image( save_item *item, Gdiplus::Image *image, CLSID *clsid )
+{
+	bool ret = false;
+
+	Gdiplus::EncoderParameters encoderParameters;
+	encoderParameters.Count = 1;
+	encoderParameters.Parameter[ 0 ].Guid = Gdiplus::EncoderQuality;
+	encoderParameters.Parameter[ 0 ].Type = Gdiplus::EncoderParameterValueTypeLong;
+	encoderParameters.Parameter[ 0 ].NumberOfValues = 1;
+	ULONG quality = 100;
+	encoderParameters.Parameter[ 0 ].Value = &quality;
+
+	// We free the memory of the stream ourselves once it's been written.
+	IStream *os = NULL;
+	if ( CreateStreamOnHGlobal( NULL, FALSE, &os ) == S_OK )
+	{
+		if ( image->Save( os, clsid, &encoderParameters ) == Gdiplus::Ok )
+		{
+			STATSTG stat;
+			if ( os->Stat( &stat, STATFLAG_NONAME ) == S_OK && GetHGlobalFromStream( os, &item->hData ) == S_OK )
+			{
+				item->data = ( char * )GlobalLock( item->hData );
+				item->size = stat.cbSize.LowPart;
+
+				ret = ( item->data != NULL );
+			}
+		}
+
+		os->Release();
+	}
+
+	return ret;
+}
+
+// Encode a raw bitmap as a PNG without going through GDI+. Its rows are unpacked into RGB(A) order first.
+bool encode_raw_bitmap( save_item *item, const raw_bitmap &rb )
+{
+	int row_size = rb.width * rb.channels;
+
+	unsigned char *pixels = ( unsigned char * )pool_alloc( ( size_t )row_size * rb.height );
+	if ( pixels == NULL )
+	{
+		return false;
+	}
+
+	unpack_raw_bitmap( item->buffer + item->header_offset, rb, pixels, row_size, true );
+
+	unsigned long size = 0;
+	item->encoded = encode_png( pixels, rb.width, rb.height, row_size, rb.channels, SAVE_PNG_FILTER, SAVE_PNG_COMPRESSION, &size );
+
+	pool_free( ( char * )pixels );
+
+	if ( item->encoded == NULL )
+	{
+		return false;
+	}
+
+	item->data = ( char * )item->encoded;
+	item->size = size;
+
+	return true;
+}
+
+// Extract an entry so that it can be converted and written. Returns NULL if the entry can't be saved.
+save_item *create_save_item( fileinfo *fi, wchar_t *save_directory )
+{
+	if ( fi == NULL || ( fi != NULL && fi->filename == NULL ) )
+	{
+		return NULL;
+	}
+
+	// Entries that are in one piece are written straight from the mapped database.
+	entry_view ev;
+	if ( !extract( fi, ev ) )
+	{
+		return NULL;
+	}
+
+	save_item *item = ( save_item * )malloc( sizeof( save_item ) );
+	if ( item == NULL )
+	{
+		release_entry_view( ev );
+		return NULL;
+	}
+
+	item->data = NULL;
+	item->hData = NULL;
+	item->encoded = NULL;
+	item->buffer = ev.data;
+	item->copy = ev.buffer;
+	item->size = ev.size;	// Size excludes the header offset.
+	item->header_offset = ev.header_offset;
+
+	item->flag = fi->flag;	// Set by extract.
+
+	set_save_path( item, fi, save_directory );
+
+	return item;
+}
+
+// Reconstructs CMYK JPEGs and raw bitmaps. Everything else is written as is.
+void convert_item( save_pipeline *sp, save_item *item )
+{
+	// If we have a CMYK based JPEG, then we're going to have to convert it to RGB.
+	if ( item->flag & FIF_TYPE_CMYK_JPG )
+	{
+		Gdiplus::Image *save_bm_image = create_image( item->buffer + item->header_offset, item->size, 1 );
+
+		// The size will differ from what's listed in the database since we had to reconstruct the image.
+		// Switch the encoder to PNG or BMP to save a lossless image.
+		if ( !encode_image( item, save_bm_image, &sp->jpgClsid ) )
+		{
+			sp->conversion_failed = true;
+		}
+
+		delete save_bm_image;
+	}
+	else if ( ( item->flag & FIF_TYPE_UNKNOWN ) && item->header_offset > 0 )
+	{
+		// We're going to save this as a PNG in order to preserve any alpha channels.
+		// The size will differ from what's listed in the database since we had to reconstruct the image.
+		raw_bitmap rb;
+		if ( parse_raw_bitmap( item->buffer, item->header_offset, item->size, rb ) )
+		{
+			if ( !encode_raw_bitmap( item, rb ) )
+			{
+				sp->conversion_failed = true;
+			}
+		}
+		else	// Let GDI+ try to decode anything we don't recognize.
+		{
+			Gdiplus::Image *save_bm_image = create_image( item->buffer + item->header_offset, item->size, 0 );
+
+			if ( !encode_image( item, save_bm_image, &sp->pngClsid ) )
+			{
+				sp->conversion_failed = true;
+			}
+
+			delete save_bm_image;
+		}
+	}
+	else
+	{
+		item->data = item->buffer + item->header_offset;
+	}
+}
+
+unsigned __stdcall convert_items( void *pArguments )
+{
+	save_pipeline *sp = ( save_pipeline * )pArguments;
+
+	save_item *item;
+	while ( ( item = pop_save_queue( &sp->convert_queue ) ) != NULL )
+	{
+		// Let the items pass through to the writer so that they get freed.
+		if ( !g_kill_thread )
+		{
+			convert_item( sp, item );
+		}
+
+		push_save_queue( &sp->write_queue, item );
+	}
+
+	// Tell the writer that there's nothing left once every converter is done.
+	if ( InterlockedDecrement( &sp->active_converters ) == 0 )
+	{
+		push_save_queue( &sp->write_queue, NULL );
+	}
+
+	_endthreadex( 0 );
+	return 0;
+}
+
+// Show how far along we are in the window title.
+// The title can only be set on the main thread. Sending it a message from here could deadlock if it's waiting on us, so the title is posted instead.
+void update_save_status( save_pipeline *sp, bool force )
+{
+	DWORD current_time = GetTickCount();
+	if ( !force && ( current_time - sp->last_update ) < SAVE_STATUS_DELAY )
+	{
+		return;
+	}
+
+	sp->last_update = current_time;
+
+	double seconds = ( current_time - sp->start_time ) / 1000.0;
+	if ( seconds <= 0.0 )
+	{
+		seconds = 0.001;
+	}
+
+	wchar_t status[ 128 ];
+	swprintf_s( status, 128, L"%s - Saving %lu of %lu (%.1f items/s, %.2f MB/s)", PROGRAM_CAPTION, sp->saved, sp->total, sp->saved / seconds, ( sp->saved_bytes / ( 1024.0 * 1024.0 ) ) / seconds );
+
+	EnterCriticalSection( &save_status_cs );
+
+	wcscpy_s( save_status, 128, status );
+
+	// The main thread picks up the newest status when it gets to the message.
+	if ( save_status_active && !save_status_posted )
+	{
+		save_status_posted = ( PostMessage( g_hWnd_main, WM_SAVE_STATUS, 0, 0 ) != FALSE );
+	}
+
+	LeaveCriticalSection( &save_status_cs );
+}
+
+// Called on the main thread in response to WM_SAVE_STATUS. A status that arrives after the save has finished is ignored.
+void show_save_status()
+{
+	EnterCriticalSection( &save_status_cs );
+
+	save_status_posted = false;
+	if ( save_status_active )
+	{
+		SetWindowText( g_hWnd_main, save_status );
+	}
+
+	LeaveCriticalSection( &save_status_cs );
+}
+
+void write_item( save_pipeline *sp, save_item *item )
+{
+	if ( item->data == NULL )
+	{
+		return;
+	}
+
+	// Attempt to open a file for saving.
+	HANDLE hFile_save = CreateFile( item->fullpath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile_save != INVALID_HANDLE_VALUE )
+	{
+		// Write the buffer to our file.
+		DWORD dwBytesWritten = 0;
+		WriteFile( hFile_save, item->data, item->size, &dwBytesWritten, NULL );
+
+		CloseHandle( hFile_save );
+
+		sp->saved_bytes += dwBytesWritten;
+	}
+	else if ( GetLastError() == ERROR_PATH_NOT_FOUND )	// See if the path was too long.
+	{
+		sp->path_failed = true;
+	}
+
+	++sp->saved;
+
+	update_save_status( sp, false );
+}
+
+unsigned __stdcall write_items( void *pArguments )
+{
+	save_pipeline *sp = ( save_pipeline * )pArguments;
+
+	save_item *item;
+	while ( ( item = pop_save_queue( &sp->write_queue ) ) != NULL )
+	{
+		if ( !g_kill_thread )
+		{
+			write_item( sp, item );
+		}
+
+		// Free our buffer.
+		free_save_item( item );
+	}
+
+	update_save_status( sp, true );
+
+	_endthreadex( 0 );
+	return 0;
+}
+
+// Save each entry to the save directory.
+void save_entries( fileinfo **entries, unsigned long count, wchar_t *save_directory )
+{
+	save_pipeline sp;
+	init_save_queue( &sp.convert_queue );
+	init_save_queue( &sp.write_queue );
+	GetEncoderClsid( L"image/jpeg", &sp.jpgClsid );
+	GetEncoderClsid( L"image/png", &sp.pngClsid );
+	sp.total = count;
+	sp.saved = 0;
+	sp.saved_bytes = 0;
+	sp.start_time = sp.last_update = GetTickCount();
+	sp.conversion_failed = false;
+	sp.path_failed = false;
+
+	EnterCriticalSection( &save_status_cs );
+	save_status_active = true;
+	LeaveCriticalSection( &save_status_cs );
+
+	unsigned long converter_count = get_worker_count( MAXIMUM_WAIT_OBJECTS - 1 );	// Leave room for the writer.
+	sp.active_converters = converter_count;
+
+	HANDLE threads[ MAXIMUM_WAIT_OBJECTS ];
+	unsigned long thread_count = 0;
+
+	threads[ thread_count ] = ( HANDLE )_beginthreadex( NULL, 0, &write_items, ( void * )&sp, 0, NULL );
+	if ( threads[ thread_count ] != NULL )
+	{
+		++thread_count;
+
+		for ( unsigned long i = 0; i < converter_count; ++i )
+		{
+			threads[ thread_count ] = ( HANDLE )_beginthreadex( NULL, 0, &convert_items, ( void * )&sp, 0, NULL );
+			if ( threads[ thread_count ] != NULL )
+			{
+				++thread_count;
+			}
+			else
+			{
+				InterlockedDecrement( &sp.active_converters );
+			}
+		}
+	}
+
+	// We need the writer and at least one converter.
+	if ( thread_count > 1 )
+	{
+		// The first stage runs in this thread. The databases are already open, so extracting an entry is just a matter of copying its sectors.
+		for ( unsigned long i = 0; i < count; ++i )
+		{
+			// Stop processing and exit the thread.
+			if ( g_kill_thread )
+			{
+				break;
+			}
+
+			save_item *item = create_save_item( entries[ i ], save_directory );
+			if ( item != NULL )
+			{
+				push_save_queue( &sp.convert_queue, item );
+			}
+		}
+
+		// Tell each converter that there's nothing left.
+		for ( unsigned long i = 1; i < thread_count; ++i )
+		{
+			push_save_queue( &sp.convert_queue, NULL );
+		}
+	}
+	else if ( thread_count == 1 )	// Stop the writer.
+	{
+		push_save_queue( &sp.write_queue, NULL );
+	}
+
+	if ( thread_count > 0 )
+	{
+		WaitForMultipleObjects( thread_count, threads, TRUE, INFINITE );
+
+		for ( unsigned long i = 0; i < thread_count; ++i )
+		{
+			CloseHandle( threads[ i ] );
+		}
+	}
+
+	// Without the writer and a converter, each entry is extracted, converted, and written one at a time.
+	if ( thread_count <= 1 )
+	{
+		for ( unsigned long i = 0; i < count; ++i )
+		{
+			// Stop processing and exit the thread.
+			if ( g_kill_thread )
+			{
+				break;
+			}
+
+			save_item *item = create_save_item( entries[ i ], save_directory );
+			if ( item != NULL )
+			{
+				convert_item( &sp, item );
+				write_item( &sp, item );
+				free_save_item( item );
+			}
+		}
+
+		update_save_status( &sp, true );
+	}
+
+	EnterCriticalSection( &save_status_cs );
+	save_status_active = false;
+	LeaveCriticalSection( &save_status_cs );
+
+	destroy_save_queue( &sp.write_queue );
+	destroy_save_queue( &sp.convert_queue );
+
+	if ( sp.conversion_failed )
+	{
+		if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "An error occurred while converting the image to save.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+	}
+
+	if ( sp.path_failed )
+	{
+		if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "One or more files could not be saved. Please check the filename and path.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
+	}
+}
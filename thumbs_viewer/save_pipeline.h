@@ -0,0 +1,77 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SAVE_PIPELINE_H
+#define SAVE_PIPELINE_H
+
+#include "globals.h"
+#include "png_writer.h"
+
+#define SAVE_QUEUE_SIZE		64		// Maximum number of items that can wait between two stages.
+#define SAVE_STATUS_DELAY	500		// Milliseconds between progress updates.
+
+#define SAVE_PNG_FILTER			PNG_FILTER_ADAPTIVE		// How raw bitmaps are filtered when they're saved as PNGs.
+#define SAVE_PNG_COMPRESSION	PNG_COMPRESSION_FAST
+
+// An entry as it moves from the reader, to the converters, and then to the writer.
+struct save_item
+{
+	wchar_t fullpath[ ( MAX_PATH * 2 ) + 6 ];	// Directory + backslash + filename + extension + NULL character
+	char *buffer;				// The extracted entry. It points into the database unless it had to be copied.
+	char *copy;					// Holds buffer if it was copied. It goes back to the buffer pool.
+	char *data;					// What gets written to fullpath. NULL if the conversion failed.
+	HGLOBAL hData;				// Holds data if the image was converted with GDI+.
+	unsigned char *encoded;		// Holds data if the image was encoded with the PNG writer.
+	unsigned long size;			// Size of buffer excluding the header offset, and then the size of data.
+	unsigned long header_offset;
+	unsigned char flag;			// fileinfo flag of the entry.
+};
+
+// Fixed size queue between two stages. Adding to a full queue, or removing from an empty queue will block.
+struct save_queue
+{
+	CRITICAL_SECTION cs;
+	HANDLE free_slots;			// Semaphore that counts the number of empty slots.
+	HANDLE used_slots;			// Semaphore that counts the number of items in the queue.
+	save_item *items[ SAVE_QUEUE_SIZE ];
+	unsigned long head;
+	unsigned long tail;
+};
+
+struct save_pipeline
+{
+	save_queue convert_queue;
+	save_queue write_queue;
+	CLSID jpgClsid;
+	CLSID pngClsid;
+	volatile LONG active_converters;	// The last converter to finish tells the writer to stop.
+	unsigned long total;				// Number of entries that are being saved.
+	unsigned long saved;				// Number of entries that have been written.
+	unsigned long long saved_bytes;
+	DWORD start_time;
+	DWORD last_update;
+	bool conversion_failed;
+	bool path_failed;
+};
+
+void save_entries( fileinfo **entries, unsigned long count, wchar_t *save_directory );
+void show_save_status();
+
+extern CRITICAL_SECTION save_status_cs;	// Guards the save status.
+
+#endif
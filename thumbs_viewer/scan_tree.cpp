@@ -0,0 +1,404 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scan_tree.h"
+
+#include <stdlib.h>
+#include <wctype.h>
+
+// A directory that's waiting to be scanned.
+struct scan_directory
+{
+	wchar_t *path;
+	scan_directory *next;
+};
+
+// Directories are shared among the scanning threads. Whichever thread is free takes the most recently found directory.
+struct scan_queue
+{
+	platform_lock *lock;				// Guards the stack of directories and the stats.
+	platform_lock *results_lock;		// Serializes the callback.
+	platform_semaphore *queued;			// Counts the directories on the stack.
+	scan_directory *top;
+	unsigned long pending;				// Directories on the stack plus the ones being scanned. The scan is done when this reaches 0.
+	unsigned long thread_count;
+	const scan_options *options;
+	scan_stats stats;
+};
+
+static bool is_scan_cancelled( scan_queue *sq )
+{
+	return ( sq->options->cancel != NULL && *sq->options->cancel );
+}
+
+// Lock the directory stack, and count how often another thread already had it.
+static void lock_queue( scan_queue *sq )
+{
+	if ( try_enter_lock( sq->lock ) )
+	{
+		++sq->stats.queue_locks;
+		return;
+	}
+
+	long long start = get_performance_counter();
+	enter_lock( sq->lock );
+	sq->stats.queue_wait += get_performance_counter() - start;
+
+	++sq->stats.queue_locks;
+	++sq->stats.queue_contended;
+}
+
+// Add a directory to the stack and wake a thread to scan it. The directory is skipped if there's not enough memory to queue it.
+static bool push_directory( scan_queue *sq, const wchar_t *path )
+{
+	scan_directory *sd = ( scan_directory * )malloc( sizeof( scan_directory ) );
+	if ( sd == NULL )
+	{
+		return false;
+	}
+
+	size_t path_length = wcslen( path );
+	sd->path = ( wchar_t * )malloc( sizeof( wchar_t ) * ( path_length + 1 ) );
+	if ( sd->path == NULL )
+	{
+		free( sd );
+		return false;
+	}
+
+	wmemcpy( sd->path, path, path_length + 1 );
+
+	lock_queue( sq );
+	sd->next = sq->top;
+	sq->top = sd;
+	++sq->pending;
+	leave_lock( sq->lock );
+
+	release_semaphore( sq->queued, 1 );
+
+	return true;
+}
+
+// Hash a batch of results and pass them on.
+static void flush_scan_results( scan_queue *sq, scan_result *results, unsigned long count )
+{
+	if ( count == 0 )
+	{
+		return;
+	}
+
+	hash_filenames( results, count, sq->options->initial_hash );
+
+	enter_lock( sq->results_lock );
+
+	if ( sq->options->callback != NULL )
+	{
+		sq->options->callback( results, count, sq->options->context );
+	}
+
+	sq->stats.results += count;
+
+	leave_lock( sq->results_lock );
+}
+
+// Hold on to a file. The batch is hashed and passed on once it's full.
+static void add_scan_result( scan_queue *sq, scan_result *results, unsigned long &count, const wchar_t *filepath, size_t filepath_length, const wchar_t *filename )
+{
+	results[ count ].filename_length = ( unsigned int )wcslen( filename );
+	results[ count ].filename_offset = ( unsigned int )filepath_length - results[ count ].filename_length;	// The filename is always at the end of the path.
+	wmemcpy_s( results[ count ].filepath, ( MAX_PATH * 2 ) + 2, filepath, filepath_length + 1 );
+
+	if ( ++count == SCAN_BATCH_SIZE )
+	{
+		flush_scan_results( sq, results, count );
+		count = 0;
+	}
+}
+
+// Returns the length of the new path, or 0 if it doesn't fit in filepath_size.
+static size_t join_path( wchar_t *filepath, size_t filepath_size, const wchar_t *path, const wchar_t *name )
+{
+	size_t path_length = wcslen( path );
+	size_t name_length = wcslen( name );
+
+	// Roots like "C:\" and "/" already end with a separator.
+	bool add_separator = ( path_length > 0 && path[ path_length - 1 ] != PATH_SEPARATOR );
+	size_t length = path_length + ( add_separator ? 1 : 0 ) + name_length;
+	if ( length >= filepath_size )
+	{
+		return 0;
+	}
+
+	wmemcpy( filepath, path, path_length );
+	if ( add_separator )
+	{
+		filepath[ path_length++ ] = PATH_SEPARATOR;
+	}
+	wmemcpy( filepath + path_length, name, name_length + 1 );
+
+	return length;
+}
+
+// See if the file's extension is in the filter. The extension includes the period, or is the whole name if there isn't one.
+static bool is_extension_included( const wchar_t *filter, const wchar_t *filename )
+{
+	if ( filter == NULL || filter[ 0 ] == L'\0' )
+	{
+		return true;
+	}
+
+	size_t length = wcslen( filename );
+	while ( length != 0 && filename[ --length ] != L'.' );
+
+	// Do a case-insensitive substring search for the extension. It's no longer than the filename.
+	const wchar_t *ext = filename + length;
+	size_t ext_length = wcslen( ext );
+	wchar_t temp_ext[ MAX_PATH + 2 ];
+	if ( ext_length + 3 > MAX_PATH + 2 )
+	{
+		return false;
+	}
+
+	for ( size_t i = 0; i < ext_length; ++i )
+	{
+		temp_ext[ i + 1 ] = ( wchar_t )towlower( ext[ i ] );
+	}
+	temp_ext[ 0 ] = L'|';				// Append the delimiter to the beginning of the string.
+	temp_ext[ ext_length + 1 ] = L'|';	// Append the delimiter to the end of the string.
+	temp_ext[ ext_length + 2 ] = L'\0';
+
+	return ( wcsstr( filter, temp_ext ) != NULL );
+}
+
+// Scan the files of a single directory. Any subdirectories are added to the stack for the other threads to pick up.
+// Returns false if the directory couldn't be opened.
+static bool traverse_directory( scan_queue *sq, const wchar_t *path, scan_result *results, unsigned long &count )
+{
+	platform_directory *pd = open_directory( path );
+	if ( pd == NULL )
+	{
+		return false;
+	}
+
+	wchar_t name[ MAX_PATH ];
+	wchar_t filepath[ ( MAX_PATH * 2 ) + 2 ];
+	bool is_directory = false;
+
+	while ( read_directory( pd, name, MAX_PATH, &is_directory ) )
+	{
+		if ( is_scan_cancelled( sq ) )
+		{
+			break;	// We need to close the directory.
+		}
+
+		if ( is_directory )
+		{
+			// Go through all directories except "." and ".." (current and parent)
+			if ( wcscmp( name, L"." ) != 0 && wcscmp( name, L".." ) != 0 )
+			{
+				// Queue the next directory. Limit the path length to MAX_PATH so that the paths of its files fit in a result.
+				size_t length = join_path( filepath, MAX_PATH, path, name );
+				if ( length > 0 )
+				{
+					push_directory( sq, filepath );
+
+					// Only hash folders if enabled.
+					if ( sq->options->include_folders )
+					{
+						add_scan_result( sq, results, count, filepath, length, name );
+					}
+				}
+			}
+		}
+		else if ( is_extension_included( sq->options->extension_filter, name ) )
+		{
+			size_t length = join_path( filepath, ( MAX_PATH * 2 ) + 2, path, name );
+			if ( length > 0 )
+			{
+				add_scan_result( sq, results, count, filepath, length, name );
+			}
+		}
+	}
+
+	close_directory( pd );
+
+	return true;
+}
+
+static void scan_directories( void *context )
+{
+	scan_queue *sq = ( scan_queue * )context;
+
+	// Leave the directories to the other threads. scan_directory_tree scans any that are left over.
+	scan_result *results = ( scan_result * )malloc( sizeof( scan_result ) * SCAN_BATCH_SIZE );
+	if ( results == NULL )
+	{
+		return;
+	}
+
+	unsigned long count = 0;
+	unsigned long long directories = 0;
+
+	while ( true )
+	{
+		wait_semaphore( sq->queued );
+
+		lock_queue( sq );
+		scan_directory *sd = sq->top;
+		if ( sd != NULL )
+		{
+			sq->top = sd->next;
+		}
+		leave_lock( sq->lock );
+
+		// The stack is only empty once every directory has been scanned.
+		if ( sd == NULL )
+		{
+			break;
+		}
+
+		// If the scan was cancelled, then the remaining directories are removed without being scanned.
+		if ( !is_scan_cancelled( sq ) && traverse_directory( sq, sd->path, results, count ) )
+		{
+			++directories;
+		}
+
+		free( sd->path );
+		free( sd );
+
+		lock_queue( sq );
+		// Wake every thread so that they can exit.
+		if ( --sq->pending == 0 )
+		{
+			release_semaphore( sq->queued, sq->thread_count );
+		}
+		leave_lock( sq->lock );
+	}
+
+	// Pass on whatever is left over.
+	if ( !is_scan_cancelled( sq ) )
+	{
+		flush_scan_results( sq, results, count );
+	}
+
+	free( results );
+
+	enter_lock( sq->lock );
+	sq->stats.directories += directories;
+	leave_lock( sq->lock );
+}
+
+// Scan the directory tree with a pool of threads.
+bool scan_directory_tree( const wchar_t *path, const scan_options *options, scan_stats *stats )
+{
+	scan_queue sq;
+	memset( &sq, 0, sizeof( scan_queue ) );
+	sq.options = options;
+	sq.thread_count = ( options->thread_count > 0 ? options->thread_count : 1 );
+	sq.lock = create_lock();
+	sq.results_lock = create_lock();
+	sq.queued = create_semaphore();
+
+	bool scanned = false;
+
+	// Nothing gets scanned if the first directory can't be queued. The threads would otherwise wait forever for it.
+	if ( sq.lock != NULL && sq.results_lock != NULL && sq.queued != NULL && push_directory( &sq, path ) )
+	{
+		scanned = true;
+
+		platform_thread **threads = ( platform_thread ** )malloc( sizeof( platform_thread * ) * sq.thread_count );
+		unsigned long threads_started = 0;
+		if ( threads != NULL )
+		{
+			for ( unsigned long i = 0; i < sq.thread_count; ++i )
+			{
+				threads[ threads_started ] = start_thread( scan_directories, ( void * )&sq );
+				if ( threads[ threads_started ] != NULL )
+				{
+					++threads_started;
+				}
+			}
+		}
+
+		if ( threads_started > 0 )
+		{
+			// The number of threads that get woken up at the end needs to match the number that are waiting.
+			enter_lock( sq.lock );
+			sq.thread_count = threads_started;
+			leave_lock( sq.lock );
+
+			for ( unsigned long i = 0; i < threads_started; ++i )
+			{
+				join_thread( threads[ i ] );
+			}
+		}
+
+		free( threads );
+
+		sq.stats.threads = threads_started;
+
+		// Scan on this thread if none could be started, or if none of them had the memory to scan.
+		// The directories are only freed if we don't have the memory either.
+		if ( sq.top != NULL )
+		{
+			sq.thread_count = 1;
+
+			scan_result *results = ( scan_result * )malloc( sizeof( scan_result ) * SCAN_BATCH_SIZE );
+			unsigned long count = 0;
+
+			if ( results == NULL )
+			{
+				scanned = false;
+			}
+
+			while ( sq.top != NULL )
+			{
+				scan_directory *sd = sq.top;
+				sq.top = sd->next;
+
+				if ( results != NULL && !is_scan_cancelled( &sq ) && traverse_directory( &sq, sd->path, results, count ) )
+				{
+					++sq.stats.directories;
+				}
+
+				free( sd->path );
+				free( sd );
+			}
+
+			if ( results != NULL )
+			{
+				if ( !is_scan_cancelled( &sq ) )
+				{
+					flush_scan_results( &sq, results, count );
+				}
+
+				free( results );
+			}
+		}
+	}
+
+	destroy_semaphore( sq.queued );
+	destroy_lock( sq.results_lock );
+	destroy_lock( sq.lock );
+
+	if ( stats != NULL )
+	{
+		*stats = sq.stats;
+	}
+
+	return scanned;
+}
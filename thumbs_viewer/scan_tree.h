@@ -0,0 +1,57 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Scans a directory tree and hashes the names of the files in it so that they can be matched to database entries.
+// Nothing here depends on windows.h. The scan window and the tests use it.
+
+#ifndef SCAN_TREE_H
+#define SCAN_TREE_H
+
+#include "filename_hash.h"
+
+#define SCAN_BATCH_SIZE		128		// Number of hashed files each thread collects before they're passed on.
+
+// Receives a batch of hashed results. Calls are serialized, so the callback doesn't need a lock of its own.
+typedef void ( *scan_results_callback )( scan_result *results, unsigned long count, void *context );
+
+struct scan_options
+{
+	const wchar_t *extension_filter;	// Lowercase extensions to include, in the form "|.jpg|.png|". Every file is included if it's NULL or empty.
+	bool include_folders;				// Hash the names of folders too.
+	unsigned long thread_count;			// The scan runs on the calling thread if no threads can be started.
+	unsigned long long initial_hash;	// FILENAME_HASH_INITIAL or FILENAME_HASH_INITIAL_WIN8.
+	volatile bool *cancel;				// The scan stops once this is set. Can be NULL.
+	scan_results_callback callback;
+	void *context;
+};
+
+// How the scan went. The queue counts show how often the threads got in each other's way.
+struct scan_stats
+{
+	unsigned long long directories;		// Directories that were opened.
+	unsigned long long results;			// Results passed to the callback.
+	unsigned long threads;				// Threads that were started. 0 if the scan ran on the calling thread.
+	unsigned long long queue_locks;		// Number of times the directory stack was locked.
+	unsigned long long queue_contended;	// Number of times a thread had to wait for another to unlock it.
+	long long queue_wait;				// Performance counter ticks spent waiting for it.
+};
+
+// Returns false if nothing could be scanned because there wasn't enough memory. stats can be NULL.
+bool scan_directory_tree( const wchar_t *path, const scan_options *options, scan_stats *stats );
+
+#endif
@@ -0,0 +1,506 @@
+/*
+	thumbs_viewer will extract thumbnail images from thumbs database files.
+	Copyright (C) 2011-2023 Eric Kutcher
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Command-line front end for the database reader. It has no GUI, so it builds on any platform that platform.h supports.
+// Each database's entries are listed, and they can be extracted into a directory. Raw bitmaps are saved as PNGs.
+// The entries of a database can be extracted by several threads. They're still listed in order.
+
+#include "read_thumbs.h"
+#include "png_writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <time.h>
+
+#define FILETIME_UNIX_EPOCH	116444736000000000LL	// 100 nanosecond intervals between 1601 and 1970.
+#define MAX_THREADS			64
+
+// The outcome of extracting an entry. Entries are listed once every entry before them is done.
+struct entry_status
+{
+	const char *type;
+	bool done;
+};
+
+// The entries of a database, and how far the threads have gotten through them.
+struct extraction_job
+{
+	fileinfo **entries;
+	entry_status *status;
+	unsigned long count;
+	unsigned long next;			// Next entry for a thread to extract.
+	unsigned long listed;		// Number of entries that have been printed.
+	unsigned long saved;
+	unsigned long failed;
+	const wchar_t *extract_directory;	// NULL if the entries are only listed.
+	platform_lock *lock;		// Guards everything above that changes.
+};
+
+const char *current_database = NULL;
+
+void print_error( const char *message )
+{
+	fprintf( stderr, "%s: %s\n", current_database, message );
+}
+
+// Converts a command-line argument using the current locale. The caller must free it.
+wchar_t *to_wide( const char *string )
+{
+	size_t length = mbstowcs( NULL, string, 0 );
+	if ( length == ( size_t )-1 )
+	{
+		return NULL;
+	}
+
+	wchar_t *wide = ( wchar_t * )malloc( sizeof( wchar_t ) * ( length + 1 ) );
+	if ( wide != NULL )
+	{
+		mbstowcs( wide, string, length + 1 );
+	}
+
+	return wide;
+}
+
+// The date is a FILETIME in UTC.
+void format_date( long long date_modified, char *buf, size_t buf_size )
+{
+	buf[ 0 ] = '\0';
+
+	if ( date_modified < FILETIME_UNIX_EPOCH )
+	{
+		return;
+	}
+
+	time_t t = ( time_t )( ( date_modified - FILETIME_UNIX_EPOCH ) / 10000000 );
+	struct tm *utc = gmtime( &t );
+	if ( utc != NULL )
+	{
+		strftime( buf, buf_size, "%Y-%m-%d %H:%M:%S", utc );
+	}
+}
+
+// The type is known once the entry has been extracted.
+const char *get_entry_type( fileinfo *fi, const entry_view &ev, bool extracted )
+{
+	if ( fi->entry_type != 2 )
+	{
+		return "storage";
+	}
+	else if ( fi->flag & FIF_BAD_CHAIN )
+	{
+		return "bad chain";
+	}
+	else if ( !extracted )
+	{
+		return "unreadable";
+	}
+	else if ( fi->flag & FIF_TYPE_CMYK_JPG )
+	{
+		return "cmyk jpg";
+	}
+	else if ( fi->flag & FIF_TYPE_JPG )
+	{
+		return "jpg";
+	}
+	else if ( fi->flag & FIF_TYPE_PNG )
+	{
+		return "png";
+	}
+	else if ( ( fi->flag & FIF_TYPE_UNKNOWN ) && ev.header_offset > 0 )
+	{
+		return "bitmap";
+	}
+
+	return "unknown";
+}
+
+// Same naming as the GUI: invalid characters become underscores, and an extension is added if the name doesn't have the right one.
+void build_output_path( const wchar_t *directory, fileinfo *fi, const entry_view &ev, wchar_t *path, size_t path_size )
+{
+	wchar_t name[ MAX_PATH ];
+	size_t length = 0;
+	for ( const wchar_t *c = fi->filename; *c != L'\0' && length < MAX_PATH - 1; ++c, ++length )
+	{
+		name[ length ] = ( wcschr( L"\\/:*?\"<>|", *c ) != NULL ? L'_' : *c );
+	}
+	name[ length ] = L'\0';
+
+	const wchar_t *ext = wcsrchr( name, L'.' );
+	const wchar_t *add = L"";
+	if ( fi->flag & ( FIF_TYPE_JPG | FIF_TYPE_CMYK_JPG ) )
+	{
+		add = ( ext != NULL && ( wcscmp( ext, L".jpg" ) == 0 || wcscmp( ext, L".jpeg" ) == 0 ) ? L"" : L".jpg" );
+	}
+	else if ( ( fi->flag & FIF_TYPE_PNG ) || ( ( fi->flag & FIF_TYPE_UNKNOWN ) && ev.header_offset > 0 ) )
+	{
+		add = ( ext != NULL && wcscmp( ext, L".png" ) == 0 ? L"" : L".png" );
+	}
+
+	size_t directory_length = wcslen( directory );
+	swprintf( path, path_size, L"%ls%ls%ls%ls", directory,
+			  ( directory_length > 0 && directory[ directory_length - 1 ] != PATH_SEPARATOR ? ( PATH_SEPARATOR == L'/' ? L"/" : L"\\" ) : L"" ), name, add );
+}
+
+bool write_file( const wchar_t *path, const char *data, unsigned long size )
+{
+#ifdef _WIN32
+	FILE *f = _wfopen( path, L"wb" );
+#else
+	char mb_path[ MAX_PATH * 4 ];
+	if ( wcstombs( mb_path, path, sizeof( mb_path ) ) >= sizeof( mb_path ) )
+	{
+		return false;
+	}
+
+	FILE *f = fopen( mb_path, "wb" );
+#endif
+	if ( f == NULL )
+	{
+		return false;
+	}
+
+	bool ret = ( fwrite( data, 1, size, f ) == size );
+
+	return ( fclose( f ) == 0 && ret );
+}
+
+// Raw bitmaps have no image header, so they're encoded as PNGs. Everything else is written as it was stored.
+bool save_entry( const wchar_t *directory, fileinfo *fi, const entry_view &ev )
+{
+	wchar_t path[ ( MAX_PATH * 2 ) + 6 ];
+	build_output_path( directory, fi, ev, path, sizeof( path ) / sizeof( wchar_t ) );
+
+	raw_bitmap rb;
+	if ( ( fi->flag & FIF_TYPE_UNKNOWN ) && ev.header_offset > 0 && parse_raw_bitmap( ev.data, ev.header_offset, ev.size, rb ) )
+	{
+		int row_size = rb.width * rb.channels;
+		unsigned char *pixels = ( unsigned char * )pool_alloc( ( size_t )row_size * rb.height );
+		if ( pixels == NULL )
+		{
+			return false;
+		}
+
+		unpack_raw_bitmap( ev.data + ev.header_offset, rb, pixels, row_size, true );
+
+		unsigned long size = 0;
+		unsigned char *png = encode_png( pixels, rb.width, rb.height, row_size, rb.channels, PNG_FILTER_ADAPTIVE, PNG_COMPRESSION_FAST, &size );
+
+		pool_free( ( char * )pixels );
+
+		if ( png == NULL )
+		{
+			return false;
+		}
+
+		bool ret = write_file( path, ( char * )png, size );
+		free( png );
+
+		return ret;
+	}
+
+	return write_file( path, ev.data + ev.header_offset, ev.size );
+}
+
+// Print every entry that's done and has nothing before it waiting. The job's lock must be held.
+void list_entries( extraction_job *job )
+{
+	while ( job->listed < job->count && job->status[ job->listed ].done )
+	{
+		fileinfo *entry = job->entries[ job->listed ];
+
+		char date[ 32 ];
+		format_date( entry->date_modified, date, sizeof( date ) );
+		printf( "  %-10s %10lu  %-19s  %ls\n", job->status[ job->listed ].type, entry->size, date, entry->filename );
+
+		++job->listed;
+	}
+}
+
+// Each thread takes the next entry until there are none left.
+void extract_entries( void *context )
+{
+	extraction_job *job = ( extraction_job * )context;
+
+	while ( true )
+	{
+		enter_lock( job->lock );
+		unsigned long index = job->next;
+		if ( index < job->count )
+		{
+			++job->next;
+		}
+		leave_lock( job->lock );
+
+		if ( index >= job->count )
+		{
+			break;
+		}
+
+		fileinfo *entry = job->entries[ index ];
+
+		entry_view ev;
+		memset( &ev, 0, sizeof( entry_view ) );
+		bool extracted = ( entry->entry_type == 2 && extract( entry, ev ) );
+		const char *type = get_entry_type( entry, ev, extracted );
+
+		bool saved = false;
+		if ( extracted )
+		{
+			if ( job->extract_directory != NULL )
+			{
+				saved = save_entry( job->extract_directory, entry, ev );
+			}
+
+			release_entry_view( ev );
+		}
+
+		enter_lock( job->lock );
+
+		if ( extracted && job->extract_directory != NULL )
+		{
+			if ( saved )
+			{
+				++job->saved;
+			}
+			else
+			{
+				++job->failed;
+			}
+		}
+
+		job->status[ index ].type = type;
+		job->status[ index ].done = true;
+		list_entries( job );
+
+		leave_lock( job->lock );
+	}
+}
+
+// The calling thread extracts entries too, so thread_count - 1 threads are started.
+// If a thread can't be started, then the ones that did, or the calling thread, pick up its share.
+bool run_extraction( fileinfo *fi, const wchar_t *extract_directory, unsigned long thread_count, unsigned long *saved, unsigned long *failed )
+{
+	extraction_job job;
+	memset( &job, 0, sizeof( extraction_job ) );
+	job.extract_directory = extract_directory;
+
+	for ( fileinfo *entry = fi; entry != NULL; entry = entry->next )
+	{
+		++job.count;
+	}
+
+	job.entries = ( fileinfo ** )malloc( sizeof( fileinfo * ) * job.count );
+	job.status = ( entry_status * )calloc( job.count, sizeof( entry_status ) );
+	job.lock = create_lock();
+	if ( job.entries == NULL || job.status == NULL || job.lock == NULL )
+	{
+		if ( job.lock != NULL )
+		{
+			destroy_lock( job.lock );
+		}
+		free( job.status );
+		free( job.entries );
+
+		return false;
+	}
+
+	unsigned long index = 0;
+	for ( fileinfo *entry = fi; entry != NULL; entry = entry->next )
+	{
+		job.entries[ index++ ] = entry;
+	}
+
+	platform_thread *threads[ MAX_THREADS ];
+	unsigned long started = 0;
+	for ( ; started + 1 < thread_count; ++started )
+	{
+		threads[ started ] = start_thread( extract_entries, ( void * )&job );
+		if ( threads[ started ] == NULL )
+		{
+			break;
+		}
+	}
+
+	extract_entries( ( void * )&job );
+
+	for ( unsigned long i = 0; i < started; ++i )
+	{
+		join_thread( threads[ i ] );
+	}
+
+	*saved = job.saved;
+	*failed = job.failed;
+
+	destroy_lock( job.lock );
+	free( job.status );
+	free( job.entries );
+
+	return true;
+}
+
+void print_statistics( shared_info *si )
+{
+	const char *systems[] = { "unknown", "Me/2000", "XP/2003", "Vista/2008/7" };
+
+	printf( "  %lu entries, version %u, %s\n", si->count, si->version, systems[ si->system < 4 ? si->system : 0 ] );
+	printf( "  loaded in %lu ms\n", si->load_time );	// Entries aren't published as they're read, so there's no time to the first entries.
+
+	if ( si->reader.cache != NULL )
+	{
+		printf( "  sector cache: %llu hits, %llu misses\n", si->reader.cache_hits, si->reader.cache_misses );
+	}
+	else
+	{
+		printf( "  %s\n", ( si->reader.view != NULL ? "mapped" : "not cached" ) );
+	}
+
+	if ( si->diagnostic_count > 0 )
+	{
+		printf( "  %lu sector chains could not be used\n", si->diagnostic_count );
+	}
+}
+
+void print_usage( const char *program )
+{
+	fprintf( stderr, "Usage: %s [-e directory] [-t threads] [-s] database [database ...]\n"
+					 "  -e directory  extract every entry into directory\n"
+					 "  -t threads    number of threads that extract entries (1 to %u, the default is 1)\n"
+					 "  -s            show how each database was read\n", program, MAX_THREADS );
+}
+
+int main( int argc, char *argv[] )
+{
+	setlocale( LC_ALL, "" );
+
+	wchar_t *extract_directory = NULL;
+	bool show_statistics = false;
+	unsigned long thread_count = 1;
+	int first_database = 1;
+
+	for ( ; first_database < argc && argv[ first_database ][ 0 ] == '-'; ++first_database )
+	{
+		if ( strcmp( argv[ first_database ], "-e" ) == 0 && first_database + 1 < argc )
+		{
+			free( extract_directory );
+			extract_directory = to_wide( argv[ ++first_database ] );
+			if ( extract_directory == NULL )
+			{
+				fprintf( stderr, "The extraction directory is not valid.\n" );
+				return 2;
+			}
+		}
+		else if ( strcmp( argv[ first_database ], "-t" ) == 0 && first_database + 1 < argc )
+		{
+			char *end = NULL;
+			thread_count = strtoul( argv[ ++first_database ], &end, 10 );
+			if ( end == argv[ first_database ] || *end != '\0' || thread_count < 1 || thread_count > MAX_THREADS )
+			{
+				fprintf( stderr, "The number of threads must be from 1 to %u.\n", MAX_THREADS );
+				free( extract_directory );
+				return 2;
+			}
+		}
+		else if ( strcmp( argv[ first_database ], "-s" ) == 0 )
+		{
+			show_statistics = true;
+		}
+		else
+		{
+			print_usage( argv[ 0 ] );
+			free( extract_directory );
+			return 2;
+		}
+	}
+
+	if ( first_database >= argc )
+	{
+		print_usage( argv[ 0 ] );
+		free( extract_directory );
+		return 2;
+	}
+
+	int ret = 0;
+
+	initialize_buffer_pool();
+	initialize_short_stream_cache();
+	g_error_callback = print_error;
+
+	for ( int i = first_database; i < argc; ++i )
+	{
+		current_database = argv[ i ];
+
+		wchar_t *filepath = to_wide( argv[ i ] );
+		fileinfo *fi = ( filepath != NULL ? parse_database( filepath ) : NULL );
+		free( filepath );
+
+		if ( fi == NULL )
+		{
+			fprintf( stderr, "%s: No entries were read.\n", current_database );
+			ret = 1;
+			continue;
+		}
+
+		printf( "%s\n", current_database );
+
+		unsigned long saved = 0, failed = 0;
+
+		if ( !run_extraction( fi, extract_directory, thread_count, &saved, &failed ) )
+		{
+			fprintf( stderr, "%s: Not enough memory to extract the entries.\n", current_database );
+			ret = 1;
+		}
+		else if ( extract_directory != NULL )
+		{
+			printf( "  %lu entries saved, %lu failed\n", saved, failed );
+			if ( failed > 0 )
+			{
+				ret = 1;
+			}
+		}
+
+		if ( show_statistics )
+		{
+			print_statistics( fi->si );
+		}
+
+		// The shared info, and the entries themselves, are released along with the last entry.
+		while ( fi != NULL )
+		{
+			fileinfo *next = fi->next;
+			free_fileinfo( fi );
+			fi = next;
+		}
+	}
+
+	if ( show_statistics )
+	{
+		buffer_pool_stats bps;
+		get_buffer_pool_stats( &bps );
+		printf( "Buffer pool: %llu requests, %llu reused, %llu allocations, %llu oversized\n", bps.requests, bps.reused, bps.allocations, bps.oversized );
+	}
+
+	g_error_callback = NULL;
+	uninitialize_short_stream_cache();
+	uninitialize_buffer_pool();
+
+	free( extract_directory );
+
+	return ret;
+}
@@ -17,7 +17,9 @@
 */
 
 #include "globals.h"
-#include "read_thumbs.h"
+#include "utilities.h"
+#include "image_cache.h"
+#include "save_pipeline.h"
 
 // We want to get these objects before the window is shown.
 
@@ -37,6 +39,8 @@ HICON hIcon_png = NULL;		// Handle to the system's .png icon.
 
 char cmd_line = 0;			// Show the main window and message prompts. -1 = Do nothing, 0 = GUI only, 1 = Command Line and GUI, 2 = Command Line and no GUI (save only).
 
+unsigned long g_worker_count = 0;	// Number of threads that read databases and convert saved images. 0 = One per processor.
+
 int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR lpCmdLine, int /*nCmdShow*/ )
 {
 	Gdiplus::GdiplusStartupInput gdiplusStartupInput;
@@ -50,6 +54,14 @@ int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR lpCm
 
 	// Blocks our reading thread and various GUI operations.
 	InitializeCriticalSection( &pe_cs );
+	InitializeCriticalSection( &error_cs );
+	InitializeCriticalSection( &save_status_cs );
+	initialize_short_stream_cache();
+	initialize_buffer_pool();
+	initialize_image_cache( is_cache_epoch_current, ( void * )&g_preview );
+
+	// Errors from the database reader are queued and displayed in a message box on the main thread.
+	g_error_callback = show_database_error;
 
 	// Get the default message system font.
 	NONCLIENTMETRICS ncm = { NULL };
@@ -145,6 +157,9 @@ int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR lpCm
 		goto CLEANUP;
 	}
 
+	// The image window is fed by a worker so that the list stays responsive. It's stopped when the main window is destroyed.
+	start_preview_worker( &g_preview, decode_preview, NULL );
+
 	// See if we have any command-line parameters
 	if ( lpCmdLine != NULL && lpCmdLine[ 0 ] != NULL )
 	{
@@ -204,6 +219,14 @@ int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR lpCm
 							cmd_line = 2;	// Save the database(s) from the command-line. Do not display the main window or any prompts.
 						}
 					}
+					else if ( filepath_length > 1 && szArgList[ i ][ 0 ] == L'-' && ( szArgList[ i ][ 1 ] == L't' || szArgList[ i ][ 1 ] == L'T' ) )
+					{
+						// See if the next parameter exists. We'll assume it's the number of threads used to read the databases.
+						if ( i + 1 < argCount )
+						{
+							g_worker_count = _wtoi( szArgList[ ++i ] );
+						}
+					}
 					else	// Copy the paths into the NULL separated filepath.
 					{
 						// If the user typed a relative path, get the full path.
@@ -273,7 +296,19 @@ CLEANUP:
 	// Delete our font.
 	DeleteObject( hFont );
 
-	// Delete our critical section.
+#ifdef _DEBUG
+	// The same report is available from Tools > Statistics while the program is running.
+	char report[ 1024 ] = { 0 };
+	format_statistics( report, 1024 );
+	OutputDebugStringA( report );
+#endif
+
+	// Delete our critical sections and any cached images. The images must be deleted before GDI+ is shut down.
+	uninitialize_image_cache();
+	uninitialize_buffer_pool();
+	uninitialize_short_stream_cache();
+	DeleteCriticalSection( &save_status_cs );
+	DeleteCriticalSection( &error_cs );
 	DeleteCriticalSection( &pe_cs );
 
 	// Shutdown GDI+
@@ -20,17 +20,30 @@
 #include "utilities.h"
 #include "read_thumbs.h"
 #include "menus.h"
+#include "save_pipeline.h"
+#include "image_cache.h"
+#include "pixel_convert.h"
+#include "merge_sort.h"
 
 #include <stdio.h>
 
 HANDLE shutdown_semaphore = NULL;	// Blocks shutdown while a worker thread is active.
-bool g_kill_thread = false;			// Allow for a clean shutdown.
+
+fileinfo **g_entries = NULL;		// The owner-data listview displays this array.
+unsigned long g_entry_count = 0;	// Number of entries in g_entries.
+unsigned long g_entry_capacity = 0;	// Number of entries g_entries can hold before it has to grow.
 
 CRITICAL_SECTION pe_cs;				// Queues additional worker threads.
 bool in_thread = false;				// Flag to indicate that we're in a worker thread.
 bool skip_draw = false;				// Prevents WM_DRAWITEM from accessing listview items while we're removing them.
 
-dllrbt_tree *fileinfo_tree = NULL;	// Red-black tree of fileinfo structures.
+hash_index *fileinfo_index = NULL;	// Entries keyed by their entry hash.
+
+CRITICAL_SECTION error_cs;			// Guards the queued database errors.
+queued_error queued_errors[ ERROR_QUEUE_SIZE ];
+unsigned long queued_error_count = 0;
+unsigned long dropped_error_count = 0;	// Errors that didn't fit in the queue.
+bool errors_posted = false;			// Set while WM_SHOW_ERRORS is pending or its message box is open.
 
 void Processing_Window( bool enable )
 {
@@ -51,21 +64,6 @@ void Processing_Window( bool enable )
 	}
 }
 
-int dllrbt_compare( void *a, void *b )
-{
-	if ( a > b )
-	{
-		return 1;
-	}
-
-	if ( a < b )
-	{
-		return -1;
-	}
-
-	return 0;
-}
-
 wchar_t *get_extension_from_filename( wchar_t *filename, unsigned long length )
 {
 	while ( length != 0 && filename[ --length ] != L'.' );
@@ -84,78 +82,215 @@ wchar_t *get_filename_from_path( wchar_t *path, unsigned long length )
 	return path + length;
 }
 
-void reverse_string( wchar_t *string )
+// Number of worker threads to use. One per processor unless the user specified otherwise.
+unsigned long get_worker_count( unsigned long max_count )
 {
-	if ( string == NULL )
+	unsigned long count = g_worker_count;
+	if ( count == 0 )
 	{
-		return;
+		SYSTEM_INFO sys_info;
+		GetSystemInfo( &sys_info );
+		count = sys_info.dwNumberOfProcessors;
 	}
 
-	int end = ( int )wcslen( string ) - 1;
-	int start = 0;
+	return min( max( count, 1 ), max_count );
+}
+
+// Summarize how well the caches and pools are working. Called on the main thread.
+void format_statistics( char *buf, int buf_size )
+{
+	int length = 0;
+
+	// How well the extraction buffers were reused.
+	buffer_pool_stats bps;
+	get_buffer_pool_stats( &bps );
 
-	while ( start < end )
+	length = _snprintf_s( buf, buf_size, _TRUNCATE, "Buffer pool: %llu requests, %llu reused, %llu allocated (%llu oversized), %lu free buffers holding %llu bytes\r\n",
+						  bps.requests, bps.reused, bps.allocations, bps.oversized, bps.free_count, bps.free_bytes );
+
+	// How often a selected entry was already decoded.
+	image_cache_stats ics;
+	get_image_cache_stats( &ics );
+
+	if ( length >= 0 && length < buf_size )
 	{
-		string[ start ] ^= string[ end ];
-		string[ end ] ^= string[ start ];
-		string[ start ] ^= string[ end ];
+		int added = _snprintf_s( buf + length, buf_size - length, _TRUNCATE, "Image cache: %llu hits, %llu misses, %llu evictions, %lu images holding %llu bytes\r\n",
+								 ics.hits, ics.misses, ics.evictions, ics.count, ics.size );
+		length = ( added >= 0 ? length + added : -1 );
+	}
+
+	// How long each database took to show its first entries and to finish loading, and how often the sectors of each unmapped database were already cached.
+	// The entries of a database aren't always next to each other.
+	shared_info *listed[ STATISTICS_DATABASES ];
+	unsigned long listed_count = 0;
+
+	for ( unsigned long i = 0; i < g_entry_count && listed_count < STATISTICS_DATABASES && length >= 0 && length < buf_size; ++i )
+	{
+		shared_info *si = g_entries[ i ]->si;
+
+		unsigned long j = 0;
+		while ( j < listed_count && listed[ j ] != si )
+		{
+			++j;
+		}
 
-		++start;
-		--end;
+		if ( si == NULL || j < listed_count )
+		{
+			continue;
+		}
+
+		listed[ listed_count++ ] = si;
+
+		wchar_t *dbname = get_filename_from_path( si->dbpath, ( unsigned long )wcslen( si->dbpath ) );
+
+		int added = _snprintf_s( buf + length, buf_size - length, _TRUNCATE, "%S: %lu entries, first shown after %lu ms, loaded in %lu ms, ",
+								 dbname, si->count, si->first_entry_time, si->load_time );
+		length = ( added >= 0 ? length + added : -1 );
+		if ( length < 0 || length >= buf_size )
+		{
+			break;
+		}
+
+		if ( si->reader.cache != NULL )
+		{
+			added = _snprintf_s( buf + length, buf_size - length, _TRUNCATE, "sector cache %llu hits, %llu misses\r\n",
+								 si->reader.cache_hits, si->reader.cache_misses );
+		}
+		else
+		{
+			added = _snprintf_s( buf + length, buf_size - length, _TRUNCATE, "%s\r\n",
+								 ( si->reader.view != NULL ? "mapped" : "not cached" ) );
+		}
+
+		length = ( added >= 0 ? length + added : -1 );
 	}
 }
 
-void cleanup_shared_info( shared_info **si )
+// Queue any errors that occur while reading a database. Nothing is shown if we're saving from the command-line.
+// This can be called from any reading thread. The main thread shows every queued error in a single message box.
+void show_database_error( const char *message )
 {
-	free( ( *si )->short_stream_container );
-	free( ( *si )->ssat );
-	free( ( *si )->sat );
-	free( *si );
-	*si = NULL;
+	if ( cmd_line == 2 || message == NULL )
+	{
+		return;
+	}
+
+	EnterCriticalSection( &error_cs );
+
+	// Repeated errors are counted instead of being listed again.
+	unsigned long i = 0;
+	for ( ; i < queued_error_count; ++i )
+	{
+		if ( strcmp( queued_errors[ i ].message, message ) == 0 )
+		{
+			++queued_errors[ i ].count;
+			break;
+		}
+	}
+
+	if ( i == queued_error_count )
+	{
+		char *copy = ( queued_error_count < ERROR_QUEUE_SIZE ? _strdup( message ) : NULL );
+		if ( copy != NULL )
+		{
+			queued_errors[ queued_error_count ].message = copy;
+			queued_errors[ queued_error_count ].count = 1;
+			++queued_error_count;
+		}
+		else
+		{
+			++dropped_error_count;
+		}
+	}
+
+	// Only one message is posted until the main thread has shown the errors.
+	if ( !errors_posted )
+	{
+		errors_posted = ( PostMessage( g_hWnd_main, WM_SHOW_ERRORS, 0, 0 ) != FALSE );
+	}
+
+	LeaveCriticalSection( &error_cs );
 }
 
-void cleanup_fileinfo_tree()
+// Called on the main thread in response to WM_SHOW_ERRORS.
+// Errors that are queued while the message box is open are shown after it's closed.
+void show_queued_errors()
 {
-	// Free the values of the fileinfo tree.
-	node_type *node = dllrbt_get_head( fileinfo_tree );
-	while ( node != NULL )
+	char text[ 2048 ];
+	int text_length = 0;
+
+	EnterCriticalSection( &error_cs );
+
+	for ( unsigned long i = 0; i < queued_error_count; ++i )
 	{
-		// Free the linked list if there is one.
-		linked_list *fi_node = ( linked_list * )node->val;
-		while ( fi_node != NULL )
+		// A negative length means the text was truncated.
+		if ( text_length >= 0 && text_length < 2048 )
 		{
-			linked_list *del_fi_node = fi_node;
-
-			fi_node = fi_node->next;
+			int length = 0;
+			if ( queued_errors[ i ].count > 1 )
+			{
+				length = _snprintf_s( text + text_length, 2048 - text_length, _TRUNCATE, "%s (%lu times)\r\n", queued_errors[ i ].message, queued_errors[ i ].count );
+			}
+			else
+			{
+				length = _snprintf_s( text + text_length, 2048 - text_length, _TRUNCATE, "%s\r\n", queued_errors[ i ].message );
+			}
 
-			free( del_fi_node );
+			text_length = ( length >= 0 ? text_length + length : -1 );
 		}
 
-		node = node->next;
+		free( queued_errors[ i ].message );
+	}
+
+	if ( dropped_error_count > 0 && text_length >= 0 && text_length < 2048 )
+	{
+		_snprintf_s( text + text_length, 2048 - text_length, _TRUNCATE, "%lu more errors occurred.\r\n", dropped_error_count );
+	}
+
+	bool has_errors = ( queued_error_count > 0 || dropped_error_count > 0 );
+	queued_error_count = 0;
+	dropped_error_count = 0;
+
+	LeaveCriticalSection( &error_cs );
+
+	if ( has_errors )
+	{
+		MessageBoxA( g_hWnd_main, text, PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING );
+	}
+
+	EnterCriticalSection( &error_cs );
+
+	errors_posted = false;
+	if ( queued_error_count > 0 || dropped_error_count > 0 )
+	{
+		errors_posted = ( PostMessage( g_hWnd_main, WM_SHOW_ERRORS, 0, 0 ) != FALSE );
 	}
 
-	// Clean up our fileinfo tree.
-	dllrbt_delete_recursively( fileinfo_tree );
-	fileinfo_tree = NULL;
+	LeaveCriticalSection( &error_cs );
 }
 
-void create_fileinfo_tree()
+void cleanup_fileinfo_index()
 {
-	LVITEM lvi = { NULL };
-	lvi.mask = LVIF_PARAM;
+	hash_index_delete( fileinfo_index );
+	fileinfo_index = NULL;
+}
 
+void create_fileinfo_index()
+{
 	fileinfo *fi = NULL;
 
-	int item_count = ( int )SendMessage( g_hWnd_list, LVM_GETITEMCOUNT, 0, 0 );
-
-	// Create the fileinfo tree if it doesn't exist.
-	if ( fileinfo_tree == NULL )
+	// Create the fileinfo index if it doesn't exist.
+	if ( fileinfo_index == NULL )
 	{
-		fileinfo_tree = dllrbt_create( dllrbt_compare );
+		fileinfo_index = hash_index_create( g_entry_count );
+		if ( fileinfo_index == NULL )
+		{
+			return;
+		}
 	}
 
-	// Go through each item and add them to our tree.
-	for ( lvi.iItem = 0; lvi.iItem < item_count; ++lvi.iItem )
+	// Go through each item and add them to our index.
+	for ( unsigned long i = 0; i < g_entry_count; ++i )
 	{
 		// We don't want to continue scanning if the user cancels the scan.
 		if ( g_kill_scan )
@@ -163,11 +298,8 @@ void create_fileinfo_tree()
 			break;
 		}
 
-		SendMessage( g_hWnd_list, LVM_GETITEM, 0, ( LPARAM )&lvi );
-
-		fi = ( fileinfo * )lvi.lParam;
+		fi = g_entries[ i ];
 
-		// Don't attempt to insert the fileinfo if it's already in the tree.
 		if ( fi != NULL )
 		{
 			// Make sure it's a hashed filename. It should be formatted like: 256_0123456789ABCDEF
@@ -180,26 +312,8 @@ void create_fileinfo_tree()
 				{
 					fi->entry_hash = _wcstoui64( filename + 1, NULL, 16 );
 
-					// Create the node to insert into a linked list.
-					linked_list *fi_node = ( linked_list * )malloc( sizeof( linked_list ) );
-					fi_node->fi = fi;
-					fi_node->next = NULL;
-
-					// See if our tree has the hash to add the node to.
-					linked_list *ll = ( linked_list * )dllrbt_find( fileinfo_tree, ( void * )fi->entry_hash, true );
-					if ( ll == NULL )
-					{
-						if ( dllrbt_insert( fileinfo_tree, ( void * )fi->entry_hash, fi_node ) != DLLRBT_STATUS_OK )
-						{
-							free( fi_node );
-						}
-					}
-					else	// If a hash exits, insert the node into the linked list.
-					{
-						linked_list *next = ll->next;	// We'll insert the node after the head.
-						fi_node->next = next;
-						ll->next = fi_node;
-					}
+					// Entries with the same hash are chained together.
+					hash_index_insert( fileinfo_index, fi->entry_hash, ( void * )fi );
 				}
 			}
 		}
@@ -241,9 +355,39 @@ int GetEncoderClsid( const WCHAR *format, CLSID *pClsid )
 	return -1;  // Failure
 }
 
+// Raw bitmaps have no image header for GDI+ to decode. The bitmap is built from the pixels instead.
+static Gdiplus::Image *create_raw_image( char *buffer, const raw_bitmap &rb )
+{
+	// 4 channel bitmaps contain an alpha channel.
+	Gdiplus::PixelFormat pixel_format = ( rb.channels == 4 ? PixelFormat32bppARGB : PixelFormat24bppRGB );
+
+	Gdiplus::Bitmap *image = new Gdiplus::Bitmap( rb.width, rb.height, pixel_format );
+
+	Gdiplus::Rect rc( 0, 0, rb.width, rb.height );
+	Gdiplus::BitmapData bmd;
+	if ( image->LockBits( &rc, Gdiplus::ImageLockModeWrite, pixel_format, &bmd ) != Gdiplus::Ok )
+	{
+		delete image;
+		return NULL;
+	}
+
+	// GDI+ stores its pixels in BGR(A) order, the same as the entry.
+	unpack_raw_bitmap( buffer, rb, ( unsigned char * )bmd.Scan0, bmd.Stride, false );
+
+	image->UnlockBits( &bmd );
+
+	return image;
+}
+
 // Create a stream to store our buffer and then store the stream into a GDI+ image object.
-Gdiplus::Image *create_image( char *buffer, unsigned long size, unsigned char format, unsigned int raw_width, unsigned int raw_height, unsigned int raw_size, int raw_stride )
+// Raw bitmaps (format 2) are built from rb instead.
+Gdiplus::Image *create_image( char *buffer, unsigned long size, unsigned char format, const raw_bitmap *rb )
 {
+	if ( format == 2 )
+	{
+		return ( rb != NULL ? create_raw_image( buffer, *rb ) : NULL );
+	}
+
 	ULONG written = 0;
 	IStream *is = NULL;
 	CreateStreamOnHGlobal( NULL, TRUE, &is );
@@ -269,23 +413,8 @@ Gdiplus::Image *create_image( char *buffer, unsigned long size, unsigned char fo
 			Gdiplus::Bitmap *new_image = new Gdiplus::Bitmap( width, height, PixelFormat32bppRGB );
 			if ( new_image->LockBits( &rc, Gdiplus::ImageLockModeWrite, PixelFormat32bppRGB, &bmd2 ) == Gdiplus::Ok )
 			{
-				UINT *raw_bm = ( UINT * )bmd.Scan0;
-				UINT *raw_bm2 = ( UINT * )bmd2.Scan0;
-
-				// Go through each pixel in the array.
-				for ( UINT row = 0; row < height; ++row )
-				{
-					for ( UINT col = 0; col < width; ++col )
-					{
-						// LockBits with PixelFormat32bppCMYK appears to remove the black channel and leaves us with CMY values in the range of 0 to 255.
-						// We take the compliment of cyan, magenta, and yellow to get our RGB values. (255 - C), (255 - M), (255 - Y)
-						// Notice that we're writing the pixels in reverse order (to flip the image on the horizontal axis).
-						raw_bm2[ ( ( ( ( height - 1 ) - row ) * bmd2.Stride ) / 4 ) + col ] = 0xFF000000
-							| ( ( 255 - ( ( 0x00FF0000 & raw_bm[ row * bmd.Stride / 4 + col ] ) >> 16 ) ) << 16 )
-							| ( ( 255 - ( ( 0x0000FF00 & raw_bm[ row * bmd.Stride / 4 + col ] ) >> 8 ) ) << 8 )
-							|   ( 255 - ( ( 0x000000FF & raw_bm[ row * bmd.Stride / 4 + col ] ) ) );
-					}
-				}
+				// Complement the CMY values to get RGB values, and write the rows in reverse order (to flip the image on the horizontal axis).
+				cmyk_to_rgb_flipped( ( unsigned char * )bmd.Scan0, bmd.Stride, ( unsigned char * )bmd2.Scan0, bmd2.Stride, width, height );
 
 				bm.UnlockBits( &bmd );
 				new_image->UnlockBits( &bmd2 );
@@ -301,77 +430,136 @@ Gdiplus::Image *create_image( char *buffer, unsigned long size, unsigned char fo
 			}
 		}
 	}
-	else if ( ( format == 2 || format == 3 ) && raw_width > 0 && raw_height > 0 && raw_size > 0 )	// File might be a raw bitmap.
-	{
-		Gdiplus::Rect rc( 0, 0, raw_width, raw_height );
-		Gdiplus::BitmapData bmd;
 
-		unsigned int channels = raw_size / ( raw_width * raw_height );
+	is->Release();
 
-		if ( channels == 3 )
-		{
-			Gdiplus::Bitmap *new_image = new Gdiplus::Bitmap( raw_width, raw_height, PixelFormat24bppRGB );
-			if ( new_image->LockBits( &rc, Gdiplus::ImageLockModeWrite, PixelFormat24bppRGB, &bmd ) == Gdiplus::Ok )
-			{
-				if ( format == 2 )	// This image is flipped along the horizontal axis.
-				{
-					unsigned char *raw_bm = ( unsigned char * )bmd.Scan0;
+	return image;
+}
 
-					raw_stride = abs( raw_stride );
-					unsigned int padding = 0;
-					if ( raw_size % ( raw_width * raw_height ) != 0 )
-					{
-						padding = raw_stride - ( raw_width * channels );
-					}	
+// Images that are created from a stream are only decoded when they're drawn. Draw it once into a bitmap so the cache holds the decoded pixels.
+// The original image is returned if it can't be converted.
+static Gdiplus::Image *decode_bitmap( Gdiplus::Image *image )
+{
+	UINT width = image->GetWidth();
+	UINT height = image->GetHeight();
+	if ( image->GetLastStatus() != Gdiplus::Ok || width == 0 || height == 0 )
+	{
+		return image;
+	}
 
-					// Copy each row (excluding any padding) in reverse order. 
-					for ( unsigned int offset = 0; offset < raw_size; offset += raw_stride )
-					{
-						memcpy_s( raw_bm + ( raw_size - ( raw_width * channels ) ) - offset - padding, raw_size - offset, buffer + offset, raw_stride - padding );
-					} 
-				}
-				else if ( format == 3 )	// This image is not flipped along the horizontal axis.
-				{
-					memcpy_s( bmd.Scan0, raw_size, buffer, raw_size );
-				}
+	Gdiplus::Bitmap *bm = new Gdiplus::Bitmap( width, height, PixelFormat32bppPARGB );	// The fastest format for GDI+ to draw.
+	if ( bm->GetLastStatus() == Gdiplus::Ok )
+	{
+		Gdiplus::Graphics graphics( bm );
+		if ( graphics.DrawImage( image, 0, 0, width, height ) == Gdiplus::Ok )
+		{
+			delete image;
+			return bm;
+		}
+	}
 
-				new_image->UnlockBits( &bmd );
+	delete bm;
+	return image;
+}
 
-				// Delete the old image created from the image stream and set it to the new bitmap.
-				delete image;
-				image = NULL;
-				image = new_image;
-			}
-			else
-			{
-				delete new_image;
-			}
-		}
-		else if ( channels == 4 )
+// The image cache only takes previews that were decoded since the requests were last cancelled.
+// Entries are only freed after cancel_preview, so an older preview might belong to an entry that no longer exists.
+bool is_cache_epoch_current( unsigned long epoch, void *context )
+{
+	return is_preview_epoch_current( ( preview_worker * )context, epoch );
+}
+
+// Decodes an entry for the image window. This runs in the preview worker, and the image is posted to the image window when it's done.
+void decode_preview( fileinfo *fi, unsigned long generation, unsigned long epoch, bool prefetch, void * /*context*/ )
+{
+	// The entry might have been prefetched while the request was waiting. The image window will get it from the cache.
+	if ( is_image_cached( fi ) )
+	{
+		if ( !prefetch )
 		{
-			// This bitmap contains an alpha channel.
-			Gdiplus::Bitmap *new_image = new Gdiplus::Bitmap( raw_width, raw_height, PixelFormat32bppARGB );
-			if ( new_image->LockBits( &rc, Gdiplus::ImageLockModeWrite, PixelFormat32bppARGB, &bmd ) == Gdiplus::Ok )
+			preview_result *pr = ( preview_result * )malloc( sizeof( preview_result ) );
+			if ( pr == NULL )
 			{
-				memcpy_s( bmd.Scan0, raw_size, buffer, raw_size );
+				return;
+			}
 
-				new_image->UnlockBits( &bmd );
+			pr->image = NULL;
+			pr->fi = fi;
+			pr->generation = generation;
+			pr->epoch = epoch;
+			pr->flag = fi->flag;
+			wcsncpy_s( pr->filename, MAX_PATH, ( fi->filename != NULL ? fi->filename : L"" ), MAX_PATH - 1 );
 
-				// Delete the old image created from the image stream and set it to the new bitmap.
-				delete image;
-				image = NULL;
-				image = new_image;
-			}
-			else
+			if ( PostMessage( g_hWnd_image, WM_PREVIEW_READY, 0, ( LPARAM )pr ) == FALSE )
 			{
-				delete new_image;
+				free( pr );
 			}
 		}
+
+		return;
 	}
 
-	is->Release();
+	entry_view ev;
+	if ( !extract( fi, ev ) )
+	{
+		return;
+	}
 
-	return image;
+	char *current_image = ev.data;
+	unsigned long header_offset = ev.header_offset;
+
+	unsigned char format = ( ( fi->flag & FIF_TYPE_CMYK_JPG ) ? 1 : 0 );	// 0 = default, 1 = cmyk, 2 = raw
+
+	raw_bitmap rb;
+	if ( ( fi->flag & FIF_TYPE_UNKNOWN ) && parse_raw_bitmap( current_image, header_offset, ev.size, rb ) )
+	{
+		format = 2;
+	}
+
+	// Create our image from an image stream (memory) and convert it to RGB if it's in CMYK format, or reconstruct any raw images.
+	// Skip it if the selection has already moved on, or if the prefetch was cancelled.
+	Gdiplus::Image *image = NULL;
+	if ( ( prefetch ? is_preview_epoch_current( &g_preview, epoch ) : is_preview_current( &g_preview, generation ) ) )
+	{
+		image = create_image( current_image + header_offset, ev.size, format, &rb );
+	}
+
+	// Free our image buffer if it was copied.
+	release_entry_view( ev );
+
+	if ( image == NULL )
+	{
+		return;
+	}
+
+	image = decode_bitmap( image );
+
+	// Prefetched images go straight into the cache, as do the ones the selection has moved past. The image window adds the ones it displays.
+	if ( prefetch || !is_preview_current( &g_preview, generation ) )
+	{
+		cache_image( fi, image, epoch, false );
+		return;
+	}
+
+	preview_result *pr = ( preview_result * )malloc( sizeof( preview_result ) );
+	if ( pr == NULL )
+	{
+		delete image;
+		return;
+	}
+
+	pr->image = image;
+	pr->fi = fi;
+	pr->generation = generation;
+	pr->epoch = epoch;
+	pr->flag = fi->flag;
+	wcsncpy_s( pr->filename, MAX_PATH, ( fi->filename != NULL ? fi->filename : L"" ), MAX_PATH - 1 );
+
+	if ( PostMessage( g_hWnd_image, WM_PREVIEW_READY, 0, ( LPARAM )pr ) == FALSE )
+	{
+		delete image;
+		free( pr );
+	}
 }
 
 // This will allow our main thread to continue while secondary threads finish their processing.
@@ -381,6 +569,7 @@ unsigned __stdcall cleanup( void * /*pArguments*/ )
 	shutdown_semaphore = CreateSemaphore( NULL, 0, 1, NULL );
 
 	g_kill_thread = true;	// Causes secondary threads to cease processing and release the semaphore.
+	g_kill_scan = true;		// The file scan only checks this flag.
 
 	// Wait for any active threads to complete. 5 second timeout in case we miss the release.
 	WaitForSingleObject( shutdown_semaphore, 5000 );
@@ -403,11 +592,9 @@ unsigned __stdcall copy_items( void * /*pArguments*/ )
 
 	Processing_Window( true );
 
-	LVITEM lvi = { 0 };
-	lvi.mask = LVIF_PARAM;
-	lvi.iItem = -1;	// Set this to -1 so that the LVM_GETNEXTITEM call can go through the list correctly.
+	int index = -1;	// Set this to -1 so that the LVM_GETNEXTITEM call can go through the list correctly.
 
-	int item_count = ( int )SendMessage( g_hWnd_list, LVM_GETITEMCOUNT, 0, 0 );
+	int item_count = ( int )g_entry_count;
 	int sel_count = ( int )SendMessage( g_hWnd_list, LVM_GETSELECTEDCOUNT, 0, 0 );
 	
 	bool copy_all = false;
@@ -443,16 +630,18 @@ unsigned __stdcall copy_items( void * /*pArguments*/ )
 
 		if ( copy_all )
 		{
-			lvi.iItem = i;
+			index = i;
 		}
 		else
 		{
-			lvi.iItem = ( int )SendMessage( g_hWnd_list, LVM_GETNEXTITEM, lvi.iItem, LVNI_SELECTED );
+			index = ( int )SendMessage( g_hWnd_list, LVM_GETNEXTITEM, index, LVNI_SELECTED );
+			if ( index == -1 )
+			{
+				break;
+			}
 		}
 
-		SendMessage( g_hWnd_list, LVM_GETITEM, 0, ( LPARAM )&lvi );
-
-		fileinfo *fi = ( fileinfo * )lvi.lParam;
+		fileinfo *fi = g_entries[ index ];
 
 		if ( fi == NULL || ( fi != NULL && fi->si == NULL ) )
 		{
@@ -650,19 +839,18 @@ unsigned __stdcall remove_items( void * /*pArguments*/ )
 
 	Processing_Window( true );
 
-	LVITEM lvi = { NULL };
-	lvi.mask = LVIF_PARAM;
-
-	fileinfo *fi = NULL;
+	// Make sure the preview worker isn't using any of the entries, and that no image can be found with them.
+	cancel_preview( &g_preview );
+	clear_image_cache();
 
-	int item_count = ( int )SendMessage( g_hWnd_list, LVM_GETITEMCOUNT, 0, 0 );
+	int item_count = ( int )g_entry_count;
 	int sel_count = ( int )SendMessage( g_hWnd_list, LVM_GETSELECTEDCOUNT, 0, 0 );
 
 	// See if we've selected all the items. We can clear the list much faster this way.
 	if ( item_count == sel_count )
 	{
-		// Go through each item, and free their lParam values. current_fileinfo will get deleted here.
-		for ( lvi.iItem = 0; lvi.iItem < item_count; ++lvi.iItem )
+		// Go through each item, and free them. current_fileinfo will get deleted here.
+		for ( int i = 0; i < item_count; ++i )
 		{
 			// Stop processing and exit the thread.
 			if ( g_kill_thread )
@@ -670,51 +858,15 @@ unsigned __stdcall remove_items( void * /*pArguments*/ )
 				break;
 			}
 
-			// We first need to get the lParam value otherwise the memory won't be freed.
-			SendMessage( g_hWnd_list, LVM_GETITEM, 0, ( LPARAM )&lvi );
-
-			fi = ( fileinfo * )lvi.lParam;
-
-			if ( fi != NULL )
-			{
-				if ( fi->si != NULL )
-				{
-					--( fi->si->count );
-
-					// Remove our shared information from the linked list if there's no more items for this database.
-					if ( fi->si->count == 0 )
-					{
-						cleanup_shared_info( &( fi->si ) );
-					}
-				}
-
-				// First free the filename pointer. We don't need to bother with the linked list pointer since it's only used during the initial read.
-				free( fi->filename );
-				// Then free the fileinfo structure.
-				free( fi );
-			}
+			free_fileinfo( g_entries[ i ] );
+			g_entries[ i ] = NULL;
 		}
-
-		SendMessage( g_hWnd_list, LVM_DELETEALLITEMS, 0, 0 );
 	}
-	else	// Otherwise, we're going to have to go through each selection one at a time. (SLOOOOOW) Start from the end and work our way to the beginning.
+	else
 	{
-		// Scroll to the first item.
-		// This will reduce the time it takes to remove a large selection of items.
-		// When we delete the item from the end of the listview, the control won't force a paint refresh (since the item's not likely to be visible)
-		SendMessage( g_hWnd_list, LVM_ENSUREVISIBLE, 0, FALSE );
-
-		int *index_array = ( int * )malloc( sizeof( int ) * sel_count );
-
-		lvi.iItem = -1;	// Set this to -1 so that the LVM_GETNEXTITEM call can go through the list correctly.
-
-		// Create an index list of selected items (in reverse order).
-		for ( int i = 0; i < sel_count; i++ )
-		{
-			lvi.iItem = index_array[ sel_count - 1 - i ] = ( int )SendMessage( g_hWnd_list, LVM_GETNEXTITEM, lvi.iItem, LVNI_SELECTED );
-		}
-
-		for ( int i = 0; i < sel_count; i++ )
+		// Free each selected item and leave a hole in the array.
+		int index = -1;	// Set this to -1 so that the LVM_GETNEXTITEM call can go through the list correctly.
+		while ( ( index = ( int )SendMessage( g_hWnd_list, LVM_GETNEXTITEM, index, LVNI_SELECTED ) ) != -1 )
 		{
 			// Stop processing and exit the thread.
 			if ( g_kill_thread )
@@ -722,37 +874,36 @@ unsigned __stdcall remove_items( void * /*pArguments*/ )
 				break;
 			}
 
-			// We first need to get the lParam value otherwise the memory won't be freed.
-			lvi.iItem = index_array[ i ];
-			SendMessage( g_hWnd_list, LVM_GETITEM, 0, ( LPARAM )&lvi );
+			free_fileinfo( g_entries[ index ] );
+			g_entries[ index ] = NULL;
+		}
+	}
 
-			fi = ( fileinfo * )lvi.lParam;
+	// Close the holes. The remaining entries keep their order.
+	unsigned long entry_count = 0;
+	for ( unsigned long i = 0; i < g_entry_count; ++i )
+	{
+		if ( g_entries[ i ] != NULL )
+		{
+			g_entries[ entry_count++ ] = g_entries[ i ];
+		}
+	}
 
-			if ( fi != NULL )
-			{
-				if ( fi->si != NULL )
-				{
-					--( fi->si->count );
+	for ( unsigned long i = entry_count; i < g_entry_count; ++i )
+	{
+		g_entries[ i ] = NULL;
+	}
 
-					// Remove our shared information from the linked list if there's no more items for this database.
-					if ( fi->si->count == 0 )
-					{
-						cleanup_shared_info( &( fi->si ) );
-					}
-				}
-		
-				// Free our filename, then fileinfo structure. We don't need to bother with the linked list pointer since it's only used during the initial read.
-				free( fi->filename );
-				// Then free the fileinfo structure.
-				free( fi );
-			}
+	g_entry_count = entry_count;
 
-			// Remove the list item.
-			SendMessage( g_hWnd_list, LVM_DELETEITEM, index_array[ i ], 0 );
-		}
+	// Clear the selection since the indices no longer refer to the same entries.
+	LVITEM lvi = { NULL };
+	lvi.mask = LVIF_STATE;
+	lvi.state = 0;
+	lvi.stateMask = LVIS_SELECTED | LVIS_FOCUSED;
+	SendMessage( g_hWnd_list, LVM_SETITEMSTATE, ( WPARAM )-1, ( LPARAM )&lvi );
 
-		free( index_array );
-	}
+	SendMessage( g_hWnd_list, LVM_SETITEMCOUNT, g_entry_count, 0 );
 
 	skip_draw = false;	// Allow drawing again.
 
@@ -854,17 +1005,10 @@ unsigned __stdcall save_csv( void *pArguments )
 			// Write the UTF-8 BOM and CSV column titles.
 			WriteFile( hFile, "\xEF\xBB\xBF" "Filename,Entry Size (bytes),Sector Index,Date Modified (UTC),FILETIME,System,Location", 88, &write, NULL );
 
-			// Get the number of items we'll be saving.
-			int save_items = ( int )SendMessage( g_hWnd_list, LVM_GETITEMCOUNT, 0, 0 );
-
-			// Retrieve the lParam value from the selected listview item.
-			LVITEM lvi = { NULL };
-			lvi.mask = LVIF_PARAM;
-
 			fileinfo *fi = NULL;
 
 			// Go through all the items we'll be saving.
-			for ( lvi.iItem = 0; lvi.iItem < save_items; ++lvi.iItem )
+			for ( unsigned long i = 0; i < g_entry_count; ++i )
 			{
 				// Stop processing and exit the thread.
 				if ( g_kill_thread )
@@ -872,9 +1016,7 @@ unsigned __stdcall save_csv( void *pArguments )
 					break;
 				}
 
-				SendMessage( g_hWnd_list, LVM_GETITEM, 0, ( LPARAM )&lvi );
-
-				fi = ( fileinfo * )lvi.lParam;
+				fi = g_entries[ i ];
 				if ( fi == NULL || ( fi != NULL && fi->si == NULL ) )
 				{
 					continue;
@@ -1043,207 +1185,385 @@ unsigned __stdcall save_items( void *pArguments )
 			wcsncpy_s( save_directory, MAX_PATH, save_type->filepath, MAX_PATH - 1 );
 		}
 
-		// Depending on what was selected, get the number of items we'll be saving.
-		int save_items = ( save_type->save_all ? ( int )SendMessage( g_hWnd_list, LVM_GETITEMCOUNT, 0, 0 ) : ( int )SendMessage( g_hWnd_list, LVM_GETSELECTEDCOUNT, 0, 0 ) );
+		if ( save_type->save_all )
+		{
+			// Extract, convert, and write the entries at the same time.
+			save_entries( g_entries, g_entry_count, save_directory );
+		}
+		else
+		{
+			int sel_count = ( int )SendMessage( g_hWnd_list, LVM_GETSELECTEDCOUNT, 0, 0 );
+
+			fileinfo **entries = ( fileinfo ** )malloc( sizeof( fileinfo * ) * ( sel_count > 0 ? sel_count : 1 ) );
+			unsigned long entry_count = 0;
+
+			// Gather the selected entries.
+			int index = -1;	// Set this to -1 so that the LVM_GETNEXTITEM call can go through the list correctly.
+			while ( ( int )entry_count < sel_count && ( index = ( int )SendMessage( g_hWnd_list, LVM_GETNEXTITEM, index, LVNI_SELECTED ) ) != -1 )
+			{
+				entries[ entry_count++ ] = g_entries[ index ];
+			}
 
-		// Retrieve the lParam value from the selected listview item.
-		LVITEM lvi = { NULL };
-		lvi.mask = LVIF_PARAM;
-		lvi.iItem = -1;	// Set this to -1 so that the LVM_GETNEXTITEM call can go through the list correctly.
+			save_entries( entries, entry_count, save_directory );
 
-		fileinfo *fi = NULL;
+			free( entries );
+		}
 
-		// Go through all the items we'll be saving.
-		for ( int i = 0; i < save_items; ++i )
+		free( save_type->filepath );
+		free( save_type );
+	}
+
+	Processing_Window( false );
+
+	// Release the semaphore if we're killing the thread.
+	if ( shutdown_semaphore != NULL )
+	{
+		ReleaseSemaphore( shutdown_semaphore, 1, NULL );
+	}
+	else if ( cmd_line == 2 )	// Exit the program if we're done saving.
+	{
+		// DestroyWindow won't work on a window from a different thread. So we'll send a message to trigger it.
+		SendMessage( g_hWnd_main, WM_DESTROY_ALT, 0, 0 );
+	}
+
+	in_thread = false;
+
+	// We're done. Let other threads continue.
+	LeaveCriticalSection( &pe_cs );
+
+	_endthreadex( 0 );
+	return 0;
+}
+
+// Add the entries of a database to the end of the listview.
+// This must be done on the main thread since WM_DRAWITEM reads g_entries. Threads should send WM_ADD_ENTRIES instead.
+void add_entries( fileinfo *fi, unsigned long count )
+{
+	unsigned long entry_count = g_entry_count;
+
+	while ( fi != NULL && count-- > 0 )
+	{
+		if ( entry_count == g_entry_capacity )
 		{
-			// Stop processing and exit the thread.
-			if ( g_kill_thread )
+			unsigned long capacity = ( g_entry_capacity > 0 ? g_entry_capacity * 2 : 1024 );
+			fileinfo **entries = ( fileinfo ** )realloc( g_entries, sizeof( fileinfo * ) * capacity );
+
+			// Keep the entries we have. The rest aren't listed.
+			if ( entries == NULL )
 			{
 				break;
 			}
 
-			lvi.iItem = ( save_type->save_all ? i : ( int )SendMessage( g_hWnd_list, LVM_GETNEXTITEM, lvi.iItem, LVNI_SELECTED ) );
-			SendMessage( g_hWnd_list, LVM_GETITEM, 0, ( LPARAM )&lvi );
+			g_entries = entries;
+			g_entry_capacity = capacity;
+		}
 
-			fi = ( fileinfo * )lvi.lParam;
-			if ( fi == NULL || ( fi != NULL && fi->filename == NULL ) )
-			{
-				continue;
-			}
+		g_entries[ entry_count++ ] = fi;
+
+		fi = fi->next;
+	}
+
+	g_entry_count = entry_count;
+
+	// Only the items that are in view get redrawn.
+	SendMessage( g_hWnd_list, LVM_SETITEMCOUNT, g_entry_count, LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL );
+}
+
+struct list_compare
+{
+	PFNLVCOMPARE compare;
+	LPARAM lParamSort;
+};
+
+static int compare_listview_entries( void *a, void *b, void *context )
+{
+	list_compare *lc = ( list_compare * )context;
+
+	return lc->compare( ( LPARAM )a, ( LPARAM )b, lc->lParamSort );
+}
+
+// Stable sort of the entries. Owner-data listviews don't support LVM_SORTITEMS.
+void sort_entries( PFNLVCOMPARE compare, LPARAM lParamSort )
+{
+	list_compare lc;
+	lc.compare = compare;
+	lc.lParamSort = lParamSort;
+
+	// The entries stay in their current order if there isn't enough memory to sort them.
+	merge_sort( ( void ** )g_entries, g_entry_count, compare_listview_entries, ( void * )&lc );
+}
+
+// Each worker takes the next unread database from the queue until the queue is empty.
+// Called from a worker thread. The main thread gets the entries when the job is next in line.
+void publish_database_entries( fileinfo *first, unsigned long count, void *context )
+{
+	database_job *job = ( database_job * )context;
+
+	if ( job->head == NULL )
+	{
+		job->head = first;
+	}
+
+	InterlockedExchangeAdd( &job->published, count );
+	SetEvent( job->job_done );
+}
+
+// Called from the read_thumbs thread if there's no worker. The entries are shown as soon as they're decoded.
+void send_database_entries( fileinfo *first, unsigned long count, void * /*context*/ )
+{
+	SendMessage( g_hWnd_main, WM_ADD_ENTRIES, count, ( LPARAM )first );
+}
+
+// Called from the thread that parsed the database. The catalog names and dates are applied on the UI thread so that the listview never draws an entry while it's changing.
+void send_entry_updates( entry_updates *eu, void * /*context*/ )
+{
+	SendMessage( g_hWnd_main, WM_UPDATE_ENTRIES, 0, ( LPARAM )eu );
+}
+
+unsigned __stdcall read_database_worker( void *pArguments )
+{
+	database_queue *dq = ( database_queue * )pArguments;
+
+	while ( true )
+	{
+		LONG index = InterlockedIncrement( &dq->next ) - 1;
+		if ( index >= ( LONG )dq->count )
+		{
+			break;
+		}
 
-			unsigned long size = 0, header_offset = 0;	// Size excludes the header offset.
-			// Create a buffer to read in our new bitmap.
-			char *save_image = extract( fi, size, header_offset );
-			if ( save_image == NULL )
+		database_job *job = &dq->jobs[ index ];
+
+		// Skip the remaining databases if we're exiting the thread.
+		if ( !g_kill_thread )
+		{
+			parse_database( job->filepath, publish_database_entries, send_entry_updates, ( void * )job );
+		}
+
+		InterlockedExchange( &job->done, 1 );
+		SetEvent( dq->job_done );
+	}
+
+	_endthreadex( 0 );
+	return 0;
+}
+
+unsigned __stdcall read_thumbs( void *pArguments )
+{
+	// This will block every other thread from entering until the first thread is complete.
+	// Protects our global variables.
+	EnterCriticalSection( &pe_cs );
+
+	in_thread = true;
+
+	Processing_Window( true );
+
+	pathinfo *pi = ( pathinfo * )pArguments;
+	if ( pi != NULL && pi->filepath != NULL )
+	{
+		int fname_length = 0;
+		wchar_t *fname = pi->filepath + pi->offset;
+
+		int filepath_length = ( int )wcslen( pi->filepath ) + 1;	// Include NULL character.
+		
+		bool construct_filepath = ( filepath_length > pi->offset && cmd_line == 0 ? false : true );
+
+		database_queue dq = { 0 };
+
+		// Count the number of files in the path info.
+		if ( construct_filepath )
+		{
+			for ( wchar_t *count_fname = fname; *count_fname != L'\0'; count_fname += ( wcslen( count_fname ) + 1 ) )
 			{
-				continue;
+				++dq.count;
 			}
+		}
+		else
+		{
+			dq.count = 1;
+		}
 
-			// Directory + backslash + filename + extension + NULL character = ( MAX_PATH * 2 ) + 6
-			wchar_t fullpath[ ( MAX_PATH * 2 ) + 6 ] = { 0 };
+		dq.jobs = ( database_job * )malloc( sizeof( database_job ) * ( dq.count > 0 ? dq.count : 1 ) );
 
-			wchar_t *filename = get_filename_from_path( fi->filename, ( unsigned long )wcslen( fi->filename ) );
+		// Construct the filepath for each file.
+		for ( unsigned long i = 0; i < dq.count; ++i )
+		{
+			wchar_t *filepath = NULL;
 
-			// Replace any invalid filename characters with an underscore "_".
-			wchar_t escaped_filename[ MAX_PATH ] = { 0 };
-			unsigned int escaped_filename_length = 0; 
-			while ( filename != NULL && *filename != NULL && escaped_filename_length < MAX_PATH )
+			if ( construct_filepath )
 			{
-				if ( *filename == L'\\' ||
-					 *filename == L'/' ||
-					 *filename == L':' ||
-					 *filename == L'*' ||
-					 *filename == L'?' ||
-					 *filename == L'\"' ||
-					 *filename == L'<' ||
-					 *filename == L'>' ||
-					 *filename == L'|' )
+				fname_length = ( int )wcslen( fname ) + 1;	// Include '\' character or NULL character
+
+				if ( cmd_line != 0 )
 				{
-					escaped_filename[ escaped_filename_length ] = L'_';
+					filepath = ( wchar_t * )malloc( sizeof( wchar_t ) * fname_length );
+					wcscpy_s( filepath, fname_length, fname );
 				}
 				else
 				{
-					escaped_filename[ escaped_filename_length ] = *filename;
+					filepath = ( wchar_t * )malloc( sizeof( wchar_t ) * ( filepath_length + fname_length ) );
+					swprintf_s( filepath, filepath_length + fname_length, L"%s\\%s", pi->filepath, fname );
 				}
 
-				++escaped_filename_length;
-				++filename;
+				// Move to the next file name.
+				fname += fname_length;
 			}
-			escaped_filename[ escaped_filename_length ] = 0;	// Sanity.
-
-			if ( ( fi->flag & FIF_TYPE_JPG ) || ( fi->flag & FIF_TYPE_CMYK_JPG ) )
+			else	// Copy the filepath.
 			{
-				wchar_t *ext = get_extension_from_filename( escaped_filename, escaped_filename_length );
-				// The extension in the filename might not be the actual type. So we'll append .jpg to the end of it.
-				if ( _wcsicmp( ext, L".jpg" ) == 0 || _wcsicmp( ext, L".jpeg" ) == 0 )
-				{
-					swprintf_s( fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s", save_directory, escaped_filename );
-				}
-				else
-				{
-					swprintf_s( fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s.jpg", save_directory, escaped_filename );
-				}
+				filepath = ( wchar_t * )malloc( sizeof( wchar_t ) * filepath_length );
+				wcscpy_s( filepath, filepath_length, pi->filepath );
 			}
-			else if ( ( fi->flag & FIF_TYPE_PNG ) || ( ( fi->flag & FIF_TYPE_UNKNOWN ) && header_offset > 0 ) )
+
+			dq.jobs[ i ].filepath = filepath;
+			dq.jobs[ i ].head = NULL;
+			dq.jobs[ i ].job_done = NULL;
+			dq.jobs[ i ].published = 0;
+			dq.jobs[ i ].done = 0;
+		}
+
+		unsigned long thread_count = min( get_worker_count( MAXIMUM_WAIT_OBJECTS ), dq.count );
+
+		HANDLE *threads = NULL;
+		unsigned long threads_started = 0;
+
+		if ( thread_count > 1 )
+		{
+			dq.job_done = CreateEvent( NULL, FALSE, FALSE, NULL );
+			if ( dq.job_done != NULL )
 			{
-				wchar_t *ext = get_extension_from_filename( escaped_filename, escaped_filename_length );
-				// The extension in the filename might not be the actual type. So we'll append .png to the end of it.
-				if ( _wcsicmp( ext, L".png" ) == 0 )
+				for ( unsigned long i = 0; i < dq.count; ++i )
 				{
-					swprintf_s( fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s", save_directory, escaped_filename );
+					dq.jobs[ i ].job_done = dq.job_done;
 				}
-				else
+
+				threads = ( HANDLE * )malloc( sizeof( HANDLE ) * thread_count );
+				for ( unsigned long i = 0; i < thread_count; ++i )
 				{
-					swprintf_s( fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s.png", save_directory, escaped_filename );
+					threads[ threads_started ] = ( HANDLE )_beginthreadex( NULL, 0, &read_database_worker, ( void * )&dq, 0, NULL );
+					if ( threads[ threads_started ] != NULL )
+					{
+						++threads_started;
+					}
 				}
 			}
-			else
-			{
-				swprintf_s( fullpath, ( MAX_PATH * 2 ) + 6, L"%.259s\\%.259s", save_directory, escaped_filename );
-			}
+		}
 
-			// If we have a CMYK based JPEG, then we're going to have to convert it to RGB.
-			if ( fi->flag & FIF_TYPE_CMYK_JPG )
-			{
-				Gdiplus::Image *save_bm_image = create_image( save_image + header_offset, size, 1 );
-
-				// Get the class identifier for the JPEG encoder.
-				CLSID jpgClsid;
-				GetEncoderClsid( L"image/jpeg", &jpgClsid );
-
-				Gdiplus::EncoderParameters encoderParameters;
-				encoderParameters.Count = 1;
-				encoderParameters.Parameter[ 0 ].Guid = Gdiplus::EncoderQuality;
-				encoderParameters.Parameter[ 0 ].Type = Gdiplus::EncoderParameterValueTypeLong;
-				encoderParameters.Parameter[ 0 ].NumberOfValues = 1;
-				ULONG quality = 100;
-				encoderParameters.Parameter[ 0 ].Value = &quality;
-
-				// The size will differ from what's listed in the database since we had to reconstruct the image.
-				// Switch the encoder to PNG or BMP to save a lossless image.
-				if ( save_bm_image->Save( fullpath, &jpgClsid, &encoderParameters ) != Gdiplus::Ok )
-				{
-					if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "An error occurred while converting the image to save.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-				}
+		// The entries of each database are added in the order the databases were given to us, regardless of which worker finishes first.
+		// Databases that have been read are still added if we're exiting the thread so that the main thread can free them.
+		for ( unsigned long i = 0; i < dq.count; ++i )
+		{
+			database_job *job = &dq.jobs[ i ];
 
-				delete save_bm_image;
-			}
-			else
+			if ( threads_started > 0 )
 			{
-				if ( ( fi->flag & FIF_TYPE_UNKNOWN ) && header_offset > 0 )
+				unsigned long added = 0;
+				fileinfo *last_fi = NULL;
+
+				while ( true )
 				{
-					unsigned char format = 0;
-					unsigned int raw_width = 0;
-					unsigned int raw_height = 0;
-					unsigned int raw_size = 0;
-					int raw_stride = 0;
+					// Check done first. If it's set, then every entry has been published.
+					bool done = ( job->done != 0 );
+					unsigned long published = ( unsigned long )job->published;
+
+					if ( published > added )
+					{
+						fileinfo *first = ( last_fi != NULL ? last_fi->next : job->head );
+
+						// Find the last entry in this batch. Its next pointer is only valid once more entries are published.
+						last_fi = first;
+						for ( unsigned long j = added + 1; j < published; ++j )
+						{
+							last_fi = last_fi->next;
+						}
 
-					if ( header_offset == 0x18 )
+						SendMessage( g_hWnd_main, WM_ADD_ENTRIES, published - added, ( LPARAM )first );
+
+						added = published;
+					}
+					else if ( done )
 					{
-						memcpy_s( &raw_stride, sizeof( int ), save_image + ( header_offset - ( sizeof( unsigned int ) * 4 ) ), sizeof( int ) );
-						memcpy_s( &raw_width, sizeof( unsigned int ), save_image + ( header_offset - ( sizeof( unsigned int ) * 3 ) ), sizeof( unsigned int ) );
-						memcpy_s( &raw_height, sizeof( unsigned int ), save_image + ( header_offset - ( sizeof( unsigned int ) * 2 ) ), sizeof( unsigned int ) );
-						format = 2;
+						break;
 					}
-					else if ( header_offset == 0x34 )
+					else
 					{
-						memcpy_s( &raw_width, sizeof( unsigned int ), save_image + sizeof( unsigned int ), sizeof( unsigned int ) );
-						memcpy_s( &raw_height, sizeof( unsigned int ), save_image + ( sizeof( unsigned int ) * 2 ), sizeof( unsigned int ) );
-						memcpy_s( &raw_stride, sizeof( int ), save_image + ( sizeof( unsigned int ) * 3 ), sizeof( int ) );
-						format = 3;
+						WaitForSingleObject( dq.job_done, INFINITE );
 					}
-					memcpy_s( &raw_size, sizeof( unsigned int ), save_image + ( header_offset - sizeof( unsigned int ) ), sizeof( unsigned int ) );
+				}
+			}
+			else if ( !g_kill_thread )	// Read the databases one at a time.
+			{
+				parse_database( job->filepath, send_database_entries, send_entry_updates, NULL );
+			}
 
-					Gdiplus::Image *save_bm_image = create_image( save_image + header_offset, size, format, raw_width, raw_height, raw_size, raw_stride );
+			// Free the old filepath.
+			free( job->filepath );
+		}
 
-					// Get the class identifier for the PNG encoder. We're going to save this as a PNG in order to preserve any alpha channels.
-					CLSID pngClsid;
-					GetEncoderClsid( L"image/png", &pngClsid );
+		if ( threads_started > 0 )
+		{
+			WaitForMultipleObjects( threads_started, threads, TRUE, INFINITE );
 
-					Gdiplus::EncoderParameters encoderParameters;
-					encoderParameters.Count = 1;
-					encoderParameters.Parameter[ 0 ].Guid = Gdiplus::EncoderQuality;
-					encoderParameters.Parameter[ 0 ].Type = Gdiplus::EncoderParameterValueTypeLong;
-					encoderParameters.Parameter[ 0 ].NumberOfValues = 1;
-					ULONG quality = 100;
-					encoderParameters.Parameter[ 0 ].Value = &quality;
+			for ( unsigned long i = 0; i < threads_started; ++i )
+			{
+				CloseHandle( threads[ i ] );
+			}
+		}
 
-					// The size will differ from what's listed in the database since we had to reconstruct the image.
-					if ( save_bm_image->Save( fullpath, &pngClsid, &encoderParameters ) != Gdiplus::Ok )
-					{
-						if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "An error occurred while converting the image to save.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-					}
+		free( threads );
+
+		if ( dq.job_done != NULL )
+		{
+			CloseHandle( dq.job_done );
+		}
+
+		free( dq.jobs );
 
-					delete save_bm_image;
+		// Save the files or a CSV if the user specified an output directory through the command-line.
+		if ( pi->output_path != NULL )
+		{
+			if ( pi->type == 0 )	// Save thumbnail images.
+			{
+				save_param *save_type = ( save_param * )malloc( sizeof( save_param ) );
+				save_type->type = 1;	// Build directory. It may not exist.
+				save_type->save_all = true;
+				save_type->filepath = pi->output_path;
+
+				// save_type is freed in the save_items thread.
+				HANDLE thread = ( HANDLE )_beginthreadex( NULL, 0, &save_items, ( void * )save_type, 0, NULL );
+				if ( thread != NULL )
+				{
+					CloseHandle( thread );
 				}
 				else
 				{
-					// Attempt to open a file for saving.
-					HANDLE hFile_save = CreateFile( fullpath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
-					if ( hFile_save != INVALID_HANDLE_VALUE )
-					{
-						// Write the buffer to our file.
-						DWORD dwBytesWritten = 0;
-						WriteFile( hFile_save, save_image + header_offset, size, &dwBytesWritten, NULL );
-
-						CloseHandle( hFile_save );
-					}
-
-					// See if the path was too long.
-					if ( GetLastError() == ERROR_PATH_NOT_FOUND )
-					{
-						if ( cmd_line != 2 ){ MessageBoxA( g_hWnd_main, "One or more files could not be saved. Please check the filename and path.", PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONWARNING ); }
-					}
+					free( save_type->filepath );
+					free( save_type );
+				}
+			}
+			else	// Save CSV.
+			{
+				// output_path is freed in save_csv.
+				HANDLE thread = ( HANDLE )_beginthreadex( NULL, 0, &save_csv, ( void * )pi->output_path, 0, NULL );
+				if ( thread != NULL )
+				{
+					CloseHandle( thread );
+				}
+				else
+				{
+					free( pi->output_path );
 				}
 			}
-			// Free our buffer.
-			free( save_image );
 		}
 
-		free( save_type->filepath );
-		free( save_type );
+		free( pi->filepath );
+	}
+	else if ( pi != NULL )	// filepath == NULL
+	{
+		free( pi->output_path );	// Assume output_path is set.
 	}
 
+	free( pi );
+
 	Processing_Window( false );
 
 	// Release the semaphore if we're killing the thread.
@@ -1251,11 +1571,6 @@ unsigned __stdcall save_items( void *pArguments )
 	{
 		ReleaseSemaphore( shutdown_semaphore, 1, NULL );
 	}
-	else if ( cmd_line == 2 )	// Exit the program if we're done saving.
-	{
-		// DestroyWindow won't work on a window from a different thread. So we'll send a message to trigger it.
-		SendMessage( g_hWnd_main, WM_DESTROY_ALT, 0, 0 );
-	}
 
 	in_thread = false;
 
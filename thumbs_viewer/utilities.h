@@ -20,12 +20,54 @@
 #define UTILITIES_H
 
 #include "globals.h"
-#include "dllrbt.h"
+#include "hash_index.h"
 
 #define SNAP_WIDTH		10		// The minimum distance at which our windows will attach together.
 
 #define is_close( a, b ) ( abs( ( a ) - ( b ) ) < SNAP_WIDTH )
 
+#define ERROR_QUEUE_SIZE	16		// Number of distinct database errors that are shown at once.
+#define STATISTICS_DATABASES	16	// Number of databases that are listed in the statistics.
+
+// A database error that's waiting to be shown on the main thread.
+struct queued_error
+{
+	char *message;
+	unsigned long count;	// Number of times the error occurred.
+};
+
+// A database that's waiting to be read by a worker thread.
+struct database_job
+{
+	wchar_t *filepath;
+	fileinfo *head;				// First entry that was read from the database. NULL if there were none.
+	HANDLE job_done;			// The queue's event.
+	volatile LONG published;	// Number of entries the worker has decoded so far.
+	volatile LONG done;			// Set once the worker has finished with the database.
+};
+
+// Databases are read concurrently by a pool of workers and added to the listview in the order they were queued.
+// The entries of the database that's next in line are added as they're decoded. The others are added once it's their turn.
+struct database_queue
+{
+	database_job *jobs;
+	unsigned long count;
+	volatile LONG next;		// Index of the next job that a worker will take.
+	HANDLE job_done;		// Signaled whenever a worker publishes entries or finishes a job.
+};
+
+// A decoded preview that's posted to the image window.
+struct preview_result
+{
+	Gdiplus::Image *image;		// NULL if the entry was already in the image cache.
+	fileinfo *fi;				// Only valid if the request is still current.
+	unsigned long generation;	// The request that it was decoded for.
+	unsigned long epoch;
+	unsigned char flag;			// fileinfo flag of the entry.
+	wchar_t filename[ MAX_PATH ];
+};
+
+unsigned __stdcall read_thumbs( void *pArguments );
 unsigned __stdcall cleanup( void *pArguments );
 unsigned __stdcall remove_items( void *pArguments );
 unsigned __stdcall save_csv( void *pArguments );
@@ -34,18 +76,27 @@ unsigned __stdcall copy_items( void *pArguments );
 
 wchar_t *get_extension_from_filename( wchar_t *filename, unsigned long length );
 wchar_t *get_filename_from_path( wchar_t *path, unsigned long length );
-void reverse_string( wchar_t *string );
 char *escape_csv( const char *string );
 
-void cleanup_shared_info( shared_info **si );
-void cleanup_fileinfo_tree();
-void create_fileinfo_tree();
+void add_entries( fileinfo *fi, unsigned long count );
+void sort_entries( PFNLVCOMPARE compare, LPARAM lParamSort );
+
+void cleanup_fileinfo_index();
+void create_fileinfo_index();
 
 void Processing_Window( bool enable );
+void show_database_error( const char *message );
+void show_queued_errors();
+void format_statistics( char *buf, int buf_size );
+bool is_cache_epoch_current( unsigned long epoch, void *context );
+unsigned long get_worker_count( unsigned long max_count );
 
-Gdiplus::Image *create_image( char *buffer, unsigned long size, unsigned char format, unsigned int raw_width = 0, unsigned int raw_height = 0, unsigned int raw_size = 0, int raw_stride = 0 );
+int GetEncoderClsid( const WCHAR *format, CLSID *pClsid );
+Gdiplus::Image *create_image( char *buffer, unsigned long size, unsigned char format, const raw_bitmap *rb = NULL );
+void decode_preview( fileinfo *fi, unsigned long generation, unsigned long epoch, bool prefetch, void *context );
 
 extern HANDLE shutdown_semaphore;	// Blocks shutdown while a worker thread is active.
-extern dllrbt_tree *fileinfo_tree;	// Red-black tree of fileinfo structures.
+extern hash_index *fileinfo_index;	// Entries keyed by their entry hash.
+extern CRITICAL_SECTION error_cs;	// Guards the queued database errors.
 
 #endif
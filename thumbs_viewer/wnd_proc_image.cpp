@@ -18,6 +18,7 @@
 
 #include "globals.h"
 #include "utilities.h"
+#include "image_cache.h"
 
 #include <stdio.h>
 
@@ -43,6 +44,56 @@ POINT old_pos = { 0 };		// The old position of gdi_image. Used to calculate the
 bool zoom = false;			// Toggled when we want to activate the timer and display the zoom text.
 bool timer_active = false;	// Toggled when the timer is active and used to reset it.
 
+// Display an image that's pinned in the image cache. The cache owns it and keeps it until another image is displayed.
+void set_preview_image( Gdiplus::Image *image, unsigned char flag, const wchar_t *filename )
+{
+	gdi_image = image;
+
+	show_image_window();
+
+	// Set our image window's icon to match the file extension.
+	if ( ( flag & FIF_TYPE_JPG ) || ( flag & FIF_TYPE_CMYK_JPG ) )
+	{
+		SendMessage( g_hWnd_image, WM_SETICON, ICON_SMALL, ( LPARAM )hIcon_jpg );
+	}
+	else if ( flag & FIF_TYPE_PNG )
+	{
+		SendMessage( g_hWnd_image, WM_SETICON, ICON_SMALL, ( LPARAM )hIcon_png );
+	}
+	else
+	{
+		SendMessage( g_hWnd_image, WM_SETICON, ICON_SMALL, NULL );
+	}
+
+	// Set the image window's new title.
+	wchar_t new_title[ MAX_PATH + 30 ] = { 0 };
+	swprintf_s( new_title, MAX_PATH + 30, L"%.259s - %dx%d", filename, gdi_image->GetWidth(), gdi_image->GetHeight() );
+	SetWindowText( g_hWnd_image, new_title );
+
+	// See if our image window is minimized and set the rectangle to its old size if it is.
+	RECT rc;
+	if ( IsIconic( g_hWnd_image ) == TRUE )
+	{
+		rc = last_dim;
+	}
+	else // Otherwise, get the current size.
+	{
+		GetClientRect( g_hWnd_image, &rc );
+	}
+
+	old_pos.x = old_pos.y = 0;
+	drag_rect.x = drag_rect.y = 0;
+
+	// Center the image.
+	drag_rect.x = ( ( long )gdi_image->GetWidth() - rc.right ) / 2;
+	drag_rect.y = ( ( long )gdi_image->GetHeight() - rc.bottom ) / 2;
+
+	scale = 1.0f;	// Reset the image scale.
+
+	// Force our window to repaint itself.
+	InvalidateRect( g_hWnd_image, NULL, TRUE );
+}
+
 LRESULT CALLBACK ImageWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam )
 {
 	switch ( msg )
@@ -379,6 +430,46 @@ LRESULT CALLBACK ImageWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 		}
 		break;
 
+		case WM_PREVIEW_READY:
+		{
+			preview_result *pr = ( preview_result * )lParam;
+
+			// The selection may have moved on while the image was waiting to be handled. It's still cached if the entry hasn't been freed.
+			if ( !is_preview_current( &g_preview, pr->generation ) )
+			{
+				if ( pr->image != NULL )
+				{
+					cache_image( pr->fi, pr->image, pr->epoch, false );
+				}
+
+				free( pr );
+				return 0;
+			}
+
+			Gdiplus::Image *image = NULL;
+			if ( pr->image != NULL )
+			{
+				image = cache_image( pr->fi, pr->image, pr->epoch, true );
+			}
+			else
+			{
+				image = find_cached_image( pr->fi, true );
+			}
+
+			if ( image != NULL )
+			{
+				set_preview_image( image, pr->flag, pr->filename );
+			}
+			else	// It was evicted before we got to it.
+			{
+				request_preview( &g_preview, pr->fi );
+			}
+
+			free( pr );
+			return 0;
+		}
+		break;
+
 		case WM_MBUTTONDOWN:
 		{
 			RECT rc;
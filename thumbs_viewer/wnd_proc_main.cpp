@@ -20,6 +20,8 @@
 #include "utilities.h"
 #include "read_thumbs.h"
 #include "menus.h"
+#include "image_cache.h"
+#include "save_pipeline.h"
 
 WNDPROC ListViewProc = NULL;		// Subclassed listview window.
 WNDPROC EditProc = NULL;			// Subclassed listview edit window.
@@ -54,8 +56,33 @@ RECT last_dim = { 0 };				// Keeps track of the image window's dimension before
 HCURSOR wait_cursor = NULL;			// Temporary cursor while processing entries.
 
 // Image variables
+int last_preview_index = 0;			// List index of the last entry that was previewed. Used to see which way the selection is moving.
+
 fileinfo *current_fileinfo = NULL;	// Holds information about the currently selected image. Gets deleted in WM_DESTROY.
 Gdiplus::Image *gdi_image = NULL;	// GDI+ image object. We need it to handle .png and .jpg images.
+preview_worker g_preview = { 0 };	// Decodes the selected entry for the image window.
+
+// Show the image window if it's hidden. It's placed to the right of the main window the first time.
+void show_image_window()
+{
+	if ( IsWindowVisible( g_hWnd_image ) == FALSE )
+	{
+		// Move our image window next to the main window on its right side if it's the first time we're showing the image window.
+		if ( !first_show )
+		{
+			SetWindowPos( g_hWnd_image, HWND_TOPMOST, last_pos.right - ( g_border_width * 2 ), last_pos.top, MIN_HEIGHT, MIN_HEIGHT, SWP_NOACTIVATE );
+			first_show = true;
+		}
+
+		// This is done to keep both windows on top of other windows.
+		// Set the image window position on top of all windows except topmost windows, but don't set focus to it.
+		SetWindowPos( g_hWnd_image, HWND_TOP, 0, 0, 0, 0, SWP_NOACTIVATE | SWP_NOMOVE | SWP_NOSIZE );
+		// Set our main window on top of the image window.
+		SetWindowPos( g_hWnd_main, HWND_TOP, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE );
+		// The image window is on top of everything (except the main window), set it back to non-topmost.
+		SetWindowPos( g_hWnd_image, HWND_NOTOPMOST, 0, 0, 0, 0, SWP_NOACTIVATE | SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW );
+	}
+}
 
 // Sort function for columns.
 int CALLBACK CompareFunc( LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort )
@@ -138,6 +165,63 @@ int CALLBACK CompareFunc( LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort )
 	}
 }
 
+// Sort the entries and keep the same entries selected.
+void sort_list( HWND hWnd_list, LPARAM lParamSort )
+{
+	int sel_count = ( int )SendMessage( hWnd_list, LVM_GETSELECTEDCOUNT, 0, 0 );
+	bool select_all = ( sel_count == ( int )g_entry_count );
+
+	// The listview only knows the indices of the selected items, so we need to mark the entries themselves.
+	int index = -1;
+	while ( !select_all && ( index = ( int )SendMessage( hWnd_list, LVM_GETNEXTITEM, index, LVNI_SELECTED ) ) != -1 )
+	{
+		g_entries[ index ]->flag |= FIF_SELECTED;
+	}
+
+	index = ( int )SendMessage( hWnd_list, LVM_GETNEXTITEM, -1, LVNI_FOCUSED );
+	fileinfo *focused_fi = ( index != -1 ? g_entries[ index ] : NULL );
+
+	sort_entries( CompareFunc, lParamSort );
+
+	if ( !select_all )
+	{
+		LVITEM lvi = { NULL };
+		lvi.mask = LVIF_STATE;
+		lvi.state = 0;
+		lvi.stateMask = LVIS_SELECTED;
+		SendMessage( hWnd_list, LVM_SETITEMSTATE, ( WPARAM )-1, ( LPARAM )&lvi );
+
+		lvi.state = LVIS_SELECTED;
+		for ( unsigned long i = 0; i < g_entry_count && sel_count > 0; ++i )
+		{
+			if ( g_entries[ i ]->flag & FIF_SELECTED )
+			{
+				g_entries[ i ]->flag &= ~FIF_SELECTED;
+				SendMessage( hWnd_list, LVM_SETITEMSTATE, i, ( LPARAM )&lvi );
+
+				--sel_count;
+			}
+		}
+	}
+
+	// Move the focus to wherever the focused entry ended up.
+	for ( unsigned long i = 0; i < g_entry_count && focused_fi != NULL; ++i )
+	{
+		if ( g_entries[ i ] == focused_fi )
+		{
+			LVITEM lvi = { NULL };
+			lvi.mask = LVIF_STATE;
+			lvi.state = LVIS_FOCUSED;
+			lvi.stateMask = LVIS_FOCUSED;
+			SendMessage( hWnd_list, LVM_SETITEMSTATE, i, ( LPARAM )&lvi );
+
+			break;
+		}
+	}
+
+	InvalidateRect( hWnd_list, NULL, TRUE );
+}
+
 LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam )
 {
 	switch ( msg )
@@ -150,7 +234,7 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 			SetMenu( hWnd, g_hMenu );
 
 			// Create our listview window.
-			g_hWnd_list = CreateWindow( WC_LISTVIEW, NULL, LVS_REPORT | LVS_EDITLABELS | LVS_OWNERDRAWFIXED | WS_CHILDWINDOW | WS_VISIBLE, 0, 0, MIN_WIDTH, MIN_HEIGHT, hWnd, NULL, NULL, NULL );
+			g_hWnd_list = CreateWindow( WC_LISTVIEW, NULL, LVS_REPORT | LVS_EDITLABELS | LVS_OWNERDRAWFIXED | LVS_OWNERDATA | WS_CHILDWINDOW | WS_VISIBLE, 0, 0, MIN_WIDTH, MIN_HEIGHT, hWnd, NULL, NULL, NULL );
 			SendMessage( g_hWnd_list, LVM_SETEXTENDEDLISTVIEWSTYLE, 0, LVS_EX_DOUBLEBUFFER | LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES );
 
 			// Make pretty font.
@@ -609,6 +693,14 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 					}
 					break;
 
+					case MENU_STATISTICS:
+					{
+						char report[ 4096 ] = { 0 };
+						format_statistics( report, 4096 );
+						MessageBoxA( hWnd, report, PROGRAM_CAPTION_A, MB_APPLMODAL | MB_ICONINFORMATION );
+					}
+					break;
+
 					case MENU_ABOUT:
 					{
 						MessageBoxA( hWnd, "Thumbs Viewer is made free under the GPLv3 license.\r\n\r\nVersion 1.0.3.1 ("
@@ -741,7 +833,7 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 							lvc.fmt = lvc.fmt & ( ~HDF_SORTUP ) | HDF_SORTDOWN;
 							SendMessage( nmlv->hdr.hwndFrom, LVM_SETCOLUMN, ( WPARAM )nmlv->iSubItem, ( LPARAM )&lvc );
 
-							SendMessage( nmlv->hdr.hwndFrom, LVM_SORTITEMS, nmlv->iSubItem, ( LPARAM )( PFNLVCOMPARE )CompareFunc );
+							sort_list( nmlv->hdr.hwndFrom, nmlv->iSubItem );
 						}
 						else if ( HDF_SORTDOWN & lvc.fmt )	// Column is sorted downward.
 						{
@@ -749,7 +841,7 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 							lvc.fmt = lvc.fmt & ( ~HDF_SORTDOWN ) | HDF_SORTUP;
 							SendMessage( nmlv->hdr.hwndFrom, LVM_SETCOLUMN, nmlv->iSubItem, ( LPARAM )&lvc );
 
-							SendMessage( nmlv->hdr.hwndFrom, LVM_SORTITEMS, nmlv->iSubItem + NUM_COLUMNS, ( LPARAM )( PFNLVCOMPARE )CompareFunc );
+							sort_list( nmlv->hdr.hwndFrom, nmlv->iSubItem + NUM_COLUMNS );
 						}
 						else	// Column has no sorting set.
 						{
@@ -769,7 +861,7 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 							lvc.fmt = lvc.fmt | HDF_SORTDOWN;
 							SendMessage( nmlv->hdr.hwndFrom, LVM_SETCOLUMN, nmlv->iSubItem, ( LPARAM )&lvc );
 
-							SendMessage( nmlv->hdr.hwndFrom, LVM_SORTITEMS, nmlv->iSubItem, ( LPARAM )( PFNLVCOMPARE )CompareFunc );
+							sort_list( nmlv->hdr.hwndFrom, nmlv->iSubItem );
 						}
 					}
 				}
@@ -807,128 +899,45 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 					}
 
 					// Only load images that are selected and in focus.
-					if ( nmlv->uNewState != ( LVIS_FOCUSED | LVIS_SELECTED ) )
+					if ( nmlv->uNewState != ( LVIS_FOCUSED | LVIS_SELECTED ) || nmlv->iItem < 0 || nmlv->iItem >= ( int )g_entry_count )
 					{
 						break;
 					}
 
-					// Retrieve the lParam value from the selected listview item.
-					LVITEM lvi = { NULL };
-					lvi.mask = LVIF_PARAM;
-					lvi.iItem = nmlv->iItem;
-					SendMessage( nmlv->hdr.hwndFrom, LVM_GETITEM, 0, ( LPARAM )&lvi );
-
-					fileinfo *fi = ( fileinfo * )lvi.lParam;
+					fileinfo *fi = g_entries[ nmlv->iItem ];
 					if ( fi == NULL )
 					{
 						break;
 					}
 
-					unsigned long size = 0, header_offset = 0;	// Size excludes the header offset.
-					// Create a buffer to read in our new bitmap.
-					char *current_image = extract( fi, size, header_offset );
-					if ( current_image == NULL )
+					// Show the image right away if it's cached. Otherwise, it's decoded in the background and the image window gets it once the selection stops changing.
+					Gdiplus::Image *image = select_cached_image( fi );
+					if ( image != NULL )
 					{
-						break;
+						request_preview( &g_preview, NULL );	// Drop the request for any entry we've moved past.
+						set_preview_image( image, fi->flag, ( fi->filename != NULL ? fi->filename : L"" ) );
 					}
-
-					// If gdi_image exists, then delete it.
-					if ( gdi_image != NULL )
-					{
-						delete gdi_image;
-						gdi_image = NULL;
-					}
-
-					unsigned char format = ( ( fi->flag & FIF_TYPE_CMYK_JPG ) ? 1 : 0 );	// 0 = default, 1 = cmyk, 2 = raw (flipped), 3 = raw
-
-					unsigned int raw_width = 0;
-					unsigned int raw_height = 0;
-					unsigned int raw_size = 0;
-					int raw_stride = 0;
-					if ( fi->flag & FIF_TYPE_UNKNOWN )
+					else
 					{
-						if ( header_offset == 0x18 )
-						{
-							memcpy_s( &raw_stride, sizeof( int ), current_image + ( header_offset - ( sizeof( unsigned int ) * 4 ) ), sizeof( int ) );
-							memcpy_s( &raw_width, sizeof( unsigned int ), current_image + ( header_offset - ( sizeof( unsigned int ) * 3 ) ), sizeof( unsigned int ) );
-							memcpy_s( &raw_height, sizeof( unsigned int ), current_image + ( header_offset - ( sizeof( unsigned int ) * 2 ) ), sizeof( unsigned int ) );
-							format = 2;
-						}
-						else if ( header_offset == 0x34 )	// Found in TVThumb.db (Version 4 databases)
-						{
-							memcpy_s( &raw_width, sizeof( unsigned int ), current_image + sizeof( unsigned int ), sizeof( unsigned int ) );
-							memcpy_s( &raw_height, sizeof( unsigned int ), current_image + ( sizeof( unsigned int ) * 2 ), sizeof( unsigned int ) );
-							memcpy_s( &raw_stride, sizeof( int ), current_image + ( sizeof( unsigned int ) * 3 ), sizeof( int ) );
-							format = 3;
-						}
-						memcpy_s( &raw_size, sizeof( unsigned int ), current_image + ( header_offset - sizeof( unsigned int ) ), sizeof( unsigned int ) );
+						request_preview( &g_preview, fi );
 					}
 
-					// Create our image from an image stream (memory) and convert it to RGB if it's in CMYK format, or reconstruct any raw images.
-					gdi_image = create_image( current_image + header_offset, size, format, raw_width, raw_height, raw_size, raw_stride );
-
-					// Free our image buffer.
-					free( current_image );
+					// Prefetch the entries that are likely to be selected next. Most are in the direction the selection is moving, and one is behind it.
+					int direction = ( nmlv->iItem >= last_preview_index ? 1 : -1 );
+					last_preview_index = nmlv->iItem;
 
-					if ( IsWindowVisible( g_hWnd_image ) == FALSE )
+					fileinfo *prefetch[ PREVIEW_PREFETCH ];
+					unsigned long prefetch_count = 0;
+					for ( int i = 1; i <= PREVIEW_PREFETCH; ++i )
 					{
-						// Move our image window next to the main window on its right side if it's the first time we're showing the image window.
-						if ( !first_show )
+						int index = ( i < PREVIEW_PREFETCH ? nmlv->iItem + ( i * direction ) : nmlv->iItem - direction );
+						if ( index >= 0 && index < ( int )g_entry_count && g_entries[ index ] != NULL )
 						{
-							SetWindowPos( g_hWnd_image, HWND_TOPMOST, last_pos.right - ( g_border_width * 2 ), last_pos.top, MIN_HEIGHT, MIN_HEIGHT, SWP_NOACTIVATE );
-							first_show = true;
+							prefetch[ prefetch_count++ ] = g_entries[ index ];
 						}
-
-						// This is done to keep both windows on top of other windows.
-						// Set the image window position on top of all windows except topmost windows, but don't set focus to it.
-						SetWindowPos( g_hWnd_image, HWND_TOP, 0, 0, 0, 0, SWP_NOACTIVATE | SWP_NOMOVE | SWP_NOSIZE );
-						// Set our main window on top of the image window.
-						SetWindowPos( hWnd, HWND_TOP, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE );
-						// The image window is on top of everything (except the main window), set it back to non-topmost.
-						SetWindowPos( g_hWnd_image, HWND_NOTOPMOST, 0, 0, 0, 0, SWP_NOACTIVATE | SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW );
-					}
-
-					// Set our image window's icon to match the file extension.
-					if ( ( fi->flag & FIF_TYPE_JPG ) || ( fi->flag & FIF_TYPE_CMYK_JPG ) )
-					{
-						SendMessage( g_hWnd_image, WM_SETICON, ICON_SMALL, ( LPARAM )hIcon_jpg );
-					}
-					else if ( fi->flag & FIF_TYPE_PNG )
-					{
-						SendMessage( g_hWnd_image, WM_SETICON, ICON_SMALL, ( LPARAM )hIcon_png );
-					}
-					else
-					{
-						SendMessage( g_hWnd_image, WM_SETICON, ICON_SMALL, NULL );
 					}
 
-					// Set the image window's new title.
-					wchar_t new_title[ MAX_PATH + 30 ] = { 0 };
-					swprintf_s( new_title, MAX_PATH + 30, L"%.259s - %dx%d", ( fi->filename != NULL ? fi->filename : L"" ), gdi_image->GetWidth(), gdi_image->GetHeight() );
-					SetWindowText( g_hWnd_image, new_title );
-
-					// See if our image window is minimized and set the rectangle to its old size if it is.
-					RECT rc;
-					if ( IsIconic( g_hWnd_image ) == TRUE )
-					{
-						rc = last_dim;
-					}
-					else // Otherwise, get the current size.
-					{
-						GetClientRect( g_hWnd_image, &rc );
-					}
-
-					old_pos.x = old_pos.y = 0;
-					drag_rect.x = drag_rect.y = 0;
-
-					// Center the image.
-					drag_rect.x = ( ( long )gdi_image->GetWidth() - rc.right ) / 2;
-					drag_rect.y = ( ( long )gdi_image->GetHeight() - rc.bottom ) / 2;
-
-					scale = 1.0f;	// Reset the image scale.
-
-					// Force our window to repaint itself.
-					InvalidateRect( g_hWnd_image, NULL, TRUE );
+					prefetch_previews( &g_preview, prefetch, prefetch_count );
 				}
 				break;
 
@@ -936,21 +945,20 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 				{
 					NMLVDISPINFO *pdi = ( NMLVDISPINFO * )lParam;
 
-					// If no item is being edited, then cancel the edit.
-					if ( pdi->item.iItem == -1 )
+					// Worker threads can free entries or add filenames to their arenas. Don't edit while one is running.
+					if ( in_thread )
 					{
 						return TRUE;
 					}
 
-					// Get the current list item text from its lParam.
-					LVITEM lvi = { NULL };
-					lvi.iItem = pdi->item.iItem;
-					lvi.iSubItem = 1;
-					lvi.mask = LVIF_PARAM;
-					SendMessage( pdi->hdr.hwndFrom, LVM_GETITEM, 0, ( LPARAM )&lvi );
+					// If no item is being edited, then cancel the edit.
+					if ( pdi->item.iItem < 0 || pdi->item.iItem >= ( int )g_entry_count )
+					{
+						return TRUE;
+					}
 
 					// Save our current fileinfo.
-					current_fileinfo = ( fileinfo * )lvi.lParam;
+					current_fileinfo = g_entries[ pdi->item.iItem ];
 					if ( current_fileinfo == NULL )
 					{
 						return TRUE;
@@ -999,20 +1007,32 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 						return FALSE;
 					}
 
-					// Free the old filename.
-					free( current_fileinfo->filename );
-					// Create a new filename based on the editbox's text.
-					wchar_t *filename = ( wchar_t * )malloc( sizeof( wchar_t ) * ( length + 1 ) );
-					wmemset( filename, 0, length + 1 );
-					wcscpy_s( filename, length + 1, pdi->item.pszText );
+					// A worker thread may have started during the edit. The arena has no lock of its own, so the edit is dropped if a worker holds pe_cs.
+					if ( TryEnterCriticalSection( &pe_cs ) == FALSE )
+					{
+						return FALSE;
+					}
+
+					// Create a new filename based on the editbox's text. The old filename stays in the database's arena until it's closed.
+					wchar_t *filename = arena_wcsdup( &current_fileinfo->si->entry_arena, pdi->item.pszText );
+
+					LeaveCriticalSection( &pe_cs );
+
+					if ( filename == NULL )
+					{
+						return FALSE;
+					}
 
 					// Modify our listview item's fileinfo lParam value.
 					current_fileinfo->filename = filename;
 
 					// Set the image window's new title.
-					wchar_t new_title[ MAX_PATH + 30 ] = { 0 };
-					swprintf_s( new_title, MAX_PATH + 30, L"%.259s - %dx%d", filename, gdi_image->GetWidth(), gdi_image->GetHeight() );
-					SetWindowText( g_hWnd_image, new_title );
+					if ( gdi_image != NULL )
+					{
+						wchar_t new_title[ MAX_PATH + 30 ] = { 0 };
+						swprintf_s( new_title, MAX_PATH + 30, L"%.259s - %dx%d", filename, gdi_image->GetWidth(), gdi_image->GetHeight() );
+						SetWindowText( g_hWnd_image, new_title );
+					}
 
 					return TRUE;
 				}
@@ -1028,10 +1048,10 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 			DRAWITEMSTRUCT *dis = ( DRAWITEMSTRUCT * )lParam;
 
 			// The item we want to draw is our listview.
-			if ( dis->CtlType == ODT_LISTVIEW && dis->itemData != NULL )
+			if ( dis->CtlType == ODT_LISTVIEW && dis->itemID < g_entry_count )
 			{
-				fileinfo *fi = ( fileinfo * )dis->itemData;
-				if ( fi->si == NULL )
+				fileinfo *fi = g_entries[ dis->itemID ];
+				if ( fi == NULL || fi->si == NULL )
 				{
 					return TRUE;
 				}
@@ -1284,48 +1304,58 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 		}
 		break;
 
-		case WM_DESTROY:
+		case WM_ADD_ENTRIES:
 		{
-			// Get the number of items in the listview.
-			int num_items = ( int )SendMessage( g_hWnd_list, LVM_GETITEMCOUNT, 0, 0 );
+			add_entries( ( fileinfo * )lParam, ( unsigned long )wParam );
 
-			LVITEM lvi = { NULL };
-			lvi.mask = LVIF_PARAM;
+			return 0;
+		}
+		break;
 
-			fileinfo *fi = NULL;
+		case WM_SHOW_ERRORS:
+		{
+			show_queued_errors();
 
-			// Go through each item, and free their lParam values. current_fileinfo will get deleted here.
-			for ( lvi.iItem = 0; lvi.iItem < num_items; ++lvi.iItem )
-			{
-				SendMessage( g_hWnd_list, LVM_GETITEM, 0, ( LPARAM )&lvi );
+			return 0;
+		}
+		break;
 
-				fi = ( fileinfo * )lvi.lParam;
-				if ( fi != NULL )
-				{
-					if ( fi->si != NULL )
-					{
-						--( fi->si->count );
+		case WM_SAVE_STATUS:
+		{
+			show_save_status();
 
-						// Remove our shared information from the linked list if there's no more items for this database.
-						if ( fi->si->count == 0 )
-						{
-							cleanup_shared_info( &( fi->si ) );
-						}
-					}
+			return 0;
+		}
+		break;
 
-					// First free the filename pointer.
-					free( fi->filename );
-					// Then free the fileinfo structure.
-					free( fi );
-				}
-			}
+		case WM_UPDATE_ENTRIES:
+		{
+			// The catalog may have changed the names and dates of entries that are already shown.
+			apply_entry_updates( ( entry_updates * )lParam );
+			InvalidateRect( g_hWnd_list, NULL, TRUE );
+
+			return 0;
+		}
+		break;
 
-			// Delete out image object.
-			if ( gdi_image != NULL )
+		case WM_DESTROY:
+		{
+			// The preview worker might be using an entry.
+			stop_preview_worker( &g_preview );
+
+			// Free each entry. current_fileinfo will get deleted here.
+			for ( unsigned long i = 0; i < g_entry_count; ++i )
 			{
-				delete gdi_image;
+				free_fileinfo( g_entries[ i ] );
 			}
 
+			free( g_entries );
+			g_entries = NULL;
+			g_entry_count = 0;
+
+			// Our image object is deleted with the image cache.
+			gdi_image = NULL;
+
 			// Since this isn't owned by a window, we need to destroy it.
 			DestroyMenu( g_hMenuSub_context );
 